@@ -47,12 +47,49 @@ void cMeasurementLoop::begin()
     // assume we have a pressure sensor
     this->m_fSCD = true;
 
+    // collect measurements for batched uplinks.
+    this->m_history.clear();
+    this->m_Scd.setHistory(&this->m_history);
+    this->m_summary.clear();
+    this->m_Scd.setSummary(&this->m_summary);
+
+    // keep warm-up readings, NaNs and outliers out of the uplinks.
+    cSCD30::FilterConfig const filter
+        {
+        kFilterWarmupSamples, kFilterOutlierThreshold,
+        kFilterMinCO2ppm, kFilterMinTemperature, kFilterMinRelativeHumidity,
+        /* fRejectInvalid */ true
+        };
+    (void) this->m_Scd.setFilter(filter);
+
+    // account for the time (and estimated charge) in each state.
+    this->m_profile.setCurrents(
+        cPowerProfile::Currents
+            {
+            kCurrentAwake_uA, kCurrentLight_uA, kCurrentDeep_uA,
+            kCurrentRadio_uA, kSupply_mV
+            }
+        );
+    this->m_profile.setRadioStates(
+        (1u << unsigned(State::stTransmit)) |
+        (1u << unsigned(State::stForward)) |
+        (1u << unsigned(State::stDiag))
+        );
+    this->m_profile.clear();
+
+    // find any measurements that weren't sent before we were reset.
+    std::uint32_t bootCount = 0;
+    (void) gCatena.getBootCount(bootCount);
+    if (this->m_store.begin(gfFlash ? &gFlash : nullptr, bootCount))
+        gCatena.SafePrintf("sample store: %u samples to forward\n", unsigned(this->m_store.getNumSamples()));
+
     // register for polling.
     if (! this->m_registered)
         {
         this->m_registered = true;
 
         gCatena.registerObject(this);
+        this->addSleepSources();
         }
 
     if (! this->m_running)
@@ -88,6 +125,9 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
     {
     State newState = State::stNoChange;
 
+    if (fEntry)
+        this->m_profile.enterState(unsigned(currentState));
+
     if (fEntry && gLog.isEnabled(gLog.DebugFlags::kTrace))
         {
         gLog.printf(
@@ -133,8 +173,31 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
             this->m_active = false;
             newState = State::stInactive;
             }
+        else if (this->isBurstMode())
+            {
+            // the sensor is stopped until the next burst.
+            if (this->getMsToNextBurst() == 0)
+                newState = State::stWake;
+            else
+                this->sleep();
+            }
+        else if (this->m_Scd.getState() == cSCD30::State::Idle)
+            // stopped by burst mode; start it again.
+            newState = State::stWake;
         else if (this->m_Scd.queryReady(fError))
             newState = State::stMeasure;
+        else if (fError && cSCD30::isRecoverableError(this->m_Scd.getLastError()))
+            {
+            // the driver has scheduled its next attempt; sleep until then.
+            if (gLog.isEnabled(gLog.kError))
+                gLog.printf(
+                    gLog.kAlways,
+                    "SCD30 error: %s, failure %u, recovering\n",
+                    this->m_Scd.getLastErrorName(),
+                    unsigned(this->m_Scd.getRecoveryFailures())
+                    );
+            this->sleep();
+            }
         else if (fError)
             {
             newState = State::stInactive;
@@ -150,13 +213,11 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
         else
             {
             auto const msToNext = this->m_Scd.getMsToNextMeasurement();
-            if (msToNext < 20)
+            if (msToNext < this->getWakeLeadMs())
                 newState = State::stWake;
-            else if (msToNext > 500)
-                // sleep and stay in state.
-                this->sleep();
             else
-                /* stay in this state */;
+                // sleep as deeply as we can, and stay in state.
+                this->sleep();
             }
         }
         break;
@@ -168,7 +229,23 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
             gLed.Set(McciCatena::LedPattern::WarmingUp);
             if (k4802)
                 digitalWrite(D34, 1);
-            this->setTimer(20);
+
+            if (this->isBurstMode())
+                this->startBurst();
+            else if (this->m_Scd.getState() == cSCD30::State::Idle)
+                {
+                auto const pressure_mBar = this->m_Scd.getAmbientPressure();
+
+                if (! (pressure_mBar != 0 ? this->m_Scd.startContinuousMeasurement(pressure_mBar)
+                                          : this->m_Scd.startContinuousMeasurement()) &&
+                    gLog.isEnabled(gLog.kError))
+                    gLog.printf(gLog.kAlways, "SCD30 start failed: %s\n", this->m_Scd.getLastErrorName());
+                }
+
+            // start the other sensors' conversions; they run while
+            // we wait for the SCD30.
+            this->m_tasks.start();
+            this->setTimer(kWakeLeadMs);
             }
         if (this->timedOut())
             {
@@ -182,19 +259,80 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
         if (fEntry)
             {
             this->m_measurement_valid = false;
+            this->m_fMeasurementPending = false;
+            this->m_fMeasurementDone = false;
+            this->m_fMeasurementDropped = false;
+            this->m_fTasksPending = false;
             gLed.Set(McciCatena::LedPattern::Measuring);
             }
-        if (this->m_Scd.queryReady(fError))
+        if (this->m_fTasksPending)
+            {
+            // the SCD30 is finished; wait for the other sensors.
+            if (this->m_tasks.isDone())
+                {
+                this->logSensorTasks();
+                newState = State::stSleepSensor;
+                }
+            }
+        else if (this->m_fMeasurementPending)
+            {
+            // wait for readMeasurementDone() to be called.
+            }
+        else if (this->m_fMeasurementDone && this->m_measurement_valid &&
+                 this->m_Scd.isBurstActive())
+            {
+            // the burst needs more readings.
+            this->m_fMeasurementDone = false;
+            }
+        else if (this->m_fMeasurementDone && this->m_fMeasurementDropped)
+            {
+            // the filter dropped the reading; wait for the next one.
+            if (gLog.isEnabled(gLog.kTrace))
+                gLog.printf(gLog.kAlways, "SCD30 reading dropped: %s\n",
+                    cSCD30::getErrorName(this->m_Scd.getLastError())
+                    );
+            this->m_fMeasurementDone = false;
+            }
+        else if (this->m_fMeasurementDone)
+            {
+            if (this->m_measurement_valid)
+                {
+                this->logMeasurement();
+                this->updatePressure();
+                newState = State::stSleepSensor;
+                }
+            else
+                {
+                if (gLog.isEnabled(gLog.kError))
+                    {
+                    gLog.printf(gLog.kError, "SCD30 measurement failed: error %s(%u)\n",
+                            this->m_Scd.getLastErrorName(),
+                            unsigned(this->m_Scd.getLastError())
+                            );
+                    }
+
+                // report the failure, unless the driver is still
+                // recovering; then try again after its backoff. A
+                // burst carries on from here.
+                if (! this->isRecovering())
+                    newState = State::stSleepSensor;
+                else if (this->isBurstMode())
+                    this->m_fMeasurementDone = false;
+                else
+                    newState = State::stSleeping;
+                }
+            }
+        else if (this->m_Scd.queryReady(fError))
             {
-            this->m_measurement_valid = this->m_Scd.readMeasurement();
-            if ((! this->m_measurement_valid) && gLog.isEnabled(gLog.kError))
+            // start the read; the driver calls us back when it's done,
+            // and we don't block while the sensor prepares the data.
+            this->m_fMeasurementPending = true;
+            if (! this->m_Scd.readMeasurementAsync(readMeasurementDone, (void *)this))
                 {
-                gLog.printf(gLog.kError, "SCD30 measurement failed: error %s(%u)\n",
-                        this->m_Scd.getLastErrorName(),
-                        unsigned(this->m_Scd.getLastError())
-                        );
+                this->m_fMeasurementPending = false;
+                this->m_fMeasurementDone = true;
+                this->m_fMeasurementDropped = false;
                 }
-            newState = State::stSleepSensor;
             }
         else if (fError)
             {
@@ -206,132 +344,1117 @@ cMeasurementLoop::State cMeasurementLoop::fsmDispatch(
                     unsigned(this->m_Scd.getLastError())
                     );
 
-            newState = State::stSleepSensor;
+            // as above; a burst waits here, below.
+            if (! this->isRecovering())
+                newState = State::stSleepSensor;
+            else if (! this->isBurstMode())
+                newState = State::stSleeping;
+            }
+        else if (this->isBurstMode())
+            {
+            // wait for the rest of the burst as cheaply as we can.
+            this->sleep();
+            }
+
+        // the other sensors must finish before we go on; usually
+        // they already have.
+        if (newState == State::stSleepSensor && ! this->m_fTasksPending)
+            {
+            if (this->m_tasks.isDone())
+                this->logSensorTasks();
+            else
+                {
+                this->m_fTasksPending = true;
+                newState = State::stNoChange;
+                }
+            }
+        }
+        break;
+
+    case State::stSleepSensor:
+        {
+        bool fHeartbeat;
+
+        if (fEntry)
+            {
+            // in burst mode, stop the sensor until the next burst.
+            if (this->isBurstMode() &&
+                this->m_Scd.getState() != cSCD30::State::Idle &&
+                ! this->m_Scd.stopMeasurement() &&
+                gLog.isEnabled(gLog.kError))
+                gLog.printf(gLog.kAlways, "SCD30 stop failed: %s\n", this->m_Scd.getLastErrorName());
+
+            if (k4802)
+                digitalWrite(D34, 0);
+
+            gLed.Set(McciCatena::LedPattern::Settling);
+            }
+
+        // when batching, wait for a full batch. But send right away if
+        // the measurement failed, so that the failure is visible. A
+        // multi-sensor report carries only the newest sample, so it
+        // goes every cycle.
+        if (! (kSamplesPerUplink == 1 ||
+               this->isMultiSensor() ||
+               ! this->m_measurement_valid ||
+               this->m_history.full()))
+            newState = State::stSleeping;
+        else if (this->checkReport(fHeartbeat))
+            {
+            this->m_fHeartbeat = fHeartbeat;
+            newState = State::stTransmit;
+            }
+        else
+            {
+            // nothing worth sending; the samples are all within the
+            // deadband of the last one sent.
+            if (gLog.isEnabled(gLog.kTrace))
+                gLog.printf(gLog.kAlways, "no change: uplink skipped\n");
+            this->m_history.clear();
+            newState = State::stSleeping;
+            }
+        }
+        break;
+
+    case State::stTransmit:
+        if (fEntry)
+            {
+            gLed.Set(McciCatena::LedPattern::Sending);
+
+            TxBuffer_t b;
+            if (this->isMultiSensor())
+                {
+                this->startMultiReport();
+                this->fillTxBufferMulti(b, true);
+                }
+            else
+                this->fillTxBuffer(b);
+            this->startTransmission(b);
+
+            // start a new reporting window.
+            this->noteReport();
+            this->m_summary.clear();
+            }
+        if (this->txComplete() && ! this->m_txerr && this->m_multiPending != 0)
+            {
+            // the report didn't fit in one frame; send the next.
+            TxBuffer_t b;
+            this->fillTxBufferMulti(b, false);
+            this->startTransmission(b);
+            }
+        else if (this->txComplete())
+            {
+            this->m_multiPending = 0;
+            // keep the samples if the uplink failed. If it worked, the
+            // network is there; send any backlog.
+            if (this->m_txerr)
+                this->saveSamples();
+            this->m_history.clear();
+
+            if (this->m_txerr)
+                newState = State::stSleeping;
+            else if (this->m_store.getNumSamples() != 0)
+                newState = State::stForward;
+            else
+                newState = this->getStateAfterUplink();
+            }
+        break;
+
+    case State::stForward:
+        if (fEntry)
+            {
+            this->m_nForwardBatches = 0;
+            if (! this->startForward())
+                newState = this->getStateAfterUplink();
+            }
+        else if (this->txComplete())
+            {
+            if (this->m_txerr)
+                // lost the network again; keep the samples for later.
+                newState = State::stSleeping;
+            else
+                {
+                this->m_store.consume(this->m_nForward);
+                if (++this->m_nForwardBatches >= kMaxForwardBatches ||
+                    ! this->startForward())
+                    newState = this->getStateAfterUplink();
+                }
+            }
+        break;
+
+    case State::stDiag:
+        if (fEntry)
+            {
+            // due or not, wait a full interval for the next try, so a
+            // profile that doesn't fit doesn't keep us awake.
+            this->m_tLastDiag = millis();
+            if (! this->startDiag())
+                newState = State::stSleeping;
+            }
+        else if (this->txComplete())
+            newState = State::stSleeping;
+        break;
+
+    case State::stFinal:
+        break;
+
+    default:
+        break;
+        }
+
+    return newState;
+    }
+
+/****************************************************************************\
+|
+|   Measurement completion (called from the SCD30 driver's poll()).
+|
+\****************************************************************************/
+
+void cMeasurementLoop::readMeasurementDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cMeasurementLoop *)pClientData;
+
+    pThis->m_measurement_valid = fSuccess;
+    pThis->m_fMeasurementDropped = ! fSuccess && cSCD30::isFilterError(pRequest->error);
+    pThis->m_fMeasurementPending = false;
+    pThis->m_fMeasurementDone = true;
+    }
+
+/****************************************************************************\
+|
+|   Pressure compensation
+|
+\****************************************************************************/
+
+// feed the current barometer reading to the SCD30. The driver only
+// sends it to the sensor if it has changed enough, so this is cheap.
+void cMeasurementLoop::updatePressure()
+    {
+    std::uint16_t pressure_mBar;
+
+    if (this->m_pPressureFn == nullptr ||
+        ! this->m_pPressureFn(this->m_pPressureClientData, pressure_mBar))
+        return;
+
+    if (! this->m_Scd.setAmbientPressure(pressure_mBar) && gLog.isEnabled(gLog.kError))
+        gLog.printf(gLog.kAlways, "SCD30 pressure %u mBar rejected: %s\n",
+            unsigned(pressure_mBar),
+            this->m_Scd.getLastErrorName()
+            );
+    }
+
+/****************************************************************************\
+|
+|   Report on change
+|
+\****************************************************************************/
+
+/*
+
+Name:	cMeasurementLoop::checkReport()
+
+Function:
+    Decide whether the measurements are worth an uplink.
+
+Definition:
+    bool cMeasurementLoop::checkReport(
+        bool &fHeartbeat
+        ) const;
+
+Description:
+    If report on change is enabled (m_deadband.HeartbeatSecs is not
+    zero), each sample waiting in the history is compared with the
+    newest sample of the last uplink. If any value has moved by more
+    than its deadband, there's a change to report. Otherwise, an
+    uplink is only needed as a heartbeat, once HeartbeatSecs have
+    passed since the last one. Failed measurements and the first
+    uplink are always sent.
+
+    Comparing with the last sample sent, rather than the previous
+    sample, means that a slow drift is reported once it adds up.
+
+Returns:
+    `true` if an uplink should be sent, with fHeartbeat set if it's
+    only a heartbeat; `false` if it should be skipped.
+
+*/
+
+bool cMeasurementLoop::checkReport(bool &fHeartbeat) const
+    {
+    auto const &db = this->m_deadband;
+
+    fHeartbeat = false;
+    if (db.HeartbeatSecs == 0 ||
+        ! this->m_measurement_valid ||
+        ! this->m_fLastReport)
+        return true;
+
+    auto const &last = this->m_lastReport;
+    auto const moved = [](std::int32_t v, std::int32_t v0, std::uint16_t deadband)
+        {
+        std::int32_t const d = v - v0;
+        return (d < 0 ? -d : d) > std::int32_t(deadband);
+        };
+
+    for (auto const &s : this->m_history)
+        {
+        if (moved(s.Temperature, last.Temperature, db.Temperature) ||
+            moved(s.RelativeHumidity, last.RelativeHumidity, db.RelativeHumidity))
+            return true;
+
+        // the first reading after power-up has no CO2.
+        if (s.CO2ppm != 0 && last.CO2ppm != 0 &&
+            moved(s.CO2ppm, last.CO2ppm, db.CO2ppm))
+            return true;
+        }
+
+    if (std::uint32_t(millis() - this->m_tLastReport) / 1000 >= db.HeartbeatSecs)
+        {
+        fHeartbeat = true;
+        return true;
+        }
+
+    return false;
+    }
+
+// remember what the uplink just built carried.
+void cMeasurementLoop::noteReport()
+    {
+    this->m_tLastReport = millis();
+    if (this->m_measurement_valid && ! this->m_history.empty())
+        {
+        this->m_lastReport = this->m_history.back();
+        this->m_fLastReport = true;
+        }
+    }
+
+/****************************************************************************\
+|
+|   Burst mode
+|
+\****************************************************************************/
+
+// start the SCD30 on the burst for the next report.
+void cMeasurementLoop::startBurst()
+    {
+    cSCD30::BurstConfig const config
+        {
+        kBurstIntervalSecs, kBurstSettleSamples, kBurstSamples, cSCD30::BurstCombine::Median
+        };
+
+    // keep a steady report cadence, however long the burst takes; but
+    // if we've fallen behind, start over from now.
+    std::uint32_t const reportMs = this->m_burstReportSecs * 1000;
+
+    this->m_tNextBurst += reportMs;
+    if (this->getMsToNextBurst() == 0)
+        this->m_tNextBurst = millis() + reportMs;
+
+    if (! this->m_Scd.startBurst(config) && gLog.isEnabled(gLog.kError))
+        gLog.printf(gLog.kAlways, "SCD30 burst failed: %s\n", this->m_Scd.getLastErrorName());
+    }
+
+/****************************************************************************\
+|
+|   The other sensors
+|
+\****************************************************************************/
+
+bool cMeasurementLoop::setVbatTask(cVbatTask &task)
+    {
+    if (! this->m_tasks.add(task))
+        return false;
+
+    this->m_pVbatTask = &task;
+    return true;
+    }
+
+bool cMeasurementLoop::setThTask(cSht3xTask &task)
+    {
+    if (! this->m_tasks.add(task))
+        return false;
+
+    this->m_pThTask = &task;
+    return true;
+    }
+
+// the battery voltage from this cycle, or read it now if there isn't one.
+float cMeasurementLoop::getVbat() const
+    {
+    if (this->m_pVbatTask != nullptr && this->m_pVbatTask->isValid())
+        return this->m_pVbatTask->getVbat();
+    else
+        return gCatena.ReadVbat();
+    }
+
+void cMeasurementLoop::logSensorTasks()
+    {
+    if (gLog.isEnabled(gLog.kTrace))
+        gLog.printf(
+            gLog.kAlways,
+            "sensor tasks: %u done in %u ms\n",
+            this->m_tasks.getNumTasks(),
+            unsigned(this->m_tasks.getLastCycleMs())
+            );
+
+    if (! gLog.isEnabled(gLog.kInfo) || this->m_pThTask == nullptr)
+        return;
+    if (! this->m_pThTask->isValid())
+        {
+        gCatena.SafePrintf("SHT3x:  no reading\n");
+        return;
+        }
+
+    auto const m = this->m_pThTask->getMeasurement();
+
+    char ts = ' ';
+    std::int32_t t200 = m.Temperature;
+    if (t200 < 0) { ts = '-'; t200 = -t200; }
+    std::int32_t t100 = (t200 + 1) / 2;
+    std::int32_t tint = t100 / 100;
+    std::int32_t tfrac = t100 - (tint * 100);
+
+    std::int32_t rh100 = std::int32_t((std::uint32_t(m.RelativeHumidity) * 10000u + 32767u) / 65535u);
+    std::int32_t rhint = rh100 / 100;
+    std::int32_t rhfrac = rh100 - (rhint * 100);
+
+    gCatena.SafePrintf(
+        "SHT3x:  T(C): %c%d.%02d  RH(%%): %d.%02d\n",
+        ts, tint, tfrac,
+        rhint, rhfrac
+        );
+    }
+
+/****************************************************************************\
+|
+|   Display the most recent measurement
+|
+\****************************************************************************/
+
+void cMeasurementLoop::logMeasurement()
+    {
+    if (! gLog.isEnabled(gLog.kInfo))
+        return;
+
+    // use the fixed-point form, which is already in uplink units.
+    auto const m = this->m_Scd.getFixedMeasurement();
+
+    char ts = ' ';
+    std::int32_t t200 = m.Temperature;
+    if (t200 < 0) { ts = '-'; t200 = -t200; }
+    std::int32_t t100 = (t200 + 1) / 2;
+    std::int32_t tint = t100 / 100;
+    std::int32_t tfrac = t100 - (tint * 100);
+
+    std::int32_t rh100 = std::int32_t((std::uint32_t(m.RelativeHumidity) * 10000u + 32767u) / 65535u);
+    std::int32_t rhint = rh100 / 100;
+    std::int32_t rhfrac = rh100 - (rhint * 100);
+
+    std::int32_t co2_100 = std::int32_t((std::uint64_t(m.CO2ppm) * 100u + 0x8000u) >> 16);
+    std::int32_t co2int = co2_100 / 100;
+    std::int32_t co2frac = co2_100 - (co2int * 100);
+
+    gCatena.SafePrintf(
+        "SCD30:  T(C): %c%d.%02d  RH(%%): %d.%02d  CO2(ppm): %d.%02d\n",
+        ts, tint, tfrac,
+        rhint, rhfrac,
+        co2int, co2frac
+        );
+    }
+
+/****************************************************************************\
+|
+|   Prepare a buffer to be transmitted.
+|
+\****************************************************************************/
+
+void cMeasurementLoop::fillTxBuffer(cMeasurementLoop::TxBuffer_t& b)
+    {
+    b.begin();
+    Flags flag;
+
+    flag = Flags(0);
+
+    // insert format byte
+    b.put(kSamplesPerUplink == 1 ? kMessageFormat : kBatchMessageFormat);
+
+    // insert a byte that will become flags later.
+    std::uint8_t * const pFlag = b.getp();
+    b.put(std::uint8_t(flag));
+
+    // send Vbat
+    float Vbat = this->getVbat();
+    gCatena.SafePrintf("Vbat:    %d mV\n", (int) (Vbat * 1000.0f));
+    b.putV(Vbat);
+    flag |= Flags::Vbat;
+
+    // send Vdd if we can measure it.
+
+    // send boot count
+    uint32_t bootCount;
+    if (gCatena.getBootCount(bootCount))
+        {
+        b.putBootCountLsb(bootCount);
+        flag |= Flags::Boot;
+        }
+
+    if (kSamplesPerUplink > 1)
+        {
+        if (this->m_fSCD)
+            {
+            Sample samples[kSamplesPerUplink];
+            std::size_t const n = this->m_history.size();
+
+            for (std::size_t i = 0; i < n; ++i)
+                samples[i] = this->m_history[i];
+
+            this->fillTxBufferBatch(b, flag, samples, n);
             }
         }
+    else if (this->m_fSCD && this->m_measurement_valid)
+        {
+        // use the fixed-point form, which is already in uplink units.
+        auto const m = this->m_Scd.getFixedMeasurement();
+        // channels the sensor sent as NaN read as zero; leave them out.
+        auto const invalid = this->m_Scd.getInvalidChannels();
+
+        // temperature is 2 bytes from -163.840 to +163.835 degrees C
+        // pressure is 4 bytes, first signed units, then scale.
+        if ((invalid & (cSCD30::kChannelTemperature | cSCD30::kChannelRelativeHumidity)) == 0)
+            {
+            b.put2(std::int32_t(m.Temperature));
+            b.put2(std::uint32_t(m.RelativeHumidity));
+            flag |= Flags::TH;
+            }
+        else if (this->m_pThTask != nullptr && this->m_pThTask->isValid())
+            {
+            // use the on-board sensor's T/RH instead.
+            auto const th = this->m_pThTask->getMeasurement();
+
+            b.put2(std::int32_t(th.Temperature));
+            b.put2(std::uint32_t(th.RelativeHumidity));
+            flag |= Flags::TH;
+            }
+
+        // The CO2 sensor returns 0 on the first reading,
+        // and we want to suppress that.
+        if (m.CO2ppm != 0 && (invalid & cSCD30::kChannelCO2) == 0)
+            {
+            // put2 takes a uint32_t or int32_t. We want the uint32_t version,
+            // so we cast. getCO2uflt16() gives the same encoding as
+            // LMIC_f2uflt16(CO2ppm / 40000.0f).
+            b.put2(std::uint32_t(cSCD30::getCO2uflt16(m)));
+            flag |= Flags::CO2ppm;
+            }
+        }
+
+    if (this->m_fHeartbeat)
+        flag |= Flags::Heartbeat;
+
+    if (kUplinkSummary && this->m_fSCD && this->m_summary.getCount() != 0)
+        {
+        this->fillTxBufferSummary(b);
+        flag |= Flags::Summary;
+        }
+
+    *pFlag = std::uint8_t(flag);
+    }
+
+/*
+
+Name:	cMeasurementLoop::fillTxBufferSummary()
+
+Function:
+    Append the statistics of the reporting window to an uplink.
+
+Definition:
+    void cMeasurementLoop::fillTxBufferSummary(
+        cMeasurementLoop::TxBuffer_t &b
+        );
+
+Description:
+    This appends the number of readings since the last uplink (at most
+    255), then the min, max, mean and standard deviation of the
+    temperature (int16, 0.005 degrees C), the relative humidity
+    (uint16, 0xFFFF is 100%) and CO2 (uflt16, as for field 4). If no
+    reading had CO2, its four values are zero.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cMeasurementLoop::fillTxBufferSummary(cMeasurementLoop::TxBuffer_t &b)
+    {
+    auto const &t = this->m_summary.getTemperature();
+    auto const &rh = this->m_summary.getRelativeHumidity();
+    auto const &co2 = this->m_summary.getCO2ppm();
+
+    // round to nearest, and clamp.
+    auto const quantize = [](float v, float vMin, float vMax) -> std::int32_t
+        {
+        if (! (v > vMin))
+            v = vMin;
+        else if (v > vMax)
+            v = vMax;
+        return std::int32_t(v < 0.0f ? v - 0.5f : v + 0.5f);
+        };
+    // same encoding as getCO2uflt16().
+    auto const putCO2 = [&b](float ppm)
+        {
+        cSCD30::FixedMeasurement m;
+
+        m.CO2ppm = ppm < 65535.0f ? std::uint32_t(ppm * 65536.0f + 0.5f) : 0xFFFF0000u;
+        b.put2(std::uint32_t(cSCD30::getCO2uflt16(m)));
+        };
+
+    auto const n = this->m_summary.getCount();
+    b.put(std::uint8_t(n > 255 ? 255 : n));
+
+    b.put2(std::int32_t(t.getMin()));
+    b.put2(std::int32_t(t.getMax()));
+    b.put2(quantize(t.getMean(), -32768.0f, 32767.0f));
+    b.put2(std::uint32_t(quantize(t.getStdDev(), 0.0f, 65535.0f)));
+
+    b.put2(std::uint32_t(rh.getMin()));
+    b.put2(std::uint32_t(rh.getMax()));
+    b.put2(std::uint32_t(quantize(rh.getMean(), 0.0f, 65535.0f)));
+    b.put2(std::uint32_t(quantize(rh.getStdDev(), 0.0f, 65535.0f)));
+
+    if (co2.empty())
+        {
+        for (unsigned i = 0; i < 4; ++i)
+            b.put2(std::uint32_t(0));
+        }
+    else
+        {
+        putCO2(float(co2.getMin()));
+        putCO2(float(co2.getMax()));
+        putCO2(co2.getMean());
+        putCO2(co2.getStdDev());
+        }
+    }
+
+/*
+
+Name:	cMeasurementLoop::fillTxBufferBatch()
+
+Function:
+    Append samples to a format 0x1F message.
+
+Definition:
+    void cMeasurementLoop::fillTxBufferBatch(
+        cMeasurementLoop::TxBuffer_t &b,
+        cMeasurementLoop::Flags &flag,
+        const cMeasurementLoop::Sample *pSamples,
+        std::size_t nSamples
+        );
+
+Description:
+    If nSamples is not zero, this appends a count, the
+    sample period in seconds, and a byte giving the delta encoding
+    for each field (bits 1..0 temperature, 3..2 RH, 5..4 CO2). Then
+    it appends sample 0 in full (as in format 0x1E), followed by
+    samples 1..n-1, each field encoded as a difference from sample 0
+    (or as an absolute value, if the differences are too large).
+    Samples are oldest first. `flag` is updated to show which fields
+    are present.
+
+    The first CO2 reading after power-up is zero; if any sample has
+    no CO2, CO2 is omitted for the whole batch.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cMeasurementLoop::fillTxBufferBatch(
+    cMeasurementLoop::TxBuffer_t &b,
+    cMeasurementLoop::Flags &flag,
+    const cMeasurementLoop::Sample *pSamples,
+    std::size_t nSamples
+    )
+    {
+    std::size_t const n = nSamples;
+
+    if (n == 0 || n > kMaxBatchSamples)
+        return;
+
+    std::int32_t t[kMaxBatchSamples];
+    std::int32_t rh[kMaxBatchSamples];
+    std::int32_t co2[kMaxBatchSamples];
+    bool fCO2 = true;
+
+    for (std::size_t i = 0; i < n; ++i)
+        {
+        auto const &s = pSamples[i];
+        cSCD30::FixedMeasurement m;
+
+        m.CO2ppm = std::uint32_t(s.CO2ppm) << 16;
+        t[i] = s.Temperature;
+        rh[i] = s.RelativeHumidity;
+        co2[i] = cSCD30::getCO2uflt16(m);
+        if (s.CO2ppm == 0)
+            fCO2 = false;
+        }
+
+    // seconds between samples, from the sample times.
+    std::uint32_t period;
+    if (n > 1)
+        period = (pSamples[n - 1].tSample - pSamples[0].tSample + (n - 1) * 500) / ((n - 1) * 1000);
+    else
+        period = this->m_Scd.getMeasurementInterval();
+
+    DeltaCode const codeT = getDeltaCode(t, n);
+    DeltaCode const codeRH = getDeltaCode(rh, n);
+    DeltaCode const codeCO2 = fCO2 ? getDeltaCode(co2, n) : DeltaCode::Same;
+
+    b.put(std::uint8_t(n));
+    b.put2(std::uint32_t(period > 0xFFFF ? 0xFFFF : period));
+    b.put(std::uint8_t((std::uint8_t(codeCO2) << 4) | (std::uint8_t(codeRH) << 2) | std::uint8_t(codeT)));
+
+    flag |= Flags::TH;
+    b.put2(std::int32_t(t[0]));
+    b.put2(std::uint32_t(rh[0]));
+    if (fCO2)
+        {
+        flag |= Flags::CO2ppm;
+        b.put2(std::uint32_t(co2[0]));
+        }
+
+    for (std::size_t i = 1; i < n; ++i)
+        {
+        putDelta(b, codeT, t[i], t[0]);
+        putDelta(b, codeRH, rh[i], rh[0]);
+        if (fCO2)
+            putDelta(b, codeCO2, co2[i], co2[0]);
+        }
+
+    if (gLog.isEnabled(gLog.kTrace))
+        gLog.printf(gLog.kAlways, "batch: %u samples, period %u s, codes %u/%u/%u\n",
+            unsigned(n), unsigned(period),
+            unsigned(codeT), unsigned(codeRH), unsigned(codeCO2)
+            );
+    }
+
+// choose the smallest encoding for values[1..n-1] relative to values[0].
+cMeasurementLoop::DeltaCode cMeasurementLoop::getDeltaCode(
+    const std::int32_t *pValues,
+    std::size_t nValues
+    )
+    {
+    DeltaCode result = DeltaCode::Same;
+
+    for (std::size_t i = 1; i < nValues; ++i)
+        {
+        std::int32_t const d = pValues[i] - pValues[0];
+
+        if (d < -32768 || d > 32767)
+            return DeltaCode::Absolute;
+        else if (d < -128 || d > 127)
+            result = DeltaCode::Int16;
+        else if (d != 0 && result == DeltaCode::Same)
+            result = DeltaCode::Int8;
+        }
+
+    return result;
+    }
+
+void cMeasurementLoop::putDelta(
+    cMeasurementLoop::TxBuffer_t &b,
+    cMeasurementLoop::DeltaCode code,
+    std::int32_t v,
+    std::int32_t v0
+    )
+    {
+    std::int32_t const d = v - v0;
+
+    switch (code)
+        {
+    case DeltaCode::Int8:
+        b.put(std::uint8_t(d));
+        break;
+    case DeltaCode::Int16:
+        b.put(std::uint8_t(d >> 8));
+        b.put(std::uint8_t(d));
+        break;
+    case DeltaCode::Absolute:
+        b.put(std::uint8_t(v >> 8));
+        b.put(std::uint8_t(v));
+        break;
+    case DeltaCode::Same:
+    default:
         break;
+        }
+    }
+
+/****************************************************************************\
+|
+|   Multi-sensor reports
+|
+\****************************************************************************/
+
+void cMeasurementLoop::setAuxSensors(cSCD30BusManager *pManager)
+    {
+    if (this->m_pAux != nullptr)
+        this->m_pAux->setMeasurementFn(nullptr, nullptr);
+
+    this->m_pAux = pManager;
+    this->m_auxValid = 0;
+    if (pManager != nullptr)
+        pManager->setMeasurementFn(auxMeasurementDone, (void *)this);
+    }
+
+// a measurement has been read (or failed) for an auxiliary sensor.
+void cMeasurementLoop::auxMeasurementDone(
+    void *pClientData,
+    unsigned iSensor,
+    cSCD30 &sensor,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cMeasurementLoop *)pClientData;
+
+    if (iSensor >= kMaxAuxSensors)
+        return;
+
+    std::uint8_t const bit = 1u << iSensor;
+
+    if (fSuccess)
+        {
+        pThis->m_aux[iSensor] = cSCD30HistoryBase::encode(millis(), sensor.getFixedMeasurement());
+        pThis->m_auxValid |= bit;
+        }
+    else
+        {
+        // don't report a stale reading.
+        pThis->m_auxValid &= ~bit;
+        if (gLog.isEnabled(gLog.kError))
+            gLog.printf(gLog.kAlways, "auxiliary SCD30 %u failed: %s\n", iSensor, sensor.getLastErrorName());
+        }
+    }
+
+// collect the readings for a format 0x20 report; each reading is
+// sent once.
+void cMeasurementLoop::startMultiReport()
+    {
+    this->m_multiPending = 0;
+    if (this->m_fSCD && this->m_measurement_valid && ! this->m_history.empty())
+        {
+        this->m_multi[0] = this->m_history.back();
+        this->m_multiPending = 1u << 0;
+        }
+
+    for (unsigned i = 0; i < kMaxAuxSensors; ++i)
+        {
+        if (this->m_auxValid & (1u << i))
+            {
+            this->m_multi[1 + i] = this->m_aux[i];
+            this->m_multiPending |= 1u << (1 + i);
+            }
+        }
+    this->m_auxValid = 0;
+    }
+
+/*
+
+Name:	cMeasurementLoop::fillTxBufferMulti()
+
+Function:
+    Prepare a frame of a format 0x20 multi-sensor report.
+
+Definition:
+    void cMeasurementLoop::fillTxBufferMulti(
+        cMeasurementLoop::TxBuffer_t &b,
+        bool fFirst
+        );
+
+Description:
+    The frame has the format byte, the flags, and (if fFirst) the
+    battery voltage and boot count. Then comes a bitmap of sensor
+    indices, followed by a record for each sensor in the bitmap, in
+    ascending index order: temperature (int16, 0.005 degrees C), RH
+    (uint8, 0xFF = 100%) and CO2 (uflt16, zero if none). Index 0 is
+    the primary SCD30; index i is auxiliary sensor i - 1.
+
+    Pending records (m_multiPending) are added until the frame is as
+    large as the current data rate allows; the ones that were sent
+    are removed from m_multiPending. If any are left, Flags::More is
+    set, and the state machine sends another frame once this one is
+    done. A frame with no records is still sent, so that a failure
+    is visible.
+
+Returns:
+    No explicit result.
 
-    case State::stSleepSensor:
-        if (fEntry)
-            {
-            // nothing to do for sleeping the sensor, unless it's 4802
-            if (k4802)
-                digitalWrite(D34, 0);
+*/
 
-            gLed.Set(McciCatena::LedPattern::Settling);
-            }
+void cMeasurementLoop::fillTxBufferMulti(
+    cMeasurementLoop::TxBuffer_t &b,
+    bool fFirst
+    )
+    {
+    std::size_t const nPayload = getMaxPayload();
+    std::size_t const nMax = nPayload < kTxBufferSize ? nPayload : kTxBufferSize;
+    Flags flag = Flags(0);
 
-        newState = State::stTransmit;
-        break;
+    b.begin();
+    b.put(kMultiMessageFormat);
+    std::uint8_t * const pFlag = b.getp();
+    b.put(std::uint8_t(flag));
 
-    case State::stTransmit:
-        if (fEntry)
-            {
-            gLed.Set(McciCatena::LedPattern::Sending);
+    if (fFirst)
+        {
+        float Vbat = this->getVbat();
+        gCatena.SafePrintf("Vbat:    %d mV\n", (int) (Vbat * 1000.0f));
+        b.putV(Vbat);
+        flag |= Flags::Vbat;
 
-            TxBuffer_t b;
-            this->fillTxBuffer(b);
-            this->startTransmission(b);
-            }
-        if (this->txComplete())
+        uint32_t bootCount;
+        if (gCatena.getBootCount(bootCount))
             {
-            newState = State::stSleeping;
+            b.putBootCountLsb(bootCount);
+            flag |= Flags::Boot;
             }
-        break;
 
-    case State::stFinal:
-        break;
+        if (this->m_fHeartbeat)
+            flag |= Flags::Heartbeat;
+        }
 
-    default:
-        break;
+    std::uint8_t * const pBitmap = b.getp();
+    std::uint8_t bitmap = 0;
+    b.put(bitmap);
+
+    for (unsigned i = 0; i < kMaxMultiSensors; ++i)
+        {
+        std::uint8_t const bit = 1u << i;
+
+        if (! (this->m_multiPending & bit))
+            continue;
+        if (b.getn() + kMultiRecordBytes > nMax)
+            break;
+
+        auto const &s = this->m_multi[i];
+        cSCD30::FixedMeasurement m;
+
+        m.CO2ppm = std::uint32_t(s.CO2ppm) << 16;
+        b.put2(std::int32_t(s.Temperature));
+        b.put(std::uint8_t((std::uint32_t(s.RelativeHumidity) + 128) / 257));
+        b.put2(std::uint32_t(s.CO2ppm == 0 ? 0 : cSCD30::getCO2uflt16(m)));
+
+        bitmap |= bit;
+        this->m_multiPending &= ~bit;
         }
 
-    return newState;
+    if (this->m_multiPending != 0)
+        flag |= Flags::More;
+
+    *pBitmap = bitmap;
+    *pFlag = std::uint8_t(flag);
+
+    if (gLog.isEnabled(gLog.kTrace))
+        gLog.printf(gLog.kAlways, "multi: sensors %02x, %u bytes (max %u)%s\n",
+            bitmap, unsigned(b.getn()), unsigned(nMax),
+            this->m_multiPending != 0 ? ", more to come" : ""
+            );
+    }
+
+// the largest application payload at the current data rate. MAC
+// commands piggybacked in the header aren't allowed for, nor are
+// dwell time limits.
+std::size_t cMeasurementLoop::getMaxPayload()
+    {
+#if defined(CFG_us915)
+    static constexpr std::uint8_t kMaxPayload[] = { 11, 53, 125, 242, 242 };
+#else
+    // EU868, AU915 and similar plans.
+    static constexpr std::uint8_t kMaxPayload[] = { 51, 51, 51, 115, 222, 222, 222, 222 };
+#endif
+    unsigned const dr = LMIC.datarate;
+
+    return kMaxPayload[dr < sizeof(kMaxPayload) ? dr : 0];
     }
 
 /****************************************************************************\
 |
-|   Prepare a buffer to be transmitted.
+|   Store and forward
 |
 \****************************************************************************/
 
-void cMeasurementLoop::fillTxBuffer(cMeasurementLoop::TxBuffer_t& b)
+// the uplink failed: keep the samples, so we can send them later.
+void cMeasurementLoop::saveSamples()
     {
-    b.begin();
-    Flags flag;
+    for (auto const &s : this->m_history)
+        {
+        if (! this->m_store.append(s))
+            break;
+        }
+    }
 
-    flag = Flags(0);
+/*
 
-    // insert format byte
-    b.put(kMessageFormat);
+Name:	cMeasurementLoop::startForward()
 
-    // insert a byte that will become flags later.
+Function:
+    Start an uplink of stored samples.
+
+Definition:
+    bool cMeasurementLoop::startForward();
+
+Description:
+    The oldest stored samples are sent in a format 0x1F message: as
+    many as fit in the payload at the current data rate, up to
+    kMaxForwardSamples, however many samples a live uplink carries.
+    If the samples were taken since the last reset, the message
+    includes their age, so the network side can place them in time.
+    The samples stay in the store until the uplink succeeds; then the
+    state machine consumes them.
+
+Returns:
+    `true` if an uplink was started; `false` if there was nothing
+    to send, or if not even one sample fits.
+
+*/
+
+bool cMeasurementLoop::startForward()
+    {
+    std::size_t const nPayload = getMaxPayload();
+    std::size_t const nMax = nPayload < kTxBufferSize ? nPayload : kTxBufferSize;
+    std::size_t const nOverhead = kForwardHeaderBytes + kForwardAgeBytes;
+
+    this->m_nForward = 0;
+    if (nMax < nOverhead + kForwardSampleBytes)
+        return false;
+
+    std::size_t nFit = (nMax - nOverhead) / kForwardSampleBytes;
+    if (nFit > kMaxForwardSamples)
+        nFit = kMaxForwardSamples;
+
+    Sample samples[kMaxForwardSamples];
+    bool fThisBoot;
+    auto const n = this->m_store.peek(samples, nFit, fThisBoot);
+
+    this->m_nForward = std::uint8_t(n);
+    if (n == 0)
+        return false;
+
+    TxBuffer_t b;
+    Flags flag = Flags(0);
+
+    b.begin();
+    b.put(kBatchMessageFormat);
     std::uint8_t * const pFlag = b.getp();
     b.put(std::uint8_t(flag));
 
-    // send Vbat
-    float Vbat = gCatena.ReadVbat();
-    gCatena.SafePrintf("Vbat:    %d mV\n", (int) (Vbat * 1000.0f));
-    b.putV(Vbat);
-    flag |= Flags::Vbat;
-
-    // send Vdd if we can measure it.
+    this->fillTxBufferBatch(b, flag, samples, n);
 
-    // send boot count
-    uint32_t bootCount;
-    if (gCatena.getBootCount(bootCount))
+    if (fThisBoot)
         {
-        b.putBootCountLsb(bootCount);
-        flag |= Flags::Boot;
+        std::uint32_t const age = (millis() - samples[n - 1].tSample) / (60 * 1000);
+
+        b.put2(std::uint32_t(age > 0xFFFF ? 0xFFFF : age));
+        flag |= Flags::Age;
         }
 
-    if (this->m_fSCD && this->m_measurement_valid)
+    *pFlag = std::uint8_t(flag);
+
+    gCatena.SafePrintf("forwarding %u stored samples (%u left)\n",
+        unsigned(n), unsigned(this->m_store.getNumSamples() - n)
+        );
+
+    this->startTransmission(b);
+    return true;
+    }
+
+/****************************************************************************\
+|
+|   Power profile uplinks
+|
+\****************************************************************************/
+
+/*
+
+Name:	cMeasurementLoop::startDiag()
+
+Function:
+    Start an uplink of the power profile.
+
+Definition:
+    bool cMeasurementLoop::startDiag();
+
+Description:
+    The profile since it was last cleared is sent on kDiagPort, in
+    format kDiagMessageFormat: the window (uint16, minutes), the
+    average current (uint16, uA), and the share of the time spent
+    awake, in light sleep and in deep sleep (uint16 each, 0xFFFF is
+    100%). Then, for each state that was entered, its number (uint8),
+    its share of the time (uint16, as before) and its estimated charge
+    (uint16, uAh). Values that don't fit are clamped to 0xFFFF. As
+    many states as fit in the payload at the current data rate are
+    sent, in state order.
+
+Returns:
+    `true` if an uplink was started; `false` if it wouldn't fit.
+
+*/
+
+bool cMeasurementLoop::startDiag()
+    {
+    std::size_t const nPayload = getMaxPayload();
+    std::size_t const nMax = nPayload < kDiagTxBytes ? nPayload : kDiagTxBytes;
+
+    if (nMax < kDiagHeaderBytes)
+        return false;
+
+    auto &p = this->m_profile;
+    p.update();
+
+    std::uint32_t totalMs = 0;
+    for (unsigned i = 0; i < kNumStates; ++i)
+        totalMs += cPowerProfile::getMs(p.getTotals(i));
+
+    auto const clamp16 = [](std::uint32_t v) -> std::uint32_t
+        {
+        return v > 0xFFFF ? 0xFFFF : v;
+        };
+    auto const share = [totalMs](std::uint32_t ms) -> std::uint32_t
         {
-        auto const m = this->m_Scd.getMeasurement();
+        return totalMs == 0 ? 0 : std::uint32_t((std::uint64_t(ms) * 0xFFFF + totalMs / 2) / totalMs);
+        };
 
-        // temperature is 2 bytes from -163.840 to +163.835 degrees C
-        // pressure is 4 bytes, first signed units, then scale.
-        if (gLog.isEnabled(gLog.kInfo))
-            {
-            char ts = ' ';
-            std::int32_t t100 = std::int32_t(m.Temperature * 100.0f + 0.5f);
-            if (m.Temperature < 0) { ts = '-'; t100 = -t100; }
-            std::int32_t tint = t100 / 100;
-            std::int32_t tfrac = t100 - (tint * 100);
-
-            std::int32_t rh100 = std::int32_t(m.RelativeHumidity * 100.0f + 0.5f);
-            std::int32_t rhint = rh100 / 100;
-            std::int32_t rhfrac = rh100 - (rhint * 100);
-
-            std::int32_t co2_100 = std::int32_t(m.CO2ppm * 100.0f + 0.5f);
-            std::int32_t co2int = co2_100 / 100;
-            std::int32_t co2frac = co2_100 - (co2int * 100);
-
-            gCatena.SafePrintf(
-                "SCD30:  T(C): %c%d.%02d  RH(%%): %d.%02d  CO2(ppm): %d.%02d\n",
-                ts, tint, tfrac,
-                rhint, rhfrac,
-                co2int, co2frac
-                );
-            }
+    DiagBuffer_t b;
 
-        b.put2(std::int32_t(m.Temperature * 200.0f + 0.5f));
-        b.put2(std::uint32_t(m.RelativeHumidity * 65535.0f / 100.0f + 0.5f));
-        flag |= Flags::TH;
+    b.begin();
+    b.put(kDiagMessageFormat);
+    b.put2(clamp16(p.getWindowMs() / (60 * 1000)));
+    b.put2(clamp16(p.getAverageMicroAmps()));
+    b.put2(share(p.getModeMs(cPowerProfile::SleepMode::Awake)));
+    b.put2(share(p.getModeMs(cPowerProfile::SleepMode::Light)));
+    b.put2(share(p.getModeMs(cPowerProfile::SleepMode::Deep)));
+
+    for (unsigned i = 0; i < kNumStates; ++i)
+        {
+        auto const &t = p.getTotals(i);
 
-        // The CO2 sensor returns 0 on the first reading,
-        // and we want to suppress that.
-        if (m.CO2ppm != 0.0f)
-            {
-            // put2 takes a uint32_t or int32_t. We want the uint32_t version,
-            // so we cast. f2uflt16() takes [0.0f, +1.0f) and returns a uint16_t
-            // as an encoding.
-            b.put2(std::uint32_t(LMIC_f2uflt16(m.CO2ppm / 40000.0f)));
-            flag |= Flags::CO2ppm;
-            }
+        if (t.nEntries == 0)
+            continue;
+        if (b.getn() + kDiagRecordBytes > nMax)
+            break;
+
+        b.put(std::uint8_t(i));
+        b.put2(share(cPowerProfile::getMs(t)));
+        b.put2(clamp16(cPowerProfile::getMicroAmpHours(p.getCharge(i))));
         }
 
-    *pFlag = std::uint8_t(flag);
+    gCatena.SafePrintf("power profile: %u uA average\n", unsigned(p.getAverageMicroAmps()));
+
+    this->startTransmission(b.getbase(), b.getn(), kDiagPort);
+    return true;
     }
 
 /****************************************************************************\
@@ -347,7 +1470,9 @@ void cMeasurementLoop::fillTxBuffer(cMeasurementLoop::TxBuffer_t& b)
 \****************************************************************************/
 
 void cMeasurementLoop::startTransmission(
-    cMeasurementLoop::TxBuffer_t &b
+    const std::uint8_t *pBuffer,
+    std::size_t nBuffer,
+    std::uint8_t port
     )
     {
     auto const savedLed = gLed.Set(McciCatena::LedPattern::Sending);
@@ -374,7 +1499,7 @@ void cMeasurementLoop::startTransmission(
     this->m_txpending = true;
     this->m_txcomplete = this->m_txerr = false;
 
-    if (! gLoRaWAN.SendBuffer(b.getbase(), b.getn(), sendBufferDoneCb, (void *)this, fConfirmed, kUplinkPort))
+    if (! gLoRaWAN.SendBuffer(pBuffer, nBuffer, sendBufferDoneCb, (void *)this, fConfirmed, port))
         {
         // uplink wasn't launched.
         this->m_txcomplete = true;
@@ -391,6 +1516,172 @@ void cMeasurementLoop::sendBufferDone(bool fSuccess)
     this->m_fsm.eval();
     }
 
+/****************************************************************************\
+|
+|   Remote configuration
+|
+\****************************************************************************/
+
+void cMeasurementLoop::receiveMessage(
+    std::uint8_t port,
+    const std::uint8_t *pMessage,
+    std::size_t nMessage
+    )
+    {
+    if (port != kConfigPort)
+        return;
+
+    cSCD30::Config config;
+
+    if (! parseConfig(config, pMessage, nMessage))
+        {
+        if (gLog.isEnabled(gLog.kError))
+            gLog.printf(gLog.kAlways, "invalid configuration downlink (%u bytes)\n", unsigned(nMessage));
+        return;
+        }
+
+    // we're called from the LMIC; apply the changes from poll(). If
+    // another downlink comes first, the later one wins.
+    this->m_ScdConfig = config;
+    this->m_rqConfig = true;
+    }
+
+/*
+
+Name:	cMeasurementLoop::parseConfig()
+
+Function:
+    Decode a configuration downlink.
+
+Definition:
+    static bool cMeasurementLoop::parseConfig(
+        cSCD30::Config &config,
+        const std::uint8_t *pMessage,
+        std::size_t nMessage
+        );
+
+Description:
+    The first byte selects the settings to change, using the bits of
+    cSCD30::ProductInfoField: bit 1 measurement interval, bit 2 ASC,
+    bit 3 forced recalibration value, bit 4 temperature offset, and
+    bit 5 altitude. The other bits must be zero. The values follow, in
+    the same order: ASC is one byte (0 or 1); the others are big-endian
+    uint16 (seconds, ppm, 0.01 degrees C, and meters, respectively).
+
+Returns:
+    `true` if the message was well-formed, with config filled in.
+    The values are checked by the driver, not here.
+
+*/
+
+bool cMeasurementLoop::parseConfig(
+    cSCD30::Config &config,
+    const std::uint8_t *pMessage,
+    std::size_t nMessage
+    )
+    {
+    using Field = cSCD30::ProductInfoField;
+
+    if (nMessage < 1)
+        return false;
+
+    config = cSCD30::Config {};
+    config.fields = Field(pMessage[0]);
+
+    if ((pMessage[0] & ~std::uint8_t(Field::All)) != 0 ||
+        (pMessage[0] & std::uint8_t(Field::FirmwareVersion)) != 0)
+        return false;
+
+    std::size_t i = 1;
+    auto const get2 =
+        [pMessage, nMessage, &i](std::uint16_t &v) -> bool
+            {
+            if (nMessage - i < 2)
+                return false;
+            v = (pMessage[i] << 8) | pMessage[i + 1];
+            i += 2;
+            return true;
+            };
+    auto const has =
+        [pMessage](Field f) -> bool
+            {
+            return (pMessage[0] & std::uint8_t(f)) != 0;
+            };
+    std::uint16_t v;
+
+    if (has(Field::MeasurementInterval))
+        {
+        if (! get2(config.Info.MeasurementInterval))
+            return false;
+        }
+    if (has(Field::ASC_status))
+        {
+        if (i >= nMessage || pMessage[i] > 1)
+            return false;
+        config.Info.fASC_status = pMessage[i++];
+        }
+    if (has(Field::ForcedRecalibrationValue))
+        {
+        if (! get2(config.Info.ForcedRecalibrationValue))
+            return false;
+        }
+    if (has(Field::TemperatureOffset))
+        {
+        if (! get2(v))
+            return false;
+        config.Info.TemperatureOffset = std::int16_t(v);
+        }
+    if (has(Field::AltitudeCompensation))
+        {
+        if (! get2(v))
+            return false;
+        config.Info.AltitudeCompensation = std::int16_t(v);
+        }
+
+    // no trailing bytes.
+    return i == nMessage;
+    }
+
+// apply the settings from the last configuration downlink.
+void cMeasurementLoop::startConfig()
+    {
+    if (this->m_Scd.applyConfigAsync(this->m_ScdConfig, applyConfigDone, (void *)this))
+        this->m_rqConfig = false;
+    else if (this->m_Scd.getLastError() != cSCD30::Error::Busy)
+        {
+        // it will never work; drop it.
+        this->m_rqConfig = false;
+        if (gLog.isEnabled(gLog.kError))
+            gLog.printf(gLog.kAlways, "SCD30 configuration rejected: %s\n", this->m_Scd.getLastErrorName());
+        }
+    // otherwise the sensor is busy with product info; try again later.
+    }
+
+void cMeasurementLoop::applyConfigDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cMeasurementLoop *)pClientData;
+
+    if (fSuccess)
+        {
+        auto const info = pThis->m_Scd.getInfo();
+
+        gCatena.SafePrintf(
+            "SCD30 configured: interval %u s, ASC %u, FRC %u ppm, offset %d, altitude %d m\n",
+            info.MeasurementInterval,
+            info.fASC_status,
+            info.ForcedRecalibrationValue,
+            info.TemperatureOffset,
+            info.AltitudeCompensation
+            );
+        }
+    else if (gLog.isEnabled(gLog.kError))
+        gLog.printf(gLog.kAlways, "SCD30 configuration failed: %s\n", pThis->m_Scd.getLastErrorName());
+    }
+
 /****************************************************************************\
 |
 |   The Polling function --
@@ -401,6 +1692,19 @@ void cMeasurementLoop::poll()
     {
     bool fEvent;
 
+    this->m_profile.notePoll();
+
+    // let the SCD30 driver finish any asynchronous commands.
+    this->m_Scd.poll();
+    if (this->m_pAux != nullptr)
+        this->m_pAux->poll();
+    // and the other sensors finish their conversions.
+    this->m_tasks.poll();
+
+    // apply any configuration downlink.
+    if (this->m_rqConfig && this->m_fSCD && ! this->m_Scd.isConfigPending())
+        this->startConfig();
+
     // no need to evaluate unless something happens.
     fEvent = false;
 
@@ -440,25 +1744,34 @@ void cMeasurementLoop::poll()
 
 void cMeasurementLoop::sleep()
     {
-    const bool fDeepSleep = checkDeepSleep();
+    std::uint32_t const windowMs = this->m_scheduler.getWindowMs();
+    auto const mode = this->m_scheduler.chooseMode(windowMs, this->checkDeepSleep());
+    const bool fDeepSleep = mode == cPowerScheduler::SleepMode::Deep;
 
-    if (! this->m_fPrintedSleeping)
-            this->doSleepAlert(fDeepSleep);
+    // a light sleep is just part of the wait; don't announce it.
+    if (! this->m_fPrintedSleeping && windowMs > 500)
+            this->doSleepAlert(fDeepSleep, windowMs);
 
     if (fDeepSleep)
             this->doDeepSleep();
+    else if (mode == cPowerScheduler::SleepMode::Light)
+            {
+            // stop the CPU until the next interrupt; the SysTick
+            // brings us back within a millisecond.
+            std::uint32_t const tSleep = micros();
+            __WFI();
+            this->m_profile.noteLightSleep(micros() - tSleep);
+            }
     }
 
+// the application's policy: may we deep sleep at all?
 bool cMeasurementLoop::checkDeepSleep()
     {
     bool const fDeepSleepTest = gCatena.GetOperatingFlags() &
                     static_cast<uint32_t>(gCatena.OPERATING_FLAGS::fDeepSleepTest);
     bool fDeepSleep;
-    std::uint32_t const sleepInterval = this->m_Scd.getMsToNextMeasurement() / 1000;
 
-    if (sleepInterval < 2)
-            fDeepSleep = false;
-    else if (fDeepSleepTest)
+    if (fDeepSleepTest)
             {
             fDeepSleep = true;
             }
@@ -486,7 +1799,157 @@ bool cMeasurementLoop::checkDeepSleep()
     return fDeepSleep;
     }
 
-void cMeasurementLoop::doSleepAlert(bool fDeepSleep)
+/*
+
+Name:	cMeasurementLoop::addSleepSources()
+
+Function:
+    Tell the power scheduler when each subsystem next needs the CPU.
+
+Definition:
+    void cMeasurementLoop::addSleepSources();
+
+Description:
+    The SCD30 needs us at its next measurement (or now, if the driver
+    has commands queued). If the RDY pin is wired to an interrupt, we
+    can sleep past the estimate; the edge is an EXTI event, which ends
+    STOP mode as soon as the data is actually ready. Once the driver
+    has learned the cadence, it polls kReadyGuardMs early, so we can
+    wake that much late. A stopped SCD30 doesn't need us; in burst
+    mode, the next burst does. Auxiliary sensors need us at the first
+    of their measurements, and the sensor tasks when the first of their
+    conversions is done. A pending uplink needs us now, as does
+    the LMIC while a transmit or receive window is in progress;
+    otherwise the LMIC needs us at its next time-critical job.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cMeasurementLoop::addSleepSources()
+    {
+    // by using lambdas, we can access the private contents
+    this->addSleepSource(
+        "scd30",
+        [](void *pClientData) -> std::uint32_t
+            {
+            auto const pThis = (cMeasurementLoop *)pClientData;
+            auto &scd = pThis->m_Scd;
+
+            if (scd.isBusy())
+                return 0;
+            else if (scd.getState() == cSCD30::State::Idle)
+                // stopped; burst mode has its own deadline.
+                return cPowerScheduler::kNoDeadline;
+            else if (scd.isReadyInterruptEnabled())
+                return scd.getMsToNextMeasurement() + 1000;
+            else
+                return scd.getMsToNextMeasurement();
+            },
+        kScdWakeSlackMs
+        );
+
+    this->addSleepSource(
+        "aux",
+        [](void *pClientData) -> std::uint32_t
+            {
+            auto const pAux = ((cMeasurementLoop *)pClientData)->m_pAux;
+
+            if (pAux == nullptr)
+                return cPowerScheduler::kNoDeadline;
+            else if (pAux->isBusy())
+                return 0;
+
+            for (unsigned i = 0; i < pAux->getNumSensors(); ++i)
+                {
+                if (pAux->getSensor(i).getState() != cSCD30::State::Idle)
+                    return pAux->getMsToNextMeasurement();
+                }
+
+            // none running.
+            return cPowerScheduler::kNoDeadline;
+            },
+        kScdWakeSlackMs
+        );
+
+    this->addSleepSource(
+        "tasks",
+        [](void *pClientData) -> std::uint32_t
+            {
+            return ((cMeasurementLoop *)pClientData)->m_tasks.getMsToReady();
+            }
+        );
+
+    this->addSleepSource(
+        "burst",
+        [](void *pClientData) -> std::uint32_t
+            {
+            auto const pThis = (cMeasurementLoop *)pClientData;
+
+            return pThis->isBurstMode() ? pThis->getMsToNextBurst() : cPowerScheduler::kNoDeadline;
+            }
+        );
+
+    this->addSleepSource(
+        "uplink",
+        [](void *pClientData) -> std::uint32_t
+            {
+            auto const pThis = (cMeasurementLoop *)pClientData;
+
+            return pThis->m_txpending ? 0 : cPowerScheduler::kNoDeadline;
+            }
+        );
+
+    this->addSleepSource(
+        "lmic",
+        [](void *) -> std::uint32_t
+            {
+            if (LMIC.opmode & OP_TXRXPEND)
+                return 0;
+
+            // the LMIC can only tell us whether a job is due within a
+            // given time, so search for the deadline. 22 steps get to
+            // 1 ms in an hour.
+            std::uint32_t lo = 0;
+            std::uint32_t hi = cPowerScheduler::kMaxSleepMs;
+
+            if (! os_queryTimeCriticalJobs(ms2osticks(hi)))
+                return cPowerScheduler::kNoDeadline;
+
+            while (hi - lo > 1)
+                {
+                std::uint32_t const mid = lo + (hi - lo) / 2;
+
+                if (os_queryTimeCriticalJobs(ms2osticks(mid)))
+                    hi = mid;
+                else
+                    lo = mid;
+                }
+
+            return lo;
+            }
+        );
+    }
+
+// add one of our sources; running out of slots means kMaxSources
+// wasn't raised with a new source, so say so.
+bool cMeasurementLoop::addSleepSource(
+    const char *pName,
+    cPowerScheduler::DeadlineFn_t *pDeadlineFn,
+    std::uint32_t slackMs
+    )
+    {
+    if (this->m_scheduler.addSource(pName, pDeadlineFn, (void *)this, slackMs))
+        return true;
+
+    if (gLog.isEnabled(gLog.kError))
+        gLog.printf(gLog.kAlways, "cMeasurementLoop: can't add sleep source %s\n", pName);
+
+    return false;
+    }
+
+void cMeasurementLoop::doSleepAlert(bool fDeepSleep, std::uint32_t windowMs)
     {
     this->m_fPrintedSleeping = true;
 
@@ -527,39 +1990,58 @@ void cMeasurementLoop::doSleepAlert(bool fDeepSleep)
             }
         }
     else
-        gCatena.SafePrintf("using light sleep; next measurement in %u ms\n", this->m_Scd.getMsToNextMeasurement());
+        gCatena.SafePrintf("using light sleep; next wakeup in %u ms\n", unsigned(windowMs));
     }
 
 void cMeasurementLoop::doDeepSleep()
     {
-    // bool const fDeepSleepTest = gCatena.GetOperatingFlags() &
-    //                         static_cast<uint32_t>(gCatena.OPERATING_FLAGS::fDeepSleepTest);
-    std::uint32_t const sleepInterval = this->m_Scd.getMsToNextMeasurement() / 1000;
+    // finish any queued SCD30 commands (such as a configuration
+    // downlink) before the driver is stopped.
+    while (this->m_Scd.isBusy() ||
+           (this->m_pAux != nullptr && this->m_pAux->isBusy()))
+        {
+        this->m_Scd.poll();
+        if (this->m_pAux != nullptr)
+            this->m_pAux->poll();
+        yield();
+        }
+
+    // the alert may have taken a while; look again.
+    unsigned iSource;
+    std::uint32_t const windowMs = this->m_scheduler.getWindowMs(iSource);
 
-    if (sleepInterval == 0)
+    if (this->m_scheduler.chooseMode(windowMs, true) != cPowerScheduler::SleepMode::Deep)
         return;
 
+    std::uint32_t const sleepInterval = this->m_scheduler.getDeepSleepSecs(windowMs);
+
     /* how long are we planning to sleep for? */
     if (gLog.isEnabled(gLog.kTrace))
         {
         gLog.printf(
             gLog.kAlways,
-            "sleep for %u sec, state %s\n",
+            "sleep for %u sec (%s in %u ms, wake latency %u ms), state %s\n",
             sleepInterval,
+            this->m_scheduler.getSourceName(iSource),
+            unsigned(windowMs),
+            unsigned(this->m_scheduler.getWakeLatencyMs()),
             this->m_Scd.getCurrentStateName()
             );
         delay(10);
         }
 
     /* ok... now it's time for a deep sleep */
+    std::uint32_t const tStart = millis();
     gLed.Set(McciCatena::LedPattern::Off);
     this->deepSleepPrepare();
 
     /* sleep */
     gCatena.Sleep(sleepInterval);
+    this->m_profile.noteDeepSleep(sleepInterval * 1000);
 
-    /* recover from sleep */
+    /* recover from sleep, and learn how long that took */
     this->deepSleepRecovery();
+    this->m_scheduler.noteDeepSleep(tStart, sleepInterval, millis());
 
     /* and now... we're awake again. trigger another measurement */
     this->m_fsm.eval();
@@ -572,8 +2054,20 @@ void cMeasurementLoop::deepSleepPrepare(void)
     // down. If porting, bear this in mind; you'll need to modify
     // this.
 
-    // stop the SCD30; we leave it running.
+    // stop the SCD30; we leave it running. Save what we know about it,
+    // so we don't have to rediscover it on wakeup.
+    this->m_fScdSnapshot = this->m_Scd.exportSnapshot(this->m_ScdSnapshot);
     this->m_Scd.end();
+    if (this->m_pAux != nullptr)
+        {
+        this->m_auxSnapshotValid = 0;
+        for (unsigned i = 0; i < this->m_pAux->getNumSensors() && i < kMaxAuxSensors; ++i)
+            {
+            if (this->m_pAux->getSensor(i).exportSnapshot(this->m_auxSnapshot[i]))
+                this->m_auxSnapshotValid |= 1u << i;
+            }
+        this->m_pAux->end();
+        }
 
     // we power down the serial port
     Serial.end();
@@ -620,9 +2114,31 @@ void cMeasurementLoop::deepSleepRecovery(void)
             gSPI2.begin();
 
     // start the SCD30, and make sure it passes the bring-up.
-    // record success in m_fDiffPressure, which is used later
-    // when collecting results to transmit.
-    this->m_fSCD = this->m_Scd.begin();
+    // record success in m_fSCD, which is used later
+    // when collecting results to transmit. If we saved a snapshot,
+    // begin() uses it and doesn't talk to the sensor at all. Otherwise,
+    // nothing else in the product info can change while we sleep, so
+    // only fetch the measurement interval.
+    if (this->m_fScdSnapshot)
+        {
+        this->m_fScdSnapshot = false;
+        this->m_Scd.importSnapshot(this->m_ScdSnapshot);
+        }
+    this->m_fSCD = this->m_Scd.begin(cSCD30::ProductInfoField::MeasurementInterval);
+
+    // the same for the auxiliary sensors; any that fail are left out
+    // of the reports until a measurement succeeds.
+    if (this->m_pAux != nullptr)
+        {
+        for (unsigned i = 0; i < this->m_pAux->getNumSensors() && i < kMaxAuxSensors; ++i)
+            {
+            if (this->m_auxSnapshotValid & (1u << i))
+                this->m_pAux->getSensor(i).importSnapshot(this->m_auxSnapshot[i]);
+            }
+        this->m_auxSnapshotValid = 0;
+        if (! this->m_pAux->begin() && gLog.isEnabled(gLog.DebugFlags::kError))
+            gLog.printf(gLog.kAlways, "auxiliary SCD30 begin() failed after sleep\n");
+        }
 
     // if it didn't start, log a message.
     if (! this->m_fSCD)
@@ -35,7 +35,16 @@ Author:
 #include <Catena_Timer.h>
 #include <Catena_TxBuffer.h>
 #include <MCCI_Catena_SCD30.h>
+#include <MCCI_Catena_SCD30_BusManager.h>
+#include <MCCI_Catena_SCD30_History.h>
+#include <MCCI_Catena_SCD30_Summary.h>
 #include <mcciadk_baselib.h>
+#include "cPowerProfile.h"
+#include "cPowerScheduler.h"
+#include "cSampleStore.h"
+#include "cSensorTask.h"
+#include "cSht3xTask.h"
+#include "cVbatTask.h"
 #include <stdlib.h>
 
 #include <cstdint>
@@ -72,6 +81,8 @@ public:
         stMeasure,   	// make the measurements
         stSleepSensor,  // sleep any sensors that need to be put to sleep
         stTransmit,     // transmit data
+        stForward,      // transmit stored data
+        stDiag,         // transmit the power profile
 
         stFinal,        // this name must be present, it's the terminal state.
         };
@@ -88,6 +99,8 @@ public:
         case State::stMeasure: return "stMeasure";
         case State::stSleepSensor: return "stSleepSensor";
         case State::stTransmit: return "stTransmit";
+        case State::stForward: return "stForward";
+        case State::stDiag: return "stDiag";
         case State::stFinal: return "stFinal";
         default: return "<<unknown>>";
             }
@@ -95,6 +108,64 @@ public:
 
     static constexpr uint8_t kUplinkPort = 1;
     static constexpr uint8_t kMessageFormat = 0x1E;
+    static constexpr uint8_t kBatchMessageFormat = 0x1F;
+    static constexpr uint8_t kMultiMessageFormat = 0x20;
+    // downlinks on this port change the SCD30 settings.
+    static constexpr uint8_t kConfigPort = 2;
+    // the optional diagnostic uplinks of the power profile use this
+    // port and format.
+    static constexpr uint8_t kDiagPort = 3;
+    static constexpr uint8_t kDiagMessageFormat = 0x21;
+
+    static constexpr unsigned kNumStates = unsigned(State::stFinal) + 1;
+    static_assert(kNumStates <= cPowerProfile::kMaxStates, "cPowerProfile::kMaxStates is too small");
+
+    // estimated current in each power mode, for the power profile:
+    // placeholders for a 4801 with the SCD30 measuring continuously
+    // at the default interval; measure your own hardware and set them
+    // with the "power current" command. The radio figure is the
+    // average over an uplink, receive windows included, and is added
+    // in stTransmit, stForward and stDiag.
+    static constexpr std::uint32_t kCurrentAwake_uA = 25000;
+    static constexpr std::uint32_t kCurrentLight_uA = 21000;
+    static constexpr std::uint32_t kCurrentDeep_uA = 19000;
+    static constexpr std::uint32_t kCurrentRadio_uA = 12000;
+    static constexpr std::uint16_t kSupply_mV = 3700;
+
+    // number of measurements sent per uplink. If 1, each measurement
+    // is sent as soon as it's taken, using format 0x1E; otherwise
+    // measurements are collected and sent K at a time, using format
+    // 0x1F, which delta-encodes samples 1..K-1 against sample 0.
+    // The default stays 1, so back ends with a decoder for 0x1E only
+    // keep working; raise it (4 is a good start) to batch.
+    static constexpr unsigned kSamplesPerUplink = 1;
+    static_assert(1 <= kSamplesPerUplink && kSamplesPerUplink <= 255, "kSamplesPerUplink must be in [1..255]");
+
+    // if true, each uplink also carries the min, max, mean and standard
+    // deviation of every reading taken since the last one (field 6).
+    static constexpr bool kUplinkSummary = false;
+    static constexpr size_t kSummaryBytes = 1 + 3 * 4 * 2;
+
+    // report on change: an uplink is skipped unless a value has moved
+    // by more than its deadband since the last one sent, or
+    // HeartbeatSecs have passed without an uplink. Values are in
+    // the units of Sample.
+    struct Deadband
+        {
+        std::uint16_t   CO2ppm;             /// min CO2 change worth sending, ppm
+        std::uint16_t   Temperature;        /// min temperature change, 0.005 degrees C
+        std::uint16_t   RelativeHumidity;   /// min RH change, where 0xFFFF is 100%
+        std::uint32_t   HeartbeatSecs;      /// max time between uplinks; 0 sends every uplink
+        };
+
+    // delta encodings for each field of a format 0x1F batch.
+    enum class DeltaCode : uint8_t
+            {
+            Same = 0,           // all samples 1..n-1 same as sample 0; no bytes
+            Int8 = 1,           // int8 difference from sample 0
+            Int16 = 2,          // int16 difference from sample 0
+            Absolute = 3,       // the value itself, not a difference
+            };
 
     enum class Flags : uint8_t
             {
@@ -104,9 +175,100 @@ public:
             TH = 1 << 3,        // temperature (int16, 0.005 deg C),
                                 // rh (uint16, 0xFFFF = 100%)
             CO2ppm = 1 << 4,    // CO2 PPM, uflt16
+            Age = 1 << 5,       // format 0x1F only: age of newest sample, minutes (uint16)
+            Summary = 1 << 6,   // count (uint8), then min, max, mean, std dev of
+                                // T (int16), RH (uint16), CO2 (uflt16)
+            More = 1 << 6,      // format 0x20 only: another frame of this
+                                // report follows
+            Heartbeat = 1 << 7, // no bytes: nothing changed by more than the
+                                // deadband since the last uplink
             };
 
-    static constexpr size_t kTxBufferSize = 36;
+    using Sample = McciCatenaScd30::cSCD30HistoryBase::Sample;
+
+    // how late (ms) we can wake for an SCD30 measurement; the driver
+    // polls this much before the predicted transition anyway.
+    static constexpr std::uint32_t kScdWakeSlackMs = McciCatenaScd30::cSCD30::kReadyGuardMs;
+
+    // how long (ms) before an SCD30 measurement we wake up; the sensor
+    // tasks start then, so this is stretched to the longest of their
+    // conversions, and they're all done when the SCD30 is.
+    static constexpr std::uint32_t kWakeLeadMs = 20;
+
+    // the power scheduler sources added by addSleepSources(), and the
+    // slots that must be left for other subsystems.
+    static constexpr unsigned kSleepSources = 6;
+    static constexpr unsigned kClientSleepSources = 4;
+    static_assert(
+        kSleepSources + kClientSleepSources <= cPowerScheduler::kMaxSources,
+        "cPowerScheduler::kMaxSources is too small"
+        );
+
+    // burst mode: the SCD30 is stopped between reports, and started
+    // for a short burst before each one. The burst runs at this
+    // measurement interval, discards readings while the sensor
+    // settles, and reports the median of the rest.
+    static constexpr std::uint16_t kBurstIntervalSecs = 2;
+    static constexpr std::uint8_t kBurstSettleSamples = 3;
+    static constexpr std::uint8_t kBurstSamples = 5;
+
+    // the SCD30's reading filter drops the first reading after the
+    // sensor starts measuring, readings with a NaN channel, and single
+    // readings far from the two before them (more than 3 robust
+    // standard deviations, and more than the minimum for the channel),
+    // so they're never reported.
+    static constexpr std::uint8_t kFilterWarmupSamples = 1;
+    static constexpr std::uint8_t kFilterOutlierThreshold = 3;
+    static constexpr std::uint16_t kFilterMinCO2ppm = 50;
+    static constexpr std::uint16_t kFilterMinTemperature = 200;        // 1 degree C
+    static constexpr std::uint16_t kFilterMinRelativeHumidity = 3277;  // 5% RH
+
+    // max number of batches of stored samples to send after each
+    // successful uplink; this bounds the extra airtime per cycle.
+    // Each batch is a format 0x1F message, with as many samples as
+    // fit in the payload at the current data rate, up to
+    // kMaxForwardSamples.
+    static constexpr unsigned kMaxForwardBatches = 2;
+    static constexpr unsigned kMaxForwardSamples = 24;
+    static_assert(1 <= kMaxForwardSamples && kMaxForwardSamples <= 255, "kMaxForwardSamples must be in [1..255]");
+
+    // the most samples fillTxBufferBatch() is asked to encode.
+    static constexpr unsigned kMaxBatchSamples =
+        kSamplesPerUplink > kMaxForwardSamples ? kSamplesPerUplink : kMaxForwardSamples;
+
+    // multi-sensor gateway nodes: up to kMaxAuxSensors sensors on a
+    // cSCD30BusManager are reported along with the primary SCD30, in
+    // format 0x20. Each sensor's record is T (int16), RH (uint8, 0xFF
+    // = 100%) and CO2 (uflt16).
+    static constexpr unsigned kMaxAuxSensors = 7;
+    static constexpr unsigned kMaxMultiSensors = 1 + kMaxAuxSensors;
+    static constexpr size_t kMultiRecordBytes = 5;
+
+    // format 0x1F worst case: format, flags, Vbat, Vsys, boot,
+    // count, period, codes, and six bytes per sample; then the summary.
+    static constexpr size_t kBatchTxBytes =
+        (kSamplesPerUplink == 1 ? 36 : 36 > 11 + 6 * kSamplesPerUplink ? 36 : 11 + 6 * kSamplesPerUplink) +
+        (kUplinkSummary ? kSummaryBytes : 0);
+    // a forwarded batch: format, flags, count, period, codes, and
+    // six bytes per sample; then the age.
+    static constexpr size_t kForwardHeaderBytes = 6;
+    static constexpr size_t kForwardSampleBytes = 6;
+    static constexpr size_t kForwardAgeBytes = 2;
+    static constexpr size_t kForwardTxBytes =
+        kForwardHeaderBytes + kForwardSampleBytes * kMaxForwardSamples + kForwardAgeBytes;
+    // the power profile uplink: format, window, average current and
+    // the share of each mode; then state, time share and charge for
+    // each state that was entered.
+    static constexpr size_t kDiagHeaderBytes = 11;
+    static constexpr size_t kDiagRecordBytes = 5;
+    static constexpr size_t kDiagTxBytes = kDiagHeaderBytes + kDiagRecordBytes * kNumStates;
+    using DiagBuffer_t = McciCatena::AbstractTxBuffer_t<kDiagTxBytes>;
+
+    // format 0x20 worst case: format, flags, Vbat, boot, bitmap, and
+    // a record for every sensor.
+    static constexpr size_t kMultiTxBytes = 6 + kMultiRecordBytes * kMaxMultiSensors;
+    static constexpr size_t kUplinkTxBytes = kBatchTxBytes > kMultiTxBytes ? kBatchTxBytes : kMultiTxBytes;
+    static constexpr size_t kTxBufferSize = kUplinkTxBytes > kForwardTxBytes ? kUplinkTxBytes : kForwardTxBytes;
     using TxBuffer_t = McciCatena::AbstractTxBuffer_t<kTxBufferSize>;
 
     // initialize measurement FSM.
@@ -117,6 +279,63 @@ public:
     // request that the measurement loop be active/inactive
     void requestActive(bool fEnable);
 
+    // a source of ambient pressure readings: set pressure_mBar and
+    // return true, or return false if there's no reading.
+    using PressureFn_t = bool (void *pClientData, std::uint16_t &pressure_mBar);
+    // after each measurement, feed the reading from pPressureFn (if not
+    // nullptr) to the SCD30's pressure compensation.
+    void setPressureSource(PressureFn_t *pPressureFn, void *pClientData)
+        {
+        this->m_pPressureFn = pPressureFn;
+        this->m_pPressureClientData = pClientData;
+        }
+
+    // report every reportSecs seconds in burst mode, or measure
+    // continuously if zero.
+    void setBurstMode(std::uint32_t reportSecs)
+        {
+        this->m_burstReportSecs = reportSecs;
+        // start the first burst right away.
+        this->m_tNextBurst = millis();
+        }
+    std::uint32_t getBurstMode() const { return this->m_burstReportSecs; }
+
+    // set the deadbands for report on change.
+    void setDeadband(const Deadband &deadband) { this->m_deadband = deadband; }
+    Deadband getDeadband() const { return this->m_deadband; }
+
+    // report the sensors on pManager (or stop, if nullptr) along with
+    // the primary SCD30, using format 0x20. The caller adds the sensors
+    // and calls pManager->begin(); we poll it from then on.
+    void setAuxSensors(McciCatenaScd30::cSCD30BusManager *pManager);
+    bool isMultiSensor() const { return this->m_pAux != nullptr; }
+
+    // the other sensors, converted alongside the SCD30 in every cycle.
+    // The battery task's reading goes in the uplinks; the T/RH task's
+    // stands in when the SCD30 doesn't have a valid T/RH.
+    bool addSensorTask(cSensorTask &task) { return this->m_tasks.add(task); }
+    bool setVbatTask(cVbatTask &task);
+    bool setThTask(cSht3xTask &task);
+    const cSensorTaskGroup &getSensorTasks() const { return this->m_tasks; }
+
+    // the power scheduler; other subsystems can add their deadlines
+    // (there's room for kClientSleepSources of them).
+    cPowerScheduler &getScheduler() { return this->m_scheduler; }
+
+    // time and estimated charge in each state.
+    cPowerProfile &getProfile() { return this->m_profile; }
+    // send the power profile every diagSecs seconds on kDiagPort, after
+    // a successful uplink; or not at all, if zero.
+    void setDiagUplink(std::uint32_t diagSecs)
+        {
+        this->m_diagSecs = diagSecs;
+        this->m_tLastDiag = millis();
+        }
+    std::uint32_t getDiagUplink() const { return this->m_diagSecs; }
+
+    // process a downlink.
+    void receiveMessage(std::uint8_t port, const std::uint8_t *pMessage, std::size_t nMessage);
+
 private:
     // evaluate the control FSM.
     State fsmDispatch(State currentState, bool fEntry);
@@ -143,15 +362,45 @@ private:
 
     // sleep handling
     void sleep();
-    // can we enter deep sleep?
+    // does the application allow deep sleep?
     bool checkDeepSleep();
-    void doSleepAlert(bool fDeepSleep);
+    void addSleepSources();
+    bool addSleepSource(
+            const char *pName,
+            cPowerScheduler::DeadlineFn_t *pDeadlineFn,
+            std::uint32_t slackMs = 0
+            );
+    void doSleepAlert(bool fDeepSleep, std::uint32_t windowMs);
     void doDeepSleep();
     void deepSleepPrepare();
     void deepSleepRecovery();
 
+    // completion for asynchronous measurement reads
+    static McciCatenaScd30::cSCD30::AsyncDoneFn_t readMeasurementDone;
+
+    void logMeasurement();
+    void logSensorTasks();
+    std::uint32_t getWakeLeadMs() const
+        {
+        auto const ms = this->m_tasks.getConversionMs();
+        return ms > kWakeLeadMs ? ms : kWakeLeadMs;
+        }
+    float getVbat() const;
     void fillTxBuffer(TxBuffer_t &b);
-    void startTransmission(TxBuffer_t &b);
+    void fillTxBufferBatch(TxBuffer_t &b, Flags &flag, const Sample *pSamples, std::size_t nSamples);
+    static DeltaCode getDeltaCode(const std::int32_t *pValues, std::size_t nValues);
+    static void putDelta(TxBuffer_t &b, DeltaCode code, std::int32_t v, std::int32_t v0);
+    void fillTxBufferSummary(TxBuffer_t &b);
+    void startMultiReport();
+    void fillTxBufferMulti(TxBuffer_t &b, bool fFirst);
+    static std::size_t getMaxPayload();
+    bool checkReport(bool &fHeartbeat) const;
+    void noteReport();
+    void startTransmission(TxBuffer_t &b)
+        {
+        this->startTransmission(b.getbase(), b.getn(), kUplinkPort);
+        }
+    void startTransmission(const std::uint8_t *pBuffer, std::size_t nBuffer, std::uint8_t port);
     void sendBufferDone(bool fSuccess);
     bool txComplete()
         {
@@ -159,6 +408,50 @@ private:
         }
     void updateTxCycleTime();
 
+    // remote configuration
+    static bool parseConfig(McciCatenaScd30::cSCD30::Config &config, const std::uint8_t *pMessage, std::size_t nMessage);
+    void startConfig();
+    static McciCatenaScd30::cSCD30::AsyncDoneFn_t applyConfigDone;
+
+    // pressure compensation
+    void updatePressure();
+
+    // burst mode
+    bool isBurstMode() const { return this->m_burstReportSecs != 0; }
+    void startBurst();
+    std::uint32_t getMsToNextBurst() const
+        {
+        auto const dt = std::int32_t(this->m_tNextBurst - millis());
+        return dt > 0 ? std::uint32_t(dt) : 0;
+        }
+
+    // error recovery: true if the last failure is one the driver is
+    // still working on, so it needn't be reported yet.
+    bool isRecovering() const
+        {
+        return McciCatenaScd30::cSCD30::isRecoverableError(this->m_Scd.getLastError()) &&
+               this->m_Scd.getRecoveryFailures() < McciCatenaScd30::cSCD30::kRecoveryCycle;
+        }
+
+    // multi-sensor: completion for each auxiliary measurement
+    static McciCatenaScd30::cSCD30BusManager::MeasurementFn_t auxMeasurementDone;
+
+    // store-and-forward
+    void saveSamples();
+    bool startForward();
+
+    // power profile uplinks
+    bool isDiagDue() const
+        {
+        return this->m_diagSecs != 0 &&
+               millis() - this->m_tLastDiag >= this->m_diagSecs * 1000;
+        }
+    State getStateAfterUplink() const
+        {
+        return this->isDiagDue() ? State::stDiag : State::stSleeping;
+        }
+    bool startDiag();
+
     // instance data
     McciCatena::cFSM <cMeasurementLoop, State>
                         m_fsm;
@@ -180,6 +473,14 @@ private:
 
     // set true if measurement is valid
     bool                m_measurement_valid: 1;
+    // set true while an asynchronous measurement read is in progress
+    bool                m_fMeasurementPending : 1;
+    // set true when the asynchronous measurement read has completed
+    bool                m_fMeasurementDone : 1;
+    // set true if the SCD30's filter dropped the reading just read
+    bool                m_fMeasurementDropped : 1;
+    // set true while stMeasure waits for the sensor tasks
+    bool                m_fTasksPending : 1;
 
     // set true if event timer times out
     bool                m_fTimerEvent : 1;
@@ -195,6 +496,74 @@ private:
     bool                m_txerr : 1;
     // set true when we've printed how we plan to sleep
     bool                m_fPrintedSleeping : 1;
+    // set true if m_ScdSnapshot is valid
+    bool                m_fScdSnapshot : 1;
+    // set true to request that m_ScdConfig be applied; cleared by poll()
+    bool                m_rqConfig : 1;
+    // set true if the next uplink is a heartbeat.
+    bool                m_fHeartbeat : 1;
+    // set true if m_lastReport is valid
+    bool                m_fLastReport : 1;
+
+    // SCD30 settings from the last configuration downlink.
+    McciCatenaScd30::cSCD30::Config     m_ScdConfig;
+
+    // source of ambient pressure readings, or nullptr.
+    PressureFn_t        *m_pPressureFn = nullptr;
+    void                *m_pPressureClientData;
+
+    // measurements not yet sent (RAM is retained across deep sleep).
+    McciCatenaScd30::cSCD30History<kSamplesPerUplink>  m_history;
+    // statistics of all readings since the last uplink.
+    McciCatenaScd30::cSCD30Summary  m_summary;
+
+    // measurements whose uplinks failed, waiting to be forwarded.
+    cSampleStore        m_store;
+    // number of samples in the forwarding uplink
+    std::uint8_t        m_nForward;
+    // number of batches forwarded this cycle
+    std::uint8_t        m_nForwardBatches;
+
+    // burst mode report interval (secs), or zero for continuous measurement.
+    std::uint32_t       m_burstReportSecs = 0;
+    // time (millis) of the next burst, in burst mode.
+    std::uint32_t       m_tNextBurst;
+
+    // report on change: the deadbands, and the newest sample and
+    // time (millis) of the last uplink.
+    Deadband            m_deadband {};
+    Sample              m_lastReport;
+    std::uint32_t       m_tLastReport;
+
+    // auxiliary sensors, or nullptr; their newest readings, and a
+    // bitmap of which readings are new since the last report.
+    McciCatenaScd30::cSCD30BusManager   *m_pAux = nullptr;
+    Sample              m_aux[kMaxAuxSensors];
+    std::uint8_t        m_auxValid = 0;
+    // the report being sent in format 0x20 (index 0 is the primary
+    // SCD30), and a bitmap of the records not yet sent.
+    Sample              m_multi[kMaxMultiSensors];
+    std::uint8_t        m_multiPending = 0;
+
+    // the other sensors, and the ones whose readings we use.
+    cSensorTaskGroup    m_tasks;
+    cVbatTask           *m_pVbatTask = nullptr;
+    cSht3xTask          *m_pThTask = nullptr;
+
+    // chooses how deeply to sleep.
+    cPowerScheduler     m_scheduler;
+    // where the time (and charge) goes.
+    cPowerProfile       m_profile;
+    // power profile uplink interval (secs), or zero; and time (millis)
+    // of the last one.
+    std::uint32_t       m_diagSecs = 0;
+    std::uint32_t       m_tLastDiag;
+
+    // SCD30 driver state, saved across deep sleep (RAM is retained).
+    McciCatenaScd30::cSCD30::Snapshot   m_ScdSnapshot;
+    // the same for each auxiliary sensor, with a bitmap of valid entries.
+    McciCatenaScd30::cSCD30::Snapshot   m_auxSnapshot[kMaxAuxSensors];
+    std::uint8_t        m_auxSnapshotValid = 0;
 
     // for simple internal timer.
     std::uint32_t           m_timer_start;
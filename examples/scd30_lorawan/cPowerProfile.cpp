@@ -0,0 +1,154 @@
+/*
+
+Module: cPowerProfile.cpp
+
+Function:
+    Time and estimated charge spent in each state of the measurement loop.
+
+Copyright:
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "cPowerProfile.h"
+
+#include <cstring>
+
+/****************************************************************************\
+|
+|   The power profile
+|
+\****************************************************************************/
+
+void cPowerProfile::clear()
+    {
+    std::memset(this->m_totals, 0, sizeof(this->m_totals));
+    this->m_tClear = this->m_tUpdate = millis();
+    this->m_lightUs = 0;
+    this->m_deepMs = 0;
+    }
+
+void cPowerProfile::enterState(unsigned iState)
+    {
+    this->update();
+    if (iState >= kMaxStates)
+        return;
+
+    this->m_iState = std::uint8_t(iState);
+    ++this->m_totals[iState].nEntries;
+    }
+
+// light sleeps are short (the SysTick ends them within a millisecond),
+// so they're counted in microseconds.
+void cPowerProfile::noteLightSleep(std::uint32_t us)
+    {
+    this->m_lightUs += us;
+    }
+
+void cPowerProfile::noteDeepSleep(std::uint32_t ms)
+    {
+    this->m_deepMs += ms;
+    }
+
+/*
+
+Name:	cPowerProfile::update()
+
+Function:
+    Charge the time since the last update to the current state.
+
+Definition:
+    void cPowerProfile::update();
+
+Description:
+    The time since the last update is split between the sleep modes:
+    first the deep sleep reported since then, then the light sleep,
+    and the rest is time awake. Neither sleep can be more than the
+    elapsed time (the clocks differ slightly); light sleep is charged
+    in whole milliseconds, and the rest carried to the next update.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cPowerProfile::update()
+    {
+    std::uint32_t const tNow = millis();
+    std::uint32_t elapsed = tNow - this->m_tUpdate;
+
+    this->m_tUpdate = tNow;
+    if (this->m_iState >= kMaxStates)
+        {
+        this->m_lightUs = this->m_deepMs = 0;
+        return;
+        }
+
+    auto &t = this->m_totals[this->m_iState];
+
+    std::uint32_t const deepMs = this->m_deepMs < elapsed ? this->m_deepMs : elapsed;
+    elapsed -= deepMs;
+    this->m_deepMs = 0;
+
+    std::uint32_t lightMs = this->m_lightUs / 1000;
+    if (lightMs > elapsed)
+        lightMs = elapsed;
+    elapsed -= lightMs;
+    this->m_lightUs -= lightMs * 1000;
+
+    t.ms[getModeIndex(SleepMode::Deep)] += deepMs;
+    t.ms[getModeIndex(SleepMode::Light)] += lightMs;
+    t.ms[getModeIndex(SleepMode::Awake)] += elapsed;
+    }
+
+std::uint32_t cPowerProfile::getModeMs(cPowerProfile::SleepMode mode) const
+    {
+    std::uint32_t result = 0;
+
+    for (auto const &t : this->m_totals)
+        result += t.ms[getModeIndex(mode)];
+
+    return result;
+    }
+
+std::uint64_t cPowerProfile::getCharge(unsigned iState) const
+    {
+    if (iState >= kMaxStates)
+        return 0;
+
+    auto const &t = this->m_totals[iState];
+    auto const &c = this->m_currents;
+    std::uint64_t const awakeMs = t.ms[getModeIndex(SleepMode::Awake)];
+    std::uint64_t const lightMs = t.ms[getModeIndex(SleepMode::Light)];
+    std::uint64_t const deepMs = t.ms[getModeIndex(SleepMode::Deep)];
+
+    std::uint64_t result = awakeMs * c.Awake_uA + lightMs * c.Light_uA + deepMs * c.Deep_uA;
+
+    if (this->m_radioStates & (std::uint32_t(1) << iState))
+        result += (awakeMs + lightMs) * c.Radio_uA;
+
+    return result;
+    }
+
+std::uint64_t cPowerProfile::getCharge() const
+    {
+    std::uint64_t result = 0;
+
+    for (unsigned i = 0; i < kMaxStates; ++i)
+        result += this->getCharge(i);
+
+    return result;
+    }
+
+std::uint32_t cPowerProfile::getAverageMicroAmps() const
+    {
+    std::uint64_t ms = 0;
+
+    for (auto const &t : this->m_totals)
+        ms += getMs(t);
+
+    return ms == 0 ? 0 : std::uint32_t(this->getCharge() / ms);
+    }
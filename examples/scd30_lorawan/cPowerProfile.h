@@ -0,0 +1,146 @@
+/*
+
+Module:	cPowerProfile.h
+
+Function:
+	Time and estimated charge spent in each state of the measurement loop.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cPowerProfile_h_
+#define _cPowerProfile_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <Arduino.h>
+#include "cPowerScheduler.h"
+
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   The power profile
+|
+\****************************************************************************/
+
+/// Residency accounting for a state machine.
+///
+/// Each state entry is counted, and the time from one entry to the
+/// next is charged to the state that was left. Within each state, the
+/// time is split by sleep mode: time in deep sleep and in light sleep
+/// is reported by the code that sleeps, and the rest is time awake
+/// (working, or polling with nothing to do). Multiplying by a current
+/// for each mode gives an estimate of the charge drawn in each state.
+///
+/// States are numbered from zero; the caller passes its state enum
+/// as an unsigned.
+class cPowerProfile
+    {
+public:
+    using SleepMode = cPowerScheduler::SleepMode;
+
+    static constexpr unsigned kMaxStates = 12;
+    static constexpr unsigned kNumModes = 3;
+
+    /// the current drawn in each mode, for the charge estimates.
+    struct Currents
+        {
+        std::uint32_t   Awake_uA;       /// CPU running
+        std::uint32_t   Light_uA;       /// CPU stopped until the next interrupt
+        std::uint32_t   Deep_uA;        /// STOP mode
+        std::uint32_t   Radio_uA;       /// added in the radio states, awake or light
+        std::uint16_t   Supply_mV;      /// for converting charge to energy
+        };
+
+    /// the totals for one state.
+    struct StateTotals
+        {
+        std::uint32_t   nEntries;       /// times the state was entered
+        std::uint32_t   nPolls;         /// polls while in the state
+        std::uint32_t   ms[kNumModes];  /// ms in each SleepMode
+        };
+
+    // constructor
+    cPowerProfile() {}
+
+    // neither copyable nor movable
+    cPowerProfile(const cPowerProfile&) = delete;
+    cPowerProfile& operator=(const cPowerProfile&) = delete;
+    cPowerProfile(const cPowerProfile&&) = delete;
+    cPowerProfile& operator=(const cPowerProfile&&) = delete;
+
+    void setCurrents(const Currents &currents) { this->m_currents = currents; }
+    const Currents &getCurrents() const { return this->m_currents; }
+    // the states in which the radio is drawing Radio_uA (a bitmap).
+    void setRadioStates(std::uint32_t states) { this->m_radioStates = states; }
+
+    // zero the totals, but keep the current state.
+    void clear();
+    // note entry to a state.
+    void enterState(unsigned iState);
+    // note a poll.
+    void notePoll()
+        {
+        if (this->m_iState < kMaxStates)
+            ++this->m_totals[this->m_iState].nPolls;
+        }
+    // note time asleep in the current state.
+    void noteLightSleep(std::uint32_t us);
+    void noteDeepSleep(std::uint32_t ms);
+
+    // bring the current state's totals up to now.
+    void update();
+    const StateTotals &getTotals(unsigned iState) const { return this->m_totals[iState]; }
+    // total ms in each state, and in a mode over all states.
+    static std::uint32_t getMs(const StateTotals &t)
+        {
+        return t.ms[0] + t.ms[1] + t.ms[2];
+        }
+    std::uint32_t getModeMs(SleepMode mode) const;
+    // ms since clear().
+    std::uint32_t getWindowMs() const { return millis() - this->m_tClear; }
+
+    // estimated charge (uA * ms) for a state, or over all states.
+    std::uint64_t getCharge(unsigned iState) const;
+    std::uint64_t getCharge() const;
+    // conversions.
+    static std::uint32_t getMicroAmpHours(std::uint64_t charge)
+        {
+        return std::uint32_t((charge + 1800000u) / 3600000u);
+        }
+    std::uint32_t getMilliJoules(std::uint64_t charge) const
+        {
+        return std::uint32_t((charge * this->m_currents.Supply_mV + 500000000u) / 1000000000u);
+        }
+    // average current since clear(), uA.
+    std::uint32_t getAverageMicroAmps() const;
+
+private:
+    static unsigned getModeIndex(SleepMode mode) { return unsigned(mode); }
+
+    Currents        m_currents {};
+    std::uint32_t   m_radioStates = 0;
+    StateTotals     m_totals[kMaxStates] {};
+    // the current state, or kMaxStates before the first entry.
+    std::uint8_t    m_iState = kMaxStates;
+    // time (millis) of the last update, and of the last clear.
+    std::uint32_t   m_tUpdate = 0;
+    std::uint32_t   m_tClear = 0;
+    // time asleep in the current state since the last update.
+    std::uint32_t   m_lightUs = 0;
+    std::uint32_t   m_deepMs = 0;
+    };
+
+#endif /* _cPowerProfile_h_ */
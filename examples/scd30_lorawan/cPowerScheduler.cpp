@@ -0,0 +1,137 @@
+/*
+
+Module: cPowerScheduler.cpp
+
+Function:
+    Choose how deeply to sleep, from the deadlines of each subsystem.
+
+Copyright:
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "cPowerScheduler.h"
+
+/****************************************************************************\
+|
+|   The power scheduler
+|
+\****************************************************************************/
+
+bool cPowerScheduler::addSource(
+    const char *pName,
+    cPowerScheduler::DeadlineFn_t *pDeadlineFn,
+    void *pClientData,
+    std::uint32_t slackMs
+    )
+    {
+    if (pDeadlineFn == nullptr || this->m_nSources >= kMaxSources)
+        return false;
+
+    auto &s = this->m_source[this->m_nSources++];
+    s.pName = pName;
+    s.pDeadlineFn = pDeadlineFn;
+    s.pClientData = pClientData;
+    s.slackMs = slackMs;
+    return true;
+    }
+
+std::uint32_t cPowerScheduler::getWindowMs(unsigned &iSource) const
+    {
+    std::uint32_t result = kNoDeadline;
+
+    iSource = kMaxSources;
+    for (unsigned i = 0; i < this->m_nSources; ++i)
+        {
+        auto const &s = this->m_source[i];
+        auto ms = s.pDeadlineFn(s.pClientData);
+
+        // busy means now, whatever the slack.
+        if (ms != 0)
+            ms = ms < kNoDeadline - s.slackMs ? ms + s.slackMs : kNoDeadline;
+
+        if (ms < result)
+            {
+            result = ms;
+            iSource = i;
+            // nobody can beat "now".
+            if (ms == 0)
+                break;
+            }
+        }
+
+    return result;
+    }
+
+/*
+
+Name:	cPowerScheduler::chooseMode()
+
+Function:
+    Pick the deepest sleep that fits in a window.
+
+Definition:
+    cPowerScheduler::SleepMode cPowerScheduler::chooseMode(
+        std::uint32_t windowMs,
+        bool fDeepAllowed
+        ) const;
+
+Description:
+    A deep sleep is chosen if the application allows it, and the
+    window leaves at least kMinDeepSleepMs after the measured wake-up
+    latency (shorter deep sleeps cost more to enter and leave than they
+    save). Otherwise, if the window isn't zero, a light sleep is chosen.
+
+Returns:
+    The sleep mode.
+
+*/
+
+cPowerScheduler::SleepMode cPowerScheduler::chooseMode(
+    std::uint32_t windowMs,
+    bool fDeepAllowed
+    ) const
+    {
+    if (windowMs == 0)
+        return SleepMode::Awake;
+
+    if (fDeepAllowed &&
+        windowMs > this->m_wakeLatencyMs &&
+        windowMs - this->m_wakeLatencyMs >= kMinDeepSleepMs)
+        return SleepMode::Deep;
+
+    return SleepMode::Light;
+    }
+
+// the sleep timer counts seconds; round down so we wake up in time.
+std::uint32_t cPowerScheduler::getDeepSleepSecs(std::uint32_t windowMs) const
+    {
+    if (windowMs > kMaxSleepMs)
+        windowMs = kMaxSleepMs;
+
+    if (windowMs <= this->m_wakeLatencyMs)
+        return 0;
+
+    return (windowMs - this->m_wakeLatencyMs) / 1000;
+    }
+
+// update the latency estimate, with a gain of 1/4.
+void cPowerScheduler::noteDeepSleep(
+    std::uint32_t tStart,
+    std::uint32_t sleepSecs,
+    std::uint32_t tEnd
+    )
+    {
+    std::uint32_t const elapsed = tEnd - tStart;
+    std::uint32_t const planned = sleepSecs * 1000;
+    std::uint32_t const latency = elapsed > planned ? elapsed - planned : 0;
+
+    if (latency > kMaxWakeLatencyMs)
+        return;
+
+    // round up, so the estimate can reach a latency of 1 ms.
+    this->m_wakeLatencyMs = (3 * this->m_wakeLatencyMs + latency + 3) / 4;
+    }
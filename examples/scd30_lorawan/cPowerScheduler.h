@@ -0,0 +1,126 @@
+/*
+
+Module:	cPowerScheduler.h
+
+Function:
+	Choose how deeply to sleep, from the deadlines of each subsystem.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cPowerScheduler_h_
+#define _cPowerScheduler_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   The power scheduler
+|
+\****************************************************************************/
+
+// Each subsystem that needs the CPU at some time registers a deadline
+// function, and how late it can tolerate being woken. Before sleeping,
+// the scheduler asks all of them, takes the earliest deadline as the
+// sleep window, and picks the deepest sleep that ends in time, allowing
+// for the time it takes to leave the sleep and restore the peripherals. That wake-up latency is measured on each
+// deep sleep, so the window is used as fully as possible.
+class cPowerScheduler
+    {
+public:
+    // return ms until the subsystem next needs the CPU; 0 if it needs
+    // it now (it's busy), kNoDeadline if it doesn't care.
+    using DeadlineFn_t = std::uint32_t (void *pClientData);
+
+    static constexpr std::uint32_t kNoDeadline = UINT32_MAX;
+    // the measurement loop registers six; the rest are for the sketch's
+    // own subsystems.
+    static constexpr unsigned kMaxSources = 10;
+    // shortest deep sleep worth the cost of shutting down, ms.
+    static constexpr std::uint32_t kMinDeepSleepMs = 2000;
+    // initial guess at the deep sleep wake-up latency, ms.
+    static constexpr std::uint32_t kInitialWakeLatencyMs = 100;
+    // longest credible wake-up latency, ms; longer means the clock was disturbed.
+    static constexpr std::uint32_t kMaxWakeLatencyMs = 5000;
+    // the longest deep sleep, ms.
+    static constexpr std::uint32_t kMaxSleepMs = 60 * 60 * 1000;
+
+    enum class SleepMode : std::uint8_t
+        {
+        Awake,          // someone needs the CPU now.
+        Light,          // stay powered up, and keep polling.
+        Deep,           // shut down the peripherals and enter STOP mode.
+        };
+
+    static constexpr const char *getSleepModeName(SleepMode m)
+        {
+        return m == SleepMode::Awake ? "Awake" :
+               m == SleepMode::Light ? "Light" :
+               m == SleepMode::Deep  ? "Deep"  :
+                                       "<<unknown>>";
+        }
+
+    // constructor
+    cPowerScheduler() {}
+
+    // neither copyable nor movable
+    cPowerScheduler(const cPowerScheduler&) = delete;
+    cPowerScheduler& operator=(const cPowerScheduler&) = delete;
+    cPowerScheduler(const cPowerScheduler&&) = delete;
+    cPowerScheduler& operator=(const cPowerScheduler&&) = delete;
+
+    bool addSource(const char *pName, DeadlineFn_t *pDeadlineFn, void *pClientData, std::uint32_t slackMs = 0);
+
+    // return ms until the earliest deadline, and which source set it.
+    std::uint32_t getWindowMs(unsigned &iSource) const;
+    std::uint32_t getWindowMs() const
+        {
+        unsigned iSource;
+        return this->getWindowMs(iSource);
+        }
+    const char *getSourceName(unsigned iSource) const
+        {
+        return iSource < this->m_nSources ? this->m_source[iSource].pName : "<<none>>";
+        }
+
+    // choose the sleep mode for a window; fDeepAllowed is the
+    // application's policy (e.g. not while USB is in use).
+    SleepMode chooseMode(std::uint32_t windowMs, bool fDeepAllowed) const;
+    // return the number of seconds to deep-sleep in a window.
+    std::uint32_t getDeepSleepSecs(std::uint32_t windowMs) const;
+
+    // record a deep sleep of sleepSecs, from tStart (just before shutting
+    // down) to tEnd (peripherals restored), both in millis.
+    void noteDeepSleep(std::uint32_t tStart, std::uint32_t sleepSecs, std::uint32_t tEnd);
+    std::uint32_t getWakeLatencyMs() const { return this->m_wakeLatencyMs; }
+
+private:
+    struct Source
+        {
+        const char      *pName;         /// name, for debugging
+        DeadlineFn_t    *pDeadlineFn;   /// deadline function
+        void            *pClientData;   /// context for pDeadlineFn
+        std::uint32_t   slackMs;        /// how late the source can be woken, ms
+        };
+
+    Source              m_source[kMaxSources];
+    std::uint8_t        m_nSources = 0;
+    // measured deep sleep overhead, ms (shutdown, wake-up, and restore).
+    std::uint32_t       m_wakeLatencyMs = kInitialWakeLatencyMs;
+    };
+
+#endif /* _cPowerScheduler_h_ */
@@ -0,0 +1,355 @@
+/*
+
+Module: cSampleStore.cpp
+
+Function:
+    Log-structured store of unsent samples, in SPI flash.
+
+Copyright:
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "cSampleStore.h"
+
+#include <cstring>
+
+using namespace McciCatena;
+
+/****************************************************************************\
+|
+|   Startup and shutdown
+|
+\****************************************************************************/
+
+/*
+
+Name:	cSampleStore::begin()
+
+Function:
+    Find the backlog in the flash.
+
+Definition:
+    bool cSampleStore::begin(
+        McciCatena::Catena_Mx25v8035f *pFlash,
+        std::uint32_t bootCount
+        );
+
+Description:
+    The page headers in the store are scanned. The page with the
+    highest sequence number is the newest; the next page is the head,
+    where the next page of samples will be programmed. The valid page
+    with the lowest sequence number that still has unconsumed samples
+    is the tail. Pages are written in sequence, so every valid page
+    from the tail to the head belongs to the backlog.
+
+    If pFlash is nullptr, the store is disabled: append() discards
+    samples, and there is never a backlog.
+
+Returns:
+    `true` if the store is enabled.
+
+*/
+
+bool cSampleStore::begin(
+    Catena_Mx25v8035f *pFlash,
+    std::uint32_t bootCount
+    )
+    {
+    this->m_pFlash = pFlash;
+    this->m_bootCount = bootCount;
+    this->m_iHead = 0;
+    this->m_sequence = 1;
+    this->m_nFlashSamples = 0;
+    this->m_ram.Header.nSamples = 0;
+    this->m_iRamFirst = 0;
+
+    if (pFlash == nullptr)
+        return false;
+
+    pFlash->powerUp();
+
+    bool fAny = false;
+    bool fTail = false;
+    std::uint32_t maxSequence = 0;
+    std::uint32_t tailSequence = 0;
+
+    for (std::uint32_t iPage = 0; iPage < kNumPages; ++iPage)
+        {
+        PageHeader h;
+
+        this->readHeader(iPage, h);
+        if (! isValid(h))
+            continue;
+
+        if (! fAny || std::int32_t(h.Sequence - maxSequence) > 0)
+            {
+            fAny = true;
+            maxSequence = h.Sequence;
+            this->m_iHead = nextPage(iPage);
+            }
+
+        auto const nUnconsumed = getNumUnconsumed(h);
+        if (nUnconsumed == 0)
+            continue;
+
+        this->m_nFlashSamples += nUnconsumed;
+        if (! fTail || std::int32_t(h.Sequence - tailSequence) < 0)
+            {
+            fTail = true;
+            tailSequence = h.Sequence;
+            this->m_iTail = iPage;
+            this->m_tailHeader = h;
+            }
+        }
+
+    if (fAny)
+        this->m_sequence = maxSequence + 1;
+
+    pFlash->powerDown();
+    return true;
+    }
+
+void cSampleStore::end()
+    {
+    this->m_pFlash = nullptr;
+    }
+
+/****************************************************************************\
+|
+|   Adding samples
+|
+\****************************************************************************/
+
+bool cSampleStore::append(const cSampleStore::Sample &s)
+    {
+    if (this->m_pFlash == nullptr)
+        return false;
+
+    this->m_ram.Samples[this->m_ram.Header.nSamples++] = s;
+
+    // program only full pages.
+    if (this->m_ram.Header.nSamples == kSamplesPerPage)
+        this->writePage();
+
+    return true;
+    }
+
+/*
+
+Name:	cSampleStore::writePage()
+
+Function:
+    Program the RAM page to the head of the store.
+
+Definition:
+    void cSampleStore::writePage();
+
+Description:
+    If the RAM page has any unconsumed samples, it's programmed
+    at the head of the ring, with the consumed samples already
+    marked. If the head is at the start of a sector, the sector is
+    erased first; any unconsumed samples in that sector are the
+    oldest in the store, and are lost. In either case, the RAM page
+    is emptied.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSampleStore::writePage()
+    {
+    auto const pFlash = this->m_pFlash;
+    auto &page = this->m_ram;
+    std::uint32_t const nUnconsumed = page.Header.nSamples - this->m_iRamFirst;
+
+    if (nUnconsumed != 0)
+        {
+        pFlash->powerUp();
+
+        if (this->m_iHead % kPagesPerSector == 0)
+            this->eraseSector(this->m_iHead);
+
+        page.Header.Magic = kMagic;
+        page.Header.Version = kVersion;
+        page.Header.Sequence = this->m_sequence++;
+        page.Header.BootCount = this->m_bootCount;
+        page.Header.Unconsumed = ~((std::uint32_t(1) << this->m_iRamFirst) - 1);
+
+        pFlash->program(
+            getPageAddress(this->m_iHead),
+            reinterpret_cast<const std::uint8_t *>(&page),
+            sizeof(page)
+            );
+
+        if (this->m_nFlashSamples == 0)
+            {
+            this->m_iTail = this->m_iHead;
+            this->m_tailHeader = page.Header;
+            }
+        this->m_nFlashSamples += nUnconsumed;
+        this->m_iHead = nextPage(this->m_iHead);
+
+        pFlash->powerDown();
+        }
+
+    page.Header.nSamples = 0;
+    this->m_iRamFirst = 0;
+    }
+
+// erase the sector starting at iPage, dropping any backlog in it.
+void cSampleStore::eraseSector(std::uint32_t iPage)
+    {
+    if (this->m_nFlashSamples != 0 &&
+        this->m_iTail / kPagesPerSector == iPage / kPagesPerSector)
+        {
+        // the ring is full; the tail is in this sector.
+        for (std::uint32_t i = 0; i < kPagesPerSector; ++i)
+            {
+            PageHeader h;
+
+            this->readHeader(iPage + i, h);
+            this->m_nFlashSamples -= getNumUnconsumed(h);
+            }
+
+        this->findTail(nextPage(iPage + kPagesPerSector - 1));
+        }
+
+    this->m_pFlash->eraseSector(getPageAddress(iPage));
+    }
+
+/****************************************************************************\
+|
+|   Removing samples
+|
+\****************************************************************************/
+
+std::size_t cSampleStore::peek(
+    cSampleStore::Sample *pSamples,
+    std::size_t nMax,
+    bool &fThisBoot
+    )
+    {
+    std::size_t n;
+
+    // the flash is older than RAM, so go there first.
+    if (this->m_nFlashSamples != 0)
+        {
+        auto const &h = this->m_tailHeader;
+        auto const iFirst = getFirstUnconsumed(h);
+
+        n = h.nSamples - iFirst;
+        if (n > nMax)
+            n = nMax;
+
+        this->m_pFlash->powerUp();
+        this->m_pFlash->read(
+            getPageAddress(this->m_iTail) + offsetof(Page, Samples) + iFirst * sizeof(Sample),
+            reinterpret_cast<std::uint8_t *>(pSamples),
+            n * sizeof(Sample)
+            );
+        this->m_pFlash->powerDown();
+
+        fThisBoot = h.BootCount == this->m_bootCount;
+        }
+    else
+        {
+        n = this->m_ram.Header.nSamples - this->m_iRamFirst;
+        if (n > nMax)
+            n = nMax;
+
+        std::memcpy(pSamples, &this->m_ram.Samples[this->m_iRamFirst], n * sizeof(Sample));
+        fThisBoot = true;
+        }
+
+    return n;
+    }
+
+/*
+
+Name:	cSampleStore::consume()
+
+Function:
+    Discard samples that have been sent.
+
+Definition:
+    void cSampleStore::consume(
+        std::size_t n
+        );
+
+Description:
+    The n oldest samples are marked as consumed. For samples in flash,
+    this clears their bits in the tail page's `Unconsumed` word, which
+    is a program, not an erase. If the tail page is then empty, the
+    tail moves to the next page with unconsumed samples.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSampleStore::consume(std::size_t n)
+    {
+    if (n == 0)
+        return;
+
+    if (this->m_nFlashSamples != 0)
+        {
+        auto &h = this->m_tailHeader;
+        auto const iNext = getFirstUnconsumed(h) + n;
+
+        h.Unconsumed = iNext >= 32 ? 0 : h.Unconsumed & ~((std::uint32_t(1) << iNext) - 1);
+        this->m_nFlashSamples -= n;
+
+        this->m_pFlash->powerUp();
+        this->m_pFlash->program(
+            getPageAddress(this->m_iTail) + offsetof(PageHeader, Unconsumed),
+            reinterpret_cast<const std::uint8_t *>(&h.Unconsumed),
+            sizeof(h.Unconsumed)
+            );
+
+        if (getNumUnconsumed(h) == 0 && this->m_nFlashSamples != 0)
+            this->findTail(nextPage(this->m_iTail));
+
+        this->m_pFlash->powerDown();
+        }
+    else
+        {
+        this->m_iRamFirst += std::uint8_t(n);
+        if (this->m_iRamFirst >= this->m_ram.Header.nSamples)
+            {
+            this->m_ram.Header.nSamples = 0;
+            this->m_iRamFirst = 0;
+            }
+        }
+    }
+
+// move the tail to the first page at or after iPage with unconsumed samples.
+void cSampleStore::findTail(std::uint32_t iPage)
+    {
+    for (; iPage != this->m_iHead; iPage = nextPage(iPage))
+        {
+        this->readHeader(iPage, this->m_tailHeader);
+        if (getNumUnconsumed(this->m_tailHeader) != 0)
+            {
+            this->m_iTail = iPage;
+            return;
+            }
+        }
+
+    // nothing left.
+    this->m_nFlashSamples = 0;
+    }
+
+void cSampleStore::readHeader(std::uint32_t iPage, cSampleStore::PageHeader &h)
+    {
+    this->m_pFlash->read(
+        getPageAddress(iPage),
+        reinterpret_cast<std::uint8_t *>(&h),
+        sizeof(h)
+        );
+    }
@@ -0,0 +1,172 @@
+/*
+
+Module:	cSampleStore.h
+
+Function:
+	Log-structured store of unsent samples, in SPI flash.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cSampleStore_h_
+#define _cSampleStore_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Catena_Mx25v8035f.h>
+#include <MCCI_Catena_SCD30_History.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   The sample store
+|
+\****************************************************************************/
+
+/// An append-only ring of samples in the SPI flash.
+///
+/// Samples are collected in a RAM page, and the page is programmed
+/// to flash only when it's full, so each flash page is programmed once
+/// per trip around the ring, and each sector is erased only when the
+/// head reaches it. Samples are consumed oldest first; consumption is
+/// recorded by clearing bits in the page header (which needs no erase),
+/// so the backlog survives a reset. A page with no unconsumed samples
+/// is never written.
+///
+/// Samples still in the RAM page are lost on reset, but, as with the
+/// rest of RAM, they're kept across deep sleep.
+class cSampleStore
+    {
+public:
+    using Sample = McciCatenaScd30::cSCD30HistoryBase::Sample;
+
+    // the part of the flash used for the store. The low half is left
+    // for other uses, such as firmware update images.
+    static constexpr std::uint32_t kBase = 0x80000;
+    static constexpr std::uint32_t kSize = 0x80000;
+
+    // MX25V8035F geometry
+    static constexpr std::uint32_t kSectorSize = 4 * 1024;
+    static constexpr std::uint32_t kPageSize = 256;
+    static constexpr std::uint32_t kPagesPerSector = kSectorSize / kPageSize;
+    static constexpr std::uint32_t kNumPages = kSize / kPageSize;
+
+    static constexpr std::uint16_t kMagic = 0x4C53;     // 'S', 'L'
+    static constexpr std::uint8_t kVersion = 1;
+
+    // the header at the start of each flash page.
+    struct PageHeader
+        {
+        std::uint16_t   Magic;          /// kMagic
+        std::uint8_t    Version;        /// kVersion
+        std::uint8_t    nSamples;       /// number of samples in page
+        std::uint32_t   Sequence;       /// page sequence number, increases by 1 per page
+        std::uint32_t   BootCount;      /// boot count when samples were taken
+        std::uint32_t   Unconsumed;     /// bit i is cleared when sample i has been sent
+        };
+
+    static constexpr std::size_t kSamplesPerPage = (kPageSize - sizeof(PageHeader)) / sizeof(Sample);
+    static_assert(kSamplesPerPage <= 32, "Unconsumed has one bit per sample");
+
+    // the layout of a page
+    struct Page
+        {
+        PageHeader  Header;
+        Sample      Samples[kSamplesPerPage];
+        };
+
+    static_assert(sizeof(Page) <= kPageSize, "Page must fit in a flash page");
+
+    // constructor
+    cSampleStore() {}
+
+    // neither copyable nor movable
+    cSampleStore(const cSampleStore&) = delete;
+    cSampleStore& operator=(const cSampleStore&) = delete;
+    cSampleStore(const cSampleStore&&) = delete;
+    cSampleStore& operator=(const cSampleStore&&) = delete;
+
+    // scan the flash and find the backlog; pFlash may be nullptr if there's no flash.
+    bool begin(McciCatena::Catena_Mx25v8035f *pFlash, std::uint32_t bootCount);
+    void end();
+
+    bool isEnabled() const { return this->m_pFlash != nullptr; }
+    // number of samples waiting to be sent.
+    std::uint32_t getNumSamples() const
+        {
+        return this->m_nFlashSamples + this->m_ram.Header.nSamples - this->m_iRamFirst;
+        }
+
+    // add a sample to the store.
+    bool append(const Sample &s);
+    // get up to nMax of the oldest samples; fThisBoot is set true if
+    // their timestamps are from this boot. Returns number of samples.
+    std::size_t peek(Sample *pSamples, std::size_t nMax, bool &fThisBoot);
+    // discard the n oldest samples, which must have been returned by peek().
+    void consume(std::size_t n);
+
+private:
+    static std::uint32_t getPageAddress(std::uint32_t iPage)
+        {
+        return kBase + iPage * kPageSize;
+        }
+    static std::uint32_t nextPage(std::uint32_t iPage)
+        {
+        return iPage + 1 == kNumPages ? 0 : iPage + 1;
+        }
+    static bool isValid(const PageHeader &h)
+        {
+        return h.Magic == kMagic && h.Version == kVersion &&
+               h.nSamples != 0 && h.nSamples <= kSamplesPerPage;
+        }
+    // number of unconsumed samples in a page.
+    static std::uint32_t getNumUnconsumed(const PageHeader &h)
+        {
+        return isValid(h) ? __builtin_popcount(h.Unconsumed & ((std::uint64_t(1) << h.nSamples) - 1)) : 0;
+        }
+    // index of first unconsumed sample in a page.
+    static std::uint32_t getFirstUnconsumed(const PageHeader &h)
+        {
+        return h.Unconsumed == 0 ? 32 : __builtin_ctz(h.Unconsumed);
+        }
+
+    void readHeader(std::uint32_t iPage, PageHeader &h);
+    void writePage();
+    void eraseSector(std::uint32_t iPage);
+    void findTail(std::uint32_t iPage);
+
+    McciCatena::Catena_Mx25v8035f *m_pFlash     /// the flash, or nullptr
+        { nullptr };
+    std::uint32_t   m_bootCount                 /// current boot count
+        { 0 };
+    std::uint32_t   m_iHead                     /// next page to program
+        { 0 };
+    std::uint32_t   m_sequence                  /// sequence number for next page
+        { 1 };
+    std::uint32_t   m_iTail                     /// oldest page with unconsumed samples
+        { 0 };
+    PageHeader      m_tailHeader                /// header of m_iTail
+        { };
+    std::uint32_t   m_nFlashSamples             /// unconsumed samples in flash
+        { 0 };
+    Page            m_ram                       /// samples not yet programmed
+        { };
+    std::uint8_t    m_iRamFirst                 /// first unconsumed sample in m_ram
+        { 0 };
+    };
+
+#endif /* _cSampleStore_h_ */
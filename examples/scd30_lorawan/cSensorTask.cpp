@@ -0,0 +1,118 @@
+/*
+
+Module: cSensorTask.cpp
+
+Function:
+    Sensor tasks, measured alongside each other in each cycle.
+
+Copyright:
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "cSensorTask.h"
+
+/****************************************************************************\
+|
+|   The sensor task group
+|
+\****************************************************************************/
+
+bool cSensorTaskGroup::add(cSensorTask &task)
+    {
+    if (this->m_nTasks >= kMaxTasks)
+        return false;
+
+    this->m_pTask[this->m_nTasks++] = &task;
+    return true;
+    }
+
+/*
+
+Name:	cSensorTaskGroup::start()
+
+Function:
+    Start a conversion on every task.
+
+Definition:
+    void cSensorTaskGroup::start();
+
+Description:
+    Each task that isn't still busy with its last conversion is
+    started; a task whose sensor doesn't respond is left stopped,
+    with no reading. All the conversions then run at once, so the
+    group is done when the slowest is.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSensorTaskGroup::start()
+    {
+    this->m_tStart = millis();
+
+    for (unsigned i = 0; i < this->m_nTasks; ++i)
+        {
+        std::uint8_t const bit = 1u << i;
+
+        if (! (this->m_running & bit) && this->m_pTask[i]->start())
+            this->m_running |= bit;
+        }
+
+    if (this->m_running == 0)
+        this->m_lastCycleMs = 0;
+    }
+
+void cSensorTaskGroup::poll()
+    {
+    if (this->m_running == 0)
+        return;
+
+    for (unsigned i = 0; i < this->m_nTasks; ++i)
+        {
+        std::uint8_t const bit = 1u << i;
+
+        if ((this->m_running & bit) && this->m_pTask[i]->poll())
+            this->m_running &= ~bit;
+        }
+
+    if (this->m_running == 0)
+        this->m_lastCycleMs = millis() - this->m_tStart;
+    }
+
+std::uint32_t cSensorTaskGroup::getMsToReady() const
+    {
+    std::uint32_t result = cSensorTask::kNoDeadline;
+
+    for (unsigned i = 0; i < this->m_nTasks; ++i)
+        {
+        if (this->m_running & (1u << i))
+            {
+            std::uint32_t const ms = this->m_pTask[i]->getMsToReady();
+
+            if (ms < result)
+                result = ms;
+            }
+        }
+
+    return result;
+    }
+
+std::uint32_t cSensorTaskGroup::getConversionMs() const
+    {
+    std::uint32_t result = 0;
+
+    for (unsigned i = 0; i < this->m_nTasks; ++i)
+        {
+        std::uint32_t const ms = this->m_pTask[i]->getConversionMs();
+
+        if (ms > result)
+            result = ms;
+        }
+
+    return result;
+    }
@@ -0,0 +1,138 @@
+/*
+
+Module:	cSensorTask.h
+
+Function:
+	Sensor tasks, measured alongside each other in each cycle.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cSensorTask_h_
+#define _cSensorTask_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   A sensor task
+|
+\****************************************************************************/
+
+/// One sensor's conversion, as a pollable task.
+///
+/// start() kicks off a conversion and returns at once; poll() is then
+/// called until it returns true. In between, getMsToReady() says when
+/// the next poll() has work to do, so the CPU can sleep until then.
+/// Tasks never wait for their sensors, so several conversions can be
+/// in progress at once.
+class cSensorTask
+    {
+public:
+    static constexpr std::uint32_t kNoDeadline = UINT32_MAX;
+
+    // constructor
+    cSensorTask(const char *pName)
+        : m_pName(pName)
+        {}
+
+    // neither copyable nor movable
+    cSensorTask(const cSensorTask&) = delete;
+    cSensorTask& operator=(const cSensorTask&) = delete;
+    cSensorTask(const cSensorTask&&) = delete;
+    cSensorTask& operator=(const cSensorTask&&) = delete;
+
+    // start a conversion; false if the sensor didn't respond, in
+    // which case there's nothing to poll.
+    virtual bool start() = 0;
+    // advance the conversion; true when it's finished, whether or
+    // not it worked (see isValid()).
+    virtual bool poll() = 0;
+    // ms until poll() has work to do; 0 if it has work now.
+    virtual std::uint32_t getMsToReady() const = 0;
+    // the longest time from start() to a result, ms.
+    virtual std::uint32_t getConversionMs() const = 0;
+
+    // true if the last conversion produced a reading.
+    bool isValid() const { return this->m_fValid; }
+    const char *getName() const { return this->m_pName; }
+
+protected:
+    void setValid(bool fValid) { this->m_fValid = fValid; }
+
+private:
+    const char  *m_pName;       /// name, for debugging
+    bool        m_fValid        /// set if the last conversion worked
+        { false };
+    };
+
+/****************************************************************************\
+|
+|   The sensor task group
+|
+\****************************************************************************/
+
+/// The sensor tasks measured together in each cycle.
+///
+/// start() starts every task, and poll() polls the ones still running,
+/// so the conversions overlap: a cycle takes as long as its slowest
+/// task, not the sum of them all. Start the group getConversionMs()
+/// ahead of the time the readings are needed.
+class cSensorTaskGroup
+    {
+public:
+    static constexpr unsigned kMaxTasks = 4;
+
+    // constructor
+    cSensorTaskGroup() {}
+
+    // neither copyable nor movable
+    cSensorTaskGroup(const cSensorTaskGroup&) = delete;
+    cSensorTaskGroup& operator=(const cSensorTaskGroup&) = delete;
+    cSensorTaskGroup(const cSensorTaskGroup&&) = delete;
+    cSensorTaskGroup& operator=(const cSensorTaskGroup&&) = delete;
+
+    bool add(cSensorTask &task);
+
+    // start every task that isn't still running.
+    void start();
+    // poll the running tasks.
+    void poll();
+    // true when no task is running.
+    bool isDone() const { return this->m_running == 0; }
+
+    // ms until a running task has work; kNoDeadline if none is running.
+    std::uint32_t getMsToReady() const;
+    // the longest conversion of any task, ms.
+    std::uint32_t getConversionMs() const;
+    // ms from the last start() until the last task finished.
+    std::uint32_t getLastCycleMs() const { return this->m_lastCycleMs; }
+
+    unsigned getNumTasks() const { return this->m_nTasks; }
+    cSensorTask &getTask(unsigned i) const { return *this->m_pTask[i]; }
+
+private:
+    cSensorTask     *m_pTask[kMaxTasks];
+    std::uint8_t    m_nTasks = 0;
+    // bitmap of the tasks still running.
+    std::uint8_t    m_running = 0;
+    // time (millis) of the last start().
+    std::uint32_t   m_tStart = 0;
+    std::uint32_t   m_lastCycleMs = 0;
+    };
+
+#endif /* _cSensorTask_h_ */
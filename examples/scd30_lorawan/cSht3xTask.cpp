@@ -0,0 +1,108 @@
+/*
+
+Module: cSht3xTask.cpp
+
+Function:
+    Sensor task for the on-board SHT3x temperature/humidity sensor.
+
+Copyright:
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "cSht3xTask.h"
+
+/****************************************************************************\
+|
+|   The SHT3x task
+|
+\****************************************************************************/
+
+bool cSht3xTask::start()
+    {
+    std::uint8_t const cmd[2] = { std::uint8_t(kCmdMeasureHigh >> 8), std::uint8_t(kCmdMeasureHigh) };
+
+    this->m_wire->beginTransmission(std::uint8_t(this->m_address));
+    this->m_wire->write(cmd, sizeof(cmd));
+    if (this->m_wire->endTransmission() != 0)
+        {
+        // not there, or still busy.
+        this->setValid(false);
+        return false;
+        }
+
+    this->m_tStart = millis();
+    this->m_fBusy = true;
+    return true;
+    }
+
+/*
+
+Name:	cSht3xTask::poll()
+
+Function:
+    Collect the SHT3x reading, once the conversion is done.
+
+Definition:
+    virtual bool cSht3xTask::poll() override;
+
+Description:
+    Until kConversionMs have passed since start(), this does nothing.
+    Then the six-byte response is read, the CRCs checked, and the
+    words converted to the uplink units: T = -45 + 175 * raw / 65535
+    degrees C, which is -9000 + 35000 * raw / 65535 in 0.005 degree
+    units; RH = 100 * raw / 65535 percent, which is raw when 0xFFFF
+    is 100%.
+
+Returns:
+    true if the task is finished, whether or not the reading is valid.
+
+*/
+
+bool cSht3xTask::poll()
+    {
+    if (! this->m_fBusy)
+        return true;
+    if (millis() - this->m_tStart < kConversionMs)
+        return false;
+
+    this->m_fBusy = false;
+
+    auto &r = this->m_buffer;
+    std::uint8_t const nBytes = std::uint8_t(sizeof(r.raw));
+
+    if (this->m_wire->requestFrom(std::uint8_t(this->m_address), nBytes) != nBytes ||
+        this->m_wire->available() != nBytes)
+        {
+        this->setValid(false);
+        return true;
+        }
+
+    this->m_wire->readBytes(r.raw, nBytes);
+    if (! r.pack())
+        {
+        this->setValid(false);
+        return true;
+        }
+
+    auto words = r.getReader();
+    std::uint32_t const rawT = words.getUint16();
+
+    this->m_measurement.Temperature = std::int16_t(std::int32_t((35000u * rawT + 32767u) / 65535u) - 9000);
+    this->m_measurement.RelativeHumidity = words.getUint16();
+    this->setValid(true);
+    return true;
+    }
+
+std::uint32_t cSht3xTask::getMsToReady() const
+    {
+    if (! this->m_fBusy)
+        return kNoDeadline;
+
+    std::uint32_t const dt = millis() - this->m_tStart;
+
+    return dt < kConversionMs ? kConversionMs - dt : 0;
+    }
@@ -0,0 +1,95 @@
+/*
+
+Module:	cSht3xTask.h
+
+Function:
+	Sensor task for the on-board SHT3x temperature/humidity sensor.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cSht3xTask_h_
+#define _cSht3xTask_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include "cSensorTask.h"
+#include <Wire.h>
+#include <MCCI_Catena_SCD30_Words.h>
+
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   The SHT3x task
+|
+\****************************************************************************/
+
+/// A single-shot SHT3x measurement, without clock stretching.
+///
+/// start() sends the measurement command, and the sensor then converts
+/// on its own; the result is read once the conversion time has passed,
+/// so the bus is free (and the CPU can sleep) in between. The response
+/// is two words, each with a CRC, just like the SCD30's, so it's
+/// checked and decoded the same way.
+class cSht3xTask : public cSensorTask
+    {
+public:
+    enum class Address : std::uint8_t
+        {
+        A = 0x44,       // ADDR pin low; as on the Catena 4801/4802
+        B = 0x45,       // ADDR pin high
+        };
+
+    // high repeatability: 15.5 ms max; the datasheet's figure, rounded up.
+    static constexpr std::uint32_t kConversionMs = 16;
+
+    /// a reading, in the units of cSCD30HistoryBase::Sample.
+    struct Measurement
+        {
+        std::int16_t    Temperature;        /// 0.005 degrees C
+        std::uint16_t   RelativeHumidity;   /// 0xFFFF is 100%
+        };
+
+    // constructor
+    cSht3xTask(TwoWire &wire, Address address = Address::A)
+        : cSensorTask("sht3x")
+        , m_wire(&wire)
+        , m_address(address)
+        {}
+
+    virtual bool start() override;
+    virtual bool poll() override;
+    virtual std::uint32_t getMsToReady() const override;
+    virtual std::uint32_t getConversionMs() const override { return kConversionMs; }
+
+    // the last reading; only meaningful if isValid().
+    Measurement getMeasurement() const { return this->m_measurement; }
+
+private:
+    // measurement command: single shot, high repeatability, no clock stretching.
+    static constexpr std::uint16_t kCmdMeasureHigh = 0x2400;
+
+    TwoWire         *m_wire;
+    Address         m_address;
+    // set from start() until the reading is taken.
+    bool            m_fBusy = false;
+    // time (millis) of the measurement command.
+    std::uint32_t   m_tStart;
+    Measurement     m_measurement;
+    // T and RH, each with its CRC.
+    McciCatenaScd30::tSCD30Response<2> m_buffer;
+    };
+
+#endif /* _cSht3xTask_h_ */
@@ -0,0 +1,83 @@
+/*
+
+Module:	cVbatTask.h
+
+Function:
+	Sensor task for the battery voltage.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cVbatTask_h_
+#define _cVbatTask_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include "cSensorTask.h"
+#include <Catena.h>
+
+#include <cstdint>
+
+/****************************************************************************\
+|
+|   The battery voltage task
+|
+\****************************************************************************/
+
+/// The battery voltage, read with the other sensors.
+///
+/// The ADC conversion is short, and done in a single poll(). As a
+/// task, it's taken inside the awake window of each cycle, alongside
+/// the other sensors, rather than afterwards, when the uplink is built.
+class cVbatTask : public cSensorTask
+    {
+public:
+    // constructor
+    cVbatTask(McciCatena::Catena &catena)
+        : cSensorTask("vbat")
+        , m_catena(&catena)
+        {}
+
+    virtual bool start() override
+        {
+        this->m_fPending = true;
+        return true;
+        }
+    virtual bool poll() override
+        {
+        if (this->m_fPending)
+            {
+            this->m_fPending = false;
+            this->m_Vbat = this->m_catena->ReadVbat();
+            this->setValid(true);
+            }
+        return true;
+        }
+    virtual std::uint32_t getMsToReady() const override
+        {
+        return this->m_fPending ? 0 : kNoDeadline;
+        }
+    virtual std::uint32_t getConversionMs() const override { return 1; }
+
+    // the last reading, volts; only meaningful if isValid().
+    float getVbat() const { return this->m_Vbat; }
+
+private:
+    McciCatena::Catena  *m_catena;
+    // set from start() until the reading is taken.
+    bool                m_fPending = false;
+    float               m_Vbat;
+    };
+
+#endif /* _cVbatTask_h_ */
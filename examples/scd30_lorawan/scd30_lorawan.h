@@ -29,11 +29,13 @@ Author:
 #include <Catena.h>
 #include <Catena_Led.h>
 #include <Catena_Log.h>
+#include <Catena_Mx25v8035f.h>
 
 extern McciCatena::Catena gCatena;
 extern McciCatena::Catena::LoRaWAN gLoRaWAN;
 extern McciCatena::StatusLed gLed;
 extern SPIClass gSPI2;
+extern McciCatena::Catena_Mx25v8035f gFlash;
 extern bool gfFlash;
 // extern McciCatena::cLog gLog;
 
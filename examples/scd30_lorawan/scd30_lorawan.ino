@@ -75,25 +75,48 @@ Catena_Mx25v8035f gFlash;
 // status flag, true if flash was probed at boot.
 bool gfFlash;
 
+// the SCD30 RDY pin, or -1 if not connected.
+static constexpr cSCD30::Pin_t kPinScdReady = -1;
+
 // The SDP Sensor
-cSCD30 gSCD { Wire };
+cSCD30 gSCD { Wire, cSCD30::Address::SCD30, kPinScdReady };
 
 // the measurement loop instance
 cMeasurementLoop gMeasurementLoop { gSCD };
 
+// the other sensors, measured alongside the SCD30: the battery, and
+// the on-board SHT3x of the 4802.
+cVbatTask gVbat { gCatena };
+cSht3xTask gSht3x { Wire };
+
+// the ambient pressure, set by the "pressure" command; 0 means unknown.
+// The 4801 and 4802 have no barometer; on a board with one, return its
+// reading from getPressure() instead.
+static std::uint16_t sPressure_mBar;
+
 // forward reference to the command functions
+cCommandStream::CommandFn cmdBurst;
+cCommandStream::CommandFn cmdDeadband;
 cCommandStream::CommandFn cmdDebugFlags;
 cCommandStream::CommandFn cmdInfo;
 cCommandStream::CommandFn cmdInterval;
+cCommandStream::CommandFn cmdPower;
+cCommandStream::CommandFn cmdPressure;
 cCommandStream::CommandFn cmdRunStop;
+cCommandStream::CommandFn cmdStats;
 
 // the individual commmands are put in this table
 static const cCommandStream::cEntry sMyExtraCommmands[] =
         {
+        { "burst", cmdBurst },
+        { "deadband", cmdDeadband },
         { "debugflags", cmdDebugFlags },
         { "info", cmdInfo },
         { "interval", cmdInterval },
+        { "power", cmdPower },
+        { "pressure", cmdPressure },
         { "run", cmdRunStop },
+        { "stats", cmdStats },
         { "stop", cmdRunStop },
         // other commands go here....
         };
@@ -250,13 +273,32 @@ void setup_flash(void)
         }
     }
 
+// pass downlinks to the measurement loop.
+static void receiveMessage(
+    void *pContext,
+    uint8_t port,
+    const uint8_t *pMessage,
+    size_t nMessage
+    )
+    {
+    gMeasurementLoop.receiveMessage(port, pMessage, nMessage);
+    }
+
 void setup_radio()
     {
     gLoRaWAN.begin(&gCatena);
     gCatena.registerObject(&gLoRaWAN);
+    gLoRaWAN.SetReceiveBufferBufferCb(receiveMessage);
     LMIC_setClockError(5 * MAX_CLOCK_ERROR / 100);
     }
 
+// return the ambient pressure for the SCD30's compensation.
+static bool getPressure(void *pContext, std::uint16_t &pressure_mBar)
+    {
+    pressure_mBar = sPressure_mBar;
+    return true;
+    }
+
 void setup_sensors()
     {
     Wire.begin();
@@ -275,6 +317,23 @@ void setup_sensors()
         printSCDinfo();
         }
 
+    // if the RDY pin is connected, use it instead of polling the sensor.
+    if (kPinScdReady >= 0)
+        {
+        if (gSCD.enableReadyInterrupt(true))
+            gCatena.SafePrintf("Using SCD30 RDY pin interrupt\n");
+        else
+            gCatena.SafePrintf("gSCD.enableReadyInterrupt() failed %s(%u)\n",
+                        gSCD.getLastErrorName(),
+                        unsigned(gSCD.getLastError())
+                        );
+        }
+
+    gMeasurementLoop.setVbatTask(gVbat);
+    if (k4802)
+        gMeasurementLoop.setThTask(gSht3x);
+
+    gMeasurementLoop.setPressureSource(getPressure, nullptr);
     gMeasurementLoop.begin();
     }
 
@@ -478,3 +537,333 @@ cCommandStream::CommandStatus cmdInterval(
 
     return result;
     }
+
+/* process "burst" */
+// argv[0] is the matched command name
+// argv[1] if present is the report interval in seconds, or 0 to
+// measure continuously.
+cCommandStream::CommandStatus cmdBurst(
+    cCommandStream *pThis,
+    void *pContext,
+    int argc,
+    char **argv
+    )
+    {
+    if (argc > 2)
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    if (argc < 2)
+        {
+        auto const reportSecs = gMeasurementLoop.getBurstMode();
+
+        if (reportSecs == 0)
+            pThis->printf("burst: off\n");
+        else
+            pThis->printf("burst: every %u secs\n", unsigned(reportSecs));
+        return cCommandStream::CommandStatus::kSuccess;
+        }
+
+    std::uint32_t reportSecs;
+    cCommandStream::CommandStatus result;
+
+    result = cCommandStream::getuint32(argc, argv, 1, 10, reportSecs, 0);
+    if (result == cCommandStream::CommandStatus::kSuccess)
+        {
+        // a report interval shorter than the burst itself makes no sense.
+        if (reportSecs == 0 || reportSecs >= 60)
+            gMeasurementLoop.setBurstMode(reportSecs);
+        else
+            result = cCommandStream::CommandStatus::kInvalidParameter;
+        }
+
+    return result;
+    }
+
+/* process "deadband" */
+// argv[0] is the matched command name
+// argv[1..4] if present are the CO2 deadband (ppm), the temperature
+// deadband (0.01 degrees C), the RH deadband (0.1%) and the heartbeat
+// (secs); a heartbeat of 0 turns off report on change.
+cCommandStream::CommandStatus cmdDeadband(
+    cCommandStream *pThis,
+    void *pContext,
+    int argc,
+    char **argv
+    )
+    {
+    if (argc == 1)
+        {
+        auto const db = gMeasurementLoop.getDeadband();
+
+        if (db.HeartbeatSecs == 0)
+            pThis->printf("deadband: off\n");
+        else
+            pThis->printf("deadband: CO2 %u ppm, T %u.%02u C, RH %u.%u%%, heartbeat %u secs\n",
+                unsigned(db.CO2ppm),
+                unsigned(db.Temperature / 200), unsigned(db.Temperature % 200) / 2,
+                unsigned((db.RelativeHumidity * 1000u + 32767u) / 65535u) / 10,
+                unsigned((db.RelativeHumidity * 1000u + 32767u) / 65535u) % 10,
+                unsigned(db.HeartbeatSecs)
+                );
+        return cCommandStream::CommandStatus::kSuccess;
+        }
+
+    if (argc != 5)
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    std::uint32_t co2, t, rh, heartbeat;
+    cCommandStream::CommandStatus result;
+
+    result = cCommandStream::getuint32(argc, argv, 1, 10, co2, 0);
+    if (result == cCommandStream::CommandStatus::kSuccess)
+        result = cCommandStream::getuint32(argc, argv, 2, 10, t, 0);
+    if (result == cCommandStream::CommandStatus::kSuccess)
+        result = cCommandStream::getuint32(argc, argv, 3, 10, rh, 0);
+    if (result == cCommandStream::CommandStatus::kSuccess)
+        result = cCommandStream::getuint32(argc, argv, 4, 10, heartbeat, 0);
+    if (result != cCommandStream::CommandStatus::kSuccess)
+        return result;
+
+    if (co2 > UINT16_MAX || t > UINT16_MAX / 2 || rh > 1000)
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    cMeasurementLoop::Deadband db;
+
+    // convert to the units of the samples.
+    db.CO2ppm = std::uint16_t(co2);
+    db.Temperature = std::uint16_t(t * 2);
+    db.RelativeHumidity = std::uint16_t((rh * 65535u + 500u) / 1000u);
+    db.HeartbeatSecs = heartbeat;
+    gMeasurementLoop.setDeadband(db);
+
+    return cCommandStream::CommandStatus::kSuccess;
+    }
+
+/* process "stats" */
+// argv[0] is the matched command name
+// argv[1], if present, must be "clear"
+cCommandStream::CommandStatus cmdStats(
+    cCommandStream *pThis,
+    void *pContext,
+    int argc,
+    char **argv
+    )
+    {
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "clear") != 0))
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    if (! cSCD30::kStatsEnabled)
+        {
+        pThis->printf("statistics not enabled; build with MCCI_CATENA_SCD30_STATS=1\n");
+        return cCommandStream::CommandStatus::kError;
+        }
+
+    if (argc == 2)
+        {
+        gSCD.clearStats();
+        return cCommandStream::CommandStatus::kSuccess;
+        }
+
+    auto const stats = gSCD.getStats();
+
+    pThis->printf("bus transactions:\n");
+    for (unsigned i = 0; i < cSCD30::kNumCommands; ++i)
+        {
+        if (stats.nTransactions[i] != 0)
+            pThis->printf(
+                "  0x%04x: %u\n",
+                unsigned(cSCD30::getCommandByIndex(i)),
+                unsigned(stats.nTransactions[i])
+                );
+        }
+    pThis->printf("CRC errors:       %u\n", unsigned(stats.nCrcErrors));
+    pThis->printf("I2cReadShort:     %u\n", unsigned(stats.nReadShort));
+    pThis->printf("I2cReadRequest:   %u\n", unsigned(stats.nReadRequest));
+    pThis->printf("retries:          %u\n", unsigned(stats.nRetries));
+    pThis->printf("backoffs:         %u\n", unsigned(stats.nBackoffs));
+    pThis->printf("bus recoveries:   %u\n", unsigned(stats.nBusRecoveries));
+    pThis->printf("soft resets:      %u\n", unsigned(stats.nSoftResets));
+    pThis->printf("failures now:     %u\n", unsigned(gSCD.getRecoveryFailures()));
+    pThis->printf("settings written: %u (%u skipped)\n", unsigned(stats.nConfigWrites), unsigned(stats.nConfigSkipped));
+    pThis->printf("queryReady busy:  %u\n", unsigned(stats.nReadyBusy));
+    pThis->printf("measurements:     %u\n", unsigned(stats.nMeasurements));
+    pThis->printf("dropped:          %u warm-up, %u outliers; %u invalid\n",
+        unsigned(stats.nWarmupDropped), unsigned(stats.nOutliers), unsigned(stats.nInvalid)
+        );
+    if (stats.nMeasurements != 0)
+        pThis->printf(
+            "GetDataReady per measurement: %u.%02u (max %u)\n",
+            unsigned(stats.nReadyPolls / stats.nMeasurements),
+            unsigned((stats.nReadyPolls % stats.nMeasurements) * 100 / stats.nMeasurements),
+            unsigned(stats.nReadyPollsMax)
+            );
+    pThis->printf("time waiting:     %u ms\n", unsigned(stats.WaitUs / 1000));
+
+    return cCommandStream::CommandStatus::kSuccess;
+    }
+
+/* process "power" */
+// argv[0] is the matched command name.
+// argv[1], if present, is "clear"; or "current", followed by the
+// awake, light sleep, deep sleep and radio currents (uA) and,
+// optionally, the supply voltage (mV); or "uplink", followed by the
+// diagnostic uplink interval (secs, 0 for none).
+cCommandStream::CommandStatus cmdPower(
+    cCommandStream *pThis,
+    void *pContext,
+    int argc,
+    char **argv
+    )
+    {
+    auto &profile = gMeasurementLoop.getProfile();
+    cCommandStream::CommandStatus result = cCommandStream::CommandStatus::kSuccess;
+
+    if (argc == 2 && strcmp(argv[1], "clear") == 0)
+        {
+        profile.clear();
+        return result;
+        }
+    else if (argc >= 2 && strcmp(argv[1], "current") == 0)
+        {
+        auto c = profile.getCurrents();
+
+        if (argc == 2)
+            {
+            pThis->printf("current (uA): awake %u, light %u, deep %u, radio %u; supply %u mV\n",
+                unsigned(c.Awake_uA), unsigned(c.Light_uA), unsigned(c.Deep_uA),
+                unsigned(c.Radio_uA), unsigned(c.Supply_mV)
+                );
+            return result;
+            }
+        if (argc != 6 && argc != 7)
+            return cCommandStream::CommandStatus::kInvalidParameter;
+
+        std::uint32_t mV = c.Supply_mV;
+
+        result = cCommandStream::getuint32(argc, argv, 2, 10, c.Awake_uA, 0);
+        if (result == cCommandStream::CommandStatus::kSuccess)
+            result = cCommandStream::getuint32(argc, argv, 3, 10, c.Light_uA, 0);
+        if (result == cCommandStream::CommandStatus::kSuccess)
+            result = cCommandStream::getuint32(argc, argv, 4, 10, c.Deep_uA, 0);
+        if (result == cCommandStream::CommandStatus::kSuccess)
+            result = cCommandStream::getuint32(argc, argv, 5, 10, c.Radio_uA, 0);
+        if (result == cCommandStream::CommandStatus::kSuccess && argc == 7)
+            result = cCommandStream::getuint32(argc, argv, 6, 10, mV, 0);
+        if (result != cCommandStream::CommandStatus::kSuccess)
+            return result;
+        if (mV > UINT16_MAX)
+            return cCommandStream::CommandStatus::kInvalidParameter;
+
+        c.Supply_mV = std::uint16_t(mV);
+        profile.setCurrents(c);
+        return result;
+        }
+    else if (argc >= 2 && strcmp(argv[1], "uplink") == 0)
+        {
+        if (argc == 2)
+            {
+            auto const diagSecs = gMeasurementLoop.getDiagUplink();
+
+            if (diagSecs == 0)
+                pThis->printf("power uplink: off\n");
+            else
+                pThis->printf("power uplink: every %u secs\n", unsigned(diagSecs));
+            return result;
+            }
+        if (argc != 3)
+            return cCommandStream::CommandStatus::kInvalidParameter;
+
+        std::uint32_t diagSecs;
+
+        result = cCommandStream::getuint32(argc, argv, 2, 10, diagSecs, 0);
+        if (result == cCommandStream::CommandStatus::kSuccess)
+            {
+            // at most a week, so the interval fits in ms.
+            if (diagSecs <= 7 * 24 * 60 * 60)
+                gMeasurementLoop.setDiagUplink(diagSecs);
+            else
+                result = cCommandStream::CommandStatus::kInvalidParameter;
+            }
+        return result;
+        }
+    else if (argc != 1)
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    profile.update();
+
+    pThis->printf("%-14s %8s %8s %10s %10s %10s %8s\n",
+        "state", "entries", "polls", "awake ms", "light ms", "deep ms", "uAh"
+        );
+    for (unsigned i = 0; i < cMeasurementLoop::kNumStates; ++i)
+        {
+        auto const &t = profile.getTotals(i);
+
+        if (t.nEntries == 0)
+            continue;
+
+        pThis->printf("%-14s %8u %8u %10u %10u %10u %8u\n",
+            cMeasurementLoop::getStateName(cMeasurementLoop::State(i)),
+            unsigned(t.nEntries),
+            unsigned(t.nPolls),
+            unsigned(t.ms[unsigned(cPowerProfile::SleepMode::Awake)]),
+            unsigned(t.ms[unsigned(cPowerProfile::SleepMode::Light)]),
+            unsigned(t.ms[unsigned(cPowerProfile::SleepMode::Deep)]),
+            unsigned(cPowerProfile::getMicroAmpHours(profile.getCharge(i)))
+            );
+        }
+
+    auto const charge = profile.getCharge();
+
+    pThis->printf("%-14s %8s %8s %10u %10u %10u %8u\n",
+        "total", "", "",
+        unsigned(profile.getModeMs(cPowerProfile::SleepMode::Awake)),
+        unsigned(profile.getModeMs(cPowerProfile::SleepMode::Light)),
+        unsigned(profile.getModeMs(cPowerProfile::SleepMode::Deep)),
+        unsigned(cPowerProfile::getMicroAmpHours(charge))
+        );
+    pThis->printf("over %u secs: %u uA average, %u mJ\n",
+        unsigned(profile.getWindowMs() / 1000),
+        unsigned(profile.getAverageMicroAmps()),
+        unsigned(profile.getMilliJoules(charge))
+        );
+
+    return result;
+    }
+
+/* process "pressure" */
+// argv[0] is the matched command name.
+// argv[1] if present is the ambient pressure in mBar, or 0 for none.
+cCommandStream::CommandStatus cmdPressure(
+    cCommandStream *pThis,
+    void *pContext,
+    int argc,
+    char **argv
+    )
+    {
+    if (argc > 2)
+        return cCommandStream::CommandStatus::kInvalidParameter;
+
+    if (argc < 2)
+        {
+        pThis->printf("pressure: %u mBar (sensor using %u)\n",
+            unsigned(sPressure_mBar),
+            unsigned(gSCD.getAmbientPressure())
+            );
+        return cCommandStream::CommandStatus::kSuccess;
+        }
+
+    std::uint32_t pressure;
+    cCommandStream::CommandStatus result;
+
+    result = cCommandStream::getuint32(argc, argv, 1, 10, pressure, 0);
+    if (result == cCommandStream::CommandStatus::kSuccess)
+        {
+        if (pressure == 0 || (700 <= pressure && pressure <= 1400))
+            // used after the next measurement.
+            sPressure_mBar = std::uint16_t(pressure);
+        else
+            result = cCommandStream::CommandStatus::kInvalidParameter;
+        }
+
+    return result;
+    }
@@ -0,0 +1,160 @@
+/*
+
+Module:	crc-benchmark.cpp
+
+Function:
+	Micro-benchmark for the SCD30 library's CRC-8 variants.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+// To build:
+//  Open a Visual Studio 2019 C++ command line window. Then:
+//
+//  C> cl /EHsc /O2 /I..\src crc-benchmark.cpp
+//
+//  Or, with GCC or Clang:
+//
+//  $ g++ -O2 -std=c++14 -I../src -o crc-benchmark crc-benchmark.cpp
+//
+// The header is the one the library uses, so this measures the library's
+// code. Host timings only show the relative cost; measure on the target
+// for absolute numbers.
+
+#include "MCCI_Catena_SCD30_Crc.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+using namespace McciCatenaScd30;
+
+// a measurement frame: three big-endian IEEE floats, with a CRC after
+// each 16-bit word.
+struct Frame
+    {
+    std::uint8_t b[18];
+    };
+
+static void putFloat(std::uint8_t *p, float f)
+    {
+    std::uint32_t v;
+    std::memcpy(&v, &f, sizeof(v));
+
+    p[0] = std::uint8_t(v >> 24);
+    p[1] = std::uint8_t(v >> 16);
+    p[2] = Crc8::crc(&p[0], 2);
+    p[3] = std::uint8_t(v >> 8);
+    p[4] = std::uint8_t(v);
+    p[5] = Crc8::crc(&p[3], 2);
+    }
+
+// the original approach: one pass to check, another to extract.
+template <bool a_fTable256>
+static bool twoPass(const std::uint8_t *buf, std::uint16_t *pWords)
+    {
+    for (unsigned i = 0; i < 18; i += 3)
+        {
+        if (tCrc8<a_fTable256>::crc(&buf[i], 2) != buf[i + 2])
+            return false;
+        }
+
+    for (unsigned i = 0; i < 6; ++i)
+        pWords[i] = std::uint16_t((buf[i * 3] << 8) | buf[i * 3 + 1]);
+
+    return true;
+    }
+
+// what the library does: check and pack in one pass, in place, then
+// read the words back. The frame is copied first, as packing
+// overwrites it; the library packs its receive buffer instead.
+template <bool a_fTable256>
+static bool packed(const std::uint8_t *buf, std::uint16_t *pWords)
+    {
+    std::uint8_t b[18];
+
+    std::memcpy(b, buf, sizeof(b));
+    if (! tCrc8<a_fTable256>::packWords(b, sizeof(b)))
+        return false;
+
+    for (unsigned i = 0; i < 6; ++i)
+        pWords[i] = std::uint16_t((b[i * 2] << 8) | b[i * 2 + 1]);
+
+    return true;
+    }
+
+using Fn_t = bool (const std::uint8_t *, std::uint16_t *);
+
+static constexpr unsigned kFrames = 64;
+static constexpr unsigned long kPasses = 200000;
+
+static Frame gFrames[kFrames];
+static volatile std::uint32_t gSink;
+
+static void run(const char *pName, Fn_t *pFn)
+    {
+    std::uint32_t sum = 0;
+    auto const tStart = std::chrono::steady_clock::now();
+
+    for (unsigned long pass = 0; pass < kPasses; ++pass)
+        {
+        for (auto const &f : gFrames)
+            {
+            std::uint16_t words[6];
+
+            if (pFn(f.b, words))
+                sum += words[0] ^ words[3] ^ words[5];
+            }
+        }
+
+    auto const tEnd = std::chrono::steady_clock::now();
+    double const ns = std::chrono::duration<double, std::nano>(tEnd - tStart).count();
+
+    gSink = sum;
+    std::cout << pName << ": " << ns / (double(kPasses) * kFrames) << " ns/frame\n";
+    }
+
+int main()
+    {
+    for (unsigned i = 0; i < kFrames; ++i)
+        {
+        putFloat(&gFrames[i].b[0], 400.0f + i);
+        putFloat(&gFrames[i].b[6], 21.1f + i * 0.01f);
+        putFloat(&gFrames[i].b[12], 50.0f - i * 0.1f);
+        }
+
+    // make sure all variants agree before timing them.
+    for (auto const &f : gFrames)
+        {
+        std::uint16_t w[4][6];
+
+        if (! (twoPass<false>(f.b, w[0]) && twoPass<true>(f.b, w[1]) &&
+               packed<false>(f.b, w[2]) && packed<true>(f.b, w[3])) ||
+            std::memcmp(w[0], w[1], sizeof(w[0])) != 0 ||
+            std::memcmp(w[0], w[2], sizeof(w[0])) != 0 ||
+            std::memcmp(w[0], w[3], sizeof(w[0])) != 0)
+            {
+            std::cerr << "variants disagree\n";
+            return 1;
+            }
+        }
+
+    std::cout << "18-byte ReadMeasurement frame, " << kFrames << " frames x " << kPasses << " passes\n";
+    run("two-pass,  16-entry table ", twoPass<false>);
+    run("two-pass,  256-entry table", twoPass<true>);
+    run("packWords, 16-entry table ", packed<false>);
+    run("packWords, 256-entry table", packed<true>);
+    return 0;
+    }
@@ -0,0 +1,340 @@
+/*
+
+Module:	message-port1-format-1e-archive.h
+
+Function:
+	Archives of port 1 payloads, and a parallel decoder for them.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+// An archive is simply the raw payloads, back to back, each preceded by
+// a length byte (a LoRaWAN payload is at most 242 bytes). There's no
+// header; an empty file is an empty archive. The decode tool's -p
+// option makes one from hex lines, such as the test vector generator's
+// output.
+
+#ifndef _message_port1_format_1e_archive_h_
+#define _message_port1_format_1e_archive_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include "message-port1-format-1e.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+# include <fstream>
+# include <iterator>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace McciCatenaScd30 {
+namespace Port1 {
+
+/****************************************************************************\
+|
+|   Archive files
+|
+\****************************************************************************/
+
+// append a payload to an archive image.
+inline bool appendRecord(std::vector<std::uint8_t> &archive, const std::uint8_t *pMessage, std::size_t nMessage)
+    {
+    if (nMessage > 0xFF)
+        return false;
+
+    archive.push_back(std::uint8_t(nMessage));
+    archive.insert(archive.end(), pMessage, pMessage + nMessage);
+    return true;
+    }
+
+/// A read-only view of an archive file.
+///
+/// The file is mapped, rather than read, so the decoder streams
+/// straight from the page cache, and archives larger than memory are
+/// fine. On Windows, it's read into memory instead.
+class cArchiveFile
+    {
+public:
+    cArchiveFile() {}
+    ~cArchiveFile() { this->close(); }
+
+    // neither copyable nor movable
+    cArchiveFile(const cArchiveFile&) = delete;
+    cArchiveFile& operator=(const cArchiveFile&) = delete;
+    cArchiveFile(const cArchiveFile&&) = delete;
+    cArchiveFile& operator=(const cArchiveFile&&) = delete;
+
+    bool open(const char *pName);
+    void close();
+
+    const std::uint8_t *data() const { return this->m_pData; }
+    std::size_t size() const { return this->m_nData; }
+
+private:
+    const std::uint8_t          *m_pData = nullptr;
+    std::size_t                 m_nData = 0;
+#ifdef _WIN32
+    std::vector<std::uint8_t>   m_contents;
+#else
+    void                        *m_pMap = nullptr;
+#endif
+    };
+
+#ifdef _WIN32
+
+inline bool cArchiveFile::open(const char *pName)
+    {
+    this->close();
+
+    std::ifstream f { pName, std::ios::binary };
+
+    if (! f)
+        return false;
+
+    this->m_contents.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    this->m_pData = this->m_contents.data();
+    this->m_nData = this->m_contents.size();
+    return true;
+    }
+
+inline void cArchiveFile::close()
+    {
+    this->m_contents.clear();
+    this->m_pData = nullptr;
+    this->m_nData = 0;
+    }
+
+#else
+
+inline bool cArchiveFile::open(const char *pName)
+    {
+    this->close();
+
+    int const fd = ::open(pName, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    bool fResult = false;
+
+    if (::fstat(fd, &st) == 0)
+        {
+        if (st.st_size == 0)
+            {
+            // can't map an empty file, but it's a valid archive.
+            fResult = true;
+            }
+        else
+            {
+            void * const p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (p != MAP_FAILED)
+                {
+                // it's read once, front to back.
+                ::madvise(p, std::size_t(st.st_size), MADV_SEQUENTIAL);
+                this->m_pMap = p;
+                this->m_pData = static_cast<const std::uint8_t *>(p);
+                this->m_nData = std::size_t(st.st_size);
+                fResult = true;
+                }
+            }
+        }
+
+    // the mapping doesn't need the descriptor.
+    ::close(fd);
+    return fResult;
+    }
+
+inline void cArchiveFile::close()
+    {
+    if (this->m_pMap != nullptr)
+        ::munmap(this->m_pMap, this->m_nData);
+
+    this->m_pMap = nullptr;
+    this->m_pData = nullptr;
+    this->m_nData = 0;
+    }
+
+#endif
+
+/****************************************************************************\
+|
+|   Parallel decoding
+|
+\****************************************************************************/
+
+/// The results of decoding an archive.
+struct ArchiveStats
+    {
+    std::size_t nMessages = 0;      /// messages decoded
+    std::size_t nErrors = 0;        /// messages rejected, including a truncated last record
+    std::size_t nRows = 0;          /// rows produced
+    std::size_t nBytes = 0;         /// archive bytes consumed
+    };
+
+/*
+
+Name:	decodeArchive()
+
+Function:
+    Decode an archive in batches, on several threads.
+
+Definition:
+    template <typename TFn>
+    ArchiveStats decodeArchive(
+        const std::uint8_t *pArchive,
+        std::size_t nArchive,
+        unsigned nThreads,
+        std::size_t nBatch,
+        TFn &&fn
+        );
+
+Description:
+    The archive is taken a window at a time: the calling thread finds
+    the next nThreads * nBatch records (which only means following the
+    length bytes), and each of nThreads workers then parses and
+    converts one run of nBatch records into its own cBatch. When all
+    are done, fn(const cBatch &) is called for each batch, in archive
+    order, on the calling thread; so fn needs no locking, and sees the
+    rows in the same order as a single-threaded decode would give.
+    Message numbers (cBatch::iMessage) count records from the start of
+    the archive.
+
+    With nThreads of 1, or a window with only one batch, everything
+    is done on the calling thread.
+
+Returns:
+    The totals.
+
+*/
+
+template <typename TFn>
+ArchiveStats decodeArchive(
+    const std::uint8_t *pArchive,
+    std::size_t nArchive,
+    unsigned nThreads,
+    std::size_t nBatch,
+    TFn &&fn
+    )
+    {
+    struct Run
+        {
+        std::size_t     iRecord;        // first record
+        std::size_t     nRecords;
+        std::size_t     offset;         // of its first length byte
+        cBatch          batch;
+        };
+
+    ArchiveStats result;
+
+    if (nThreads == 0)
+        nThreads = 1;
+    if (nBatch == 0)
+        nBatch = 1;
+
+    std::vector<Run> runs(nThreads);
+    std::vector<std::thread> workers;
+    std::size_t offset = 0;
+    std::size_t iRecord = 0;
+
+    for (auto &run : runs)
+        run.batch.reserve(nBatch);
+
+    auto const decodeRun = [pArchive](Run *pRun)
+        {
+        std::size_t offset = pRun->offset;
+
+        pRun->batch.clear();
+        for (std::size_t i = 0; i < pRun->nRecords; ++i)
+            {
+            std::size_t const n = pArchive[offset];
+
+            pRun->batch.parse(pArchive + offset + 1, n, std::uint32_t(pRun->iRecord + i));
+            offset += 1 + n;
+            }
+        pRun->batch.convert();
+        };
+
+    while (offset < nArchive)
+        {
+        std::size_t nRuns = 0;
+
+        // split the window; everything found is known to be in bounds.
+        for (; nRuns < nThreads && offset < nArchive; ++nRuns)
+            {
+            Run &run = runs[nRuns];
+
+            run.iRecord = iRecord;
+            run.offset = offset;
+            run.nRecords = 0;
+            while (run.nRecords < nBatch && offset < nArchive)
+                {
+                std::size_t const n = pArchive[offset];
+
+                if (nArchive - offset - 1 < n)
+                    {
+                    // truncated; drop the tail.
+                    ++result.nErrors;
+                    offset = nArchive;
+                    break;
+                    }
+
+                offset += 1 + n;
+                ++run.nRecords;
+                }
+
+            iRecord += run.nRecords;
+            }
+
+        if (nRuns == 1)
+            decodeRun(&runs[0]);
+        else
+            {
+            workers.clear();
+            for (std::size_t i = 0; i < nRuns; ++i)
+                workers.emplace_back(decodeRun, &runs[i]);
+            for (auto &w : workers)
+                w.join();
+            }
+
+        for (std::size_t i = 0; i < nRuns; ++i)
+            {
+            auto const &batch = runs[i].batch;
+
+            result.nMessages += batch.nMessages;
+            result.nErrors += batch.nErrors;
+            result.nRows += batch.size();
+            fn(batch);
+            }
+        }
+
+    result.nBytes = offset;
+    return result;
+    }
+
+} // namespace Port1
+} // namespace McciCatenaScd30
+
+#endif /* _message_port1_format_1e_archive_h_ */
@@ -0,0 +1,311 @@
+/*
+
+Module:	message-port1-format-1e-benchmark.cpp
+
+Function:
+	Throughput benchmark for the port 1 bulk decoder.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+// To build:
+//  Open a Visual Studio 2019 C++ command line window. Then:
+//
+//  C> cl /EHsc /O2 message-port1-format-1e-benchmark.cpp
+//
+//  Or, with GCC or Clang:
+//
+//  $ g++ -O2 -std=c++14 -pthread -o message-port1-format-1e-benchmark message-port1-format-1e-benchmark.cpp
+//
+// The archives are made with the test vector generator's encoders, and
+// each is checked against the values encoded before it's timed. The two
+// passes of the decoder (parse and convert) are timed separately on one
+// thread, then the whole decode with increasing numbers of threads.
+
+#include "message-port1-format-1e-archive.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace McciCatenaScd30::Port1;
+
+static constexpr unsigned kMessages = 200000;
+static constexpr unsigned kPasses = 5;
+static constexpr std::size_t kBatch = 4096;
+
+// the values encoded, one per row, for checking the decode.
+struct Expected
+    {
+    float   Vbat;
+    float   T;
+    float   RH;
+    float   CO2;
+    };
+
+struct Archive
+    {
+    const char                  *pName;
+    std::vector<std::uint8_t>   bytes;
+    std::vector<Expected>       rows;
+    std::size_t                 nMessages = 0;
+    };
+
+// a small, repeatable generator, so runs are comparable.
+static std::uint32_t gSeed = 1;
+
+static float uniform(float lo, float hi)
+    {
+    gSeed = gSeed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * float(gSeed >> 8) * (1.0f / 16777216.0f);
+    }
+
+static Sample makeSample(float t, float rh, float co2)
+    {
+    Sample s {};
+
+    s.SCD.fValid = true;
+    s.SCD.v.Temperature = t;
+    s.SCD.v.RelativeHumidity = rh;
+    s.CO2.fValid = true;
+    s.CO2.v = co2;
+    return s;
+    }
+
+static void add(Archive &a, Buffer &buf)
+    {
+    appendRecord(a.bytes, buf.data(), buf.size());
+    ++a.nMessages;
+    }
+
+// format 0x1e: one measurement, with Vbat, Vsys and boot.
+static void addSingle(Archive &a)
+    {
+    Measurements m {};
+    Buffer buf;
+
+    m.Vbat = { true, uniform(3.0f, 4.2f) };
+    m.Vsys = { true, 3.3f };
+    m.Boot = { true, 7 };
+    m.SCD = { true, { uniform(-10.0f, 40.0f), uniform(10.0f, 90.0f) } };
+    m.CO2 = { true, uniform(400.0f, 5000.0f) };
+    encodeMeasurement(buf, m);
+    add(a, buf);
+    a.rows.push_back({ m.Vbat.v, m.SCD.v.Temperature, m.SCD.v.RelativeHumidity, m.CO2.v });
+    }
+
+// format 0x1f: four samples a minute apart, delta-encoded.
+static void addBatch(Archive &a)
+    {
+    Measurements m {};
+    Buffer buf;
+    float const t = uniform(-10.0f, 40.0f);
+    float const rh = uniform(10.0f, 90.0f);
+    float const co2 = uniform(400.0f, 5000.0f);
+
+    m.Vbat = { true, uniform(3.0f, 4.2f) };
+    m.Period = { true, 60 };
+    for (unsigned i = 0; i < 4; ++i)
+        {
+        m.Samples.push_back(makeSample(t + uniform(-0.5f, 0.5f), rh + uniform(-2.0f, 2.0f), co2 + uniform(-50.0f, 50.0f)));
+        a.rows.push_back({ m.Vbat.v, m.Samples.back().SCD.v.Temperature, m.Samples.back().SCD.v.RelativeHumidity, m.Samples.back().CO2.v });
+        }
+    encodeBatch(buf, m);
+    add(a, buf);
+    }
+
+// format 0x20: three sensors.
+static void addMulti(Archive &a)
+    {
+    Measurements m {};
+    Buffer buf;
+
+    m.Vbat = { true, uniform(3.0f, 4.2f) };
+    for (unsigned i = 0; i < 3; ++i)
+        {
+        m.Sensors.push_back({ i, makeSample(uniform(-10.0f, 40.0f), uniform(10.0f, 90.0f), uniform(400.0f, 5000.0f)) });
+        a.rows.push_back({ m.Vbat.v, m.Sensors.back().s.SCD.v.Temperature, m.Sensors.back().s.SCD.v.RelativeHumidity, m.Sensors.back().s.CO2.v });
+        }
+    encodeMulti(buf, m);
+    add(a, buf);
+    }
+
+// compare the decode with the values encoded, allowing for the
+// resolution of each encoding.
+static bool check(const Archive &a)
+    {
+    std::size_t iRow = 0;
+    bool fResult = true;
+
+    auto const stats = decodeArchive(
+        a.bytes.data(), a.bytes.size(), 1, kBatch,
+        [&](const cBatch &b)
+            {
+            for (std::size_t i = 0; i < b.size() && fResult; ++i, ++iRow)
+                {
+                if (iRow >= a.rows.size())
+                    {
+                    fResult = false;
+                    break;
+                    }
+
+                auto const &e = a.rows[iRow];
+                float const tolRH = b.format[i] == std::uint8_t(Format::Multi) ? 0.2f : 0.001f;
+
+                if (! (std::fabs(b.Vbat[i] - e.Vbat) <= 0.0002f &&
+                       std::fabs(b.T[i] - e.T) <= 0.003f &&
+                       std::fabs(b.RH[i] - e.RH) <= tolRH &&
+                       std::fabs(b.CO2[i] - e.CO2) <= e.CO2 / 2048.0f))
+                    {
+                    std::cerr << a.pName << ": row " << iRow << " decoded as "
+                              << b.Vbat[i] << " " << b.T[i] << " " << b.RH[i] << " " << b.CO2[i]
+                              << ", expected "
+                              << e.Vbat << " " << e.T << " " << e.RH << " " << e.CO2 << "\n";
+                    fResult = false;
+                    }
+                }
+            }
+        );
+
+    return fResult && stats.nErrors == 0 && stats.nMessages == a.nMessages && iRow == a.rows.size();
+    }
+
+template <typename TFn>
+static double bestMs(TFn &&fn)
+    {
+    double best = 0;
+
+    for (unsigned iPass = 0; iPass < kPasses; ++iPass)
+        {
+        auto const t0 = std::chrono::steady_clock::now();
+        fn();
+        double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        if (iPass == 0 || ms < best)
+            best = ms;
+        }
+
+    return best;
+    }
+
+static void report(const char *pWhat, const Archive &a, double ms)
+    {
+    std::cout << "  " << std::left << std::setw(12) << pWhat << std::right
+              << std::fixed << std::setprecision(2)
+              << std::setw(8) << ms << " ms"
+              << std::setw(9) << a.nMessages / ms / 1000.0 << " M msg/s"
+              << std::setw(9) << a.rows.size() / ms / 1000.0 << " M rows/s"
+              << std::setw(9) << a.bytes.size() / ms / 1000.0 << " MB/s\n";
+    }
+
+static void run(const Archive &a)
+    {
+    cBatch batch;
+
+    std::cout << a.pName << ": " << a.nMessages << " messages, "
+              << a.rows.size() << " rows, " << a.bytes.size() << " bytes\n";
+
+    // the two passes, on one thread, over the whole archive.
+    batch.reserve(a.rows.size());
+    double const msParse = bestMs([&]()
+        {
+        std::size_t offset = 0;
+
+        batch.clear();
+        for (std::uint32_t i = 0; offset < a.bytes.size(); ++i)
+            {
+            std::size_t const n = a.bytes[offset];
+
+            batch.parse(&a.bytes[offset + 1], n, i);
+            offset += 1 + n;
+            }
+        });
+    report("parse", a, msParse);
+
+    double const msConvert = bestMs([&]()
+        {
+        // convert() starts from the rows it hasn't done.
+        batch.Vbat.clear();
+        batch.convert();
+        });
+    report("convert", a, msConvert);
+
+    unsigned const nMax = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() : 1;
+
+    for (unsigned nThreads = 1; ; nThreads *= 2)
+        {
+        if (nThreads > nMax)
+            nThreads = nMax;
+
+        std::size_t nRows = 0;
+        double const ms = bestMs([&]()
+            {
+            nRows = 0;
+            decodeArchive(
+                a.bytes.data(), a.bytes.size(), nThreads, kBatch,
+                [&nRows](const cBatch &b) { nRows += b.size(); }
+                );
+            });
+
+        char what[16];
+        std::snprintf(what, sizeof(what), "%u thread%s", nThreads, nThreads == 1 ? "" : "s");
+        report(what, a, ms);
+
+        if (nThreads == nMax)
+            break;
+        }
+    }
+
+int main()
+    {
+    Archive single, batch, multi, mixed;
+
+    single.pName = "0x1e";
+    batch.pName = "0x1f (4 samples)";
+    multi.pName = "0x20 (3 sensors)";
+    mixed.pName = "mixed";
+
+    for (unsigned i = 0; i < kMessages; ++i)
+        {
+        addSingle(single);
+        addBatch(batch);
+        addMulti(multi);
+        switch (i % 3)
+            {
+        case 0: addSingle(mixed); break;
+        case 1: addBatch(mixed); break;
+        default: addMulti(mixed); break;
+            }
+        }
+
+    for (auto const pArchive : { &single, &batch, &multi, &mixed })
+        {
+        if (! check(*pArchive))
+            {
+            std::cerr << pArchive->pName << ": decode doesn't match\n";
+            return 1;
+            }
+        }
+
+    std::cout << "port 1 bulk decode, batches of " << kBatch << ", best of " << kPasses << " passes\n";
+    for (auto const pArchive : { &single, &batch, &multi, &mixed })
+        run(*pArchive);
+
+    return 0;
+    }
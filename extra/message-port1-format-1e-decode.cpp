@@ -0,0 +1,234 @@
+/*
+
+Module:	message-port1-format-1e-decode.cpp
+
+Function:
+	Bulk decoder for archives of port 1 payloads.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+// To build:
+//  Open a Visual Studio 2019 C++ command line window. Then:
+//
+//  C> cl /EHsc /O2 message-port1-format-1e-decode.cpp
+//
+//  Or, with GCC or Clang:
+//
+//  $ g++ -O2 -std=c++14 -pthread -o message-port1-format-1e-decode message-port1-format-1e-decode.cpp
+//
+// To use:
+//
+//  $ message-port1-format-1e-decode -p < payloads.txt > payloads.bin
+//  $ message-port1-format-1e-decode [-j threads] [-b batch] [-q] payloads.bin
+//
+// -p reads lines of hex bytes (anything else is skipped, so the test
+// vector generator's output can be used as is), and writes an archive.
+// Otherwise, the archive is decoded, and written as CSV, one row per
+// sample; -q writes only the totals. The totals and elapsed time go to
+// stderr.
+
+#include "message-port1-format-1e-archive.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+# include <fcntl.h>
+# include <io.h>
+#endif
+
+using namespace McciCatenaScd30::Port1;
+
+static void usage()
+    {
+    std::cerr << "usage: message-port1-format-1e-decode [-j threads] [-b batch] [-q] archive\n"
+              << "       message-port1-format-1e-decode -p < hexlines > archive\n";
+    }
+
+static int hexDigit(char c)
+    {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    else if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    else
+        return -1;
+    }
+
+// parse a line of space-separated hex bytes; false if it's anything else.
+static bool parseHexLine(const std::string &line, std::vector<std::uint8_t> &bytes)
+    {
+    bytes.clear();
+    for (std::size_t i = 0; i < line.size(); )
+        {
+        if (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')
+            {
+            ++i;
+            continue;
+            }
+
+        if (i + 1 >= line.size())
+            return false;
+
+        int const hi = hexDigit(line[i]);
+        int const lo = hexDigit(line[i + 1]);
+
+        if (hi < 0 || lo < 0 ||
+            (i + 2 < line.size() && line[i + 2] != ' ' && line[i + 2] != '\t' && line[i + 2] != '\r'))
+            return false;
+
+        bytes.push_back(std::uint8_t((hi << 4) | lo));
+        i += 2;
+        }
+
+    return ! bytes.empty();
+    }
+
+static int pack()
+    {
+    std::string line;
+    std::vector<std::uint8_t> bytes;
+    std::vector<std::uint8_t> archive;
+    std::size_t nRecords = 0;
+
+    while (std::getline(std::cin, line))
+        {
+        if (! parseHexLine(line, bytes))
+            continue;
+
+        if (! appendRecord(archive, bytes.data(), bytes.size()))
+            {
+            std::cerr << "payload too long: " << line << "\n";
+            return 1;
+            }
+        ++nRecords;
+        }
+
+#ifdef _WIN32
+    // the archive is binary; stop the C runtime turning LF into CR LF.
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    if (std::fwrite(archive.data(), 1, archive.size(), stdout) != archive.size())
+        {
+        std::cerr << "write failed\n";
+        return 1;
+        }
+
+    std::cerr << nRecords << " records, " << archive.size() << " bytes\n";
+    return 0;
+    }
+
+// absent values are empty fields.
+static void putValue(float v, const char *pFormat)
+    {
+    std::putchar(',');
+    if (v == v)
+        std::printf(pFormat, v);
+    }
+
+static void putBatch(const cBatch &b)
+    {
+    for (std::size_t i = 0; i < b.size(); ++i)
+        {
+        std::printf("%u,0x%02x,", unsigned(b.iMessage[i]), b.format[i]);
+        if (b.iSensor[i] != cBatch::kNoSample)
+            std::printf("%u", b.iSensor[i]);
+        std::printf(",%d,0x%02x", int(b.dt[i]), b.flags[i]);
+        putValue(b.Vbat[i], "%.4f");
+        putValue(b.T[i], "%.3f");
+        putValue(b.RH[i], "%.2f");
+        putValue(b.CO2[i], "%.1f");
+        std::putchar('\n');
+        }
+    }
+
+int main(int argc, char **argv)
+    {
+    unsigned nThreads = std::thread::hardware_concurrency();
+    std::size_t nBatch = 4096;
+    bool fQuiet = false;
+    int iArg;
+
+    for (iArg = 1; iArg < argc && argv[iArg][0] == '-'; ++iArg)
+        {
+        if (std::strcmp(argv[iArg], "-p") == 0)
+            return pack();
+        else if (std::strcmp(argv[iArg], "-q") == 0)
+            fQuiet = true;
+        else if (std::strcmp(argv[iArg], "-j") == 0 && iArg + 1 < argc)
+            nThreads = unsigned(std::strtoul(argv[++iArg], nullptr, 10));
+        else if (std::strcmp(argv[iArg], "-b") == 0 && iArg + 1 < argc)
+            nBatch = std::strtoul(argv[++iArg], nullptr, 10);
+        else
+            {
+            usage();
+            return 1;
+            }
+        }
+
+    if (iArg + 1 != argc)
+        {
+        usage();
+        return 1;
+        }
+
+    cArchiveFile archive;
+
+    if (! archive.open(argv[iArg]))
+        {
+        std::cerr << "can't open " << argv[iArg] << "\n";
+        return 1;
+        }
+
+    if (nThreads == 0)
+        nThreads = 1;
+
+    auto const tStart = std::chrono::steady_clock::now();
+
+    if (! fQuiet)
+        std::printf("message,format,sensor,dt,flags,vbat,t,rh,co2\n");
+
+    auto const stats = decodeArchive(
+        archive.data(), archive.size(), nThreads, nBatch,
+        [fQuiet](const cBatch &b)
+            {
+            if (! fQuiet)
+                putBatch(b);
+            }
+        );
+
+    std::fflush(stdout);
+
+    double const secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+
+    std::cerr << stats.nMessages << " messages, "
+              << stats.nRows << " rows, "
+              << stats.nErrors << " errors, "
+              << stats.nBytes << " bytes; "
+              << nThreads << (nThreads == 1 ? " thread, " : " threads, ")
+              << secs * 1000.0 << " ms\n";
+
+    return stats.nErrors == 0 ? 0 : 2;
+    }
@@ -3,7 +3,7 @@
 Name:   message-port1-format-1e-decoder-ttn.js
 
 Function:
-    Decode port 0x01 format 0x1e messages for TTN console.
+    Decode port 0x01 format 0x1e, 0x1f and 0x20 messages for TTN console.
 
 Copyright and License:
     See accompanying LICENSE file at https://github.com/mcci-catena/MCCI-Catena-PMS7003/
@@ -134,14 +134,17 @@ function DecodeU16(Parse) {
     return Vraw;
 }
 
-function DecodeUflt16(Parse) {
-    var rawUflt16 = DecodeU16(Parse);
+function Uflt16ToFloat(rawUflt16) {
     var exp1 = rawUflt16 >> 12;
     var mant1 = (rawUflt16 & 0xFFF) / 4096.0;
     var f_unscaled = mant1 * Math.pow(2, exp1 - 15);
     return f_unscaled;
 }
 
+function DecodeUflt16(Parse) {
+    return Uflt16ToFloat(DecodeU16(Parse));
+}
+
 function DecodeSflt16(Parse) {
     var rawSflt16 = DecodeU16(Parse);
 
@@ -188,6 +191,147 @@ function DecodeV(Parse) {
     return DecodeI16(Parse) / 4096.0;
 }
 
+function DecodeI8(Parse) {
+    var Vraw = Parse.bytes[Parse.i++];
+
+    // interpret uint8 as an int8 instead.
+    if (Vraw & 0x80)
+        Vraw += -0x100;
+
+    return Vraw;
+}
+
+// decode one field of sample 1..n-1 of a format 0x1F message, given
+// the delta code and the value (raw) from sample 0.
+function DecodeDelta(Parse, code, v0, fSigned) {
+    if (code === 0)
+        return v0;
+    else if (code === 1)
+        return v0 + DecodeI8(Parse);
+    else if (code === 2)
+        return v0 + DecodeI16(Parse);
+    else
+        return fSigned ? DecodeI16(Parse) : DecodeU16(Parse);
+}
+
+// decode the samples of a format 0x1F message. Sample 0 is sent
+// in full; the others are sent as differences from sample 0.
+function DecodeBatch(Parse, flags, decoded) {
+    var nSamples = Parse.bytes[Parse.i++];
+    var period = DecodeU16(Parse);
+    var codes = Parse.bytes[Parse.i++];
+    var codeT = codes & 3;
+    var codeRH = (codes >> 2) & 3;
+    var codeCO2 = (codes >> 4) & 3;
+    var t0, rh0, co20;
+
+    decoded.period = period;
+    decoded.samples = [];
+
+    for (var iSample = 0; iSample < nSamples; ++iSample) {
+        var sample = {};
+        var t, rh, co2;
+
+        // time of sample relative to the newest, in seconds.
+        sample.dt = -(nSamples - 1 - iSample) * period;
+
+        if (flags & 0x8) {
+            if (iSample === 0) {
+                t = t0 = DecodeI16(Parse);
+                rh = rh0 = DecodeU16(Parse);
+            } else {
+                t = DecodeDelta(Parse, codeT, t0, true);
+                rh = DecodeDelta(Parse, codeRH, rh0, false);
+            }
+            sample.temperature = t / 200;
+            sample.humidity = rh / 65535 * 100;
+            sample.heatindex = CalculateHeatIndexC(sample.temperature, sample.humidity);
+            sample.dewpoint = dewpoint(sample.temperature, sample.humidity);
+        }
+
+        if (flags & 0x10) {
+            if (iSample === 0)
+                co2 = co20 = DecodeU16(Parse);
+            else
+                co2 = DecodeDelta(Parse, codeCO2, co20, false);
+            sample.co2 = Uflt16ToFloat(co2) * 40000;
+        }
+
+        decoded.samples.push(sample);
+    }
+
+    // also report the newest sample, as for format 0x1E.
+    if (nSamples > 0) {
+        var newest = decoded.samples[nSamples - 1];
+        for (var key in newest) {
+            if (key !== "dt")
+                decoded[key] = newest[key];
+        }
+    }
+}
+
+// decode field 6: the statistics of all readings since the last
+// uplink. Each channel has min, max, mean and standard deviation.
+function DecodeSummary(Parse) {
+    var summary = {};
+    var i;
+    var v = [];
+
+    summary.n = Parse.bytes[Parse.i++];
+
+    for (i = 0; i < 4; ++i)
+        v.push(DecodeI16(Parse));
+    summary.temperature = { min: v[0] / 200, max: v[1] / 200, mean: v[2] / 200, sd: (v[3] & 0xFFFF) / 200 };
+
+    v = [];
+    for (i = 0; i < 4; ++i)
+        v.push(DecodeU16(Parse) / 65535 * 100);
+    summary.humidity = { min: v[0], max: v[1], mean: v[2], sd: v[3] };
+
+    v = [];
+    for (i = 0; i < 4; ++i)
+        v.push(DecodeU16(Parse));
+    // all zero if none of the readings had CO2.
+    if (v[0] !== 0 || v[1] !== 0) {
+        summary.co2 = {
+            min: Uflt16ToFloat(v[0]) * 40000,
+            max: Uflt16ToFloat(v[1]) * 40000,
+            mean: Uflt16ToFloat(v[2]) * 40000,
+            sd: Uflt16ToFloat(v[3]) * 40000
+            };
+    }
+
+    return summary;
+}
+
+// decode the sensor records of a format 0x20 message: a bitmap of
+// sensor indices, then T, RH and CO2 for each sensor in the bitmap,
+// in ascending index order. Index 0 is the node's own SCD30.
+function DecodeMulti(Parse, decoded) {
+    var bitmap = Parse.bytes[Parse.i++];
+
+    decoded.sensors = [];
+    for (var iSensor = 0; iSensor < 8; ++iSensor) {
+        if (! (bitmap & (1 << iSensor)))
+            continue;
+
+        var sensor = {};
+        var co2;
+
+        sensor.index = iSensor;
+        sensor.temperature = DecodeI16(Parse) / 200;
+        sensor.humidity = Parse.bytes[Parse.i++] / 255 * 100;
+        sensor.heatindex = CalculateHeatIndexC(sensor.temperature, sensor.humidity);
+        sensor.dewpoint = dewpoint(sensor.temperature, sensor.humidity);
+        // zero if the sensor had no CO2 reading.
+        co2 = DecodeU16(Parse);
+        if (co2 !== 0)
+            sensor.co2 = Uflt16ToFloat(co2) * 40000;
+
+        decoded.sensors.push(sensor);
+    }
+}
+
 function Decoder(bytes, port) {
     // Decode an uplink message from a buffer
     // (array) of bytes to an object of fields.
@@ -197,7 +341,7 @@ function Decoder(bytes, port) {
         return null;
 
     var uFormat = bytes[0];
-    if (! (uFormat === 0x1E))
+    if (! (uFormat === 0x1E || uFormat === 0x1F || uFormat === 0x20))
         return null;
 
     // an object to help us parse.
@@ -222,6 +366,43 @@ function Decoder(bytes, port) {
         decoded.boot = iBoot;
     }
 
+    if (uFormat === 0x20) {
+        // one record per sensor; a large report is split into
+        // several frames.
+        DecodeMulti(Parse, decoded);
+
+        if (flags & 0x40)
+            decoded.more = true;
+
+        if (flags & 0x80)
+            decoded.heartbeat = true;
+
+        return decoded;
+    }
+
+    if (uFormat === 0x1F) {
+        // temperature, RH and CO2 are sent as a batch of samples.
+        if (flags & 0x18)
+            DecodeBatch(Parse, flags, decoded);
+
+        if (flags & 0x20) {
+            // stored samples: age of the newest, in minutes.
+            decoded.age = DecodeU16(Parse) * 60;
+            if ("samples" in decoded) {
+                for (var i = 0; i < decoded.samples.length; ++i)
+                    decoded.samples[i].dt -= decoded.age;
+            }
+        }
+
+        if (flags & 0x40)
+            decoded.summary = DecodeSummary(Parse);
+
+        if (flags & 0x80)
+            decoded.heartbeat = true;
+
+        return decoded;
+    }
+
     if (flags & 0x8) {
         // we have temperature, RH
         decoded.temperature = DecodeI16(Parse) / 200;
@@ -235,5 +416,12 @@ function Decoder(bytes, port) {
         decoded.co2 = DecodeUflt16(Parse) * 40000;
     }
 
+    if (flags & 0x40)
+        decoded.summary = DecodeSummary(Parse);
+
+    // nothing has changed by more than the deadband.
+    if (flags & 0x80)
+        decoded.heartbeat = true;
+
     return decoded;
 }
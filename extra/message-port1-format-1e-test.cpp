@@ -3,7 +3,7 @@
 Module:	message-port1-format-1e-test.cpp
 
 Function:
-	Test vector generator for port 1, format 0x1e
+	Test vector generator for port 1, formats 0x1e, 0x1f and 0x20
 
 Copyright and License:
 	This file copyright (C) 2020 by
@@ -24,241 +24,19 @@ Author:
 //
 //  C> cl /EHsc message-port1-format-1e-test.cpp
 
+#include "message-port1-format-1e.h"
+
 #include <cmath>
 #include <cstdint>
 #include <iostream>
 #include <string>
 #include <vector>
 
+using namespace McciCatenaScd30::Port1;
+
 std::string key;
 std::string value;
 
-template <typename T>
-struct val
-    {
-    bool fValid;
-    T v;
-    };
-
-struct SCDval
-    {
-    float   Temperature;
-    float   RelativeHumidity;
-    };
-
-struct Measurements
-    {
-    val<float> Vbat;
-    val<float> Vsys;
-    val<float> Vbus;
-    val<std::uint8_t> Boot;
-    val<SCDval> SCD;
-    val<float> CO2;
-    };
-
-uint16_t
-LMIC_f2uflt16(
-        float f
-        )
-        {
-        if (f < 0.0)
-                return 0;
-        else if (f >= 1.0)
-                return 0xFFFF;
-        else
-                {
-                int iExp;
-                float normalValue;
-
-                normalValue = std::frexp(f, &iExp);
-
-                // f is supposed to be in [0..1), so useful exp
-                // is [0..-15]
-                iExp += 15;
-                if (iExp < 0)
-                        // underflow.
-                        iExp = 0;
-
-                // bits 15..12 are the exponent
-                // bits 11..0 are the fraction
-                // we conmpute the fraction and then decide if we need to round.
-                uint16_t outputFraction = std::ldexp(normalValue, 12) + 0.5;
-                if (outputFraction >= (1 << 12u))
-                        {
-                        // reduce output fraction
-                        outputFraction = 1 << 11;
-                        // increase exponent
-                        ++iExp;
-                        }
-
-                // check for overflow and return max instead.
-                if (iExp > 15)
-                        return 0xFFFF;
-
-                return (uint16_t)((iExp << 12u) | outputFraction);
-                }
-        }
-
-uint16_t
-LMIC_f2sflt16(
-        float f
-        )
-        {
-        if (f <= -1.0)
-                return 0xFFFF;
-        else if (f >= 1.0)
-                return 0x7FFF;
-        else
-                {
-                int iExp;
-                float normalValue;
-                uint16_t sign;
-
-                normalValue = frexpf(f, &iExp);
-
-                sign = 0;
-                if (normalValue < 0)
-                        {
-                        // set the "sign bit" of the result
-                        // and work with the absolute value of normalValue.
-                        sign = 0x8000;
-                        normalValue = -normalValue;
-                        }
-
-                // abs(f) is supposed to be in [0..1), so useful exp
-                // is [0..-15]
-                iExp += 15;
-                if (iExp < 0)
-                        iExp = 0;
-
-                // bit 15 is the sign
-                // bits 14..11 are the exponent
-                // bits 10..0 are the fraction
-                // we conmpute the fraction and then decide if we need to round.
-                uint16_t outputFraction = ldexpf(normalValue, 11) + 0.5;
-                if (outputFraction >= (1 << 11u))
-                        {
-                        // reduce output fraction
-                        outputFraction = 1 << 10;
-                        // increase exponent
-                        ++iExp;
-                        }
-
-                // check for overflow and return max instead.
-                if (iExp > 15)
-                        return 0x7FFF | sign;
-
-                return (uint16_t)(sign | (iExp << 11u) | outputFraction);
-                }
-        }
-
-std::uint16_t encode16s(float v)
-    {
-    float nv = std::floor(v + 0.5f);
-
-    if (nv > 32767.0f)
-        return 0x7FFFu;
-    else if (nv < -32768.0f)
-        return 0x8000u;
-    else
-        {
-        return (std::uint16_t) std::int16_t(nv);
-        }
-    }
-
-std::uint16_t encode16u(float v)
-    {
-    float nv = std::floor(v + 0.5f);
-    if (nv > 65535.0f)
-        return 0xFFFFu;
-    else if (nv < 0.0f)
-        return 0;
-    else
-        {
-        return std::uint16_t(nv);
-        }
-    }
-
-std::uint16_t encodeV(float v)
-    {
-    return encode16s(v * 4096.0f);
-    }
-
-std::uint16_t encodeT(float v)
-    {
-    return encode16s(v * 200.0f);
-    }
-
-std::uint16_t encodeRH(float v)
-    {
-    return encode16s(v * 65535.0f / 100.0f);
-    }
-
-
-std::uint16_t encodeCO2(float v)
-    {
-    return encode16u(LMIC_f2uflt16(v / 40000.0f));
-    }
-
-class Buffer : public std::vector<std::uint8_t>
-    {
-public:
-    Buffer() : std::vector<std::uint8_t>() {};
-
-    void push_back_be(std::uint16_t v)
-        {
-        this->push_back(std::uint8_t(v >> 8));
-        this->push_back(std::uint8_t(v & 0xFF));
-        }
-    };
-
-void encodeMeasurement(Buffer &buf, Measurements &m)
-    {
-    std::uint8_t flags = 0;
-
-    // sent the type byte
-    buf.clear();
-    buf.push_back(0x1E);
-    buf.push_back(0u); // flag byte.
-
-    // put the fields
-    if (m.Vbat.fValid)
-        {
-        flags |= 1 << 0;
-        buf.push_back_be(encodeV(m.Vbat.v));
-        }
-
-    if (m.Vsys.fValid)
-        {
-        flags |= 1 << 1;
-        buf.push_back_be(encodeV(m.Vsys.v));
-        }
-
-    if (m.Boot.fValid)
-        {
-        flags |= 1 << 2;
-        buf.push_back(m.Boot.v);
-        }
-    
-    if (m.SCD.fValid)
-        {
-        flags |= 1 << 3;
-
-        buf.push_back_be(encodeT(m.SCD.v.Temperature));
-        buf.push_back_be(encodeRH(m.SCD.v.RelativeHumidity));
-        }
-
-    if (m.CO2.fValid)
-        {
-        flags |= 1 << 4;
-
-        buf.push_back_be(encodeCO2(m.CO2.v));
-        }
-
-    // update the flags
-    buf.data()[1] = flags;
-    }
-
 void logMeasurement(Measurements &m)
     {
     class Padder {
@@ -311,6 +89,72 @@ void logMeasurement(Measurements &m)
                   ;
         }
 
+    if (m.Period.fValid)
+        {
+        std::cout << pad.get() << "Period " << m.Period.v;
+        }
+
+    for (auto &s : m.Samples)
+        {
+        std::cout << pad.get() << "Sample";
+        if (s.SCD.fValid)
+            {
+            std::cout << pad.get() << "T " << s.SCD.v.Temperature
+                                   << " RH " << s.SCD.v.RelativeHumidity
+                                  ;
+            }
+        if (s.CO2.fValid)
+            {
+            std::cout << pad.get() << "CO2ppm " << s.CO2.v;
+            }
+        }
+
+    if (m.Age.fValid)
+        {
+        std::cout << pad.get() << "Age " << m.Age.v;
+        }
+
+    if (m.Summary.fValid)
+        {
+        auto const &s = m.Summary.v;
+        auto const putStats = [&pad](const char *pName, const Stats &st)
+            {
+            std::cout << pad.get() << pName << " " << st.Min << " " << st.Max
+                      << " " << st.Mean << " " << st.StdDev;
+            };
+
+        std::cout << pad.get() << "Summary " << unsigned(s.n);
+        putStats("T", s.T);
+        putStats("RH", s.RH);
+        if (s.CO2.fValid)
+            putStats("CO2ppm", s.CO2.v);
+        }
+
+    for (auto &r : m.Sensors)
+        {
+        std::cout << pad.get() << "Sensor " << r.iSensor;
+        if (r.s.SCD.fValid)
+            {
+            std::cout << pad.get() << "T " << r.s.SCD.v.Temperature
+                                   << " RH " << r.s.SCD.v.RelativeHumidity
+                                  ;
+            }
+        if (r.s.CO2.fValid)
+            {
+            std::cout << pad.get() << "CO2ppm " << r.s.CO2.v;
+            }
+        }
+
+    if (m.fMore)
+        {
+        std::cout << pad.get() << "More";
+        }
+
+    if (m.fHeartbeat)
+        {
+        std::cout << pad.get() << "Heartbeat";
+        }
+
     // make the syntax cut/pastable.
     std::cout << pad.get() << ".\n";
     }
@@ -319,7 +163,12 @@ void putTestVector(Measurements &m)
     {
     Buffer buf {};
     logMeasurement(m);
-    encodeMeasurement(buf, m);
+    if (! m.Sensors.empty())
+        encodeMulti(buf, m);
+    else if (m.Samples.empty())
+        encodeMeasurement(buf, m);
+    else
+        encodeBatch(buf, m);
     bool fFirst;
 
     fFirst = true;
@@ -379,8 +228,10 @@ int main(int argc, char **argv)
 
             if (rhkey == "RH")
                 {
-                m.SCD.v = v;
-                m.SCD.fValid = true;
+                auto &scd = ! m.Sensors.empty() ? m.Sensors.back().s.SCD :
+                            m.Samples.empty() ? m.SCD : m.Samples.back().SCD;
+                scd.v = v;
+                scd.fValid = true;
                 }
             else
                 {
@@ -392,8 +243,74 @@ int main(int argc, char **argv)
             }
         else if (key == "CO2ppm")
             {
-            std::cin >> m.CO2.v;
-            m.CO2.fValid = true;
+            auto &co2 = ! m.Sensors.empty() ? m.Sensors.back().s.CO2 :
+                        m.Samples.empty() ? m.CO2 : m.Samples.back().CO2;
+            std::cin >> co2.v;
+            co2.fValid = true;
+            }
+        else if (key == "Period")
+            {
+            std::cin >> m.Period.v;
+            m.Period.fValid = true;
+            }
+        else if (key == "Age")
+            {
+            std::cin >> m.Age.v;
+            m.Age.fValid = true;
+            }
+        else if (key == "Summary")
+            {
+            // Summary n T min max mean sd RH min max mean sd [CO2ppm min max mean sd]
+            auto &s = m.Summary.v;
+            unsigned n;
+            std::string tkey, rhkey;
+
+            std::cin >> n
+                     >> tkey >> s.T.Min >> s.T.Max >> s.T.Mean >> s.T.StdDev
+                     >> rhkey >> s.RH.Min >> s.RH.Max >> s.RH.Mean >> s.RH.StdDev
+                     ;
+            s.n = std::uint8_t(n);
+            s.CO2.fValid = false;
+            if (std::cin.peek() == ' ')
+                {
+                std::cin >> std::ws;
+                if (std::cin.peek() == 'C')
+                    {
+                    std::string co2key;
+                    auto &co2 = s.CO2.v;
+
+                    std::cin >> co2key >> co2.Min >> co2.Max >> co2.Mean >> co2.StdDev;
+                    s.CO2.fValid = co2key == "CO2ppm";
+                    }
+                }
+
+            if (tkey == "T" && rhkey == "RH")
+                m.Summary.fValid = true;
+            else
+                {
+                std::cerr << "bad summary: " << tkey << " " << rhkey << "\n";
+                fUpdate = false;
+                }
+            }
+        else if (key == "Heartbeat")
+            {
+            m.fHeartbeat = true;
+            }
+        else if (key == "More")
+            {
+            m.fMore = true;
+            }
+        else if (key == "Sensor")
+            {
+            // start a new sensor record; this makes the message format 0x20.
+            SensorSample r {};
+            std::cin >> r.iSensor;
+            m.Sensors.push_back(r);
+            }
+        else if (key == "Sample")
+            {
+            // start a new sample; this makes the message format 0x1f.
+            m.Samples.push_back(Sample {});
             }
         else if (key == ".")
             {
@@ -0,0 +1,1011 @@
+/*
+
+Module:	message-port1-format-1e.h
+
+Function:
+	Encoders and a bulk decoder for port 1, formats 0x1e, 0x1f and 0x20
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	September 2020
+
+*/
+
+// This is shared by the test vector generator, the bulk decoder and its
+// benchmark, so that the decoder is checked against the same encoders
+// that make the test vectors. It's header-only, and needs only the
+// standard library.
+
+#ifndef _message_port1_format_1e_h_
+#define _message_port1_format_1e_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace McciCatenaScd30 {
+namespace Port1 {
+
+/****************************************************************************\
+|
+|   The measurements, and their encodings
+|
+\****************************************************************************/
+
+template <typename T>
+struct val
+    {
+    bool fValid;
+    T v;
+    };
+
+struct SCDval
+    {
+    float   Temperature;
+    float   RelativeHumidity;
+    };
+
+struct Sample
+    {
+    val<SCDval> SCD;
+    val<float> CO2;
+    };
+
+// for format 0x20: one sensor's record.
+struct SensorSample
+    {
+    unsigned iSensor;
+    Sample s;
+    };
+
+// the statistics of one channel, for field 6.
+struct Stats
+    {
+    float   Min;
+    float   Max;
+    float   Mean;
+    float   StdDev;
+    };
+
+struct SummaryVal
+    {
+    std::uint8_t    n;
+    Stats           T;
+    Stats           RH;
+    val<Stats>      CO2;
+    };
+
+struct Measurements
+    {
+    val<float> Vbat;
+    val<float> Vsys;
+    val<float> Vbus;
+    val<std::uint8_t> Boot;
+    val<SCDval> SCD;
+    val<float> CO2;
+    // for format 0x1f: the sample period, and the samples, oldest first.
+    val<std::uint16_t> Period;
+    std::vector<Sample> Samples;
+    val<std::uint16_t> Age;
+    val<SummaryVal> Summary;
+    bool fHeartbeat;
+    // for format 0x20: the sensor records, and whether another frame follows.
+    std::vector<SensorSample> Sensors;
+    bool fMore;
+    };
+
+inline uint16_t
+LMIC_f2uflt16(
+        float f
+        )
+        {
+        if (f < 0.0)
+                return 0;
+        else if (f >= 1.0)
+                return 0xFFFF;
+        else
+                {
+                int iExp;
+                float normalValue;
+
+                normalValue = std::frexp(f, &iExp);
+
+                // f is supposed to be in [0..1), so useful exp
+                // is [0..-15]
+                iExp += 15;
+                if (iExp < 0)
+                        // underflow.
+                        iExp = 0;
+
+                // bits 15..12 are the exponent
+                // bits 11..0 are the fraction
+                // we conmpute the fraction and then decide if we need to round.
+                uint16_t outputFraction = std::ldexp(normalValue, 12) + 0.5;
+                if (outputFraction >= (1 << 12u))
+                        {
+                        // reduce output fraction
+                        outputFraction = 1 << 11;
+                        // increase exponent
+                        ++iExp;
+                        }
+
+                // check for overflow and return max instead.
+                if (iExp > 15)
+                        return 0xFFFF;
+
+                return (uint16_t)((iExp << 12u) | outputFraction);
+                }
+        }
+
+inline uint16_t
+LMIC_f2sflt16(
+        float f
+        )
+        {
+        if (f <= -1.0)
+                return 0xFFFF;
+        else if (f >= 1.0)
+                return 0x7FFF;
+        else
+                {
+                int iExp;
+                float normalValue;
+                uint16_t sign;
+
+                normalValue = frexpf(f, &iExp);
+
+                sign = 0;
+                if (normalValue < 0)
+                        {
+                        // set the "sign bit" of the result
+                        // and work with the absolute value of normalValue.
+                        sign = 0x8000;
+                        normalValue = -normalValue;
+                        }
+
+                // abs(f) is supposed to be in [0..1), so useful exp
+                // is [0..-15]
+                iExp += 15;
+                if (iExp < 0)
+                        iExp = 0;
+
+                // bit 15 is the sign
+                // bits 14..11 are the exponent
+                // bits 10..0 are the fraction
+                // we conmpute the fraction and then decide if we need to round.
+                uint16_t outputFraction = ldexpf(normalValue, 11) + 0.5;
+                if (outputFraction >= (1 << 11u))
+                        {
+                        // reduce output fraction
+                        outputFraction = 1 << 10;
+                        // increase exponent
+                        ++iExp;
+                        }
+
+                // check for overflow and return max instead.
+                if (iExp > 15)
+                        return 0x7FFF | sign;
+
+                return (uint16_t)(sign | (iExp << 11u) | outputFraction);
+                }
+        }
+
+inline std::uint16_t encode16s(float v)
+    {
+    float nv = std::floor(v + 0.5f);
+
+    if (nv > 32767.0f)
+        return 0x7FFFu;
+    else if (nv < -32768.0f)
+        return 0x8000u;
+    else
+        {
+        return (std::uint16_t) std::int16_t(nv);
+        }
+    }
+
+inline std::uint16_t encode16u(float v)
+    {
+    float nv = std::floor(v + 0.5f);
+    if (nv > 65535.0f)
+        return 0xFFFFu;
+    else if (nv < 0.0f)
+        return 0;
+    else
+        {
+        return std::uint16_t(nv);
+        }
+    }
+
+inline std::uint16_t encodeStdDev(float v)
+    {
+    return encode16u(v);
+    }
+
+inline std::uint16_t encodeV(float v)
+    {
+    return encode16s(v * 4096.0f);
+    }
+
+inline std::uint16_t encodeT(float v)
+    {
+    return encode16s(v * 200.0f);
+    }
+
+inline std::uint16_t encodeRH(float v)
+    {
+    return encode16u(v * 65535.0f / 100.0f);
+    }
+
+
+inline std::uint16_t encodeCO2(float v)
+    {
+    return encode16u(LMIC_f2uflt16(v / 40000.0f));
+    }
+
+class Buffer : public std::vector<std::uint8_t>
+    {
+public:
+    Buffer() : std::vector<std::uint8_t>() {};
+
+    void push_back_be(std::uint16_t v)
+        {
+        this->push_back(std::uint8_t(v >> 8));
+        this->push_back(std::uint8_t(v & 0xFF));
+        }
+    };
+
+// field 6: count, then min, max, mean, std dev of T, RH and CO2.
+inline void encodeSummary(Buffer &buf, std::uint8_t &flags, Measurements &m)
+    {
+    if (! m.Summary.fValid)
+        return;
+
+    auto const &s = m.Summary.v;
+
+    flags |= 1 << 6;
+    buf.push_back(s.n);
+
+    buf.push_back_be(encodeT(s.T.Min));
+    buf.push_back_be(encodeT(s.T.Max));
+    buf.push_back_be(encodeT(s.T.Mean));
+    buf.push_back_be(encodeStdDev(s.T.StdDev * 200.0f));
+
+    buf.push_back_be(encodeRH(s.RH.Min));
+    buf.push_back_be(encodeRH(s.RH.Max));
+    buf.push_back_be(encodeRH(s.RH.Mean));
+    buf.push_back_be(encodeStdDev(s.RH.StdDev * 65535.0f / 100.0f));
+
+    if (s.CO2.fValid)
+        {
+        buf.push_back_be(encodeCO2(s.CO2.v.Min));
+        buf.push_back_be(encodeCO2(s.CO2.v.Max));
+        buf.push_back_be(encodeCO2(s.CO2.v.Mean));
+        buf.push_back_be(encodeCO2(s.CO2.v.StdDev));
+        }
+    else
+        {
+        for (unsigned i = 0; i < 4; ++i)
+            buf.push_back_be(0);
+        }
+    }
+
+inline void encodeMeasurement(Buffer &buf, Measurements &m)
+    {
+    std::uint8_t flags = 0;
+
+    // sent the type byte
+    buf.clear();
+    buf.push_back(0x1E);
+    buf.push_back(0u); // flag byte.
+
+    // put the fields
+    if (m.Vbat.fValid)
+        {
+        flags |= 1 << 0;
+        buf.push_back_be(encodeV(m.Vbat.v));
+        }
+
+    if (m.Vsys.fValid)
+        {
+        flags |= 1 << 1;
+        buf.push_back_be(encodeV(m.Vsys.v));
+        }
+
+    if (m.Boot.fValid)
+        {
+        flags |= 1 << 2;
+        buf.push_back(m.Boot.v);
+        }
+    
+    if (m.SCD.fValid)
+        {
+        flags |= 1 << 3;
+
+        buf.push_back_be(encodeT(m.SCD.v.Temperature));
+        buf.push_back_be(encodeRH(m.SCD.v.RelativeHumidity));
+        }
+
+    if (m.CO2.fValid)
+        {
+        flags |= 1 << 4;
+
+        buf.push_back_be(encodeCO2(m.CO2.v));
+        }
+
+    encodeSummary(buf, flags, m);
+    if (m.fHeartbeat)
+        flags |= 1 << 7;
+
+    // update the flags
+    buf.data()[1] = flags;
+    }
+
+// delta encodings for samples 1..n-1 of format 0x1f
+enum class DeltaCode : std::uint8_t
+    {
+    Same = 0, Int8 = 1, Int16 = 2, Absolute = 3,
+    };
+
+inline DeltaCode getDeltaCode(const std::vector<std::int32_t> &v)
+    {
+    DeltaCode result = DeltaCode::Same;
+
+    for (std::size_t i = 1; i < v.size(); ++i)
+        {
+        std::int32_t const d = v[i] - v[0];
+
+        if (d < -32768 || d > 32767)
+            return DeltaCode::Absolute;
+        else if (d < -128 || d > 127)
+            result = DeltaCode::Int16;
+        else if (d != 0 && result == DeltaCode::Same)
+            result = DeltaCode::Int8;
+        }
+
+    return result;
+    }
+
+inline void putDelta(Buffer &buf, DeltaCode code, std::int32_t v, std::int32_t v0)
+    {
+    switch (code)
+        {
+    case DeltaCode::Int8:
+        buf.push_back(std::uint8_t(v - v0));
+        break;
+    case DeltaCode::Int16:
+        buf.push_back_be(std::uint16_t(v - v0));
+        break;
+    case DeltaCode::Absolute:
+        buf.push_back_be(std::uint16_t(v));
+        break;
+    default:
+        break;
+        }
+    }
+
+inline void encodeBatch(Buffer &buf, Measurements &m)
+    {
+    std::uint8_t flags = 0;
+    bool fTH = true;
+    bool fCO2 = true;
+    std::vector<std::int32_t> t, rh, co2;
+
+    buf.clear();
+    buf.push_back(0x1F);
+    buf.push_back(0u); // flag byte.
+
+    if (m.Vbat.fValid)
+        {
+        flags |= 1 << 0;
+        buf.push_back_be(encodeV(m.Vbat.v));
+        }
+
+    if (m.Vsys.fValid)
+        {
+        flags |= 1 << 1;
+        buf.push_back_be(encodeV(m.Vsys.v));
+        }
+
+    if (m.Boot.fValid)
+        {
+        flags |= 1 << 2;
+        buf.push_back(m.Boot.v);
+        }
+
+    // a field is sent only if all samples have it.
+    for (auto &s : m.Samples)
+        {
+        fTH = fTH && s.SCD.fValid;
+        fCO2 = fCO2 && s.CO2.fValid;
+        t.push_back(std::int16_t(encodeT(s.SCD.v.Temperature)));
+        rh.push_back(encodeRH(s.SCD.v.RelativeHumidity));
+        co2.push_back(encodeCO2(s.CO2.v));
+        }
+
+    if (fTH || fCO2)
+        {
+        DeltaCode const codeT = fTH ? getDeltaCode(t) : DeltaCode::Same;
+        DeltaCode const codeRH = fTH ? getDeltaCode(rh) : DeltaCode::Same;
+        DeltaCode const codeCO2 = fCO2 ? getDeltaCode(co2) : DeltaCode::Same;
+
+        if (fTH)
+            flags |= 1 << 3;
+        if (fCO2)
+            flags |= 1 << 4;
+
+        buf.push_back(std::uint8_t(m.Samples.size()));
+        buf.push_back_be(m.Period.fValid ? m.Period.v : 0);
+        buf.push_back(std::uint8_t((unsigned(codeCO2) << 4) | (unsigned(codeRH) << 2) | unsigned(codeT)));
+
+        for (std::size_t i = 0; i < m.Samples.size(); ++i)
+            {
+            if (i == 0)
+                {
+                if (fTH)
+                    {
+                    buf.push_back_be(std::uint16_t(t[0]));
+                    buf.push_back_be(std::uint16_t(rh[0]));
+                    }
+                if (fCO2)
+                    buf.push_back_be(std::uint16_t(co2[0]));
+                }
+            else
+                {
+                if (fTH)
+                    {
+                    putDelta(buf, codeT, t[i], t[0]);
+                    putDelta(buf, codeRH, rh[i], rh[0]);
+                    }
+                if (fCO2)
+                    putDelta(buf, codeCO2, co2[i], co2[0]);
+                }
+            }
+        }
+
+    if (m.Age.fValid)
+        {
+        flags |= 1 << 5;
+        buf.push_back_be(m.Age.v);
+        }
+
+    encodeSummary(buf, flags, m);
+    if (m.fHeartbeat)
+        flags |= 1 << 7;
+
+    // update the flags
+    buf.data()[1] = flags;
+    }
+
+inline void encodeMulti(Buffer &buf, Measurements &m)
+    {
+    std::uint8_t flags = 0;
+    std::uint8_t bitmap = 0;
+    SensorSample const *pRecords[8] = {};
+
+    buf.clear();
+    buf.push_back(0x20);
+    buf.push_back(0u); // flag byte.
+
+    if (m.Vbat.fValid)
+        {
+        flags |= 1 << 0;
+        buf.push_back_be(encodeV(m.Vbat.v));
+        }
+
+    if (m.Boot.fValid)
+        {
+        flags |= 1 << 2;
+        buf.push_back(m.Boot.v);
+        }
+
+    // records are sent in ascending index order.
+    for (auto &r : m.Sensors)
+        {
+        if (r.iSensor < 8)
+            {
+            bitmap |= 1 << r.iSensor;
+            pRecords[r.iSensor] = &r;
+            }
+        else
+            std::cerr << "bad sensor index: " << r.iSensor << "\n";
+        }
+
+    buf.push_back(bitmap);
+    for (auto pRecord : pRecords)
+        {
+        if (pRecord == nullptr)
+            continue;
+
+        auto const &s = pRecord->s;
+
+        buf.push_back_be(s.SCD.fValid ? encodeT(s.SCD.v.Temperature) : 0);
+        buf.push_back(s.SCD.fValid ? std::uint8_t((encodeRH(s.SCD.v.RelativeHumidity) + 128u) / 257u) : 0);
+        buf.push_back_be(s.CO2.fValid ? encodeCO2(s.CO2.v) : 0);
+        }
+
+    if (m.fMore)
+        flags |= 1 << 6;
+    if (m.fHeartbeat)
+        flags |= 1 << 7;
+
+    // update the flags
+    buf.data()[1] = flags;
+    }
+
+/****************************************************************************\
+|
+|   Decoding
+|
+\****************************************************************************/
+
+// the format byte.
+enum class Format : std::uint8_t
+    {
+    Single = 0x1E,      // one measurement
+    Batch = 0x1F,       // delta-encoded samples
+    Multi = 0x20,       // one record per sensor
+    };
+
+// the bits of the flag byte.
+static constexpr std::uint8_t kFlagVbat = 1 << 0;
+static constexpr std::uint8_t kFlagVsys = 1 << 1;
+static constexpr std::uint8_t kFlagBoot = 1 << 2;
+static constexpr std::uint8_t kFlagTH = 1 << 3;
+static constexpr std::uint8_t kFlagCO2 = 1 << 4;
+static constexpr std::uint8_t kFlagAge = 1 << 5;        // format 0x1f
+static constexpr std::uint8_t kFlagSummary = 1 << 6;    // formats 0x1e, 0x1f
+static constexpr std::uint8_t kFlagMore = 1 << 6;       // format 0x20
+static constexpr std::uint8_t kFlagHeartbeat = 1 << 7;
+
+static constexpr std::size_t kSummaryBytes = 1 + 3 * 4 * 2;
+
+// the inverses of encodeV(), encodeT() and encodeRH().
+inline float decodeV(std::int32_t raw) { return float(raw) * (1.0f / 4096.0f); }
+inline float decodeT(std::int32_t raw) { return float(raw) * (1.0f / 200.0f); }
+inline float decodeRH(std::int32_t raw) { return float(raw) * (100.0f / 65535.0f); }
+
+// f / 4096 * 2^(b - 15), which is f * 2^(b - 27). The power of two is
+// built directly as an IEEE float (biased exponent b - 27 + 127), so
+// there's no branch or library call, and a loop of these vectorizes.
+inline float decodeUflt16(std::uint16_t raw)
+    {
+    std::uint32_t const bits = std::uint32_t((raw >> 12) + 100) << 23;
+    float scale;
+
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return float(raw & 0xFFF) * scale;
+    }
+
+// the inverse of encodeCO2().
+inline float decodeCO2(std::uint16_t raw) { return decodeUflt16(raw) * 40000.0f; }
+
+/// Reads a message, checking that it doesn't run off the end.
+///
+/// Reading past the end returns zero, and clears isValid().
+class cCursor
+    {
+public:
+    cCursor(const std::uint8_t *pMessage, std::size_t nMessage)
+        : m_p(pMessage)
+        , m_pEnd(pMessage + nMessage)
+        {}
+
+    std::uint8_t getUint8()
+        {
+        if (this->m_pEnd - this->m_p < 1)
+            return this->fail();
+        return *this->m_p++;
+        }
+    std::int8_t getInt8() { return std::int8_t(this->getUint8()); }
+    std::uint16_t getUint16()
+        {
+        if (this->m_pEnd - this->m_p < 2)
+            return this->fail();
+
+        std::uint16_t const v = std::uint16_t((this->m_p[0] << 8) | this->m_p[1]);
+        this->m_p += 2;
+        return v;
+        }
+    std::int16_t getInt16() { return std::int16_t(this->getUint16()); }
+    void skip(std::size_t n)
+        {
+        if (std::size_t(this->m_pEnd - this->m_p) < n)
+            this->fail();
+        else
+            this->m_p += n;
+        }
+    bool isValid() const { return this->m_fValid; }
+
+private:
+    std::uint8_t fail()
+        {
+        this->m_fValid = false;
+        this->m_p = this->m_pEnd;
+        return 0;
+        }
+
+    const std::uint8_t *m_p;
+    const std::uint8_t *m_pEnd;
+    bool m_fValid = true;
+    };
+
+/// A batch of decoded messages, as a structure of arrays.
+///
+/// Each row is one sample: the only one of a format 0x1e message, one
+/// of the samples of a format 0x1f message, or one sensor's record of a
+/// format 0x20 message. A message with no samples still gets a row,
+/// with iSensor set to kNoSample, so every message is represented. The
+/// message-level fields (the flags and the battery voltage) are
+/// repeated in each of its rows.
+///
+/// Decoding is in two passes. parse() walks the bytes, which is
+/// inherently serial, and appends the raw values as sent to the
+/// integer columns. convert() then turns the raw columns into floats
+/// in tight, branch-free loops over whole columns, which the compiler
+/// can vectorize. Channels a row doesn't have are NaN.
+class cBatch
+    {
+public:
+    // which channels a row has.
+    static constexpr std::uint8_t kHasVbat = 1 << 0;
+    static constexpr std::uint8_t kHasTH = 1 << 1;
+    static constexpr std::uint8_t kHasCO2 = 1 << 2;
+    // iSensor of the row for a message with no samples.
+    static constexpr std::uint8_t kNoSample = 0xFF;
+
+    // the rows.
+    std::vector<std::uint32_t>  iMessage;   /// index of the message, from parse()
+    std::vector<std::uint8_t>   format;     /// the message's format byte
+    std::vector<std::uint8_t>   flags;      /// the message's flag byte
+    std::vector<std::uint8_t>   has;        /// kHas... bits
+    std::vector<std::uint8_t>   iSensor;    /// 0x1f: sample index; 0x20: sensor index; else 0
+    std::vector<std::int32_t>   dt;         /// 0x1f: secs before the message was sent; else 0
+
+    // the values as sent.
+    std::vector<std::int16_t>   rawVbat;    /// volts * 4096
+    std::vector<std::int32_t>   rawT;       /// degrees C * 200
+    std::vector<std::int32_t>   rawRH;      /// 0xFFFF is 100% (format 0x20: * 257)
+    std::vector<std::uint16_t>  rawCO2;     /// uflt16, ppm / 40000
+
+    // the values in engineering units; filled in by convert().
+    std::vector<float>          Vbat;       /// volts
+    std::vector<float>          T;          /// degrees C
+    std::vector<float>          RH;         /// percent
+    std::vector<float>          CO2;        /// ppm
+
+    std::size_t                 nMessages = 0;  /// messages parsed
+    std::size_t                 nErrors = 0;    /// messages rejected
+
+    void clear()
+        {
+        this->truncate(0);
+        this->nMessages = this->nErrors = 0;
+        }
+    void reserve(std::size_t nRows);
+    std::size_t size() const { return this->iMessage.size(); }
+
+    bool parse(const std::uint8_t *pMessage, std::size_t nMessage, std::uint32_t iMsg);
+    void convert();
+
+private:
+    void truncate(std::size_t nRows);
+    void addRow(
+        std::uint32_t iMsg, std::uint8_t uFormat, std::uint8_t uFlags,
+        std::uint8_t uHas, std::uint8_t uSensor, std::int32_t uDt,
+        std::int16_t vbat, std::int32_t t, std::int32_t rh, std::uint16_t co2
+        );
+    static std::int32_t getDelta(cCursor &c, unsigned code, std::int32_t v0, bool fSigned);
+    };
+
+inline void cBatch::reserve(std::size_t nRows)
+    {
+    this->iMessage.reserve(nRows);
+    this->format.reserve(nRows);
+    this->flags.reserve(nRows);
+    this->has.reserve(nRows);
+    this->iSensor.reserve(nRows);
+    this->dt.reserve(nRows);
+    this->rawVbat.reserve(nRows);
+    this->rawT.reserve(nRows);
+    this->rawRH.reserve(nRows);
+    this->rawCO2.reserve(nRows);
+    this->Vbat.reserve(nRows);
+    this->T.reserve(nRows);
+    this->RH.reserve(nRows);
+    this->CO2.reserve(nRows);
+    }
+
+inline void cBatch::truncate(std::size_t nRows)
+    {
+    this->iMessage.resize(nRows);
+    this->format.resize(nRows);
+    this->flags.resize(nRows);
+    this->has.resize(nRows);
+    this->iSensor.resize(nRows);
+    this->dt.resize(nRows);
+    this->rawVbat.resize(nRows);
+    this->rawT.resize(nRows);
+    this->rawRH.resize(nRows);
+    this->rawCO2.resize(nRows);
+    this->Vbat.resize(nRows < this->Vbat.size() ? nRows : this->Vbat.size());
+    this->T.resize(this->Vbat.size());
+    this->RH.resize(this->Vbat.size());
+    this->CO2.resize(this->Vbat.size());
+    }
+
+inline void cBatch::addRow(
+    std::uint32_t iMsg, std::uint8_t uFormat, std::uint8_t uFlags,
+    std::uint8_t uHas, std::uint8_t uSensor, std::int32_t uDt,
+    std::int16_t vbat, std::int32_t t, std::int32_t rh, std::uint16_t co2
+    )
+    {
+    this->iMessage.push_back(iMsg);
+    this->format.push_back(uFormat);
+    this->flags.push_back(uFlags);
+    this->has.push_back(uHas);
+    this->iSensor.push_back(uSensor);
+    this->dt.push_back(uDt);
+    this->rawVbat.push_back(vbat);
+    this->rawT.push_back(t);
+    this->rawRH.push_back(rh);
+    this->rawCO2.push_back(co2);
+    }
+
+// one field of samples 1..n-1 of format 0x1f.
+inline std::int32_t cBatch::getDelta(cCursor &c, unsigned code, std::int32_t v0, bool fSigned)
+    {
+    switch (code)
+        {
+    case unsigned(DeltaCode::Same):
+        return v0;
+    case unsigned(DeltaCode::Int8):
+        return v0 + c.getInt8();
+    case unsigned(DeltaCode::Int16):
+        return v0 + c.getInt16();
+    default:
+        return fSigned ? std::int32_t(c.getInt16()) : std::int32_t(c.getUint16());
+        }
+    }
+
+/*
+
+Name:	cBatch::parse()
+
+Function:
+    Append the rows of one message.
+
+Definition:
+    bool cBatch::parse(
+        const std::uint8_t *pMessage,
+        std::size_t nMessage,
+        std::uint32_t iMsg
+        );
+
+Description:
+    The message is decoded as by the TTN decoder script; the voltage,
+    T/RH and CO2 of each sample go in the raw columns, tagged with
+    iMsg. The system voltage, boot counter and window statistics are
+    checked for length, and skipped. Bytes after the last field are
+    ignored, as they are by the script.
+
+Returns:
+    `true` if the message was decoded. If the format byte is unknown,
+    or the message is too short for its flags, no rows are added, and
+    nErrors is incremented.
+
+*/
+
+inline bool cBatch::parse(
+    const std::uint8_t *pMessage,
+    std::size_t nMessage,
+    std::uint32_t iMsg
+    )
+    {
+    std::size_t const nRows0 = this->size();
+    cCursor c { pMessage, nMessage };
+
+    std::uint8_t const uFormat = c.getUint8();
+    std::uint8_t const uFlags = c.getUint8();
+
+    if (! (uFormat == std::uint8_t(Format::Single) ||
+           uFormat == std::uint8_t(Format::Batch) ||
+           uFormat == std::uint8_t(Format::Multi)))
+        {
+        ++this->nErrors;
+        return false;
+        }
+
+    std::uint8_t const hasVbat = (uFlags & kFlagVbat) ? kHasVbat : 0;
+    std::int16_t const vbat = hasVbat ? c.getInt16() : 0;
+
+    if (uFlags & kFlagVsys)
+        c.skip(2);
+    if (uFlags & kFlagBoot)
+        c.skip(1);
+
+    if (uFormat == std::uint8_t(Format::Multi))
+        {
+        std::uint8_t const bitmap = c.getUint8();
+
+        for (unsigned i = 0; i < 8; ++i)
+            {
+            if (! (bitmap & (1u << i)))
+                continue;
+
+            std::int32_t const t = c.getInt16();
+            std::int32_t const rh = std::int32_t(c.getUint8()) * 257;
+            std::uint16_t const co2 = c.getUint16();
+
+            // zero CO2 means no reading.
+            this->addRow(
+                iMsg, uFormat, uFlags,
+                std::uint8_t(hasVbat | kHasTH | (co2 != 0 ? kHasCO2 : 0)),
+                std::uint8_t(i), 0, vbat, t, rh, co2
+                );
+            }
+        }
+    else if (uFormat == std::uint8_t(Format::Batch))
+        {
+        std::uint8_t const hasSample = std::uint8_t(
+                ((uFlags & kFlagTH) ? kHasTH : 0) | ((uFlags & kFlagCO2) ? kHasCO2 : 0)
+                );
+
+        if (hasSample != 0)
+            {
+            unsigned const nSamples = c.getUint8();
+            std::int32_t const period = c.getUint16();
+            unsigned const codes = c.getUint8();
+            std::int32_t t0 = 0, rh0 = 0, co20 = 0;
+
+            for (unsigned i = 0; i < nSamples && c.isValid(); ++i)
+                {
+                std::int32_t t = 0, rh = 0, co2 = 0;
+
+                if (i == 0)
+                    {
+                    if (hasSample & kHasTH)
+                        {
+                        t = t0 = c.getInt16();
+                        rh = rh0 = c.getUint16();
+                        }
+                    if (hasSample & kHasCO2)
+                        co2 = co20 = c.getUint16();
+                    }
+                else
+                    {
+                    if (hasSample & kHasTH)
+                        {
+                        t = getDelta(c, codes & 3, t0, true);
+                        rh = getDelta(c, (codes >> 2) & 3, rh0, false);
+                        }
+                    if (hasSample & kHasCO2)
+                        co2 = getDelta(c, (codes >> 4) & 3, co20, false);
+                    }
+
+                this->addRow(
+                    iMsg, uFormat, uFlags, std::uint8_t(hasVbat | hasSample),
+                    std::uint8_t(i), -std::int32_t(nSamples - 1 - i) * period,
+                    vbat, t, rh, std::uint16_t(co2)
+                    );
+                }
+            }
+
+        if (uFlags & kFlagAge)
+            {
+            // the samples were stored; place them in time.
+            std::int32_t const age = std::int32_t(c.getUint16()) * 60;
+
+            for (std::size_t i = nRows0; i < this->size(); ++i)
+                this->dt[i] -= age;
+            }
+        if (uFlags & kFlagSummary)
+            c.skip(kSummaryBytes);
+        }
+    else
+        {
+        std::int32_t t = 0, rh = 0;
+        std::uint16_t co2 = 0;
+
+        if (uFlags & kFlagTH)
+            {
+            t = c.getInt16();
+            rh = c.getUint16();
+            }
+        if (uFlags & kFlagCO2)
+            co2 = c.getUint16();
+        if (uFlags & kFlagSummary)
+            c.skip(kSummaryBytes);
+
+        std::uint8_t const hasSample = std::uint8_t(
+                ((uFlags & kFlagTH) ? kHasTH : 0) | ((uFlags & kFlagCO2) ? kHasCO2 : 0)
+                );
+
+        if (hasSample != 0)
+            this->addRow(iMsg, uFormat, uFlags, std::uint8_t(hasVbat | hasSample), 0, 0, vbat, t, rh, co2);
+        }
+
+    if (! c.isValid())
+        {
+        this->truncate(nRows0);
+        ++this->nErrors;
+        return false;
+        }
+
+    if (this->size() == nRows0)
+        this->addRow(iMsg, uFormat, uFlags, hasVbat, kNoSample, 0, vbat, 0, 0, 0);
+
+    ++this->nMessages;
+    return true;
+    }
+
+/*
+
+Name:	cBatch::convert()
+
+Function:
+    Convert the raw columns to engineering units.
+
+Definition:
+    void cBatch::convert();
+
+Description:
+    The rows added since the last convert() are converted, one column
+    at a time. Each loop reads one or two arrays and writes one, with
+    no branches (absent values are chosen with a select), so they
+    vectorize.
+
+Returns:
+    No explicit result.
+
+*/
+
+inline void cBatch::convert()
+    {
+    std::size_t const n = this->size();
+    std::size_t const i0 = this->Vbat.size();
+    float const kNaN = std::numeric_limits<float>::quiet_NaN();
+
+    this->Vbat.resize(n);
+    this->T.resize(n);
+    this->RH.resize(n);
+    this->CO2.resize(n);
+
+    std::uint8_t const * const pHas = this->has.data();
+    std::int16_t const * const pRawVbat = this->rawVbat.data();
+    std::int32_t const * const pRawT = this->rawT.data();
+    std::int32_t const * const pRawRH = this->rawRH.data();
+    std::uint16_t const * const pRawCO2 = this->rawCO2.data();
+    float * const pVbat = this->Vbat.data();
+    float * const pT = this->T.data();
+    float * const pRH = this->RH.data();
+    float * const pCO2 = this->CO2.data();
+
+    for (std::size_t i = i0; i < n; ++i)
+        pVbat[i] = (pHas[i] & kHasVbat) ? decodeV(pRawVbat[i]) : kNaN;
+    for (std::size_t i = i0; i < n; ++i)
+        pT[i] = (pHas[i] & kHasTH) ? decodeT(pRawT[i]) : kNaN;
+    for (std::size_t i = i0; i < n; ++i)
+        pRH[i] = (pHas[i] & kHasTH) ? decodeRH(pRawRH[i]) : kNaN;
+    for (std::size_t i = i0; i < n; ++i)
+        pCO2[i] = (pHas[i] & kHasCO2) ? decodeCO2(pRawCO2[i]) : kNaN;
+    }
+
+} // namespace Port1
+} // namespace McciCatenaScd30
+
+#endif /* _message_port1_format_1e_h_ */
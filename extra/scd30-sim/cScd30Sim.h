@@ -0,0 +1,523 @@
+/*
+
+Module:	cScd30Sim.h
+
+Function:
+	A simulated SCD30, as a cSCD30Transport, for host benchmarks.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _cScd30Sim_h_
+#define _cScd30Sim_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <Arduino.h>
+#include <MCCI_Catena_SCD30.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ScdSim {
+
+/// A simulated SCD30 and the bus it's on.
+///
+/// The simulation checks the driver against the sensor's timing rules:
+/// a response may not be read until kReadDelayUs after its command,
+/// and no command may be written within kRecoveryUs of a command with
+/// no response. Violations are NAKed, as the sensor would, and counted.
+///
+/// Measurements are produced every MeasurementInterval seconds of the
+/// sensor's own clock, which runs DriftPpm parts per million slow
+/// (positive) or fast (negative) relative to the host. Bus transfers take
+/// simulated time, at BusHz; if fAsyncRead is set, reads finish in the
+/// background, like a DMA transport, otherwise they block, like TwoWire.
+///
+/// Faults can be injected, to exercise the driver's error recovery: a
+/// garbled read (bad CRC), a jammed bus (nothing is acknowledged until
+/// recoverBus()), and a wedged sensor (commands are accepted, but no
+/// response is, until a SoftReset).
+class cScd30Sim : public McciCatenaScd30::cSCD30Transport
+    {
+public:
+    using cSCD30 = McciCatenaScd30::cSCD30;
+    using Command = cSCD30::Command;
+
+    static constexpr std::uint8_t kAddress = 0x61;
+    static constexpr std::uint32_t kReadDelayUs = 3000;     // datasheet: 3 ms before reading a response
+    static constexpr std::uint32_t kRecoveryUs = 20000;     // Sensirion sample code: 20 ms after a write
+    static constexpr std::uint16_t kFirmwareVersion = 0x0342;
+    static constexpr std::uint32_t kBootUs = 2000000;       // datasheet: boot time after a reset
+
+    struct Config
+        {
+        std::uint32_t   BusHz;              /// bus clock
+        std::int32_t    DriftPpm;           /// sensor clock error, parts per million
+        std::uint16_t   MeasurementInterval;    /// initial interval, seconds
+        bool            fAsyncRead;         /// reads complete in the background
+        };
+
+    /// counters, reset by clearStats().
+    struct Stats
+        {
+        std::uint32_t   nWrites;            /// write transactions
+        std::uint32_t   nReads;             /// read transactions
+        std::uint32_t   nBytes;             /// bytes on the bus, including addresses
+        std::uint64_t   busUs;              /// time the bus was busy
+        std::uint64_t   blockedUs;          /// time the CPU waited for the bus
+        std::uint32_t   nEarlyReads;        /// reads before kReadDelayUs
+        std::uint32_t   nEarlyCommands;     /// commands within kRecoveryUs
+        std::uint32_t   nBadCommands;       /// commands with a bad CRC
+        std::uint32_t   nBadReads;          /// reads with no response pending, or of the wrong size
+        std::uint32_t   nStaleReads;        /// ReadMeasurement with no new data
+        std::uint32_t   nMeasurements;      /// new measurements read
+        std::uint32_t   nMissed;            /// measurements never read
+        std::uint64_t   dataAgeUs;          /// sum of (time read - time ready) for new measurements
+        std::uint64_t   maxDataAgeUs;       /// largest data age
+        std::uint32_t   nFaults;            /// transfers failed by an injected fault
+        std::uint32_t   nBusRecoveries;     /// calls to recoverBus()
+        std::uint32_t   nResets;            /// SoftReset commands
+
+        std::uint32_t getViolations() const
+            {
+            return nEarlyReads + nEarlyCommands + nBadCommands + nBadReads + nStaleReads;
+            }
+        };
+
+    cScd30Sim(const Config &config)
+        : m_config(config)
+        , m_interval(config.MeasurementInterval)
+        {}
+
+    /*
+    ||  the transport
+    */
+    virtual bool begin() override { return true; }
+    virtual std::size_t getMaxRead() const override { return this->m_maxRead; }
+
+    virtual Status write(std::uint8_t address, const std::uint8_t *pBuffer, std::size_t nBuffer) override
+        {
+        this->busTransfer(nBuffer, true);
+        ++this->m_stats.nWrites;
+
+        if (this->m_fJammed)
+            {
+            ++this->m_stats.nFaults;
+            return Status::WriteFailed;
+            }
+
+        if (address != kAddress || nBuffer < 2)
+            return Status::WriteFailed;
+
+        auto const tNow = now();
+        if (tNow < this->m_tRecoveryEnd)
+            {
+            ++this->m_stats.nEarlyCommands;
+            return Status::WriteFailed;
+            }
+
+        bool const fParam = nBuffer == 5;
+        std::uint16_t const param = fParam ? std::uint16_t((pBuffer[2] << 8) | pBuffer[3]) : 0;
+
+        if (fParam && McciCatenaScd30::Crc8::crc(&pBuffer[2], 2) != pBuffer[4])
+            {
+            ++this->m_stats.nBadCommands;
+            return Status::WriteFailed;
+            }
+
+        this->m_nResponse = 0;
+        this->m_iWord = 0;
+        this->command(Command(std::uint16_t((pBuffer[0] << 8) | pBuffer[1])), fParam, param);
+
+        if (this->m_nResponse != 0)
+            this->m_tResponse = tNow + kReadDelayUs;
+        else if (this->m_tRecoveryEnd < tNow + kRecoveryUs)
+            // (a SoftReset has already set a longer time)
+            this->m_tRecoveryEnd = tNow + kRecoveryUs;
+
+        return Status::Success;
+        }
+
+    virtual Status startRead(std::uint8_t address, std::uint8_t *pBuffer, std::size_t nBuffer) override
+        {
+        auto const tStart = now();
+
+        ++this->m_stats.nReads;
+        this->busTransfer(nBuffer, ! this->m_config.fAsyncRead);
+
+        if (this->m_fJammed || this->m_fWedged)
+            {
+            ++this->m_stats.nFaults;
+            this->m_nResponse = 0;
+            return this->m_readStatus = Status::ReadRequestFailed;
+            }
+
+        if (address != kAddress)
+            return this->m_readStatus = Status::ReadRequestFailed;
+
+        // a response can be read in pieces, each continuing the last.
+        if (this->m_nResponse == 0 || nBuffer == 0 || nBuffer % 3 != 0 ||
+            nBuffer > this->m_maxRead ||
+            this->m_iWord + nBuffer / 3 > this->m_nResponse)
+            {
+            ++this->m_stats.nBadReads;
+            this->m_nResponse = 0;
+            return this->m_readStatus = Status::ReadRequestFailed;
+            }
+
+        if (tStart < this->m_tResponse)
+            {
+            ++this->m_stats.nEarlyReads;
+            return this->m_readStatus = Status::ReadRequestFailed;
+            }
+
+        this->m_pRead = pBuffer;
+        this->m_nRead = std::uint8_t(nBuffer / 3);
+        if (this->m_config.fAsyncRead)
+            {
+            this->m_tReadDone = tStart + this->getBusUs(nBuffer);
+            return this->m_readStatus = Status::Busy;
+            }
+
+        this->finishRead();
+        return this->m_readStatus;
+        }
+
+    virtual Status pollRead() override
+        {
+        if (this->m_readStatus == Status::Busy && now() >= this->m_tReadDone)
+            this->finishRead();
+
+        return this->m_readStatus;
+        }
+
+    virtual void abortRead() override
+        {
+        this->m_readStatus = Status::ReadRequestFailed;
+        this->m_nResponse = 0;
+        }
+
+    virtual bool recoverBus() override
+        {
+        ++this->m_stats.nBusRecoveries;
+        this->m_fJammed = false;
+        return true;
+        }
+
+    /*
+    ||  fault injection
+    */
+    // garble the CRC of the next n measurement reads; the sensor keeps the data.
+    void corruptReads(unsigned n) { this->m_nCorruptReads = n; }
+    // fail every transfer until recoverBus().
+    void jamBus() { this->m_fJammed = true; }
+    // fail every read until a SoftReset.
+    void wedge() { this->m_fWedged = true; }
+    // add these to the next new measurement: a spike, or, with NAN, a
+    // channel the sensor couldn't measure.
+    void perturbNextReading(float dCO2ppm, float dTemperature, float dRelativeHumidity)
+        {
+        this->m_perturb[0] = dCO2ppm;
+        this->m_perturb[1] = dTemperature;
+        this->m_perturb[2] = dRelativeHumidity;
+        this->m_fPerturb = true;
+        }
+    // limit reads to nBytes, as a TwoWire buffer does; longer responses
+    // must be read in pieces.
+    void setMaxRead(std::size_t nBytes) { this->m_maxRead = nBytes; }
+
+    /*
+    ||  the simulation
+    */
+    Stats getStats() const { return this->m_stats; }
+    void clearStats() { this->m_stats = Stats {}; }
+    bool isMeasuring() const { return this->m_fMeasuring; }
+    // start measuring now, without a command; as the sensor does at
+    // power-up if it was measuring when it lost power.
+    void powerUpMeasuring()
+        {
+        this->m_fMeasuring = true;
+        this->m_tStart = now();
+        this->m_iRead = 0;
+        }
+
+    // return microseconds until the next measurement is ready (0 if one is ready now).
+    std::uint64_t getUsToReady() const
+        {
+        if (! this->m_fMeasuring)
+            return ~std::uint64_t(0);
+
+        auto const tNow = now();
+        auto const tNext = this->getReadyTime(this->m_iRead + 1);
+        return tNext > tNow ? tNext - tNow : 0;
+        }
+
+    // measurement period, in host microseconds, including drift.
+    std::uint64_t getPeriodUs() const
+        {
+        return std::uint64_t(this->m_interval) * (1000000 + std::int64_t(this->m_config.DriftPpm));
+        }
+
+private:
+    static std::uint64_t now() { return clock().tNow; }
+
+    std::uint64_t getBusUs(std::size_t nBytes) const
+        {
+        // address byte plus data, 9 clocks each, plus start and stop.
+        return ((nBytes + 1) * 9 + 2) * std::uint64_t(1000000) / this->m_config.BusHz;
+        }
+
+    void busTransfer(std::size_t nBytes, bool fBlocking)
+        {
+        auto const us = this->getBusUs(nBytes);
+
+        this->m_stats.nBytes += std::uint32_t(nBytes + 1);
+        this->m_stats.busUs += us;
+        if (fBlocking)
+            {
+            this->m_stats.blockedUs += us;
+            advance(us);
+            }
+        }
+
+    std::uint64_t getReadyTime(std::uint32_t iSample) const
+        {
+        return this->m_tStart + iSample * this->getPeriodUs();
+        }
+
+    // index of most recent measurement.
+    std::uint32_t getCurrentSample() const
+        {
+        if (! this->m_fMeasuring || now() < this->m_tStart)
+            return this->m_iRead;
+        return std::uint32_t((now() - this->m_tStart) / this->getPeriodUs());
+        }
+
+    void setResponse(std::uint16_t w0)
+        {
+        this->m_words[0] = w0;
+        this->m_nResponse = 1;
+        }
+
+    void command(Command c, bool fParam, std::uint16_t param)
+        {
+        switch (c)
+            {
+        case Command::StartContinuousMeasurement:
+            if (! this->m_fMeasuring)
+                {
+                this->m_fMeasuring = true;
+                this->m_tStart = now();
+                this->m_iRead = 0;
+                }
+            break;
+
+        case Command::StopContinuosMeasurement:
+            this->m_fMeasuring = false;
+            break;
+
+        case Command::GetDataReady:
+            this->setResponse(this->getCurrentSample() > this->m_iRead);
+            break;
+
+        case Command::ReadMeasurement:
+            this->readMeasurement();
+            break;
+
+        case Command::SetMeasurementInterval:
+            if (fParam)
+                {
+                this->m_interval = param;
+                // the sensor restarts its cycle.
+                this->m_tStart = now();
+                this->m_iRead = 0;
+                }
+            else
+                this->setResponse(this->m_interval);
+            break;
+
+        case Command::AltitudeCompensation:
+            if (fParam)
+                this->m_altitude = param;
+            else
+                this->setResponse(this->m_altitude);
+            break;
+
+        case Command::SetForcedRecalibration:
+            if (fParam)
+                this->m_frc = param;
+            else
+                this->setResponse(this->m_frc);
+            break;
+
+        case Command::EnableAutoSelfCal:
+            if (fParam)
+                this->m_asc = param;
+            else
+                this->setResponse(this->m_asc);
+            break;
+
+        case Command::SetTemperatureOffset:
+            if (fParam)
+                this->m_temperatureOffset = param;
+            else
+                this->setResponse(this->m_temperatureOffset);
+            break;
+
+        case Command::ReadFirmwareVersion:
+            this->setResponse(kFirmwareVersion);
+            break;
+
+        case Command::SoftReset:
+            // reboot; measuring (if it was) starts over once booted.
+            ++this->m_stats.nResets;
+            this->m_fWedged = false;
+            this->m_tRecoveryEnd = now() + kBootUs;
+            this->m_tStart = now() + kBootUs;
+            this->m_iRead = 0;
+            break;
+
+        default:
+            break;
+            }
+        }
+
+    void readMeasurement()
+        {
+        auto const iSample = this->getCurrentSample();
+        float d[3] = { 0.0f, 0.0f, 0.0f };
+
+        if (this->m_nCorruptReads != 0)
+            {
+            // garbled on the way to the host; not consumed.
+            --this->m_nCorruptReads;
+            ++this->m_stats.nFaults;
+            this->m_fCorrupt = true;
+            }
+        else if (iSample <= this->m_iRead)
+            ++this->m_stats.nStaleReads;
+        else
+            {
+            auto const age = now() - this->getReadyTime(iSample);
+
+            ++this->m_stats.nMeasurements;
+            this->m_stats.nMissed += iSample - this->m_iRead - 1;
+            this->m_stats.dataAgeUs += age;
+            if (age > this->m_stats.maxDataAgeUs)
+                this->m_stats.maxDataAgeUs = age;
+            this->m_iRead = iSample;
+            if (this->m_fPerturb)
+                {
+                this->m_fPerturb = false;
+                std::memcpy(d, this->m_perturb, sizeof(d));
+                }
+            }
+
+        // plausible, slowly-varying values.
+        float const k = float(this->m_iRead);
+        putFloat(&this->m_words[0], 420.0f + 25.0f * std::sin(k * 0.1f) + d[0]);
+        putFloat(&this->m_words[2], 22.0f + 0.5f * std::sin(k * 0.05f) + d[1]);
+        putFloat(&this->m_words[4], 40.0f + 5.0f * std::cos(k * 0.07f) + d[2]);
+        this->m_nResponse = 6;
+        }
+
+    static void putFloat(std::uint16_t *pWords, float f)
+        {
+        std::uint32_t v;
+
+        std::memcpy(&v, &f, sizeof(v));
+        pWords[0] = std::uint16_t(v >> 16);
+        pWords[1] = std::uint16_t(v);
+        }
+
+    void finishRead()
+        {
+        auto p = this->m_pRead;
+
+        for (unsigned i = 0; i < this->m_nRead; ++i, p += 3)
+            {
+            auto const w = this->m_words[this->m_iWord + i];
+
+            p[0] = std::uint8_t(w >> 8);
+            p[1] = std::uint8_t(w);
+            p[2] = McciCatenaScd30::Crc8::crc(p, 2);
+            }
+
+        if (this->m_fCorrupt)
+            {
+            this->m_pRead[2] ^= 0x01;
+            this->m_fCorrupt = false;
+            }
+
+        this->m_iWord += this->m_nRead;
+        if (this->m_iWord == this->m_nResponse)
+            this->m_nResponse = 0;
+        this->m_readStatus = Status::Success;
+        }
+
+    Config m_config;                    /// simulation parameters
+    Stats m_stats                       /// counters
+        {};
+    std::uint16_t m_interval;           /// measurement interval, seconds
+    std::uint16_t m_altitude            /// altitude compensation
+        { 0 };
+    std::uint16_t m_frc                 /// forced recalibration value
+        { 400 };
+    std::uint16_t m_asc                 /// ASC enabled
+        { 0 };
+    std::uint16_t m_temperatureOffset   /// temperature offset
+        { 0 };
+    bool m_fMeasuring                   /// continuous measurement running
+        { false };
+    std::uint64_t m_tStart              /// when measurement (re)started
+        { 0 };
+    std::uint32_t m_iRead               /// index of last measurement read
+        { 0 };
+    std::uint64_t m_tRecoveryEnd        /// no commands until this time
+        { 0 };
+    std::uint64_t m_tResponse           /// response can't be read until this time
+        { 0 };
+    std::uint16_t m_words[6];           /// pending response
+    std::uint8_t m_nResponse            /// number of words in pending response
+        { 0 };
+    std::uint8_t m_iWord                /// words of the pending response already read
+        { 0 };
+    std::uint8_t m_nRead                /// words in the read in progress
+        { 0 };
+    std::size_t m_maxRead               /// largest read accepted, bytes
+        { 255 };
+    std::uint8_t *m_pRead               /// buffer for read in progress
+        { nullptr };
+    std::uint64_t m_tReadDone           /// when the background read finishes
+        { 0 };
+    Status m_readStatus                 /// status of last read
+        { Status::Success };
+    unsigned m_nCorruptReads            /// measurement reads still to garble
+        { 0 };
+    bool m_fCorrupt                     /// garble the response being read
+        { false };
+    float m_perturb[3];                 /// added to the next new measurement, if m_fPerturb
+    bool m_fPerturb                     /// perturb the next new measurement
+        { false };
+    bool m_fJammed                      /// nothing is acknowledged until recoverBus()
+        { false };
+    bool m_fWedged                      /// no responses until SoftReset
+        { false };
+    };
+
+} // namespace ScdSim
+
+#endif /* _cScd30Sim_h_ */
@@ -0,0 +1,95 @@
+/*
+
+Module:	Arduino.h
+
+Function:
+	Host stand-in for the parts of the Arduino API used by the SCD30
+	library, driven by a simulated clock.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _Arduino_h_
+#define _Arduino_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Time only moves when the simulation says so. Time spent awake
+// (yield(), delay(), bus transfers, loop iterations) and time spent
+// asleep are accumulated separately, so a benchmark can report both.
+namespace ScdSim {
+
+struct Clock
+    {
+    std::uint64_t   tNow;       /// current time, in microseconds
+    std::uint64_t   tAwake;     /// total time awake
+    std::uint64_t   tAsleep;    /// total time asleep
+    std::uint32_t   yieldUs;    /// cost of one call to yield()
+    };
+
+inline Clock &clock()
+    {
+    static Clock c { 0, 0, 0, 20 };
+    return c;
+    }
+
+// spend us microseconds awake.
+inline void advance(std::uint64_t us)
+    {
+    clock().tNow += us;
+    clock().tAwake += us;
+    }
+
+// spend us microseconds asleep.
+inline void sleep(std::uint64_t us)
+    {
+    clock().tNow += us;
+    clock().tAsleep += us;
+    }
+
+} // namespace ScdSim
+
+typedef std::uint8_t byte;
+
+inline std::uint32_t micros() { return std::uint32_t(ScdSim::clock().tNow); }
+inline std::uint32_t millis() { return std::uint32_t(ScdSim::clock().tNow / 1000); }
+inline void delay(std::uint32_t ms) { ScdSim::advance(std::uint64_t(ms) * 1000); }
+inline void delayMicroseconds(std::uint32_t us) { ScdSim::advance(us); }
+inline void yield() { ScdSim::advance(ScdSim::clock().yieldUs); }
+
+// there are no pins or interrupts; the RDY pin can't be simulated.
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 3
+#define FALLING 4
+#define CHANGE 5
+#define HIGH 1
+#define LOW 0
+#define NOT_AN_INTERRUPT -1
+
+inline void pinMode(int, int) {}
+inline int digitalRead(int) { return LOW; }
+inline void digitalWrite(int, int) {}
+inline int digitalPinToInterrupt(int) { return NOT_AN_INTERRUPT; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#endif /* _Arduino_h_ */
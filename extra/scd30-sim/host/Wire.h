@@ -0,0 +1,45 @@
+/*
+
+Module:	Wire.h
+
+Function:
+	Host stand-in for the Arduino TwoWire class.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#ifndef _Wire_h_
+#define _Wire_h_	/* prevent multiple includes */
+
+#pragma once
+
+#include "Arduino.h"
+
+// Enough of TwoWire to compile the library's TwoWire transport. It has
+// no devices on it; the simulator is a cSCD30Transport instead.
+class TwoWire
+    {
+public:
+    void begin() {}
+    void end() {}
+    void beginTransmission(std::uint8_t) {}
+    std::size_t write(const std::uint8_t *, std::size_t n) { return n; }
+    std::uint8_t endTransmission(bool = true) { return 2; /* address NAK */ }
+    std::uint8_t requestFrom(std::uint8_t, std::uint8_t) { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+    std::size_t readBytes(std::uint8_t *, std::size_t) { return 0; }
+    };
+
+#endif /* _Wire_h_ */
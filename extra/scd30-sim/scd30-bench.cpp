@@ -0,0 +1,823 @@
+/*
+
+Module:	scd30-bench.cpp
+
+Function:
+	Host benchmarks for the SCD30 driver, against a simulated sensor.
+
+Copyright and License:
+	This file copyright (C) 2020 by
+
+		MCCI Corporation
+		3520 Krums Corners Road
+		Ithaca, NY  14850
+
+	See accompanying LICENSE file for copyright and license information.
+
+Author:
+	Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+// To build, from this directory, with GCC or Clang:
+//
+//  $ SRC=../../src
+//  $ SKETCH=../../examples/scd30_lorawan
+//  $ g++ -O2 -std=gnu++14 -Ihost -I. -I$SRC -I$SKETCH -o scd30-bench scd30-bench.cpp $SRC/MCCI_Catena_SCD30.cpp $SRC/MCCI_Catena_SCD30_Transport.cpp $SKETCH/cPowerScheduler.cpp
+//
+// host/ has stand-ins for Arduino.h and Wire.h; time is simulated (see
+// host/Arduino.h), so results are repeatable. The program prints four
+// tables:
+//
+//  - the cost of individual driver operations: simulated time, bus
+//    transactions and bytes, and host CPU time (only useful for
+//    comparing builds on the same machine);
+//  - the time from a cold begin() to the first measurement, with and
+//    without fast start, for a sensor that was idle or measuring;
+//  - the cost of a measurement cycle, as driven by the example's
+//    measurement loop, for several intervals, clock drifts and
+//    transports: bus transactions, time awake and asleep, and how
+//    stale each measurement was when it was read;
+//  - the cost of recovering from injected faults: a garbled read, a
+//    jammed bus, and a wedged sensor.
+//
+// The exit status is non-zero if the driver broke any of the sensor's
+// timing rules, or missed or failed any measurement.
+
+#include "cScd30Sim.h"
+
+#include <MCCI_Catena_SCD30.h>
+#include <cPowerScheduler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+using namespace McciCatenaScd30;
+using ScdSim::cScd30Sim;
+
+/****************************************************************************\
+|
+|   The measurement loop
+|
+\****************************************************************************/
+
+// cMeasurementLoop (examples/scd30_lorawan) needs the whole Catena
+// platform, so this is a hand-written copy of the part of its FSM that
+// uses the sensor: stSleeping, stWake and stMeasure for a single SCD30
+// in continuous mode, and deep sleep with a snapshot, scheduled by the
+// sketch's cPowerScheduler. It is not the sketch's code, and it leaves
+// out burst mode, auxiliary sensors, the other sensor tasks, uplinks
+// and store-and-forward; so the benchmark checks the driver, and the
+// loop only as far as this copy matches it. Keep it in step with
+// cMeasurementLoop::fsmDispatch(), addSleepSources() and sleep().
+class cLoopModel
+    {
+public:
+    static constexpr std::uint32_t kLoopUs = 100;      // cost of one pass through loop()
+    static constexpr std::uint32_t kShutdownUs = 5000; // cost of deepSleepPrepare()
+    static constexpr std::uint32_t kRestoreUs = 25000; // cost of waking up, and deepSleepRecovery()
+    static constexpr std::uint32_t kSysTickUs = 1000;  // longest light sleep
+    // cMeasurementLoop::kWakeLeadMs; with no sensor tasks, that's
+    // getWakeLeadMs().
+    static constexpr std::uint32_t kWakeLeadMs = 20;
+
+    enum class State : std::uint8_t
+        {
+        stSleeping,
+        stWake,
+        stMeasure,
+        stInactive,
+        };
+
+    cLoopModel(cSCD30 &scd, bool fDeepSleep)
+        : m_Scd(scd)
+        , m_fDeepSleep(fDeepSleep)
+        {
+        this->m_scheduler.addSource(
+            "scd30",
+            [](void *pClientData) -> std::uint32_t
+                {
+                auto &scd = static_cast<cLoopModel *>(pClientData)->m_Scd;
+
+                if (scd.isBusy())
+                    return 0;
+                else if (scd.getState() == cSCD30::State::Idle)
+                    return cPowerScheduler::kNoDeadline;
+                else if (scd.isReadyInterruptEnabled())
+                    return scd.getMsToNextMeasurement() + 1000;
+                else
+                    return scd.getMsToNextMeasurement();
+                },
+            this,
+            cSCD30::kReadyGuardMs
+            );
+        }
+
+    bool begin()
+        {
+        this->setState(State::stSleeping);
+        return this->m_Scd.begin();
+        }
+
+    // one pass through loop(); returns true when a measurement cycle ends.
+    bool loop()
+        {
+        bool fCycle = false;
+        bool const fEntry = this->m_fEntry;
+
+        this->m_fEntry = false;
+        this->m_Scd.poll();
+
+        switch (this->m_state)
+            {
+        case State::stSleeping:
+            {
+            bool fError;
+
+            if (this->m_Scd.getState() == cSCD30::State::Idle)
+                this->setState(State::stWake);
+            else if (this->m_Scd.queryReady(fError))
+                this->setState(State::stMeasure);
+            else if (fError && cSCD30::isRecoverableError(this->m_Scd.getLastError()))
+                // the driver has scheduled its next attempt.
+                this->sleep();
+            else if (fError)
+                {
+                // the loop stops.
+                ++this->m_nErrors;
+                this->setState(State::stInactive);
+                }
+            else
+                {
+                auto const msToNext = this->m_Scd.getMsToNextMeasurement();
+                if (msToNext < kWakeLeadMs)
+                    this->setState(State::stWake);
+                else
+                    this->sleep();
+                }
+            }
+            break;
+
+        case State::stWake:
+            if (fEntry)
+                {
+                if (this->m_Scd.getState() == cSCD30::State::Idle &&
+                    ! this->m_Scd.startContinuousMeasurement())
+                    ++this->m_nErrors;
+                this->m_tTimer = millis();
+                }
+            if (std::uint32_t(millis() - this->m_tTimer) >= kWakeLeadMs)
+                this->setState(State::stMeasure);
+            break;
+
+        case State::stMeasure:
+            {
+            bool fError;
+
+            if (fEntry)
+                {
+                this->m_fPending = false;
+                this->m_fDone = false;
+                this->m_fValid = false;
+                this->m_fDropped = false;
+                }
+
+            if (this->m_fPending)
+                /* wait for readMeasurementDone() */;
+            else if (this->m_fDone && this->m_fDropped)
+                // the filter dropped the reading; wait for the next one.
+                this->m_fDone = false;
+            else if (this->m_fDone)
+                {
+                // a failure is reported, unless the driver is still recovering.
+                if (this->m_fValid || ! this->isRecovering())
+                    {
+                    if (! this->m_fValid)
+                        ++this->m_nErrors;
+                    fCycle = true;
+                    }
+                this->setState(State::stSleeping);
+                }
+            else if (this->m_Scd.queryReady(fError))
+                {
+                this->m_fPending = true;
+                if (! this->m_Scd.readMeasurementAsync(readMeasurementDone, this))
+                    {
+                    this->m_fPending = false;
+                    this->m_fDone = true;
+                    this->m_fDropped = false;
+                    }
+                }
+            else if (fError)
+                {
+                if (! this->isRecovering())
+                    {
+                    ++this->m_nErrors;
+                    fCycle = true;
+                    }
+                this->setState(State::stSleeping);
+                }
+            }
+            break;
+
+        case State::stInactive:
+            // stopped by an error; each pass counts as a cycle, so the
+            // benchmark ends.
+            fCycle = true;
+            break;
+            }
+
+        ScdSim::advance(kLoopUs);
+        return fCycle;
+        }
+
+    std::uint32_t getErrors() const { return this->m_nErrors; }
+
+private:
+    void setState(State s)
+        {
+        this->m_state = s;
+        this->m_fEntry = true;
+        }
+
+    static void readMeasurementDone(void *pClientData, cSCD30::AsyncRequest *pRequest, bool fSuccess)
+        {
+        auto const pThis = static_cast<cLoopModel *>(pClientData);
+
+        pThis->m_fValid = fSuccess;
+        pThis->m_fDropped = ! fSuccess && cSCD30::isFilterError(pRequest->error);
+        pThis->m_fPending = false;
+        pThis->m_fDone = true;
+        }
+
+    // cMeasurementLoop::isRecovering().
+    bool isRecovering() const
+        {
+        return cSCD30::isRecoverableError(this->m_Scd.getLastError()) &&
+               this->m_Scd.getRecoveryFailures() < cSCD30::kRecoveryCycle;
+        }
+
+    // cMeasurementLoop::sleep(), doDeepSleep(), and deepSleepRecovery().
+    void sleep()
+        {
+        std::uint32_t const windowMs = this->m_scheduler.getWindowMs();
+        auto const mode = this->m_scheduler.chooseMode(windowMs, this->m_fDeepSleep);
+
+        if (mode == cPowerScheduler::SleepMode::Light)
+            {
+            // __WFI() until the next SysTick.
+            ScdSim::sleep(kSysTickUs);
+            return;
+            }
+        else if (mode != cPowerScheduler::SleepMode::Deep)
+            return;
+
+        std::uint32_t const sleepInterval = this->m_scheduler.getDeepSleepSecs(windowMs);
+        std::uint32_t const tStart = millis();
+        cSCD30::Snapshot snapshot;
+        bool const fSnapshot = this->m_Scd.exportSnapshot(snapshot);
+
+        this->m_Scd.end();
+        ScdSim::advance(kShutdownUs);
+        ScdSim::sleep(std::uint64_t(sleepInterval) * 1000000);
+        ScdSim::advance(kRestoreUs);
+
+        if (fSnapshot)
+            this->m_Scd.importSnapshot(snapshot);
+        if (! this->m_Scd.begin(cSCD30::ProductInfoField::MeasurementInterval))
+            ++this->m_nErrors;
+
+        this->m_scheduler.noteDeepSleep(tStart, sleepInterval, millis());
+        }
+
+    cSCD30 &m_Scd;                  /// the sensor
+    bool m_fDeepSleep;              /// use deep sleep between measurements
+    cPowerScheduler m_scheduler;    /// chooses how deeply to sleep
+    State m_state                   /// current state
+        { State::stSleeping };
+    bool m_fEntry                   /// true on first pass in a state
+        { true };
+    bool m_fPending                 /// measurement read in progress
+        { false };
+    bool m_fDone                    /// measurement read finished
+        { false };
+    bool m_fValid                   /// measurement read succeeded
+        { false };
+    bool m_fDropped                 /// measurement read was dropped by the filter
+        { false };
+    std::uint32_t m_tTimer          /// start of stWake timer (millis)
+        { 0 };
+    std::uint32_t m_nErrors         /// failed measurements and queries
+        { 0 };
+    };
+
+/****************************************************************************\
+|
+|   Benchmarks
+|
+\****************************************************************************/
+
+static constexpr cScd30Sim::Config kDefaultConfig
+    {
+    /* BusHz */ 100000,
+    /* DriftPpm */ 0,
+    /* MeasurementInterval */ 2,
+    /* fAsyncRead */ false,
+    };
+
+static unsigned gFailures;
+
+// wait (asleep) for the driver's next measurement, and read it.
+static bool awaitMeasurement(cSCD30 &scd)
+    {
+    bool fError;
+
+    for (unsigned i = 0; i < 10000 && ! scd.queryReady(fError); ++i)
+        {
+        if (fError)
+            return false;
+        ScdSim::sleep(std::max<std::uint64_t>(scd.getMsToNextMeasurement(), 1) * 1000);
+        }
+
+    return scd.readMeasurement();
+    }
+
+// bring up a sensor, and start it measuring.
+static bool startSensor(cSCD30 &scd)
+    {
+    return scd.begin() && awaitMeasurement(scd);
+    }
+
+// wait (asleep) until the sensor has a new measurement, and the driver
+// expects it.
+static void sleepUntilDue(cSCD30 &scd, const cScd30Sim &sim)
+    {
+    if (scd.getState() == cSCD30::State::Ready)
+        scd.readMeasurement();
+
+    ScdSim::sleep(sim.getUsToReady() + 1000);
+    ScdSim::sleep(std::uint64_t(scd.getMsToNextMeasurement()) * 1000);
+    }
+
+template <typename TSetup, typename TOp>
+static void benchOp(const char *pName, unsigned nReps, TSetup setup, TOp op)
+    {
+    cScd30Sim sim(kDefaultConfig);
+    std::unique_ptr<cSCD30> pScd(new cSCD30(sim));
+    std::uint64_t simUs = 0;
+    double hostNs = 0;
+    cScd30Sim::Stats total {};
+    unsigned nFailed = 0;
+    unsigned nViolations = 0;
+
+    if (! startSensor(*pScd))
+        {
+        std::printf("%-32s  could not start sensor: %s\n", pName, pScd->getLastErrorName());
+        ++gFailures;
+        return;
+        }
+
+    for (unsigned i = 0; i < nReps; ++i)
+        {
+        setup(pScd, sim);
+        sim.clearStats();
+
+        auto const t0 = ScdSim::clock().tNow;
+        auto const h0 = std::chrono::steady_clock::now();
+        if (! op(*pScd, sim))
+            ++nFailed;
+        auto const h1 = std::chrono::steady_clock::now();
+
+        simUs += ScdSim::clock().tNow - t0;
+        hostNs += std::chrono::duration<double, std::nano>(h1 - h0).count();
+
+        auto const s = sim.getStats();
+        total.nWrites += s.nWrites;
+        total.nReads += s.nReads;
+        total.nBytes += s.nBytes;
+        nViolations += s.getViolations();
+        }
+
+    std::printf("%-32s %9.1f %7.2f %7.2f %7.1f %9.0f %s\n",
+        pName,
+        double(simUs) / nReps,
+        double(total.nWrites) / nReps,
+        double(total.nReads) / nReps,
+        double(total.nBytes) / nReps,
+        hostNs / nReps,
+        nFailed != 0 || nViolations != 0 ? "FAILED" : ""
+        );
+
+    if (nFailed != 0 || nViolations != 0)
+        ++gFailures;
+    }
+
+static void benchOps()
+    {
+    using Ptr = std::unique_ptr<cSCD30>;
+    constexpr unsigned kReps = 50;
+    auto const noSetup = [](Ptr &, cScd30Sim &) {};
+
+    std::printf("%-32s %9s %7s %7s %7s %9s\n", "operation", "sim us", "writes", "reads", "bytes", "host ns");
+
+    benchOp("begin(), new driver", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { pScd.reset(new cSCD30(sim)); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.begin(); }
+        );
+    benchOp("begin(), fast start", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { pScd.reset(new cSCD30(sim)); pScd->setFastStart(true); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.begin(); }
+        );
+    benchOp("begin(), fast start, interval", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { pScd.reset(new cSCD30(sim)); pScd->setFastStart(true, 2); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.begin(); }
+        );
+    benchOp("begin(MeasurementInterval)", kReps,
+        [](Ptr &pScd, cScd30Sim &) { pScd->end(); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.begin(cSCD30::ProductInfoField::MeasurementInterval); }
+        );
+    benchOp("begin() from snapshot", kReps,
+        [](Ptr &pScd, cScd30Sim &)
+            {
+            cSCD30::Snapshot snapshot;
+
+            pScd->exportSnapshot(snapshot);
+            pScd->end();
+            pScd->importSnapshot(snapshot);
+            },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.begin(); }
+        );
+    benchOp("queryReady(), not due", kReps,
+        noSetup,
+        [](cSCD30 &scd, cScd30Sim &) { bool fError; return ! scd.queryReady(fError) && ! fError; }
+        );
+    benchOp("queryReady(), due", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { sleepUntilDue(*pScd, sim); },
+        [](cSCD30 &scd, cScd30Sim &) { bool fError; return scd.queryReady(fError); }
+        );
+    benchOp("readMeasurement()", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { sleepUntilDue(*pScd, sim); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.readMeasurement(); }
+        );
+    benchOp("readMeasurement(), 12-byte reads", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { sim.setMaxRead(12); sleepUntilDue(*pScd, sim); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.readMeasurement(); }
+        );
+    benchOp("readMeasurement(), filtered", kReps,
+        [](Ptr &pScd, cScd30Sim &sim)
+            {
+            if (! pScd->isFilterEnabled())
+                pScd->setFilter(cSCD30::FilterConfig { 0, 3, 50, 200, 3277, true });
+            sleepUntilDue(*pScd, sim);
+            },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.readMeasurement(); }
+        );
+    benchOp("readMeasurementAsync() + poll()", kReps,
+        [](Ptr &pScd, cScd30Sim &sim) { sleepUntilDue(*pScd, sim); },
+        [](cSCD30 &scd, cScd30Sim &)
+            {
+            bool fResult = false;
+            auto const done = [](void *pClientData, cSCD30::AsyncRequest *pRequest, bool fSuccess)
+                {
+                (void) pRequest;
+                *static_cast<bool *>(pClientData) = fSuccess;
+                };
+
+            if (! scd.readMeasurementAsync(done, &fResult))
+                return false;
+            while (scd.isBusy())
+                {
+                ScdSim::advance(cLoopModel::kLoopUs);
+                scd.poll();
+                }
+            return fResult;
+            }
+        );
+    benchOp("readProductInfo()", kReps,
+        noSetup,
+        [](cSCD30 &scd, cScd30Sim &) { return scd.readProductInfo(); }
+        );
+    benchOp("setMeasurementInterval()", kReps,
+        noSetup,
+        [](cSCD30 &scd, cScd30Sim &) { return scd.setMeasurementInterval(2); }
+        );
+    benchOp("setTemperatureOffset(), same", kReps,
+        [](Ptr &pScd, cScd30Sim &) { pScd->setConfigCache(false); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.setTemperatureOffset(scd.getInfo().TemperatureOffset); }
+        );
+    benchOp("setTemperatureOffset(), cached", kReps,
+        [](Ptr &pScd, cScd30Sim &) { pScd->setConfigCache(true); },
+        [](cSCD30 &scd, cScd30Sim &) { return scd.setTemperatureOffset(scd.getInfo().TemperatureOffset); }
+        );
+    }
+
+struct StartupScenario
+    {
+    const char *pName;
+    bool fFastStart;                /// use setFastStart()
+    bool fMeasuring;                /// sensor was left measuring
+    std::uint32_t phaseMs;          /// time since it started measuring
+    };
+
+// cold start: a new driver, and a sensor that's idle, or that has been
+// measuring for a while. Measure the time to the first measurement.
+static void benchStartup(const StartupScenario &scenario)
+    {
+    constexpr std::uint16_t kInterval = 30;
+    cScd30Sim::Config config = kDefaultConfig;
+
+    config.MeasurementInterval = kInterval;
+
+    cScd30Sim sim(config);
+    cSCD30 scd(sim);
+
+    if (scenario.fFastStart && scenario.fMeasuring)
+        {
+        sim.powerUpMeasuring();
+        ScdSim::sleep(std::uint64_t(scenario.phaseMs) * 1000);
+        }
+
+    if (scenario.fFastStart)
+        scd.setFastStart(true);
+
+    sim.clearStats();
+    auto const t0 = ScdSim::clock().tNow;
+    bool fResult = scd.begin();
+    auto const tBegin = ScdSim::clock().tNow;
+
+    if (fResult)
+        fResult = awaitMeasurement(scd);
+
+    auto const t1 = ScdSim::clock().tNow;
+    auto const s = sim.getStats();
+
+    // a sensor that was measuring keeps its cycle: its first reading
+    // is due when that cycle says, not one interval after a fast
+    // begin().
+    bool fLate = false;
+    if (scenario.fFastStart && scenario.fMeasuring)
+        {
+        constexpr std::uint64_t kSlackUs = 500 * 1000;
+        std::uint64_t const intervalUs = std::uint64_t(kInterval) * 1000 * 1000;
+        std::uint64_t const phaseUs = std::uint64_t(scenario.phaseMs) * 1000;
+        std::uint64_t const dueUs = phaseUs >= intervalUs
+                                        ? 0
+                                        : intervalUs - phaseUs;
+
+        fLate = t1 - t0 > dueUs + kSlackUs;
+        }
+
+    bool const fFailed = ! fResult || fLate || s.getViolations() != 0;
+
+    std::printf("%-36s %9.1f %9.1f %6u %6u %4u %s\n",
+        scenario.pName,
+        double(tBegin - t0) / 1000,
+        double(t1 - t0) / 1000,
+        unsigned(s.nWrites),
+        unsigned(s.nReads),
+        unsigned(s.getViolations()),
+        fFailed ? (fLate ? "FAILED (late)" : "FAILED") : ""
+        );
+
+    if (fFailed)
+        ++gFailures;
+    }
+
+static void benchStartups()
+    {
+    static const StartupScenario kScenarios[] =
+        {
+        { "idle sensor",                        false,  false,  0     },
+        { "idle sensor, fast start",            true,   false,  0     },
+        { "measuring, data due, fast start",    true,   true,   20000 },
+        { "measuring, data waiting",            false,  true,   35000 },
+        { "measuring, data waiting, fast start", true,  true,   35000 },
+        };
+
+    std::printf("\nfirst measurement after a cold begin(), 30 s interval:\n");
+    std::printf("%-36s %9s %9s %6s %6s %4s\n",
+        "scenario", "begin ms", "first ms", "writes", "reads", "viol"
+        );
+
+    for (auto const &scenario : kScenarios)
+        benchStartup(scenario);
+    }
+
+struct CycleScenario
+    {
+    const char *pName;
+    std::uint16_t interval;         /// seconds
+    std::int32_t driftPpm;          /// sensor clock error
+    bool fAsyncRead;                /// DMA-style transport
+    bool fDeepSleep;                /// sleep between measurements
+    };
+
+static void benchCycle(const CycleScenario &scenario)
+    {
+    constexpr unsigned kWarmup = 8;     // cycles to learn the cadence
+    constexpr unsigned kCycles = 64;    // cycles measured
+
+    auto config = kDefaultConfig;
+    config.MeasurementInterval = scenario.interval;
+    config.DriftPpm = scenario.driftPpm;
+    config.fAsyncRead = scenario.fAsyncRead;
+
+    cScd30Sim sim(config);
+    cSCD30 scd(sim);
+    cLoopModel loop(scd, scenario.fDeepSleep);
+
+    // the sensor remembers its interval; the driver just reads it.
+    if (! loop.begin())
+        {
+        std::printf("%-28s could not start sensor: %s\n", scenario.pName, scd.getLastErrorName());
+        ++gFailures;
+        return;
+        }
+
+    // stop if there are no measurements for ten intervals.
+    auto const tLimit = std::uint64_t(scenario.interval) * 10 * 1000000;
+    bool fStuck = false;
+
+    for (unsigned iCycle = 0; iCycle < kWarmup + kCycles && ! fStuck; ++iCycle)
+        {
+        if (iCycle == kWarmup)
+            {
+            sim.clearStats();
+            ScdSim::clock().tAwake = 0;
+            ScdSim::clock().tAsleep = 0;
+            }
+
+        auto const tCycle = ScdSim::clock().tNow;
+        while (! loop.loop())
+            {
+            if (ScdSim::clock().tNow - tCycle > tLimit)
+                {
+                fStuck = true;
+                break;
+                }
+            }
+        }
+
+    auto const s = sim.getStats();
+    auto const &c = ScdSim::clock();
+    bool const fFailed = fStuck || s.getViolations() != 0 || s.nMissed != 0 || loop.getErrors() != 0;
+
+    std::printf("%-28s %7.2f %7.1f %7.1f %9.1f %9.1f %8.1f %8.1f %4u %4u %s\n",
+        scenario.pName,
+        double(s.nWrites + s.nReads) / kCycles,
+        double(s.nBytes) / kCycles,
+        double(s.blockedUs) / kCycles / 1000.0,
+        double(c.tAwake) / kCycles / 1000.0,
+        double(c.tAsleep) / kCycles / 1000.0,
+        s.nMeasurements == 0 ? 0.0 : double(s.dataAgeUs) / s.nMeasurements / 1000.0,
+        double(s.maxDataAgeUs) / 1000.0,
+        s.nMissed,
+        s.getViolations(),
+        fFailed ? "FAILED" : ""
+        );
+
+    if (fFailed)
+        ++gFailures;
+    }
+
+static void benchCycles()
+    {
+    static const CycleScenario kScenarios[] =
+        {
+        { "2 s, no deep sleep",      2,      0, false, false },
+        { "30 s, deep sleep",       30,      0, false, true  },
+        { "30 s, sensor 2% slow",   30,  20000, false, true  },
+        { "30 s, sensor 2% fast",   30, -20000, false, true  },
+        { "30 s, background reads", 30,      0, true,  true  },
+        { "300 s, deep sleep",     300,      0, false, true  },
+        };
+
+    std::printf("\nper measurement cycle:\n");
+    std::printf("%-28s %7s %7s %7s %9s %9s %8s %8s %4s %4s\n",
+        "scenario", "xfers", "bytes", "blk ms", "awake ms", "sleep ms", "age ms", "max age", "miss", "viol"
+        );
+
+    for (auto const &scenario : kScenarios)
+        benchCycle(scenario);
+    }
+
+enum class Fault : std::uint8_t
+    {
+    Crc,                            /// one garbled measurement read
+    JammedBus,                      /// nothing acknowledged until the bus is recovered
+    WedgedSensor,                   /// no responses until a soft reset
+    };
+
+struct RecoveryScenario
+    {
+    const char *pName;
+    Fault fault;
+    bool fDeepSleep;                /// sleep between measurements
+    };
+
+static void benchRecovery(const RecoveryScenario &scenario)
+    {
+    constexpr unsigned kWarmup = 8;     // cycles before the fault
+    constexpr unsigned kCycles = 8;     // cycles after the fault
+    constexpr std::uint16_t kInterval = 30;
+
+    auto config = kDefaultConfig;
+    config.MeasurementInterval = kInterval;
+
+    cScd30Sim sim(config);
+    cSCD30 scd(sim);
+    cLoopModel loop(scd, scenario.fDeepSleep);
+
+    if (! loop.begin())
+        {
+        std::printf("%-28s could not start sensor: %s\n", scenario.pName, scd.getLastErrorName());
+        ++gFailures;
+        return;
+        }
+
+    auto const tLimit = std::uint64_t(kInterval) * 10 * 1000000;
+    bool fStuck = false;
+
+    for (unsigned iCycle = 0; iCycle < kWarmup + kCycles && ! fStuck; ++iCycle)
+        {
+        if (iCycle == kWarmup)
+            {
+            sim.clearStats();
+            switch (scenario.fault)
+                {
+            case Fault::Crc:            sim.corruptReads(1); break;
+            case Fault::JammedBus:      sim.jamBus(); break;
+            case Fault::WedgedSensor:   sim.wedge(); break;
+                }
+            }
+
+        auto const tCycle = ScdSim::clock().tNow;
+        while (! loop.loop())
+            {
+            if (ScdSim::clock().tNow - tCycle > tLimit)
+                {
+                fStuck = true;
+                break;
+                }
+            }
+        }
+
+    auto const s = sim.getStats();
+    bool const fRecovered =
+        scenario.fault == Fault::Crc          ? s.nFaults == 1 :
+        scenario.fault == Fault::JammedBus    ? s.nBusRecoveries != 0 :
+                                                s.nResets != 0;
+    bool const fFailed = fStuck || ! fRecovered || s.getViolations() != 0 ||
+                         s.nMissed != 0 || loop.getErrors() != 0;
+
+    std::printf("%-28s %6u %6u %6u %6u %4u %4u %s\n",
+        scenario.pName,
+        s.nFaults,
+        s.nBusRecoveries,
+        s.nResets,
+        s.nMeasurements,
+        s.nMissed,
+        s.getViolations(),
+        fFailed ? "FAILED" : ""
+        );
+
+    if (fFailed)
+        ++gFailures;
+    }
+
+static void benchRecoveries()
+    {
+    static const RecoveryScenario kScenarios[] =
+        {
+        { "bad CRC, no deep sleep",     Fault::Crc,             false },
+        { "bad CRC, deep sleep",        Fault::Crc,             true  },
+        { "jammed bus, deep sleep",     Fault::JammedBus,       true  },
+        { "wedged sensor, deep sleep",  Fault::WedgedSensor,    true  },
+        };
+
+    std::printf("\nerror recovery, 30 s interval:\n");
+    std::printf("%-28s %6s %6s %6s %6s %4s %4s\n",
+        "scenario", "faults", "busrec", "resets", "meas", "miss", "viol"
+        );
+
+    for (auto const &scenario : kScenarios)
+        benchRecovery(scenario);
+    }
+
+int main()
+    {
+    benchOps();
+    benchStartups();
+    benchCycles();
+    benchRecoveries();
+
+    if (gFailures != 0)
+        {
+        std::printf("\n%u benchmark(s) FAILED\n", gFailures);
+        return 1;
+        }
+
+    return 0;
+    }
@@ -20,22 +20,45 @@ Author:
 */
 
 #include "MCCI_Catena_SCD30.h"
+#include "MCCI_Catena_SCD30_History.h"
+#include "MCCI_Catena_SCD30_Summary.h"
+
+#include <cstddef>
+#include <cstring>
 
 using namespace McciCatenaScd30;
 
-bool cSCD30::begin()
+bool cSCD30::begin(cSCD30::ProductInfoField fields)
     {
-    // if no Wire is bound, fail.
-    if (this->m_wire == nullptr)
+    // if no bus is bound, fail.
+    if (this->m_pTransport == nullptr)
         return this->setLastError(Error::NoWire);
 
     if (this->isRunning())
         return true;
 
-    this->m_wire->begin();
+    if (! this->m_pTransport->begin())
+        return this->setLastError(Error::NoWire);
+
+    // if we have a snapshot, trust it and skip the discovery.
+    if (this->m_snapshotState != State::Uninitialized)
+        {
+        this->m_state = this->m_snapshotState;
+        this->m_snapshotState = State::Uninitialized;
+        return this->setLastError(Error::Success);
+        }
+
+    if (this->m_fFastStart)
+        return this->beginFast();
+
     // assume it's in idle state.
     this->m_state = this->m_state == State::End ? State::Triggered : State::Initial;
-    bool result = this->readProductInfo();
+    this->resetReadyEstimate();
+    // the sensor may have been reconfigured while we weren't looking.
+    this->m_infoValid = ProductInfoField::None;
+
+    // we always need the measurement interval to schedule the first read.
+    bool result = this->readProductInfo(fields | ProductInfoField::MeasurementInterval);
     if (result)
         {
         this->m_tReady = millis() + this->m_ProductInfo.MeasurementInterval * 1000;
@@ -57,34 +80,617 @@ void cSCD30::end()
         this->m_state = State::End;
     }
 
-bool cSCD30::readProductInfo()
+/*
+
+Name:	cSCD30::beginFast()
+
+Function:
+    Bring up the driver without the usual discovery.
+
+Definition:
+    bool cSCD30::beginFast();
+
+Description:
+    This is called by begin() in fast-start mode (see setFastStart()),
+    if there's no snapshot. The sensor keeps its settings, and whether
+    it's measuring, in non-volatile memory. So rather than reading the
+    product info, and allowing 500 ms in Initial before forcing a
+    start, we trust the settings and ask one question: is data ready?
+    If so, the sensor is measuring, and the driver goes straight to
+    Ready; the first measurement can be read at once. If not,
+    continuous measurement is started right away (this is harmless if
+    it was running). We can't tell an idle sensor from one that's
+    between measurements, and the latter keeps its own cycle; so
+    rather than waiting out an interval, the driver polls every
+    kReadyRetryMs until the first measurement arrives. Those polls
+    bracket the sensor's phase, so the cadence is learned from the
+    first reading on.
+
+    Only the measurement interval is needed, to schedule the reads.
+    It's read from the sensor unless it was given to setFastStart().
+    The rest of the product info isn't fetched; getConfigCacheValid()
+    shows which fields are known.
+
+Returns:
+    `true` for success. `false` if the sensor didn't answer; then the
+    last error is set, and the driver isn't running.
+
+*/
+
+bool cSCD30::beginFast()
+    {
+    bool result;
+    std::uint16_t flag = 0;
+
+    this->m_state = State::Initial;
+    this->resetReadyEstimate();
+    this->m_infoValid = ProductInfoField::None;
+
+    if (this->m_fastStartInterval != 0)
+        {
+        this->m_ProductInfo.MeasurementInterval = this->m_fastStartInterval;
+        result = true;
+        }
+    else
+        result = this->readProductInfo(ProductInfoField::MeasurementInterval);
+
+    if (result)
+        result = this->readDataReadyStatus(flag);
+
+    if (result)
+        {
+        if (flag)
+            {
+            // measuring, with data waiting: read it now.
+            this->m_state = State::Ready;
+            this->m_tReady = millis();
+            }
+        else
+            {
+            // idle, or between measurements: (re)start. A sensor that
+            // was measuring keeps its own cycle, so its next reading
+            // may be due well before one interval: poll for it.
+            result = this->startContinuousMeasurementCommon(this->m_pressure);
+            if (result)
+                this->m_tReady = millis() + kReadyRetryMs;
+            }
+        }
+
+    if (! result)
+        this->m_state = State::Uninitialized;
+
+    return result;
+    }
+
+/*
+
+Name:	cSCD30::exportSnapshot()
+
+Function:
+    Capture the driver's knowledge of the sensor for later use by begin().
+
+Definition:
+    bool cSCD30::exportSnapshot(
+        cSCD30::Snapshot &snapshot
+        ) const;
+
+Description:
+    The cached product info, the current state and the estimated
+    ready time are copied to `snapshot`, which is protected by a
+    CRC. The client can keep it anywhere (FRAM, backup RAM, ...),
+    and pass it to importSnapshot() before the next begin().
+
+    This can be called while running or after end().
+
+Returns:
+    `true` if the snapshot was filled in, `false` if begin() has never
+    succeeded (so there's nothing to save).
+
+*/
+
+bool cSCD30::exportSnapshot(cSCD30::Snapshot &snapshot) const
+    {
+    if (this->m_state == State::Uninitialized)
+        return false;
+
+    std::memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.Version = kSnapshotVersion;
+    snapshot.SavedState = this->m_state;
+    snapshot.nReadyObservations = this->m_nReadyObservations;
+    snapshot.nReadyLate = this->m_nReadyLate;
+    snapshot.tReady = this->m_tReady;
+    snapshot.tLastReady = this->m_tLastReady;
+    snapshot.ReadyPeriod16 = this->m_readyPeriod16;
+    snapshot.tPressure = this->m_tPressure;
+    snapshot.AmbientPressure = this->m_pressure;
+    snapshot.fPressure = this->m_fPressure;
+    snapshot.InfoValid = this->m_infoValid;
+    snapshot.Info = this->m_ProductInfo;
+    snapshot.Crc = crc((const std::uint8_t *)&snapshot, offsetof(Snapshot, Crc));
+    return true;
+    }
+
+/*
+
+Name:	cSCD30::importSnapshot()
+
+Function:
+    Restore a snapshot taken by exportSnapshot().
+
+Definition:
+    bool cSCD30::importSnapshot(
+        const cSCD30::Snapshot &snapshot
+        );
+
+Description:
+    The snapshot is checked, and if valid, the product info and ready
+    time are restored. The next begin() then skips reading the product
+    info from the sensor, and resumes in the saved state.
+
+    The ready time is in millis(), so it's only meaningful if millis()
+    is maintained across the sleep (as it is by the Catena platform's
+    Sleep() method). If it's in the past, the first queryReady() will just
+    ask the sensor.
+
+    The snapshot is only a hint; the client should discard it if the
+    sensor may have been power-cycled or reconfigured elsewhere.
+
+Returns:
+    `true` if the snapshot was accepted. `false` if the driver is running,
+    or if the snapshot has the wrong version, a bad CRC, or an invalid
+    state; in that case, the last error is set and the next begin() does
+    a full discovery.
+
+*/
+
+bool cSCD30::importSnapshot(const cSCD30::Snapshot &snapshot)
+    {
+    if (this->isRunning())
+        return this->setLastError(Error::InternalInvalidState);
+
+    this->m_snapshotState = State::Uninitialized;
+
+    if (snapshot.Version != kSnapshotVersion)
+        return this->setLastError(Error::InvalidParameter);
+
+    if (crc((const std::uint8_t *)&snapshot, offsetof(Snapshot, Crc)) != snapshot.Crc)
+        return this->setLastError(Error::Crc);
+
+    State savedState = snapshot.SavedState;
+    if (savedState == State::Uninitialized || savedState > State::Ready)
+        return this->setLastError(Error::InvalidParameter);
+
+    // a snapshot taken after end() means the sensor was left measuring;
+    // this matches what begin() assumes after end().
+    if (savedState == State::End)
+        savedState = State::Triggered;
+
+    this->m_ProductInfo = snapshot.Info;
+    this->m_infoValid = snapshot.InfoValid & ProductInfoField::All;
+    this->m_tReady = snapshot.tReady;
+    this->m_tLastReady = snapshot.tLastReady;
+    this->m_readyPeriod16 = snapshot.ReadyPeriod16;
+    this->m_tPressure = snapshot.tPressure;
+    this->m_pressure = snapshot.AmbientPressure;
+    this->m_fPressure = snapshot.fPressure;
+    this->m_nReadyObservations = snapshot.nReadyObservations;
+    this->m_nReadyLate = snapshot.nReadyLate > kReadyMaxLate ? kReadyMaxLate : snapshot.nReadyLate;
+    this->m_fLastBusy = false;
+    this->m_snapshotState = savedState;
+    return this->setLastError(Error::Success);
+    }
+
+bool cSCD30::readProductInfo(cSCD30::ProductInfoField fields)
+    {
+    if (! this->readProductInfoAsync(fields, nullptr, nullptr))
+        return false;
+
+    // see waitRequest().
+    if (this->m_fAsyncPolling && this->m_nInfoPending != 0)
+        return this->setLastError(Error::InternalInvalidState);
+
+    auto const tWait = this->statsStartWait();
+    while (this->m_nInfoPending != 0)
+        {
+        yield();
+        this->poll();
+        }
+    this->statsEndWait(tWait);
+
+    return this->setLastError(this->m_infoError);
+    }
+
+/*
+
+Name:	cSCD30::readProductInfoAsync()
+
+Function:
+    Fetch some or all of the product info from the sensor, without blocking.
+
+Definition:
+    bool cSCD30::readProductInfoAsync(
+        cSCD30::ProductInfoField fields,
+        cSCD30::AsyncDoneFn_t *pDoneFn,
+        void *pClientData
+        );
+
+Description:
+    The reads for each field selected by `fields` are queued to the
+    asynchronous engine together, and the method returns immediately.
+    The engine runs them back to back from poll(), with no client
+    involvement between reads. When the last one completes, the
+    fetched fields are copied into the cached product info (all
+    together, and only if every read succeeded), and pDoneFn (if not
+    nullptr) is called once.
+
+    Fields that are not selected keep their previously cached values;
+    so a client that knows nothing has changed (for example, on wake
+    from deep sleep) can fetch only the fields it actually needs.
+
+Returns:
+    `true` if the reads were started; `false` (with the last error set)
+    if the driver isn't running or a previous fetch is still pending.
+
+*/
+
+// the command for each field of ProductInfo, in the same order as
+// ProductInfoField. Except for the firmware version, the same command
+// reads the setting (without a parameter) or writes it (with one).
+static constexpr cSCD30::Command kInfoCommands[cSCD30::kProductInfoFields] =
+    {
+    cSCD30::Command::ReadFirmwareVersion,
+    cSCD30::Command::SetMeasurementInterval,
+    cSCD30::Command::EnableAutoSelfCal,
+    cSCD30::Command::SetForcedRecalibration,
+    cSCD30::Command::SetTemperatureOffset,
+    cSCD30::Command::AltitudeCompensation,
+    };
+
+bool cSCD30::readProductInfoAsync(
+    cSCD30::ProductInfoField fields,
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
     {
     if (! this->checkRunning())
         return false;
 
-    ProductInfo info;
-    if (! this->readFirmwareVersion(info.FirmwareVersion))
+    if (this->m_nInfoPending != 0)
+        return this->setLastError(Error::Busy);
+
+    fields = fields & ProductInfoField::All;
+
+    this->m_infoFields = fields;
+    this->m_infoError = Error::Success;
+    this->m_pInfoDoneFn = pDoneFn;
+    this->m_pInfoClientData = pClientData;
+
+    // count first, so that completions can't finish the batch early.
+    for (unsigned i = 0; i < kProductInfoFields; ++i)
+        {
+        if ((std::uint8_t(fields) & (1u << i)) != 0)
+            ++this->m_nInfoPending;
+        }
+
+    if (this->m_nInfoPending == 0)
+        {
+        // nothing to do: complete immediately.
+        if (pDoneFn != nullptr)
+            pDoneFn(pClientData, nullptr, true);
+        return this->setLastError(Error::Success);
+        }
+
+    for (unsigned i = 0; i < kProductInfoFields; ++i)
+        {
+        if ((std::uint8_t(fields) & (1u << i)) == 0)
+            continue;
+
+        auto &r = this->m_rqInfo[i];
+        this->initReadRequest(
+            r,
+            kInfoCommands[i],
+            this->m_infoBuffer[i].raw, sizeof(this->m_infoBuffer[i].raw),
+            readProductInfoDone, (void *)this
+            );
+
+        // this can only fail if the request is still pending, which
+        // m_nInfoPending rules out.
+        this->submitRequest(r);
+        }
+
+    return true;
+    }
+
+void cSCD30::readProductInfoDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cSCD30 *)pClientData;
+
+    if (! fSuccess && pThis->m_infoError == Error::Success)
+        pThis->m_infoError = pRequest->error;
+
+    if (--pThis->m_nInfoPending != 0)
+        return;
+
+    // the last one is done.
+    fSuccess = pThis->m_infoError == Error::Success;
+    if (fSuccess)
+        {
+        auto const fields = std::uint8_t(pThis->m_infoFields);
+        auto const buf = pThis->m_infoBuffer;
+        ProductInfo info = pThis->m_ProductInfo;
+
+        if (fields & std::uint8_t(ProductInfoField::FirmwareVersion))
+            buf[0].decode(info.FirmwareVersion);
+        if (fields & std::uint8_t(ProductInfoField::MeasurementInterval))
+            buf[1].decode(info.MeasurementInterval);
+        if (fields & std::uint8_t(ProductInfoField::ASC_status))
+            buf[2].decode(info.fASC_status);
+        if (fields & std::uint8_t(ProductInfoField::ForcedRecalibrationValue))
+            buf[3].decode(info.ForcedRecalibrationValue);
+        if (fields & std::uint8_t(ProductInfoField::TemperatureOffset))
+            buf[4].decode(info.TemperatureOffset);
+        if (fields & std::uint8_t(ProductInfoField::AltitudeCompensation))
+            buf[5].decode(info.AltitudeCompensation);
+
+        pThis->m_ProductInfo = info;
+        pThis->m_infoValid = pThis->m_infoValid | pThis->m_infoFields;
+        }
+
+    if (pThis->m_pInfoDoneFn != nullptr)
+        pThis->m_pInfoDoneFn(pThis->m_pInfoClientData, pRequest, fSuccess);
+    }
+
+/****************************************************************************\
+|
+|   Changing the sensor's settings
+|
+\****************************************************************************/
+
+bool cSCD30::applyConfig(const cSCD30::Config &config)
+    {
+    if (! this->applyConfigAsync(config, nullptr, nullptr))
+        return false;
+
+    // see waitRequest().
+    if (this->m_fAsyncPolling && this->m_fConfigPending)
+        return this->setLastError(Error::InternalInvalidState);
+
+    auto const tWait = this->statsStartWait();
+    while (this->m_fConfigPending)
+        {
+        yield();
+        this->poll();
+        }
+    this->statsEndWait(tWait);
+
+    return this->setLastError(this->m_configError);
+    }
+
+/*
+
+Name:	cSCD30::applyConfigAsync()
+
+Function:
+    Change several of the sensor's settings, without blocking.
+
+Definition:
+    bool cSCD30::applyConfigAsync(
+        const cSCD30::Config &config,
+        cSCD30::AsyncDoneFn_t *pDoneFn,
+        void *pClientData
+        );
+
+Description:
+    A write is queued for each setting selected by `config.fields`,
+    followed by a single readProductInfoAsync() of the same settings;
+    the engine runs them back to back from poll(), timing the
+    recovery after each write without blocking. When the readback
+    completes, the cached product info has been updated with what the
+    sensor actually reports (all together, and only if every read
+    succeeded). Then each setting is checked against the requested
+    value, and pDoneFn (if not nullptr) is called once.
+
+    The settings are read back even if a write fails, so that the
+    cache matches the sensor.
+
+    If the measurement interval is selected, the learned measurement
+    cadence is discarded.
+
+    If write avoidance is enabled (see setConfigCache()), a setting is
+    left out if the cached product info is known to match the sensor
+    (see getConfigCacheValid()) and already has the requested value;
+    this saves the write, its recovery time and the readback, and
+    wear on the sensor's non-volatile memory. If nothing is left, the
+    call completes immediately. Note that this also skips requests to
+    repeat a forced recalibration with the same reference value; call
+    invalidateConfigCache() first to force one.
+
+    If a write limit is set (see setConfigWriteLimit()), and the last
+    call that wrote anything was less than that long ago, the call
+    fails with Error::ConfigRateLimited.
+
+Returns:
+    `true` if the changes were started; `false` (with the last error
+    set) if the driver isn't running, if a value is out of range, if
+    the write limit applies, or if a previous change or product info
+    fetch is still pending.
+
+    The result passed to pDoneFn (and the last error) report the first
+    write or read that failed, or Error::SensorUpdateFailed if the
+    sensor didn't accept a value.
+
+*/
+
+bool cSCD30::applyConfigAsync(
+    const cSCD30::Config &config,
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    if (! this->checkRunning())
         return false;
 
-    if (! this->readMeasurementInterval(info.MeasurementInterval))
+    if (this->m_fConfigPending || this->m_nInfoPending != 0)
+        return this->setLastError(Error::Busy);
+
+    if (! checkConfig(config))
+        return this->setLastError(Error::InvalidParameter);
+
+    auto fields = std::uint8_t(config.fields);
+
+    // leave out the settings the sensor is known to have already.
+    if (this->m_fConfigCache)
+        {
+        for (unsigned i = 1; i < kProductInfoFields; ++i)
+            {
+            std::uint8_t const bit = 1u << i;
+
+            if ((fields & bit) != 0 &&
+                (std::uint8_t(this->m_infoValid) & bit) != 0 &&
+                getInfoWord(this->m_ProductInfo, i) == getInfoWord(config.Info, i))
+                {
+                fields &= ~bit;
+                this->statsCount(&Stats::nConfigSkipped);
+                }
+            }
+        }
+
+    if (fields == 0)
+        {
+        // nothing to do: complete immediately.
+        this->m_configError = Error::Success;
+        if (pDoneFn != nullptr)
+            pDoneFn(pClientData, nullptr, true);
+        return this->setLastError(Error::Success);
+        }
+
+    if (this->m_configWriteLimitMs != 0 && this->m_fConfigWritten &&
+        millis() - this->m_tConfigWrite < this->m_configWriteLimitMs)
+        return this->setLastError(Error::ConfigRateLimited);
+
+    this->m_config = config;
+    this->m_config.fields = ProductInfoField(fields);
+    this->m_tConfigWrite = millis();
+    this->m_fConfigWritten = true;
+    this->m_pConfigDoneFn = pDoneFn;
+    this->m_pConfigClientData = pClientData;
+    this->m_configError = Error::Success;
+    this->m_fConfigPending = true;
+
+    for (unsigned i = 1; i < kProductInfoFields; ++i)
+        {
+        if ((fields & (1u << i)) == 0)
+            continue;
+
+        auto &r = this->m_rqConfig[i];
+        this->initWriteRequest(r, kInfoCommands[i], getInfoWord(config.Info, i));
+        this->statsCount(&Stats::nConfigWrites);
+
+        // this can only fail if the request is still pending, which
+        // m_fConfigPending rules out.
+        this->submitRequest(r);
+        }
+
+    // the reads are queued behind the writes; applyConfigDone() is
+    // called when the last one finishes. This can't fail, because
+    // we checked m_nInfoPending above.
+    this->readProductInfoAsync(this->m_config.fields, applyConfigDone, (void *)this);
+    return true;
+    }
+
+// return true if every selected setting is in range.
+bool cSCD30::checkConfig(const cSCD30::Config &config)
+    {
+    auto const fields = std::uint8_t(config.fields);
+    auto const &info = config.Info;
+
+    if ((fields & ~std::uint8_t(ProductInfoField::All)) != 0 ||
+        (fields & std::uint8_t(ProductInfoField::FirmwareVersion)) != 0)
         return false;
 
-    if (! this->readAutoSelfCalibration(info.fASC_status))
+    if ((fields & std::uint8_t(ProductInfoField::MeasurementInterval)) &&
+        (info.MeasurementInterval < 2 || info.MeasurementInterval > 1800))
         return false;
 
-    if (! this->readForcedRecalibrationValue(info.ForcedRecalibrationValue))
+    if ((fields & std::uint8_t(ProductInfoField::ForcedRecalibrationValue)) &&
+        (info.ForcedRecalibrationValue < 400 || info.ForcedRecalibrationValue > 2000))
         return false;
 
-    if (! this->readTemperatureOffset(info.TemperatureOffset))
+    // the sensor takes these as unsigned values.
+    if ((fields & std::uint8_t(ProductInfoField::TemperatureOffset)) &&
+        info.TemperatureOffset < 0)
         return false;
 
-    if (! this->readAltitudeCompensation(info.AltitudeCompensation))
+    if ((fields & std::uint8_t(ProductInfoField::AltitudeCompensation)) &&
+        info.AltitudeCompensation < 0)
         return false;
 
-    this->m_ProductInfo = info;
     return true;
     }
 
+// return field iField of info, as sent to or read from the sensor.
+std::uint16_t cSCD30::getInfoWord(const cSCD30::ProductInfo &info, unsigned iField)
+    {
+    switch (iField)
+        {
+    case 0: return info.FirmwareVersion;
+    case 1: return info.MeasurementInterval;
+    case 2: return info.fASC_status != 0;
+    case 3: return info.ForcedRecalibrationValue;
+    case 4: return std::uint16_t(info.TemperatureOffset);
+    case 5: return std::uint16_t(info.AltitudeCompensation);
+    default: return 0;
+        }
+    }
+
+void cSCD30::applyConfigDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cSCD30 *)pClientData;
+    auto const fields = std::uint8_t(pThis->m_config.fields);
+    Error error = Error::Success;
+
+    // report the first write that failed...
+    for (unsigned i = 1; i < kProductInfoFields && error == Error::Success; ++i)
+        {
+        if ((fields & (1u << i)) != 0)
+            error = pThis->m_rqConfig[i].error;
+        }
+
+    // ... or the first read ...
+    if (error == Error::Success && ! fSuccess)
+        error = pThis->m_infoError;
+
+    // if the readback failed, we don't know what the sensor has.
+    if (! fSuccess)
+        pThis->m_infoValid = ProductInfoField(std::uint8_t(pThis->m_infoValid) & ~fields);
+
+    // ... or any setting the sensor didn't take.
+    for (unsigned i = 1; i < kProductInfoFields && error == Error::Success; ++i)
+        {
+        if ((fields & (1u << i)) != 0 &&
+            getInfoWord(pThis->m_ProductInfo, i) != getInfoWord(pThis->m_config.Info, i))
+            error = Error::SensorUpdateFailed;
+        }
+
+    if (fields & std::uint8_t(ProductInfoField::MeasurementInterval))
+        pThis->resetReadyEstimate();
+
+    pThis->m_configError = error;
+    pThis->m_fConfigPending = false;
+    pThis->setLastError(error);
+
+    if (pThis->m_pConfigDoneFn != nullptr)
+        pThis->m_pConfigDoneFn(pThis->m_pConfigClientData, pRequest, error == Error::Success);
+    }
+
 bool
 cSCD30::readFirmwareVersion(
     std::uint16_t &version
@@ -122,15 +728,7 @@ cSCD30::readTemperatureOffset(
     std::int16_t &offsetCentiCel
     )
     {
-    std::uint16_t nonce;
-    bool result;
-
-    result = this->readUint16(Command::SetTemperatureOffset, nonce);
-
-    // no need to check result; readUint16 sets nonce to zero on error.
-    offsetCentiCel = (std::int16_t) nonce;
-
-    return result;
+    return this->readWords(Command::SetTemperatureOffset, offsetCentiCel);
     }
 
 bool
@@ -138,15 +736,7 @@ cSCD30::readAltitudeCompensation(
     std::int16_t &meters
     )
     {
-    std::uint16_t nonce;
-    bool result;
-
-    result = this->readUint16(Command::AltitudeCompensation, nonce);
-
-    // no need to check result; readUint16 sets nonce to zero on error.
-    meters = (std::int16_t) nonce;
-
-    return result;
+    return this->readWords(Command::AltitudeCompensation, meters);
     }
 
 bool
@@ -160,22 +750,30 @@ cSCD30::readDataReadyStatus(
 
 /*
 
-Name:	cSCD30::readUint16()
+Name:	cSCD30::readWords()
 
 Function:
-    Read a uint16_t from an SCD30 sensor.
+    Read a typed value from an SCD30 sensor.
 
 Definition:
-    bool cSCD30::readUint16(
+    template <typename T>
+    bool cSCD30::readWords(
         cSCD30::Command cmd,
-        std::uint16_t &value
+        T &value
         );
 
 Description:
     The given command is issued to the sensor. If successful, the method
-    delays 3 milliseconds, then reads 3 bytes, checking CRC. If further
-    successful, the method interprets the value read as a big-endian
-    16-bit value.
+    waits 3 milliseconds, then reads the tSCD30WordLayout<T>::kWords
+    words of the response, checking the CRCs and packing the words in
+    the same pass. If further successful, the value is decoded from
+    the packed words by tSCD30WordLayout<T>::decode().
+
+    The buffer is sized for T at compile time. Responses longer than
+    the transport can read at once are read in several pieces.
+
+    This is a blocking wrapper around the asynchronous engine; other
+    queued requests are processed while waiting.
 
 Returns:
     This function returns `true` if the value was successfully
@@ -183,95 +781,111 @@ Returns:
     code appropriately.
 
 Notes:
-    If an error occurs, the value is set to zero.
+    If an error occurs, the value is value-initialized (zero).
 
 */
 
+template <typename T>
 bool
-cSCD30::readUint16(
+cSCD30::readWords(
     cSCD30::Command cmd,
-    std::uint16_t &value
+    T &value
     )
     {
-    bool result;
-    std::uint8_t buf[3];
-
-    result = this->checkRunning();
-
-    if (result)
-        result = this->writeCommand(cmd);
+    tSCD30ResponseFor<T> buf;
+    AsyncRequest request;
 
-    if (result)
-        {
-        delay(this->kReadDelayMs);
-
-        result = this->readResponse(buf, sizeof(buf));
-        }
+    this->initReadRequest(request, cmd, buf.raw, sizeof(buf.raw));
+    bool const result = this->runRequest(request);
 
     if (result)
-        {
-        value = this->getUint16BE(buf);
-        }
+        buf.decode(value);
     else
-        {
-        value = 0;
-        }
+        value = T {};
 
     return result;
     }
 
-bool cSCD30::setMeasurementInterval(std::uint16_t interval)
-    {
-    if (interval < 2)
-        return this->setLastError(Error::InvalidParameter);
+/*
 
-    if (! this->checkRunning())
-        return false;
+Name:	cSCD30::readUint16()
 
-    bool result;
+Function:
+    Read a uint16_t from an SCD30 sensor.
 
-    // issue the command
-    result = this->writeCommand(Command::SetMeasurementInterval, interval);
+Definition:
+    bool cSCD30::readUint16(
+        cSCD30::Command cmd,
+        std::uint16_t &value
+        );
 
-    if (result)
-        {
-        delay(this->kCommandRecoveryMs);
+Description:
+    The given command is issued to the sensor, and its one-word
+    response is read with readWords().
 
-        std::uint16_t nonce;
-        result = this->readMeasurementInterval(nonce);
-        if (result)
-            {
-            // always update the idea of the measurement interval, no matter what.
-            this->m_ProductInfo.MeasurementInterval = nonce;
+Returns:
+    This function returns `true` if the value was successfully
+    fetched. Otherwise, it returns `false` and sets the last error
+    code appropriately.
 
-            // but if it doesn't match, report an error.
-            if (nonce != interval)
-                result = this->setLastError(Error::SensorUpdateFailed);
-            }
-        }
+Notes:
+    If an error occurs, the value is set to zero.
 
-    return result;
+*/
+
+bool
+cSCD30::readUint16(
+    cSCD30::Command cmd,
+    std::uint16_t &value
+    )
+    {
+    return this->readWords(cmd, value);
+    }
+
+// the single-setting methods are one-field configuration changes.
+bool cSCD30::setMeasurementInterval(std::uint16_t interval)
+    {
+    Config config {};
+
+    config.fields = ProductInfoField::MeasurementInterval;
+    config.Info.MeasurementInterval = interval;
+    return this->applyConfig(config);
     }
 
 bool cSCD30::activateAutomaticSelfCalbration(bool fEnableIfTrue)
     {
-    bool result = this->checkRunning();
-    if (result)
-        {
-        result = this->writeCommand(Command::EnableAutoSelfCal, fEnableIfTrue);
-        }
-    if (result)
-        {
-        delay(this->kCommandRecoveryMs);
+    Config config {};
 
-        std::uint16_t nonce;
-        result = this->readAutoSelfCalibration(nonce);
-        if (result)
-            this->m_ProductInfo.fASC_status = nonce;
-        if (!fEnableIfTrue != !nonce)
-            result = this->setLastError(Error::SensorUpdateFailed);
-        }
-    return result;
+    config.fields = ProductInfoField::ASC_status;
+    config.Info.fASC_status = fEnableIfTrue;
+    return this->applyConfig(config);
+    }
+
+bool cSCD30::setForcedRecalibrationValue(std::uint16_t CO2ppm)
+    {
+    Config config {};
+
+    config.fields = ProductInfoField::ForcedRecalibrationValue;
+    config.Info.ForcedRecalibrationValue = CO2ppm;
+    return this->applyConfig(config);
+    }
+
+bool cSCD30::setTemperatureOffset(std::int16_t offset_centidegrees_C)
+    {
+    Config config {};
+
+    config.fields = ProductInfoField::TemperatureOffset;
+    config.Info.TemperatureOffset = offset_centidegrees_C;
+    return this->applyConfig(config);
+    }
+
+bool cSCD30::setAltitudeCompensation(std::int16_t meters)
+    {
+    Config config {};
+
+    config.fields = ProductInfoField::AltitudeCompensation;
+    config.Info.AltitudeCompensation = meters;
+    return this->applyConfig(config);
     }
 
 bool cSCD30::writeCommand(cSCD30::Command command)
@@ -296,48 +910,88 @@ bool cSCD30::writeCommand(cSCD30::Command command, std::uint16_t param)
 
 bool cSCD30::writeCommandBuffer(const std::uint8_t *pBuffer, size_t nBuffer)
     {
-    this->m_wire->beginTransmission(std::uint8_t(this->m_address));
-    if (this->m_wire->write(pBuffer, nBuffer) != nBuffer)
-        return this->setLastError(Error::CommandWriteBufferFailed);
-    if (this->m_wire->endTransmission() != 0)
-        return this->setLastError(Error::CommandWriteFailed);
-
-    return true;
+    return this->setTransportError(
+        this->m_pTransport->write(std::uint8_t(this->m_address), pBuffer, nBuffer)
+        );
     }
 
-bool cSCD30::readResponse(std::uint8_t *buf, size_t nBuf)
+// start reading the response to the active request.
+bool cSCD30::startResponse(cSCD30::AsyncRequest &r)
     {
-    bool ok;
-    unsigned nResult;
-    const std::int8_t addr = this->getAddress();
-    uint8_t nReadFrom;
-
-    if (buf == nullptr || nBuf > 30 || addr < 0 ||
-        ((011111111111u >> nBuf) & 1u) == 0 /* not a multiple of 3 */)
+    if (r.pResponse == nullptr || this->getAddress() < 0 ||
+        r.nResponse % 3 != 0 || this->m_pTransport->getMaxRead() < 3)
         {
         return this->setLastError(Error::InternalInvalidParameter);
         }
 
-    nReadFrom = this->m_wire->requestFrom(std::uint8_t(addr), /* bytes */ std::uint8_t(nBuf));
+    r.nRead = 0;
+    return this->startResponseChunk(r);
+    }
+
+// size of the next piece of the response: as much as the transport can
+// read at once, in whole words.
+std::size_t cSCD30::getResponseChunk(const cSCD30::AsyncRequest &r) const
+    {
+    std::size_t const nMax = this->m_pTransport->getMaxRead() / 3 * 3;
+    std::size_t const nLeft = r.nResponse - r.nRead;
+
+    return nLeft < nMax ? nLeft : nMax;
+    }
+
+// start reading the next piece of the response. Each read continues
+// where the last one stopped; the CRCs are checked once all are done.
+bool cSCD30::startResponseChunk(cSCD30::AsyncRequest &r)
+    {
+    // the status is picked up by pollRead(), even if the transport
+    // has already finished.
+    this->statsCountTransaction(r.command);
+    (void) this->m_pTransport->startRead(
+        std::uint8_t(this->getAddress()),
+        r.pResponse + r.nRead,
+        this->getResponseChunk(r)
+        );
+    return true;
+    }
 
-    if (nReadFrom != nBuf)
+// the response has been read; check it.
+bool cSCD30::finishResponse(cSCD30::AsyncRequest &r)
+    {
+    // check the CRC on each 3-byte tuple, packing the words into the
+    // front of the buffer at the same time.
+    if (! Crc8::packWords(r.pResponse, r.nResponse))
         {
-        return this->setLastError(Error::I2cReadRequest);
+        this->statsCount(&Stats::nCrcErrors);
+        return this->setLastError(Error::Crc);
         }
-    nResult = this->m_wire->available();
-    if (nResult > nBuf)
-        return this->setLastError(Error::I2cReadLong);
 
-    for (unsigned i = 0; i < nResult; ++i)
-        buf[i] = this->m_wire->read();
+    return true;
+    }
+
+// convert a transport status to an error; return true for success.
+bool cSCD30::setTransportError(cSCD30Transport::Status status)
+    {
+    using Status = cSCD30Transport::Status;
 
-    if (nResult != nBuf)
+    switch (status)
         {
+    case Status::Success:
+        return true;
+    case Status::Busy:
+        return this->setLastError(Error::Busy);
+    case Status::WriteBufferFailed:
+        return this->setLastError(Error::CommandWriteBufferFailed);
+    case Status::WriteFailed:
+        return this->setLastError(Error::CommandWriteFailed);
+    case Status::ReadShort:
+        this->statsCount(&Stats::nReadShort);
         return this->setLastError(Error::I2cReadShort);
+    case Status::ReadLong:
+        return this->setLastError(Error::I2cReadLong);
+    case Status::ReadRequestFailed:
+    default:
+        this->statsCount(&Stats::nReadRequest);
+        return this->setLastError(Error::I2cReadRequest);
         }
-
-    // finally, check the CRC on each 3-byte tuple
-    return this->crc_multi(buf, nBuf);
     }
 
 bool cSCD30::startContinuousMeasurementCommon(std::uint16_t param)
@@ -345,225 +999,2018 @@ bool cSCD30::startContinuousMeasurementCommon(std::uint16_t param)
     if (! this->checkRunning())
         return false;
 
-    bool result = this->writeCommand(Command::StartContinuousMeasurement);
+    AsyncRequest request;
+
+    this->initWriteRequest(request, Command::StartContinuousMeasurement, param);
+    bool result = this->runRequest(request);
 
     if (result)
         {
-        delay(this->kCommandRecoveryMs);
-
-        this->m_state = State::Triggered;
-        this->m_tReady = millis() + this->m_ProductInfo.MeasurementInterval * 1000;
+        this->notePressureSent(param);
+        this->noteMeasurementStarted();
         }
 
     return result;
     }
 
-bool cSCD30::queryReady(bool &fError)
+/*
+
+Name:	cSCD30::stopMeasurement()
+
+Function:
+    Stop continuous measurements.
+
+Definition:
+    bool cSCD30::stopMeasurement();
+
+Description:
+    StopContinuosMeasurement is sent, and the driver goes to idle. Any
+    burst in progress is abandoned. The sensor keeps this setting in
+    non-volatile memory, so it stays idle through a reset; measurements
+    are restarted with startContinuousMeasurement() or startBurst().
+
+Returns:
+    `true` for success, `false` (with the last error set) for failure.
+
+*/
+
+bool cSCD30::stopMeasurement()
     {
-    if (! checkRunning())
-        {
-        fError = true;
+    if (! this->checkRunning())
         return false;
-        }
 
-    if (this->m_state == State::Ready)
-        {
-        fError = false;
-        return true;
-        }
+    AsyncRequest request;
 
-    if (this->m_state == State::Idle)
-        {
-        fError = true;
-        return this->setLastError(Error::NotMeasuring);
-        }
+    this->initWriteRequest(request, Command::StopContinuosMeasurement);
+    bool result = this->runRequest(request);
 
-    if ((std::int32_t)(millis() - this->m_tReady) < 0)
+    if (result)
         {
-        fError = false;
-        return this->setLastError(Error::Busy);
+        this->m_state = State::Idle;
+        this->m_fBurst = false;
+        // the next start begins a new cycle.
+        this->resetReadyEstimate();
         }
 
-    if (this->m_state == State::Triggered ||
-        this->m_state == State::Initial)
-        {
-        std::uint16_t flag;
+    return result;
+    }
 
-        if (! this->readDataReadyStatus(flag))
-            {
-            // could not read data-ready status
-            fError = true;
-            this->m_tReady = millis() + 1000;
-            return false;
-            }
+/*
 
-        if (flag)
-            {
-            // observe that there's data available
-            this->m_state = State::Ready;
-            fError = false;
-            return true;
-            }
-        else if (this->m_state == State::Initial)
-            {
-            // send the start command
-            if (! this->startContinuousMeasurement())
-                {
-                // start command failed.
-                fError = true;
-                this->m_tReady = millis() + 1000;
-                return false;
-                }
+Name:	cSCD30::startBurst()
 
-            // need to wait.
-            fError = false; // no error
-            return this->setLastError(Error::Busy);   // but not ready.
-            }
-        else
-            {
-            fError = false;
-            this->m_tReady = millis() + 100;
-            return this->setLastError(Error::Busy);   // but not ready.
-            }
-        }
+Function:
+    Start collecting a burst of measurements.
 
-    // we've observed data
-    if (this->m_state == State::Ready)
-        {
-        fError = false;
-        return true;
-        }
+Definition:
+    bool cSCD30::startBurst(
+        const cSCD30::BurstConfig &config
+        );
 
-    // internal error
-    fError = true;
-    return this->setLastError(Error::InternalInvalidState);
-    }
+Description:
+    For long reporting intervals, it's cheaper to stop the sensor
+    between reports, and take a short burst of readings when one is
+    needed. The first config.nSettle readings of the burst are
+    discarded while the sensor settles; the next config.nSamples are
+    combined, channel by channel, as config.Combine says.
+
+    The measurement interval is changed to config.Interval, if it's
+    not already that; the sensor keeps it in non-volatile memory, so
+    this normally happens once. If the sensor is idle, measurements
+    are started, with the ambient pressure last given to
+    setAmbientPressure().
+
+    Readings are then taken as usual, with readMeasurement() or
+    readMeasurementAsync(). While isBurstActive() is true, each
+    reading updates getMeasurement() but isn't added to the history.
+    After the last one, isBurstActive() is false, getMeasurement() and
+    getFixedMeasurement() return the combined result, and it's added
+    to the history. The sensor keeps measuring; call
+    stopMeasurement() to stop it until the next burst.
 
-bool cSCD30::readMeasurement()
+Returns:
+    `true` if the burst was started; `false` (with the last error set)
+    if the config is out of range, or the sensor couldn't be set up.
+
+*/
+
+bool cSCD30::startBurst(const cSCD30::BurstConfig &config)
     {
-    bool fNonce;
-    if (! this->queryReady(fNonce))
-        return false;
+    if (config.nSamples == 0 || config.nSamples > kMaxBurstSamples)
+        return this->setLastError(Error::InvalidParameter);
 
-    if (! this->writeCommand(Command::ReadMeasurement))
+    if (! this->checkRunning())
         return false;
 
-    this->m_state = State::Triggered;
-    this->m_tReady = millis() + this->m_ProductInfo.MeasurementInterval * 1000;
-    delay(3);
-
-    std::uint8_t measurementBuffer[(4 + 2) * 3];
-    bool result = this->readResponse(measurementBuffer, sizeof(measurementBuffer));
+    this->m_fBurst = false;
 
-    if (result)
-        {
-        Measurement m;
-        m.CO2ppm = getFloat32BE(&measurementBuffer[0]);
-        m.Temperature = getFloat32BE(&measurementBuffer[6]);
-        m.RelativeHumidity = getFloat32BE(&measurementBuffer[12]);
+    if (this->m_ProductInfo.MeasurementInterval != config.Interval &&
+        ! this->setMeasurementInterval(config.Interval))
+        return false;
 
-        this->m_Measurement = m;
-        }
+    if (this->m_state == State::Idle &&
+        ! this->startContinuousMeasurementCommon(this->m_pressure))
+        return false;
 
-    return result;
+    this->m_burst = config;
+    this->m_nBurstRead = 0;
+    this->m_fBurst = true;
+    return this->setLastError(Error::Success);
     }
 
-std::uint8_t cSCD30::crc(const std::uint8_t * buf, size_t nBuf, std::uint8_t crc8)
+// the sensor has accepted an ambient pressure (or 0 for none). Only a
+// real pressure starts the minimum interval: the first reading after
+// running without compensation is sent straight away.
+void cSCD30::notePressureSent(std::uint16_t pressure_mBar)
     {
-    /* see cSHT3x CRC-8-Calc.md for a little info on this */
-    static const std::uint8_t crcTable[16] =
-        {
-        0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5, 0xa6, 0x97,
-        0xb9, 0x88, 0xdb, 0xea, 0x7d, 0x4c, 0x1f, 0x2e,
-        };
+    this->m_pressure = pressure_mBar;
+    this->m_tPressure = millis();
+    this->m_fPressure = pressure_mBar != 0;
+    }
 
-    for (size_t i = nBuf; i > 0; --i, ++buf)
-        {
-        uint8_t b, p;
+/*
 
-        // calculate first nibble
-        b = *buf;
-        p = (b ^ crc8) >> 4;
-        crc8 = (crc8 << 4) ^ crcTable[p];
+Name:	cSCD30::setAmbientPressure()
 
-        // calculate second nibble
-        // this could be written as:
-        //      b <<= 4;
-        //      p = (b ^ crc8) >> 4;
-        // but it's more effective as:
-        p = ((crc8 >> 4) ^ b) & 0xF;
-        crc8 = (crc8 << 4) ^ crcTable[p];
-        }
+Function:
+    Feed a barometer reading to the sensor's pressure compensation.
 
-    return crc8;
-    }
+Definition:
+    bool cSCD30::setAmbientPressure(
+        std::uint16_t pressure_mBar
+        );
+
+Description:
+    The SCD30 compensates its CO2 readings for the ambient pressure
+    given with StartContinuousMeasurement. This is meant to be called
+    with each new barometer reading; it only resends the command if
+    the reading differs from the pressure in use by at least the
+    threshold, and at least the minimum interval has passed since the
+    last update (see setPressureGate()). Otherwise there is no bus
+    traffic at all; since readings are expected regularly, a change
+    that's held back is sent with a later reading. The interval
+    doesn't apply to the first reading while compensation is off
+    (as it is after startup, or a restart with no pressure), so
+    that's sent at once.
+
+    The command is queued to the asynchronous engine, and the method
+    returns immediately. Resending the command doesn't restart the
+    measurement cycle, so the learned cadence is kept.
+
+    If the sensor isn't measuring, the reading is just recorded; it is
+    used when the driver next starts measurements itself. Zero turns
+    compensation off.
+
+Returns:
+    `true` if the reading was accepted (whether or not it was sent);
+    `false` if it's not zero or in [700..1400], or if the driver isn't
+    running.
+
+*/
 
-bool cSCD30::crc_multi(const std::uint8_t *buf, size_t nbuf)
+bool cSCD30::setAmbientPressure(std::uint16_t pressure_mBar)
     {
-    if (buf == nullptr)
-        return this->setLastError(Error::InternalInvalidParameter);
+    if (pressure_mBar != 0 && (pressure_mBar < 700 || pressure_mBar > 1400))
+        return this->setLastError(Error::InvalidParameter);
+
+    if (! this->checkRunning())
+        return false;
 
-    for (; nbuf >= 3; buf += 3, nbuf -= 3)
+    if (! (this->m_state == State::Triggered || this->m_state == State::Ready))
         {
-        if (this->crc(buf, 2) != buf[2])
-            return this->setLastError(Error::Crc);
+        this->m_pressure = pressure_mBar;
+        return true;
         }
 
-    if (nbuf != 0)
-        return this->setLastError(Error::InternalInvalidParameter);
+    // an update is in progress; that's enough for now.
+    if (this->m_rqPressure.fPending)
+        return true;
 
-    return true;
-    }
+    std::uint16_t const delta = pressure_mBar > this->m_pressure ? pressure_mBar - this->m_pressure
+                                                                 : this->m_pressure - pressure_mBar
+                                                                 ;
+    if (delta == 0 || delta < this->m_pressureThreshold)
+        return true;
 
-static const char *scanMultiSzString(const char *p, unsigned eIndex)
-    {
-    // iterate based on error index.
-    for (; eIndex > 0; --eIndex)
-        {
-        // stop when we get to empty string
-        if (*p == '\0')
-            break;
-        // otherwise, skip this one.
-        p += strlen(p) + 1;
-        }
+    if (this->m_fPressure &&
+        std::uint32_t(millis() - this->m_tPressure) < this->m_pressureMinIntervalMs)
+        return true;
 
-    // if we have a valid string, return it
-    if (*p != '\0')
-        return p;
-    // otherwise indicate that the input wasn't valid.
-    else
-        return "<<unknown>>";
+    this->initWriteRequest(
+        this->m_rqPressure,
+        Command::StartContinuousMeasurement,
+        pressure_mBar,
+        setAmbientPressureDone, (void *)this
+        );
+
+    return this->submitRequest(this->m_rqPressure);
     }
 
-const char * cSCD30::getErrorName(cSCD30::Error e)
+void cSCD30::setAmbientPressureDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
     {
-    return scanMultiSzString(m_szErrorMessages, unsigned(e));
+    auto const pThis = (cSCD30 *)pClientData;
+
+    // if it failed, the sensor still has the old value; try again with
+    // the next reading.
+    if (fSuccess)
+        pThis->notePressureSent(pRequest->param);
     }
 
-const char * cSCD30::getStateName(cSCD30::State s)
+// the sensor has accepted StartContinuousMeasurement.
+void cSCD30::noteMeasurementStarted()
     {
-    return scanMultiSzString(m_szStateNames, unsigned(s));
+    this->m_state = State::Triggered;
+    this->m_nFailures = 0;
+    // the sensor restarts its measurement cycle.
+    this->resetReadyEstimate();
+    this->m_tReady = millis() + this->m_ProductInfo.MeasurementInterval * 1000;
+    // and its first readings need to be filtered again.
+    this->restartFilter();
     }
 
-float cSCD30::getFloat32BE(const std::uint8_t *p)
+bool cSCD30::queryReady(bool &fError)
     {
-    union
+    bool result;
+
+    if (! this->queryReadyFast(result, fError))
         {
-        std::uint32_t uint;
-        float f;
-        } v;
+        if (! result && ! fError)
+            this->statsCount(&Stats::nReadyBusy);
+        return result;
+        }
 
-    // collect the 32-bit value, skipping CRC
-    v.uint = (p[0] << 24) | (p[1] << 16) | (p[3] << 8) | (p[4] << 0);
+    std::uint16_t flag;
+    bool fRead;
 
-    // filter out NAN.
-    if ((v.uint & 0x7F800000u) == 0x7F800000u)
-        return 0.0f;            // map NANs to zero.
+    // a garbled response is retried right away.
+    while (! (fRead = this->readDataReadyStatus(flag)) &&
+           this->noteFailure(this->m_lastError))
+        /* retry */;
 
-    // eliminate denormalized numbers
-    if ((v.uint & 0x7F800000u) == 0u)
-        v.uint &= 0xFF800000u;  // map denorms to +/- zero.
+    if (! fRead)
+        {
+        // could not read data-ready status; noteFailure() has
+        // scheduled the next attempt.
+        fError = true;
+        return false;
+        }
 
-    // return the value interpreted as a float.
-    return v.f;
+    if (this->updateDataReady(flag))
+        {
+        fError = false;
+        return true;
+        }
+    else if (this->m_state == State::Initial)
+        {
+        bool fStarted;
+
+        // send the start command
+        while (! (fStarted = this->startContinuousMeasurementCommon(this->m_pressure)) &&
+               this->noteFailure(this->m_lastError))
+            /* retry */;
+
+        if (! fStarted)
+            {
+            // start command failed.
+            fError = true;
+            return false;
+            }
+
+        // need to wait.
+        fError = false; // no error
+        this->statsCount(&Stats::nReadyBusy);
+        return this->setLastError(Error::Busy);   // but not ready.
+        }
+    else
+        {
+        fError = false;
+        this->statsCount(&Stats::nReadyBusy);
+        return this->setLastError(Error::Busy);   // but not ready.
+        }
+    }
+
+/*
+
+Name:	cSCD30::queryReadyFast()
+
+Function:
+    Answer queryReady() without using the bus, if possible.
+
+Definition:
+    bool cSCD30::queryReadyFast(
+        bool &fResult,
+        bool &fError
+        );
+
+Description:
+    This does all the checks in queryReady() that don't require
+    talking to the sensor.
+
+Returns:
+    `true` if the sensor must be asked (with GetDataReady). Otherwise
+    `false`, and fResult and fError are set to the values for queryReady()
+    to return.
+
+*/
+
+bool cSCD30::queryReadyFast(bool &fResult, bool &fError)
+    {
+    fResult = false;
+
+    if (! checkRunning())
+        {
+        fError = true;
+        return false;
+        }
+
+    if (this->m_state == State::Ready)
+        {
+        fError = false;
+        fResult = true;
+        return false;
+        }
+
+    if (this->m_state == State::Idle)
+        {
+        fError = true;
+        this->setLastError(Error::NotMeasuring);
+        return false;
+        }
+
+    if (this->m_state != State::Triggered &&
+        this->m_state != State::Initial)
+        {
+        // internal error
+        fError = true;
+        this->setLastError(Error::InternalInvalidState);
+        return false;
+        }
+
+    // if using the RDY interrupt, we don't need to ask the sensor...
+    if (this->m_state == State::Triggered && this->isReadyInterruptEnabled())
+        {
+        if (this->queryReadyPin())
+            {
+            fError = false;
+            fResult = true;
+            return false;
+            }
+
+        // ...unless the edge is very late, in which case we might have
+        // missed it; then fall through and ask the sensor.
+        std::uint32_t const tGrace = this->m_ProductInfo.MeasurementInterval * (1000u / 16u) + 1000u;
+        if ((std::int32_t)(millis() - (this->m_tReady + tGrace)) < 0)
+            {
+            fError = false;
+            this->setLastError(Error::Busy);
+            return false;
+            }
+        }
+
+    if ((std::int32_t)(millis() - this->m_tReady) < 0)
+        {
+        fError = false;
+        this->setLastError(Error::Busy);
+        return false;
+        }
+
+    return true;
+    }
+
+// record the result of GetDataReady; return true if data is ready.
+bool cSCD30::updateDataReady(std::uint16_t flag)
+    {
+    auto const now = millis();
+
+    if (flag)
+        {
+        // observe that there's data available
+
+        // if we saw "not ready" shortly before, we know (roughly)
+        // when the transition happened. Otherwise, we were late;
+        // poll earlier next time.
+        if (this->m_state == State::Triggered)
+            {
+            if (this->m_fLastBusy && now - this->m_tLastBusy <= kReadyBracketMs)
+                {
+                this->observeReady(now - (now - this->m_tLastBusy) / 2);
+                if (this->m_nReadyLate != 0)
+                    --this->m_nReadyLate;
+                }
+            else
+                {
+                if (this->m_nReadyObservations > 1)
+                    this->m_nReadyObservations = 1;
+                if (this->m_nReadyLate < kReadyMaxLate)
+                    ++this->m_nReadyLate;
+                }
+            }
+
+        this->m_fLastBusy = false;
+        this->m_fReadyEdge = false;
+        this->m_state = State::Ready;
+        return true;
+        }
+    else
+        {
+        if (this->m_state == State::Triggered)
+            {
+            this->m_tLastBusy = now;
+            this->m_fLastBusy = true;
+            this->m_tReady = now + this->getReadyRetryMs();
+            }
+        return false;
+        }
+    }
+
+/*
+
+Name:	cSCD30::queryReadyAsync()
+
+Function:
+    Start the bus part of queryReady(), without blocking.
+
+Definition:
+    bool cSCD30::queryReadyAsync(
+        cSCD30::AsyncDoneFn_t *pDoneFn,
+        void *pClientData
+        );
+
+Description:
+    If queryReady() would need to ask the sensor whether data is
+    ready, this queues the GetDataReady request (and, if needed, the
+    StartContinuousMeasurement command that follows it in the Initial
+    state) to the asynchronous engine, and returns immediately. When
+    that finishes, pDoneFn (if not nullptr) is called; fSuccess is
+    false if the sensor couldn't be reached.
+
+    Either way, the caller then uses queryReady() to get the answer,
+    which will not need the bus.
+
+Returns:
+    `true` if a request was started (and pDoneFn will be called);
+    `false` if no bus transaction is needed (or one is already
+    pending), in which case pDoneFn is not called.
+
+*/
+
+bool cSCD30::queryReadyAsync(
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    bool fResult, fError;
+
+    if (this->m_rqDataReady.fPending || this->m_rqStart.fPending)
+        return this->setLastError(Error::Busy);
+
+    if (! this->queryReadyFast(fResult, fError))
+        return false;
+
+    this->m_pReadyDoneFn = pDoneFn;
+    this->m_pReadyClientData = pClientData;
+    this->initReadRequest(
+        this->m_rqDataReady,
+        Command::GetDataReady,
+        this->m_dataReadyBuffer.raw, sizeof(this->m_dataReadyBuffer.raw),
+        queryReadyDone, (void *)this
+        );
+
+    return this->submitRequest(this->m_rqDataReady);
+    }
+
+void cSCD30::queryReadyDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cSCD30 *)pClientData;
+
+    if (pRequest == &pThis->m_rqStart)
+        {
+        // StartContinuousMeasurement finished.
+        if (fSuccess)
+            {
+            pThis->notePressureSent(pRequest->param);
+            pThis->noteMeasurementStarted();
+            }
+        else if (pThis->noteFailure(pRequest->error) &&
+                 pThis->submitRequest(pThis->m_rqStart))
+            // try again, and finish when that's done.
+            return;
+        }
+    else if (! fSuccess)
+        {
+        // could not read data-ready status; retry a garbled response
+        // right away, and finish when that's done.
+        if (pThis->noteFailure(pRequest->error) &&
+            pThis->submitRequest(pThis->m_rqDataReady))
+            return;
+        }
+    else if (! pThis->updateDataReady(pThis->m_dataReadyBuffer.getReader().getUint16()) &&
+             pThis->m_state == State::Initial)
+        {
+        // not measuring yet: start it, and finish when that's done.
+        pThis->initWriteRequest(
+            pThis->m_rqStart,
+            Command::StartContinuousMeasurement,
+            pThis->m_pressure,
+            queryReadyDone, (void *)pThis
+            );
+        if (pThis->submitRequest(pThis->m_rqStart))
+            return;
+
+        fSuccess = false;
+        }
+
+    if (pThis->m_pReadyDoneFn != nullptr)
+        pThis->m_pReadyDoneFn(pThis->m_pReadyClientData, pRequest, fSuccess);
+    }
+
+bool cSCD30::readMeasurement()
+    {
+    if (! this->readMeasurementAsync(nullptr, nullptr))
+        return false;
+
+    return this->waitRequest(this->m_rqMeasurement);
+    }
+
+/*
+
+Name:	cSCD30::readMeasurementAsync()
+
+Function:
+    Start reading a measurement from the SCD30, without blocking.
+
+Definition:
+    bool cSCD30::readMeasurementAsync(
+        cSCD30::AsyncDoneFn_t *pDoneFn,
+        void *pClientData
+        );
+
+Description:
+    If a measurement is ready (as reported by queryReady()), the
+    ReadMeasurement command is queued to the asynchronous engine and
+    the method returns immediately. When the response has been read
+    and checked, the internal measurement buffer is updated and
+    pDoneFn (if not nullptr) is called with pClientData.
+
+Returns:
+    `true` if the read was started, `false` (with the last error set)
+    if no measurement is ready or a read is already in progress.
+
+*/
+
+bool cSCD30::readMeasurementAsync(
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    bool fNonce;
+
+    if (this->m_rqMeasurement.fPending)
+        return this->setLastError(Error::Busy);
+
+    if (! this->queryReady(fNonce))
+        return false;
+
+    this->m_pMeasurementDoneFn = pDoneFn;
+    this->m_pMeasurementClientData = pClientData;
+    this->initReadRequest(
+        this->m_rqMeasurement,
+        Command::ReadMeasurement,
+        this->m_measurementBuffer.raw, sizeof(this->m_measurementBuffer.raw),
+        readMeasurementDone, (void *)this
+        );
+
+    // predict the next sample before submitting: the transport may
+    // finish the read (and a failure may move m_tReady to back off)
+    // before submitRequest() returns.
+    auto const oldState = this->m_state;
+    auto const oldReady = this->m_tReady;
+
+    this->m_state = State::Triggered;
+    this->predictReady();
+
+    if (! this->submitRequest(this->m_rqMeasurement))
+        {
+        // nothing was sent.
+        this->m_state = oldState;
+        this->m_tReady = oldReady;
+        return false;
+        }
+
+    return true;
+    }
+
+void cSCD30::readMeasurementDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cSCD30 *)pClientData;
+
+    if (fSuccess)
+        {
+        RawMeasurement raw;
+
+        pThis->m_measurementBuffer.decode(raw);
+
+        auto const fixed = getFixedMeasurement(raw);
+        auto const invalid = getInvalidChannels(raw);
+
+        pThis->m_nFailures = 0;
+        pThis->statsCountMeasurement();
+        if (invalid != 0)
+            pThis->statsCount(&Stats::nInvalid);
+
+        if (pThis->m_fFilter && ! pThis->filterMeasurement(fixed, invalid))
+            {
+            // the read worked, but the reading was dropped; the
+            // client sees why in the request's error.
+            pRequest->error = pThis->getLastError();
+            fSuccess = false;
+            }
+        else
+            {
+            pThis->m_Measurement = getMeasurement(raw);
+            pThis->m_FixedMeasurement = fixed;
+            pThis->m_invalidChannels = invalid;
+
+            // the zeros in an invalid reading are made up; the client
+            // can see the reading, but the summary, the burst and the
+            // history never do.
+            if (invalid == 0)
+                {
+                // the statistics see every reading once the sensor has settled.
+                if (pThis->m_pSummary != nullptr &&
+                    ! (pThis->m_fBurst && pThis->m_nBurstRead < pThis->m_burst.nSettle))
+                    pThis->m_pSummary->put(pThis->m_FixedMeasurement);
+
+                // during a burst, only the combined result is kept.
+                bool const fResult = ! pThis->m_fBurst || pThis->noteBurstSample();
+
+                if (fResult && pThis->m_pHistory != nullptr)
+                    pThis->m_pHistory->put(cSCD30HistoryBase::encode(millis(), pThis->m_FixedMeasurement));
+                }
+            }
+        }
+    else
+        {
+        // the data wasn't consumed, so RDY is still high; we
+        // won't see another edge.
+        pThis->checkReadyPin();
+
+        // for the same reason, a garbled read can simply be repeated;
+        // the client hears about it when that's done.
+        if (pThis->noteFailure(pRequest->error) &&
+            pThis->submitRequest(pThis->m_rqMeasurement))
+            return;
+        }
+
+    if (pThis->m_pMeasurementDoneFn != nullptr)
+        pThis->m_pMeasurementDoneFn(pThis->m_pMeasurementClientData, pRequest, fSuccess);
+    }
+
+// combine n burst samples of one channel; sorts pValues for the median.
+template <typename T>
+static T combineBurstChannel(T *pValues, unsigned n, cSCD30::BurstCombine combine)
+    {
+    std::int64_t sum;
+
+    if (combine == cSCD30::BurstCombine::Mean)
+        {
+        sum = 0;
+        for (unsigned i = 0; i < n; ++i)
+            sum += pValues[i];
+        }
+    else
+        {
+        // insertion sort; n is small.
+        for (unsigned i = 1; i < n; ++i)
+            {
+            T const v = pValues[i];
+            unsigned j;
+
+            for (j = i; j > 0 && pValues[j - 1] > v; --j)
+                pValues[j] = pValues[j - 1];
+            pValues[j] = v;
+            }
+
+        if ((n & 1) != 0)
+            return pValues[n / 2];
+
+        // even: use the mean of the middle two.
+        sum = std::int64_t(pValues[n / 2 - 1]) + pValues[n / 2];
+        n = 2;
+        }
+
+    // round half away from zero.
+    std::int64_t const half = n / 2;
+    return T((sum >= 0 ? sum + half : sum - half) / std::int64_t(n));
+    }
+
+// account for a reading taken during a burst; return true if it was
+// the last one, after replacing the measurement with the result.
+bool cSCD30::noteBurstSample()
+    {
+    auto const nSettle = this->m_burst.nSettle;
+
+    if (this->m_nBurstRead < nSettle)
+        {
+        ++this->m_nBurstRead;
+        return false;
+        }
+
+    unsigned const iSample = this->m_nBurstRead++ - nSettle;
+    unsigned const n = this->m_burst.nSamples;
+
+    this->m_burstSamples[iSample] = this->m_FixedMeasurement;
+    if (iSample + 1 < n)
+        return false;
+
+    std::uint32_t co2[kMaxBurstSamples];
+    std::int16_t temperature[kMaxBurstSamples];
+    std::uint16_t rh[kMaxBurstSamples];
+
+    for (unsigned i = 0; i < n; ++i)
+        {
+        co2[i] = this->m_burstSamples[i].CO2ppm;
+        temperature[i] = this->m_burstSamples[i].Temperature;
+        rh[i] = this->m_burstSamples[i].RelativeHumidity;
+        }
+
+    auto const combine = this->m_burst.Combine;
+    FixedMeasurement result;
+
+    result.CO2ppm = combineBurstChannel(co2, n, combine);
+    result.Temperature = combineBurstChannel(temperature, n, combine);
+    result.RelativeHumidity = combineBurstChannel(rh, n, combine);
+
+    this->m_FixedMeasurement = result;
+    this->m_Measurement.CO2ppm = result.CO2ppm / 65536.0f;
+    this->m_Measurement.Temperature = result.Temperature / 200.0f;
+    this->m_Measurement.RelativeHumidity = result.RelativeHumidity * (100.0f / 65535.0f);
+
+    this->m_fBurst = false;
+    return true;
+    }
+
+/****************************************************************************\
+|
+|   Filtering measurements
+|
+\****************************************************************************/
+
+/*
+
+Name:	cSCD30::setFilter()
+
+Function:
+    Filter readings before they reach the application.
+
+Definition:
+    bool cSCD30::setFilter(
+        const cSCD30::FilterConfig &config
+        );
+
+Description:
+    The first readings after the sensor starts measuring are often
+    off, and a single reading can be far from its neighbors. Once a
+    filter is set, each reading is checked before it updates
+    getMeasurement(), the summary, the burst, or the history:
+
+    - the first config.nWarmup readings after each start of
+      measurement are dropped;
+    - if config.fRejectInvalid, a reading with a NaN or infinite
+      channel (which the driver would report as zero) is dropped.
+      Otherwise it updates getMeasurement(), but (filter or no
+      filter) never the summary, the burst or the history;
+    - if config.OutlierThreshold isn't zero, a reading that's an
+      outlier compared to the two readings before it (see FilterConfig)
+      is dropped. A step change is accepted from its second reading.
+
+    A dropped reading completes the read with `false`, and the last
+    error (and the request's error) is Error::MeasurementWarmup,
+    Error::MeasurementOutlier or Error::MeasurementInvalid; see
+    isFilterError(). These aren't failures, and don't start error
+    recovery; just wait for the next reading.
+
+    Setting the filter restarts it, as restartFilter() does.
+
+Returns:
+    `true` if the filter was set; `false` (with the last error set to
+    Error::InvalidParameter) if config.nWarmup is unreasonably large.
+
+*/
+
+bool cSCD30::setFilter(const cSCD30::FilterConfig &config)
+    {
+    // more than this, and the sensor would never be heard from.
+    constexpr std::uint8_t kMaxWarmup = 16;
+
+    if (config.nWarmup > kMaxWarmup)
+        return this->setLastError(Error::InvalidParameter);
+
+    this->m_filter = config;
+    this->m_fFilter = true;
+    this->restartFilter();
+    return this->setLastError(Error::Success);
+    }
+
+// forget the filter's history, and warm up again; called whenever the
+// sensor starts measuring. Call it after powering up the sensor, if the
+// driver doesn't know.
+void cSCD30::restartFilter()
+    {
+    this->m_nFilterHistory = 0;
+    this->m_nWarmupLeft = this->m_filter.nWarmup;
+    }
+
+// the median of three values.
+template <typename T>
+static T median3(T a, T b, T c)
+    {
+    if (a > b)
+        {
+        T const t = a;
+        a = b;
+        b = t;
+        }
+    // now a <= b.
+    return c <= a ? a : c >= b ? b : c;
+    }
+
+// Hampel check of x against the two values before it: true if x is
+// further from the median m of the three than max(k * 1.4826 * MAD, minDev),
+// where MAD is the median absolute deviation from m.
+static bool isOutlier(std::int32_t prev2, std::int32_t prev1, std::int32_t x, std::uint8_t k, std::uint32_t minDev)
+    {
+    std::int32_t const m = median3(prev2, prev1, x);
+    auto const absdev = [m](std::int32_t v) { return std::uint32_t(v < m ? m - v : v - m); };
+    std::uint32_t const dev = absdev(x);
+
+    if (dev <= minDev)
+        return false;
+
+    std::uint32_t const mad = median3(absdev(prev2), absdev(prev1), dev);
+
+    return std::uint64_t(dev) * 1000u > std::uint64_t(mad) * k * 1483u;
+    }
+
+// decide whether to keep a reading; returns false (with the reason as
+// the last error) to drop it.
+bool cSCD30::filterMeasurement(const cSCD30::FixedMeasurement &m, std::uint8_t invalidChannels)
+    {
+    auto const &filter = this->m_filter;
+
+    if (this->m_nWarmupLeft != 0)
+        {
+        --this->m_nWarmupLeft;
+        this->statsCount(&Stats::nWarmupDropped);
+        return this->setLastError(Error::MeasurementWarmup);
+        }
+
+    // the zeros in an invalid reading are made up, so it's not checked,
+    // and doesn't go into the history.
+    if (invalidChannels != 0)
+        return this->setLastError(filter.fRejectInvalid ? Error::MeasurementInvalid : Error::Success);
+
+    auto const &h = this->m_filterHistory;
+    bool fOutlier = false;
+
+    if (filter.OutlierThreshold != 0 && this->m_nFilterHistory == 2)
+        {
+        auto const k = filter.OutlierThreshold;
+
+        // CO2 is in 16.16 ppm; a zero CO2 means none yet, so skip it.
+        if (m.CO2ppm != 0 && h[0].CO2ppm != 0 && h[1].CO2ppm != 0)
+            fOutlier = isOutlier(
+                std::int32_t(h[0].CO2ppm >> 16), std::int32_t(h[1].CO2ppm >> 16), std::int32_t(m.CO2ppm >> 16),
+                k, filter.MinCO2ppm
+                );
+
+        fOutlier = fOutlier ||
+            isOutlier(h[0].Temperature, h[1].Temperature, m.Temperature, k, filter.MinTemperature) ||
+            isOutlier(h[0].RelativeHumidity, h[1].RelativeHumidity, m.RelativeHumidity, k, filter.MinRelativeHumidity);
+        }
+
+    // every valid reading goes into the history, even an outlier, so
+    // that a real step change is accepted on its second reading.
+    if (this->m_nFilterHistory == 2)
+        this->m_filterHistory[0] = this->m_filterHistory[1];
+    else
+        ++this->m_nFilterHistory;
+    this->m_filterHistory[this->m_nFilterHistory - 1] = m;
+
+    if (fOutlier)
+        {
+        this->statsCount(&Stats::nOutliers);
+        return this->setLastError(Error::MeasurementOutlier);
+        }
+
+    return this->setLastError(Error::Success);
+    }
+
+// return the channels of a reading that are NaN or infinite.
+std::uint8_t cSCD30::getInvalidChannels(const cSCD30::RawMeasurement &raw)
+    {
+    auto const isInvalid = [](std::uint32_t v) { return (v & 0x7F800000u) == 0x7F800000u; };
+    std::uint8_t result = 0;
+
+    if (isInvalid(raw.CO2ppm))
+        result |= kChannelCO2;
+    if (isInvalid(raw.Temperature))
+        result |= kChannelTemperature;
+    if (isInvalid(raw.RelativeHumidity))
+        result |= kChannelRelativeHumidity;
+
+    return result;
+    }
+
+/****************************************************************************\
+|
+|   The RDY pin interrupt
+|
+\****************************************************************************/
+
+cSCD30 *cSCD30::s_pReadyInstance[cSCD30::kMaxReadyInterrupts];
+
+template <unsigned i>
+void cSCD30::readyIsr()
+    {
+    auto const pThis = s_pReadyInstance[i];
+
+    if (pThis != nullptr)
+        {
+        pThis->m_tReadyEdge = millis();
+        pThis->m_fReadyEdge = true;
+        }
+    }
+
+/*
+
+Name:	cSCD30::enableReadyInterrupt()
+
+Function:
+    Use (or stop using) the RDY pin to detect when data is ready.
+
+Definition:
+    bool cSCD30::enableReadyInterrupt(
+        bool fEnable
+        );
+
+Description:
+    If fEnable is true, the pin given as `pinReady` to the constructor
+    is set up as an input, and an interrupt is attached to its rising
+    edge. Thereafter, while measuring, queryReady() reports data ready
+    when the interrupt has been seen, without any I2C transactions. If
+    the edge is very late compared to the estimated ready time, queryReady()
+    falls back to asking the sensor, in case an edge was missed.
+
+    The interrupt stays attached across end() and begin(), so that it
+    can be used to wake the system from sleep.
+
+    If fEnable is false, the interrupt is detached and queryReady() goes
+    back to polling.
+
+    At most kMaxReadyInterrupts instances can use the interrupt at the
+    same time.
+
+Returns:
+    `true` for success. `false` and sets last error if the instance has no
+    RDY pin, the pin can't interrupt, or all interrupt slots are in use.
+
+*/
+
+bool cSCD30::enableReadyInterrupt(bool fEnable)
+    {
+    static void (* const kReadyIsr[kMaxReadyInterrupts])() =
+        {
+        readyIsr<0>, readyIsr<1>, readyIsr<2>, readyIsr<3>,
+        };
+    static_assert(sizeof(kReadyIsr) / sizeof(kReadyIsr[0]) == kMaxReadyInterrupts,
+        "kReadyIsr[] must have an entry for each instance");
+
+    if (! fEnable)
+        {
+        if (this->isReadyInterruptEnabled())
+            {
+            detachInterrupt(digitalPinToInterrupt(this->m_pinReady));
+            s_pReadyInstance[this->m_iReadyInterrupt] = nullptr;
+            this->m_iReadyInterrupt = -1;
+            this->m_fReadyEdge = false;
+            }
+        return true;
+        }
+
+    if (this->isReadyInterruptEnabled())
+        return true;
+
+    if (this->m_pinReady < 0)
+        return this->setLastError(Error::InvalidParameter);
+
+    auto const irq = digitalPinToInterrupt(this->m_pinReady);
+#ifdef NOT_AN_INTERRUPT
+    if (irq == NOT_AN_INTERRUPT)
+        return this->setLastError(Error::InvalidParameter);
+#endif
+
+    unsigned i;
+    for (i = 0; i < kMaxReadyInterrupts; ++i)
+        {
+        if (s_pReadyInstance[i] == nullptr)
+            break;
+        }
+
+    if (i == kMaxReadyInterrupts)
+        return this->setLastError(Error::InvalidParameter);
+
+    s_pReadyInstance[i] = this;
+    this->m_iReadyInterrupt = std::int8_t(i);
+    this->m_fReadyEdge = false;
+
+    pinMode(this->m_pinReady, INPUT);
+    attachInterrupt(irq, kReadyIsr[i], RISING);
+
+    // if data is already waiting, we won't see an edge.
+    this->checkReadyPin();
+    return true;
+    }
+
+// if RDY interrupt has been seen, consume it and transition to ready.
+bool cSCD30::queryReadyPin()
+    {
+    if (! this->m_fReadyEdge)
+        return false;
+
+    this->m_fReadyEdge = false;
+    this->m_state = State::Ready;
+    this->observeReady(this->m_tReadyEdge);
+    return true;
+    }
+
+// if RDY is high, act as if we saw the edge.
+void cSCD30::checkReadyPin()
+    {
+    if (this->isReadyInterruptEnabled() && digitalRead(this->m_pinReady) != LOW)
+        {
+        // we don't know when it went high, so don't learn from it.
+        this->m_nReadyObservations = 0;
+        this->m_fReadyEdge = true;
+        }
+    }
+
+/****************************************************************************\
+|
+|   Learning the sensor's measurement cadence.
+|
+|   The SCD30 times its measurements with its own clock, which drifts
+|   relative to ours; so predicting the next sample from the nominal
+|   interval makes us either poll too early (wasting GetDataReady
+|   transactions) or sleep too long. Instead, we time the transitions
+|   to ready, and keep a filtered estimate of the actual period. Once
+|   the estimate is locked, we schedule polls kReadyGuardMs before the
+|   predicted transition.
+|
+|   Transitions are timed either by the RDY interrupt, or by a
+|   GetDataReady poll that returns ready shortly after one that
+|   returned busy. Because all observations are late by about the
+|   same amount, the bias cancels out of the period estimate.
+|
+|   If the sensor's clock is fast, a poll at the predicted time finds
+|   the data already waiting, and there's nothing to learn from. Each
+|   such late poll doubles an extra lead (up to 1/8 of the interval),
+|   so later polls move earlier until they bracket the transition; each
+|   bracketed transition then halves the extra lead.
+|
+\****************************************************************************/
+
+// forget what we've learned; use the nominal interval.
+void cSCD30::resetReadyEstimate()
+    {
+    this->m_nReadyObservations = 0;
+    this->m_nReadyLate = 0;
+    this->m_fLastBusy = false;
+    this->m_readyPeriod16 = this->m_ProductInfo.MeasurementInterval * 1000u * 16u;
+    }
+
+// record a ready transition at time tReady, and update the estimate.
+void cSCD30::observeReady(std::uint32_t tReady)
+    {
+    std::uint32_t const nominal16 = this->m_ProductInfo.MeasurementInterval * 1000u * 16u;
+    std::uint32_t period16 = this->m_readyPeriod16;
+
+    if (nominal16 == 0)
+        return;
+
+    if (this->m_nReadyObservations == 0 || period16 == 0)
+        {
+        this->m_nReadyObservations = 1;
+        this->m_readyPeriod16 = nominal16;
+        this->m_tLastReady = tReady;
+        return;
+        }
+
+    std::uint32_t const delta = tReady - this->m_tLastReady;
+    this->m_tLastReady = tReady;
+
+    // reject observations that are too far apart to align reliably.
+    if (delta > (kReadyMaxGap + 1) * (period16 / 16u))
+        {
+        this->m_nReadyObservations = 1;
+        return;
+        }
+
+    // figure out how many periods have elapsed.
+    std::uint32_t const delta16 = delta * 16u;
+    std::uint32_t const n = (delta16 + period16 / 2) / period16;
+    std::int32_t const residual = std::int32_t(delta16 - n * period16);
+
+    if (n == 0 || std::uint32_t(residual < 0 ? -residual : residual) > period16 / 8u)
+        {
+        // inconsistent; start over, keeping the current estimate.
+        this->m_nReadyObservations = 1;
+        return;
+        }
+
+    // exponential filter, weight 1/4
+    period16 = std::uint32_t(std::int32_t(period16) + residual / std::int32_t(n) / 4);
+
+    // the sensor clock is not *that* bad.
+    if (period16 < nominal16 - nominal16 / 8u || period16 > nominal16 + nominal16 / 8u)
+        period16 = nominal16;
+
+    this->m_readyPeriod16 = period16;
+    if (this->m_nReadyObservations < 0xFFu)
+        ++this->m_nReadyObservations;
+    }
+
+// the extra lead for polls, after m_nReadyLate late polls.
+std::uint32_t cSCD30::getReadyLateMs() const
+    {
+    std::uint32_t const maxLate = this->m_ProductInfo.MeasurementInterval * (1000u / 8u);
+
+    if (this->m_nReadyLate == 0)
+        return 0;
+
+    std::uint32_t const late = kReadyLearnLeadMs << (this->m_nReadyLate - 1);
+    return late < maxLate ? late : maxLate;
+    }
+
+// set m_tReady for the next sample, just after reading the current one.
+void cSCD30::predictReady()
+    {
+    auto const now = millis();
+
+    if (this->m_nReadyObservations == 0)
+        {
+        this->m_tReady = now + this->m_ProductInfo.MeasurementInterval * 1000 - this->getReadyLateMs();
+        return;
+        }
+
+    // poll a little early, so we see busy then ready, which lets us keep learning.
+    std::uint32_t const lead = (this->isReadyEstimateLocked() ? kReadyGuardMs : kReadyLearnLeadMs)
+                             + this->getReadyLateMs()
+                             ;
+
+    for (unsigned n = 1; n <= kReadyMaxGap; ++n)
+        {
+        std::uint32_t const tNext = this->m_tLastReady + (n * this->m_readyPeriod16) / 16u - lead;
+
+        if (std::int32_t(tNext - now) > 0)
+            {
+            this->m_tReady = tNext;
+            return;
+            }
+        }
+
+    // we've been away too long; start over.
+    this->resetReadyEstimate();
+    this->m_tReady = now + this->m_ProductInfo.MeasurementInterval * 1000;
+    }
+
+/****************************************************************************\
+|
+|   The asynchronous command engine
+|
+\****************************************************************************/
+
+void cSCD30::initReadRequest(
+    cSCD30::AsyncRequest &r,
+    cSCD30::Command c,
+    std::uint8_t *pResponse,
+    std::uint8_t nResponse,
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    r.pNext = nullptr;
+    r.pDoneFn = pDoneFn;
+    r.pClientData = pClientData;
+    r.pResponse = pResponse;
+    r.nResponse = nResponse;
+    r.nRead = 0;
+    r.fParam = false;
+    r.fPending = false;
+    r.error = Error::Success;
+    r.command = c;
+    r.param = 0;
+    }
+
+void cSCD30::initWriteRequest(
+    cSCD30::AsyncRequest &r,
+    cSCD30::Command c,
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    initReadRequest(r, c, nullptr, 0, pDoneFn, pClientData);
+    }
+
+void cSCD30::initWriteRequest(
+    cSCD30::AsyncRequest &r,
+    cSCD30::Command c,
+    std::uint16_t param,
+    cSCD30::AsyncDoneFn_t *pDoneFn,
+    void *pClientData
+    )
+    {
+    initReadRequest(r, c, nullptr, 0, pDoneFn, pClientData);
+    r.fParam = true;
+    r.param = param;
+    }
+
+/*
+
+Name:	cSCD30::submitRequest()
+
+Function:
+    Queue an asynchronous request to the sensor.
+
+Definition:
+    bool cSCD30::submitRequest(
+        cSCD30::AsyncRequest &r
+        );
+
+Description:
+    The request is appended to the driver's queue. If the engine is
+    idle, the command is written to the sensor immediately. The method
+    never waits; the read delay (kReadDelayMs) and command recovery
+    time (kCommandRecoveryMs) are timed by later calls to poll(), which
+    completes the request and calls its completion function.
+
+Returns:
+    `true` if the request was queued. `false` if the driver is
+    not running, or if the request is already pending; in that
+    case, the last error is set and the completion function is
+    not called.
+
+*/
+
+bool cSCD30::submitRequest(cSCD30::AsyncRequest &r)
+    {
+    if (! this->checkRunning())
+        return false;
+
+    if (r.fPending)
+        return this->setLastError(Error::InternalInvalidParameter);
+
+    if (r.nResponse != 0 && r.pResponse == nullptr)
+        return this->setLastError(Error::InternalInvalidParameter);
+
+    r.pNext = nullptr;
+    r.error = Error::Success;
+    r.fPending = true;
+
+    if (this->m_pAsyncHead == nullptr)
+        this->m_pAsyncHead = &r;
+    else
+        this->m_pAsyncTail->pNext = &r;
+
+    this->m_pAsyncTail = &r;
+
+    // get things started, if possible.
+    this->poll();
+    return true;
+    }
+
+/*
+
+Name:	cSCD30::poll()
+
+Function:
+    Advance the asynchronous command engine.
+
+Definition:
+    void cSCD30::poll();
+
+Description:
+    This must be called frequently (normally from the client's
+    loop or pollable object) whenever isBusy() is true. It checks
+    the deadline for the active request, reads the response when
+    the sensor is ready, calls completion functions, and starts
+    the next request. It never waits.
+
+    Completion functions may submit new requests; they must not
+    call any of the blocking methods.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSCD30::poll()
+    {
+    if (this->m_fAsyncPolling)
+        return;
+
+    this->m_fAsyncPolling = true;
+    while (this->asyncStep())
+        /* loop */;
+    this->m_fAsyncPolling = false;
+    }
+
+// advance the engine one step; return true if it's worth trying again.
+bool cSCD30::asyncStep()
+    {
+    auto const pRequest = this->m_pAsyncHead;
+    bool result;
+
+    if (pRequest == nullptr)
+        return false;
+
+    switch (this->m_asyncState)
+        {
+    case AsyncState::Idle:
+        if (! this->selectBus())
+            {
+            this->asyncComplete(false);
+            return true;
+            }
+
+        this->statsCountTransaction(pRequest->command);
+        if (pRequest->command == Command::GetDataReady)
+            this->statsCount(&Stats::nReadyPollsPending);
+
+        if (pRequest->fParam)
+            result = this->writeCommand(pRequest->command, pRequest->param);
+        else
+            result = this->writeCommand(pRequest->command);
+
+        if (! result)
+            {
+            this->asyncComplete(false);
+            return true;
+            }
+
+        this->m_tAsyncStart = micros();
+        this->m_asyncState = pRequest->nResponse != 0 ? AsyncState::ReadDelay
+                                                      : AsyncState::Recovery
+                                                      ;
+        return false;
+
+    case AsyncState::ReadDelay:
+        if (! this->asyncTimeElapsed(this->kReadDelayMs))
+            return false;
+
+        if (! (this->selectBus() && this->startResponse(*pRequest)))
+            {
+            this->asyncComplete(false);
+            return true;
+            }
+
+        this->m_tAsyncStart = micros();
+        this->m_asyncState = AsyncState::Reading;
+        return true;
+
+    case AsyncState::Reading:
+        {
+        auto const status = this->m_pTransport->pollRead();
+
+        if (status == cSCD30Transport::Status::Busy)
+            {
+            if (! this->asyncTimeElapsed(this->kReadTimeoutMs))
+                return false;
+
+            // the transport never finished; give up on it.
+            this->m_pTransport->abortRead();
+            this->statsCount(&Stats::nReadRequest);
+            this->asyncComplete(this->setLastError(Error::I2cReadRequest));
+            return true;
+            }
+
+        if (! this->setTransportError(status))
+            {
+            this->asyncComplete(false);
+            return true;
+            }
+
+        pRequest->nRead += std::uint8_t(this->getResponseChunk(*pRequest));
+        if (pRequest->nRead < pRequest->nResponse)
+            {
+            // the response is longer than the transport can read at
+            // once; read the next piece.
+            if (! (this->selectBus() && this->startResponseChunk(*pRequest)))
+                {
+                this->asyncComplete(false);
+                return true;
+                }
+
+            this->m_tAsyncStart = micros();
+            return true;
+            }
+
+        this->asyncComplete(this->finishResponse(*pRequest));
+        return true;
+        }
+
+    case AsyncState::Recovery:
+        if (! this->asyncTimeElapsed(this->kCommandRecoveryMs))
+            return false;
+
+        this->asyncComplete(true);
+        return true;
+
+    default:
+        // internal error; drop the request.
+        this->setLastError(Error::InternalInvalidState);
+        this->asyncComplete(false);
+        return true;
+        }
+    }
+
+/*
+
+Name:	cSCD30::setBusSelectFn()
+
+Function:
+    Register a function to be called before each bus transaction.
+
+Definition:
+    void cSCD30::setBusSelectFn(
+        cSCD30::BusSelectFn_t *pSelectFn,
+        void *pClientData
+        );
+
+Description:
+    All SCD30s have the same address, so several sensors on one bus need
+    a multiplexer. If pSelectFn is not nullptr, the engine calls it
+    before each write and each read, so that the multiplexer can be
+    pointed at this sensor. Because the read may happen long after the
+    write, other sensors can use the bus in between.
+
+    If the function returns false, the request fails with
+    Error::BusSelectFailed.
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSCD30::setBusSelectFn(
+    cSCD30::BusSelectFn_t *pSelectFn,
+    void *pClientData
+    )
+    {
+    this->m_pBusSelectFn = pSelectFn;
+    this->m_pBusSelectClientData = pClientData;
+    }
+
+bool cSCD30::selectBus()
+    {
+    if (this->m_pBusSelectFn == nullptr)
+        return true;
+
+    if (this->m_pBusSelectFn(this->m_pBusSelectClientData, this))
+        return true;
+
+    return this->setLastError(Error::BusSelectFailed);
+    }
+
+// retire the active request, and notify the client.
+void cSCD30::asyncComplete(bool fSuccess)
+    {
+    auto const pRequest = this->m_pAsyncHead;
+
+    this->m_pAsyncHead = pRequest->pNext;
+    if (this->m_pAsyncHead == nullptr)
+        this->m_pAsyncTail = nullptr;
+
+    this->m_asyncState = AsyncState::Idle;
+
+    pRequest->pNext = nullptr;
+    pRequest->error = fSuccess ? Error::Success : this->m_lastError;
+    pRequest->fPending = false;
+
+    if (pRequest->pDoneFn != nullptr)
+        pRequest->pDoneFn(pRequest->pClientData, pRequest, fSuccess);
+    }
+
+// submit a request and wait for it to complete.
+bool cSCD30::runRequest(cSCD30::AsyncRequest &r)
+    {
+    if (! this->submitRequest(r))
+        return false;
+
+    return this->waitRequest(r);
+    }
+
+// wait for a previously-submitted request to complete.
+bool cSCD30::waitRequest(cSCD30::AsyncRequest &r)
+    {
+    // we can't wait from inside a completion function; poll() would
+    // refuse to run, and we'd never finish.
+    if (this->m_fAsyncPolling && r.fPending)
+        return this->setLastError(Error::InternalInvalidState);
+
+    auto const tWait = this->statsStartWait();
+    while (r.fPending)
+        {
+        yield();
+        this->poll();
+        }
+    this->statsEndWait(tWait);
+
+    return this->setLastError(r.error);
+    }
+
+/****************************************************************************\
+|
+|   Error recovery
+|
+\****************************************************************************/
+
+cSCD30::ErrorClass cSCD30::getErrorClass(cSCD30::Error e)
+    {
+    switch (e)
+        {
+    case Error::Success:
+    case Error::Busy:
+        return ErrorClass::None;
+
+    // the read worked; the filter dropped the reading.
+    case Error::MeasurementWarmup:
+    case Error::MeasurementOutlier:
+    case Error::MeasurementInvalid:
+        return ErrorClass::None;
+
+    // the sensor answered, but the answer was garbled, or the bus
+    // library ran out of room.
+    case Error::Crc:
+    case Error::I2cReadShort:
+    case Error::I2cReadLong:
+    case Error::CommandWriteBufferFailed:
+        return ErrorClass::Transient;
+
+    // nothing answered: the bus is stuck, or the sensor is.
+    case Error::CommandWriteFailed:
+    case Error::I2cReadRequest:
+    case Error::BusSelectFailed:
+        return ErrorClass::Persistent;
+
+    // the sensor answered, but read back a different setting than was
+    // written; a bus recovery or a reset won't change its mind.
+    case Error::SensorUpdateFailed:
+        return ErrorClass::Permanent;
+
+    default:
+        return ErrorClass::Permanent;
+        }
+    }
+
+/*
+
+Name:	cSCD30::noteFailure()
+
+Function:
+    Decide how to recover from a failed transfer.
+
+Definition:
+    bool cSCD30::noteFailure(
+        cSCD30::Error e
+        );
+
+Description:
+    Called when a transfer that the measurement cycle depends on
+    fails with error `e`. The failure is counted, and handled
+    according to getErrorClass(e).
+
+    The first kRecoveryRetries transient failures are retried right
+    away; the sensor is there, and the next transfer will probably
+    work.
+
+    Otherwise, the next attempt is put off by a delay that starts at
+    kRecoveryBackoffMinMs and doubles with each further failure, up to
+    kRecoveryBackoffMaxMs; but never before the next measurement is
+    expected. If the failures go on, the driver escalates: on the
+    kRecoveryBusStep'th failure of every kRecoveryCycle, the transport
+    is asked to recover the bus; on the kRecoveryResetStep'th, the
+    sensor is sent a soft reset.
+
+    The count is cleared by the next good measurement (or start).
+
+Returns:
+    `true` if the caller should retry right away; `false` if the
+    next attempt has been scheduled by moving the ready time. Either
+    way, the last error is left set to `e`.
+
+*/
+
+bool cSCD30::noteFailure(cSCD30::Error e)
+    {
+    // wrap to the start of a cycle, so the escalation carries on.
+    if (++this->m_nFailures == 0)
+        this->m_nFailures = kRecoveryCycle;
+
+    auto const errorClass = getErrorClass(e);
+
+    if (errorClass == ErrorClass::Transient && this->m_nFailures <= kRecoveryRetries)
+        {
+        this->statsCount(&Stats::nRetries);
+        this->setLastError(e);
+        return true;
+        }
+
+    std::uint32_t delayMs = this->getBackoffMs();
+
+    this->statsCount(&Stats::nBackoffs);
+    if (isRecoverableError(e))
+        {
+        switch (this->m_nFailures % kRecoveryCycle)
+            {
+        case kRecoveryBusStep:
+            if (this->m_pTransport->recoverBus())
+                this->statsCount(&Stats::nBusRecoveries);
+            break;
+
+        case kRecoveryResetStep:
+            if (this->startSoftReset())
+                {
+                this->statsCount(&Stats::nSoftResets);
+                // the sensor won't answer while it boots.
+                if (delayMs < kSoftResetMs)
+                    delayMs = kSoftResetMs;
+                }
+            break;
+
+        default:
+            break;
+            }
+        }
+
+    auto const tRetry = millis() + delayMs;
+    if (std::int32_t(tRetry - this->m_tReady) > 0)
+        this->m_tReady = tRetry;
+
+    return this->setLastError(e);
+    }
+
+// return the backoff delay for the current failure count.
+std::uint32_t cSCD30::getBackoffMs() const
+    {
+    unsigned const shift = this->m_nFailures - 1u;
+
+    if (shift >= 16 || (kRecoveryBackoffMinMs << shift) > kRecoveryBackoffMaxMs)
+        return kRecoveryBackoffMaxMs;
+    else
+        return kRecoveryBackoffMinMs << shift;
+    }
+
+/*
+
+Name:	cSCD30::softReset()
+
+Function:
+    Restart the SCD30.
+
+Definition:
+    bool cSCD30::softReset();
+
+Description:
+    SoftReset is sent, and the driver waits for it to be accepted. The
+    sensor then reboots, which takes up to kSoftResetMs; it keeps its
+    settings, including whether it's measuring, in non-volatile memory.
+    The driver doesn't poll until the sensor is back, and then
+    rediscovers its state as after begin(), restarting measurements
+    if needed.
+
+    The driver's error recovery uses the same request, without
+    waiting, after repeated failures.
+
+Returns:
+    `true` for success, `false` (with the last error set) for failure.
+
+*/
+
+bool cSCD30::softReset()
+    {
+    if (! this->checkRunning())
+        return false;
+
+    if (! this->startSoftReset())
+        return false;
+
+    return this->waitRequest(this->m_rqReset);
+    }
+
+// queue a SoftReset; softResetDone() takes it from there.
+bool cSCD30::startSoftReset()
+    {
+    if (this->m_rqReset.fPending)
+        return this->setLastError(Error::Busy);
+
+    // the settings will be read again before we trust the cache.
+    this->invalidateConfigCache();
+
+    this->initWriteRequest(this->m_rqReset, Command::SoftReset, softResetDone, (void *)this);
+    return this->submitRequest(this->m_rqReset);
+    }
+
+void cSCD30::softResetDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pThis = (cSCD30 *)pClientData;
+
+    (void) pRequest;
+
+    // if the sensor didn't take it, the next failure escalates again.
+    if (! fSuccess)
+        return;
+
+    // any data is gone, and the cycle starts over once it's booted.
+    if (pThis->m_state != State::Idle)
+        pThis->m_state = State::Initial;
+
+    pThis->resetReadyEstimate();
+    pThis->m_tReady = millis() + kSoftResetMs;
+    }
+
+/****************************************************************************\
+|
+|   Statistics
+|
+\****************************************************************************/
+
+unsigned cSCD30::getCommandIndex(cSCD30::Command c)
+    {
+    switch (c)
+        {
+    case Command::StartContinuousMeasurement:   return 0;
+    case Command::StopContinuosMeasurement:     return 1;
+    case Command::GetDataReady:                 return 2;
+    case Command::ReadMeasurement:              return 3;
+    case Command::SetMeasurementInterval:       return 4;
+    case Command::AltitudeCompensation:         return 5;
+    case Command::SetForcedRecalibration:       return 6;
+    case Command::EnableAutoSelfCal:            return 7;
+    case Command::SetTemperatureOffset:         return 8;
+    case Command::ReadFirmwareVersion:          return 9;
+    case Command::SoftReset:
+    default:                                    return 10;
+        }
+    }
+
+cSCD30::Command cSCD30::getCommandByIndex(unsigned i)
+    {
+    static const Command kCommands[kNumCommands] =
+        {
+        Command::StartContinuousMeasurement,
+        Command::StopContinuosMeasurement,
+        Command::GetDataReady,
+        Command::ReadMeasurement,
+        Command::SetMeasurementInterval,
+        Command::AltitudeCompensation,
+        Command::SetForcedRecalibration,
+        Command::EnableAutoSelfCal,
+        Command::SetTemperatureOffset,
+        Command::ReadFirmwareVersion,
+        Command::SoftReset,
+        };
+
+    return kCommands[i < kNumCommands ? i : kNumCommands - 1];
+    }
+
+#if MCCI_CATENA_SCD30_STATS
+// a measurement was read; charge it with the GetDataReady polls since the last one.
+void cSCD30::statsCountMeasurement()
+    {
+    auto &stats = this->m_stats;
+    auto const nPolls = stats.nReadyPollsPending;
+
+    ++stats.nMeasurements;
+    stats.nReadyPolls += nPolls;
+    if (nPolls > stats.nReadyPollsMax)
+        stats.nReadyPollsMax = nPolls;
+    stats.nReadyPollsPending = 0;
+    }
+#endif
+
+std::uint8_t cSCD30::crc(const std::uint8_t * buf, size_t nBuf, std::uint8_t crc8)
+    {
+    /* see cSHT3x CRC-8-Calc.md for a little info on this */
+    return Crc8::crc(buf, nBuf, crc8);
+    }
+
+constexpr decltype(cSCD30::kErrorNames) cSCD30::kErrorNames;
+constexpr decltype(cSCD30::kStateNames) cSCD30::kStateNames;
+
+const char * cSCD30::getErrorName(cSCD30::Error e)
+    {
+    return kErrorNames.getName(unsigned(e));
+    }
+
+const char * cSCD30::getStateName(cSCD30::State s)
+    {
+    return kStateNames.getName(unsigned(s));
+    }
+
+float cSCD30::getFloat32(std::uint32_t bits)
+    {
+    union
+        {
+        std::uint32_t uint;
+        float f;
+        } v;
+
+    // the 32-bit value, from two data words
+    v.uint = bits;
+
+    // filter out NAN.
+    if ((v.uint & 0x7F800000u) == 0x7F800000u)
+        return 0.0f;            // map NANs to zero.
+
+    // eliminate denormalized numbers
+    if ((v.uint & 0x7F800000u) == 0u)
+        v.uint &= 0xFF800000u;  // map denorms to +/- zero.
+
+    // return the value interpreted as a float.
+    return v.f;
+    }
+
+/*
+
+Name:	cSCD30::getFixed32()
+
+Function:
+    Convert a float from the sensor to scaled fixed point.
+
+Definition:
+    static std::int32_t cSCD30::getFixed32(
+        std::uint32_t v,
+        std::uint8_t scale,
+        unsigned fracBits
+        );
+
+Description:
+    The IEEE single-precision value `v` (as assembled from two
+    data words with cSCD30WordReader::getUint32()) is multiplied by `scale`, and
+    converted to an integer with `fracBits` fraction bits, rounded to
+    nearest, using only integer operations. Because the scale is
+    applied to the 24-bit mantissa before rounding, the result is
+    exactly what the corresponding float expression would give.
+    As with getFloat32(), NaNs, infinities and denormalized numbers
+    are mapped to zero.
+
+Returns:
+    The value times scale times 2^fracBits, saturated to the
+    int32_t range.
+
+*/
+
+std::int32_t cSCD30::getFixed32(std::uint32_t v, std::uint8_t scale, unsigned fracBits)
+    {
+    std::int32_t const exponent = std::int32_t((v >> 23) & 0xFFu);
+
+    // filter out NAN, infinities, and denormals (and zero).
+    if (exponent == 0xFF || exponent == 0)
+        return 0;
+
+    // value is mantissa * 2^(exponent - 150); scale it. The product
+    // fits in 32 bits, since the mantissa has 24 bits.
+    std::uint32_t const mantissa = ((v & 0x7FFFFFu) | 0x800000u) * scale;
+    std::int32_t const shift = exponent - 150 + std::int32_t(fracBits);
+    std::uint32_t result;
+
+    if (shift >= 0)
+        result = (shift >= 32 || (mantissa >> (31 - shift)) != 0) ? INT32_MAX : mantissa << shift;
+    else if (shift >= -32)
+        {
+        // keep one more bit, for rounding.
+        std::uint32_t const half = mantissa >> (-shift - 1);
+        result = (half >> 1) + (half & 1u);
+        }
+    else
+        result = 0;
+
+    return (v & 0x80000000u) ? -std::int32_t(result) : std::int32_t(result);
+    }
+
+// convert a ReadMeasurement response to floating point.
+cSCD30::Measurement cSCD30::getMeasurement(const cSCD30::RawMeasurement &raw)
+    {
+    Measurement m;
+
+    m.CO2ppm = getFloat32(raw.CO2ppm);
+    m.Temperature = getFloat32(raw.Temperature);
+    m.RelativeHumidity = getFloat32(raw.RelativeHumidity);
+    return m;
+    }
+
+// convert a ReadMeasurement response to the fixed-point form.
+cSCD30::FixedMeasurement cSCD30::getFixedMeasurement(const cSCD30::RawMeasurement &raw)
+    {
+    FixedMeasurement m;
+
+    // CO2: 16.16; the sensor's range is [0, 40000] ppm.
+    std::int32_t const co2 = getFixed32(raw.CO2ppm, 1, 16);
+    m.CO2ppm = co2 < 0 ? 0 : std::uint32_t(co2);
+
+    // T: round(T * 200)
+    std::int32_t const t = getFixed32(raw.Temperature, 200, 0);
+    m.Temperature = std::int16_t(t > 32767 ? 32767 : t < -32768 ? -32768 : t);
+
+    // RH: round(RH * 65535 / 100). With x = RH * 2^16, that's
+    // (x - x / 2^16) / 100.
+    std::int32_t const rh = getFixed32(raw.RelativeHumidity, 1, 16);
+    if (rh <= 0)
+        m.RelativeHumidity = 0;
+    else
+        {
+        std::uint32_t const x = std::uint32_t(rh);
+        std::uint32_t const rh65535 = (x - ((x + 0x8000u) >> 16) + 50) / 100;
+        m.RelativeHumidity = std::uint16_t(rh65535 > 0xFFFFu ? 0xFFFFu : rh65535);
+        }
+
+    return m;
+    }
+
+/*
+
+Name:	cSCD30::getCO2uflt16()
+
+Function:
+    Encode CO2 for uplink, without floating point.
+
+Definition:
+    static std::uint16_t cSCD30::getCO2uflt16(
+        const cSCD30::FixedMeasurement &m
+        );
+
+Description:
+    This computes LMIC_f2uflt16(CO2ppm / 40000.0f), which is how
+    CO2 is sent in the uplinks, from the fixed-point CO2 value, using
+    only integer operations. A uflt16 has a 4-bit exponent in bits 15..12,
+    and a 12-bit fraction.
+
+Returns:
+    The uflt16 encoding.
+
+*/
+
+std::uint16_t cSCD30::getCO2uflt16(const cSCD30::FixedMeasurement &m)
+    {
+    // in 16.16, 40000 ppm is 2,621,440,000, which is 4096 * 640,000.
+    constexpr std::uint32_t kFullScale = 40000u << 16;
+    constexpr std::uint32_t kFractionDivisor = kFullScale / 4096u;
+    std::uint32_t q = m.CO2ppm;
+
+    // match LMIC_f2uflt16() for the edge cases.
+    if (q == 0)
+        return 0xF000u;
+    if (q >= kFullScale)
+        return 0xFFFFu;
+
+    // normalize to [kFullScale/2, kFullScale)
+    int iExp = 15;
+    while (q < kFullScale / 2)
+        {
+        q <<= 1;
+        --iExp;
+        }
+
+    if (iExp < 0)
+        // underflow.
+        iExp = 0;
+
+    std::uint32_t fraction = (q + kFractionDivisor / 2) / kFractionDivisor;
+    if (fraction >= (1u << 12))
+        {
+        fraction = 1u << 11;
+        ++iExp;
+        }
+
+    if (iExp > 15)
+        return 0xFFFFu;
+
+    return std::uint16_t((std::uint32_t(iExp) << 12) | fraction);
     }
@@ -19,9 +19,126 @@ Author:
 
 #include <cstdint>
 #include <Wire.h>
+#include "MCCI_Catena_SCD30_Crc.h"
+#include "MCCI_Catena_SCD30_Transport.h"
+#include "MCCI_Catena_SCD30_Words.h"
+
+/// \brief enable driver statistics.
+///
+/// If non-zero, each cSCD30 counts its bus transactions, errors and
+/// waits; see cSCD30::getStats(). If zero (the default), the counters
+/// and the code that updates them are compiled out. This changes the
+/// layout of cSCD30, so it must be defined the same way for the whole
+/// build, normally as a compiler flag.
+#ifndef MCCI_CATENA_SCD30_STATS
+# define MCCI_CATENA_SCD30_STATS 0
+#endif
 
 namespace McciCatenaScd30 {
 
+/// \brief the driver's errors, as X(name), in order.
+///
+/// This is the one list of errors: it generates both cSCD30::Error
+/// and the names returned by cSCD30::getErrorName(), so the two
+/// can't drift apart. Add new errors at the end.
+#define MCCI_CATENA_SCD30_ERRORS(X)          \
+    X(Success)                           \
+    X(NoWire)                            \
+    X(CommandWriteFailed)                \
+    X(CommandWriteBufferFailed)          \
+    X(InternalInvalidParameter)          \
+    X(I2cReadShort)                      \
+    X(I2cReadRequest)                    \
+    X(I2cReadLong)                       \
+    X(Busy)                              \
+    X(NotMeasuring)                      \
+    X(Crc)                               \
+    X(Uninitialized)                     \
+    X(InvalidParameter)                  \
+    X(InternalInvalidState)              \
+    X(SensorUpdateFailed)                \
+    X(BusSelectFailed)                   \
+    X(ConfigRateLimited)                 \
+    X(MeasurementWarmup)                 \
+    X(MeasurementOutlier)                \
+    X(MeasurementInvalid)
+
+/// \brief the states of the measurement engine, as X(name), in order.
+///
+/// As MCCI_CATENA_SCD30_ERRORS, for cSCD30::State and
+/// cSCD30::getStateName().
+#define MCCI_CATENA_SCD30_STATES(X)                                                   \
+    X(Uninitialized)     /* this->begin() has never succeeded. */                    \
+    X(End)               /* this->begin() succeeded, followed by this->end() */      \
+    X(Initial)           /* initial after begin [indeterminate] */                   \
+    X(Idle)              /* idle (not measuring) */                                  \
+    X(Triggered)         /* continuous measurement running, no data available. */    \
+    X(Ready)             /* continuous measurement running, data available. */
+
+// helpers for expanding the lists; undefined at the end of this file.
+#define MCCI_CATENA_SCD30_ENUM_(name)   name,
+#define MCCI_CATENA_SCD30_NAME_(name)   #name "\0"
+#define MCCI_CATENA_SCD30_COUNT_(name)  + 1
+
+/// A table of names, for looking up the name of an enum value by index.
+///
+/// The names are kept as one block of NUL-terminated strings, with
+/// the offset of each; both are computed at compile time, by
+/// makeNameTable(), so the table is a constant (in flash, on targets
+/// that keep constants there) and lookup is one array index.
+template <std::size_t a_n, std::size_t a_size>
+struct tSCD30NameTable
+    {
+    char names[a_size];             /// the names, each followed by a NUL
+    std::uint16_t offsets[a_n];     /// offset of each name in names[]
+
+    // return name i, or "<<unknown>>" if i is out of range.
+    const char *getName(unsigned i) const
+        {
+        return i < a_n ? &this->names[this->offsets[i]] : "<<unknown>>";
+        }
+    };
+
+// the offset of the name after the one at offset i.
+template <std::size_t a_size>
+constexpr std::size_t getNextNameOffset(const char (&names)[a_size], std::size_t i)
+    {
+    return i >= a_size ? a_size : names[i] == '\0' ? i + 1 : getNextNameOffset(names, i + 1);
+    }
+
+// the offset of name iName.
+template <std::size_t a_size>
+constexpr std::size_t getNameOffset(const char (&names)[a_size], std::size_t iName)
+    {
+    return iName == 0 ? 0 : getNextNameOffset(names, getNameOffset(names, iName - 1));
+    }
+
+template <std::size_t a_n, std::size_t a_size, std::size_t... a_iChar, std::size_t... a_iName>
+constexpr tSCD30NameTable<a_n, a_size> makeNameTable(
+    const char (&names)[a_size],
+    tIndices<a_iChar...>,
+    tIndices<a_iName...>
+    )
+    {
+    return tSCD30NameTable<a_n, a_size>
+        {
+        { names[a_iChar]... },
+        { std::uint16_t(getNameOffset(names, a_iName))... }
+        };
+    }
+
+/// build a tSCD30NameTable of a_n names from a block of NUL-terminated names.
+template <std::size_t a_n, std::size_t a_size>
+constexpr tSCD30NameTable<a_n, a_size> makeNameTable(const char (&names)[a_size])
+    {
+    static_assert(a_size <= 0xFFFF, "offsets are 16 bits");
+    return makeNameTable<a_n>(
+        names,
+        typename tMakeIndices<a_size>::type {},
+        typename tMakeIndices<a_n>::type {}
+        );
+    }
+
 /// create a version number for comparison
 static constexpr std::uint32_t
 makeVersion(
@@ -62,6 +179,11 @@ getLocal(std::uint32_t v)
 /// version of library, for use by clients in static_asserts
 static constexpr std::uint32_t kVersion = makeVersion(0,2,0);
 
+// see MCCI_Catena_SCD30_History.h
+class cSCD30HistoryBase;
+// see MCCI_Catena_SCD30_Summary.h
+class cSCD30Summary;
+
 class cSCD30
     {
 private:
@@ -78,9 +200,18 @@ public:
     // the type for pin assignments, in case the ready pin is used
     using Pin_t = std::int8_t;
 
-    // constructor
+    // constructor, using the built-in TwoWire transport
     cSCD30(TwoWire &wire, Address Address = Address::SCD30, Pin_t pinReady = -1)
-        : m_wire(&wire)
+        : m_wireTransport(&wire)
+        , m_pTransport(&m_wireTransport)
+        , m_address(Address)
+        , m_pinReady(pinReady)
+        {}
+
+    // constructor, using a client-supplied transport
+    cSCD30(cSCD30Transport &transport, Address Address = Address::SCD30, Pin_t pinReady = -1)
+        : m_wireTransport(nullptr)
+        , m_pTransport(&transport)
         , m_address(Address)
         , m_pinReady(pinReady)
         {}
@@ -99,6 +230,25 @@ public:
         float RelativeHumidity;
         };
 
+    // measurements, as a collection, in fixed point. These are decoded
+    // directly from the sensor's data, without floating point, in the
+    // units used by the uplink formats.
+    struct FixedMeasurement
+        {
+        std::uint32_t   CO2ppm;             /// CO2 concentration, ppm, in 16.16 fixed point
+        std::int16_t    Temperature;        /// temperature, in 0.005 degrees C
+        std::uint16_t   RelativeHumidity;   /// relative humidity, where 0xFFFF is 100%
+        };
+
+    // measurements, as read: the bits of the sensor's IEEE floats.
+    struct RawMeasurement
+        {
+        std::uint32_t   CO2ppm;
+        std::uint32_t   Temperature;
+        std::uint32_t   RelativeHumidity;
+        };
+    static constexpr unsigned kMeasurementWords = 3 * 2;  /// words in a ReadMeasurement response
+
     // product ID info
     struct ProductInfo
         {
@@ -110,6 +260,27 @@ public:
         std::int16_t    AltitudeCompensation;   /// altitude compensation in meters
         };
 
+    // the fields of ProductInfo, as a bit mask for readProductInfo().
+    enum class ProductInfoField : std::uint8_t
+        {
+        None                        = 0,
+        FirmwareVersion             = 1u << 0,
+        MeasurementInterval         = 1u << 1,
+        ASC_status                  = 1u << 2,
+        ForcedRecalibrationValue    = 1u << 3,
+        TemperatureOffset           = 1u << 4,
+        AltitudeCompensation        = 1u << 5,
+        All                         = (1u << 6) - 1,
+        };
+    static constexpr unsigned kProductInfoFields = 6; /// number of fields in ProductInfo
+
+    /// a set of changes to the sensor's settings, for applyConfig().
+    struct Config
+        {
+        ProductInfoField    fields;     /// the settings to change; FirmwareVersion is not allowed
+        ProductInfo         Info;       /// the new values of the selected settings
+        };
+
     // the I2C commands
     enum class Command : std::uint16_t
         {
@@ -126,76 +297,207 @@ public:
         ReadFirmwareVersion                     =   0xD100,     // 1.4.9; no argument (returns 3 bytes)
         SoftReset                               =   0xD304,     // 1.4.10; no argument
         };
+    static constexpr unsigned kNumCommands = 11;    /// number of entries in Command
+
+    static constexpr bool kStatsEnabled = MCCI_CATENA_SCD30_STATS != 0;
+
+    /// driver statistics, from getStats(). All zero if !kStatsEnabled.
+    struct Stats
+        {
+        std::uint32_t   nTransactions[kNumCommands];    /// bus transactions (writes and reads), by getCommandIndex()
+        std::uint32_t   nCrcErrors;         /// responses with a bad CRC
+        std::uint32_t   nReadShort;         /// I2cReadShort errors
+        std::uint32_t   nReadRequest;       /// I2cReadRequest errors
+        std::uint32_t   nReadyBusy;         /// queryReady() calls that returned Busy
+        std::uint32_t   nMeasurements;      /// successful measurement reads
+        std::uint32_t   nReadyPolls;        /// GetDataReady commands for those measurements
+        std::uint32_t   nReadyPollsMax;     /// most GetDataReady commands for one measurement
+        std::uint32_t   nReadyPollsPending; /// GetDataReady commands since the last measurement
+        std::uint32_t   nRetries;           /// transient failures retried right away
+        std::uint32_t   nBackoffs;          /// failures answered by backing off
+        std::uint32_t   nBusRecoveries;     /// bus recoveries done by the transport
+        std::uint32_t   nSoftResets;        /// soft resets sent to recover the sensor
+        std::uint32_t   nConfigWrites;      /// settings written by applyConfig()
+        std::uint32_t   nConfigSkipped;     /// settings not written, because the sensor already had them
+        std::uint32_t   nWarmupDropped;     /// readings dropped by the filter while the sensor warmed up
+        std::uint32_t   nOutliers;          /// readings rejected by the filter as outliers
+        std::uint32_t   nInvalid;           /// readings with a NaN or infinite value
+        std::uint32_t   WaitUs;             /// time spent waiting in blocking methods, microseconds
+        };
 
     // the errors
     enum class Error : std::uint8_t
         {
-        Success = 0,
-        NoWire,
-        CommandWriteFailed,
-        CommandWriteBufferFailed,
-        InternalInvalidParameter,
-        I2cReadShort,
-        I2cReadRequest,
-        I2cReadLong,
-        Busy,
-        NotMeasuring,
-        Crc,
-        Uninitialized,
-        InvalidParameter,
-        InternalInvalidState,
-        SensorUpdateFailed,
+        MCCI_CATENA_SCD30_ERRORS(MCCI_CATENA_SCD30_ENUM_)
+        };
+    static constexpr unsigned kNumErrors = 0 MCCI_CATENA_SCD30_ERRORS(MCCI_CATENA_SCD30_COUNT_);
+
+    // how the driver recovers from an error; see getErrorClass().
+    enum class ErrorClass : std::uint8_t
+        {
+        None,               /// not a failure
+        Transient,          /// one transfer was garbled; retry right away
+        Persistent,         /// the bus or sensor isn't answering; back off and escalate
+        Permanent,          /// retrying won't help (a usage or state error)
         };
 
     static constexpr std::uint32_t kCommandRecoveryMs = 20; // from Sensirion sample code.
     static constexpr std::uint32_t kReadDelayMs = 3;    // delay after write to read.
+    static constexpr std::uint32_t kReadTimeoutMs = 50; // max time for the transport to finish a read.
+    static constexpr unsigned kMaxReadyInterrupts = 4;  // max instances using RDY interrupts.
+
+    // constants for learning the sensor's measurement cadence
+    static constexpr std::uint32_t kReadyRetryMs = 100;     // GetDataReady retry while learning.
+    static constexpr std::uint32_t kReadyLearnLeadMs = 200; // how early to poll while learning.
+    static constexpr std::uint32_t kReadyGuardMs = 20;      // how early to poll, and retry, once locked.
+    static constexpr std::uint32_t kReadyBracketMs = 250;   // max Busy-to-Ready gap for a useful observation.
+    static constexpr std::uint8_t kReadyLockObservations = 3;   // observations needed to trust the estimate.
+    static constexpr unsigned kReadyMaxGap = 8;             // max periods between observations.
+    static constexpr std::uint8_t kReadyMaxLate = 8;        // max late polls counted in m_nReadyLate.
+
+    // defaults for gating ambient pressure updates; see setPressureGate().
+    static constexpr std::uint16_t kPressureThresholdMbar = 5;          // min change worth sending.
+    static constexpr std::uint32_t kPressureMinIntervalMs = 10 * 60 * 1000; // min time between updates.
+
+    // burst measurements; see startBurst().
+    static constexpr unsigned kMaxBurstSamples = 8;         // max samples combined by one burst.
+
+    // error recovery; see noteFailure().
+    static constexpr std::uint8_t kRecoveryRetries = 2;     // immediate retries of transient failures.
+    static constexpr std::uint32_t kRecoveryBackoffMinMs = 100;         // first backoff delay.
+    static constexpr std::uint32_t kRecoveryBackoffMaxMs = 60 * 1000;   // longest backoff delay.
+    static constexpr std::uint8_t kRecoveryCycle = 8;       // failures per escalation cycle...
+    static constexpr std::uint8_t kRecoveryBusStep = 3;     // ...recover the bus on this one...
+    static constexpr std::uint8_t kRecoveryResetStep = 5;   // ...and reset the sensor on this one.
+    static constexpr std::uint32_t kSoftResetMs = 2000;     // datasheet: boot time after reset.
+
+    // how a burst combines its samples
+    enum class BurstCombine : std::uint8_t
+        {
+        Median,             /// per-channel median; a stray reading is ignored
+        Mean,               /// per-channel mean
+        };
+
+    /// the shape of a burst, for startBurst().
+    struct BurstConfig
+        {
+        std::uint16_t   Interval;   /// measurement interval during the burst, in seconds
+        std::uint8_t    nSettle;    /// samples discarded while the sensor settles
+        std::uint8_t    nSamples;   /// samples combined into the result; 1..kMaxBurstSamples
+        BurstCombine    Combine;    /// how the samples are combined
+        };
+
+    // the channels of a measurement, as bits; see getInvalidChannels().
+    static constexpr std::uint8_t kChannelCO2 = 1u << 0;
+    static constexpr std::uint8_t kChannelTemperature = 1u << 1;
+    static constexpr std::uint8_t kChannelRelativeHumidity = 1u << 2;
+
+    /// the measurement filter, for setFilter().
+    ///
+    /// A reading is an outlier if, in some channel, it's further from
+    /// the median of it and the two readings before it than both
+    /// OutlierThreshold robust standard deviations (1.4826 times the
+    /// median absolute deviation of the three) and that channel's minimum.
+    struct FilterConfig
+        {
+        std::uint8_t    nWarmup;            /// readings dropped each time measurement starts
+        std::uint8_t    OutlierThreshold;   /// Hampel threshold, in standard deviations; 0 for no outlier check
+        std::uint16_t   MinCO2ppm;          /// smallest outlier deviation for CO2, in ppm
+        std::uint16_t   MinTemperature;     /// smallest outlier deviation for temperature, in 0.005 degrees C
+        std::uint16_t   MinRelativeHumidity;    /// smallest outlier deviation for RH, where 0xFFFF is 100%
+        bool            fRejectInvalid;     /// drop readings with a NaN or infinite channel
+        };
 
     // state of the measurement enging
     enum class State : std::uint8_t
         {
-        Uninitialized,      /// this->begin() has never succeeded.
-        End,                /// this->begin() succeeded, followed by this->end()
-        Initial,            /// initial after begin [indeterminate]
-        Idle,               /// idle (not measuring)
-        Triggered,          /// continuous measurement running, no data available.
-        Ready,              /// continuous measurement running, data availble.
+        MCCI_CATENA_SCD30_STATES(MCCI_CATENA_SCD30_ENUM_)
+        };
+    static constexpr unsigned kNumStates = 0 MCCI_CATENA_SCD30_STATES(MCCI_CATENA_SCD30_COUNT_);
+
+    /// A compact snapshot of the driver's knowledge of the sensor, for
+    /// saving in FRAM or backup RAM across a deep sleep. See exportSnapshot()
+    /// and importSnapshot().
+    struct Snapshot
+        {
+        std::uint8_t    Version;        /// layout version; always kSnapshotVersion
+        State           SavedState;     /// driver state when snapshot was taken
+        std::uint8_t    nReadyObservations; /// number of consistent ready observations
+        std::uint8_t    nReadyLate;     /// number of consecutive late polls
+        std::uint32_t   tReady;         /// estimated time next measurement will be ready (millis)
+        std::uint32_t   tLastReady;     /// time of last observed ready transition (millis)
+        std::uint32_t   ReadyPeriod16;  /// estimated measurement period, in 1/16 ms
+        std::uint32_t   tPressure;      /// time of last ambient pressure update (millis), if fPressure
+        std::uint16_t   AmbientPressure;    /// ambient pressure in use by the sensor (mBar), or 0
+        bool            fPressure;      /// true if tPressure is valid
+        ProductInfoField InfoValid;     /// fields of Info known to match the sensor
+        ProductInfo     Info;           /// cached product info
+        std::uint8_t    Crc;            /// CRC-8 of all preceding bytes
+        };
+
+    static constexpr std::uint8_t kSnapshotVersion = 5;
+
+    struct AsyncRequest;
+
+    /// completion function for asynchronous requests.
+    using AsyncDoneFn_t = void (void *pClientData, AsyncRequest *pRequest, bool fSuccess);
+
+    /// bus selection function, called before each bus transaction; see setBusSelectFn().
+    using BusSelectFn_t = bool (void *pClientData, cSCD30 *pSensor);
+
+    /// An asynchronous request. The client owns the storage; the driver
+    /// links it into its queue in submitRequest(), and the client must not
+    /// touch it again until the completion function has been called (or
+    /// until fPending is false).
+    struct AsyncRequest
+        {
+        AsyncRequest    *pNext;         /// next request in queue (owned by driver)
+        AsyncDoneFn_t   *pDoneFn;       /// completion function, or nullptr.
+        void            *pClientData;   /// context for completion function.
+        std::uint8_t    *pResponse;     /// response buffer, or nullptr for write-only commands.
+        std::uint8_t    nResponse;      /// size of response in bytes (a multiple of 3), or zero. On success, the words are packed into the front of pResponse.
+        std::uint8_t    nRead;          /// bytes of the response read so far (owned by driver).
+        bool            fParam;         /// true if param is to be sent with the command.
+        volatile bool   fPending;       /// true while queued (owned by driver).
+        Error           error;          /// completion status (owned by driver).
+        Command         command;        /// command to be sent.
+        std::uint16_t   param;          /// parameter, if fParam is set.
+        };
+
+    // state of the asynchronous command engine
+    enum class AsyncState : std::uint8_t
+        {
+        Idle,               /// no command in progress.
+        ReadDelay,          /// command written; waiting kReadDelayMs to read response.
+        Reading,            /// response read started; waiting for the transport to finish it.
+        Recovery,           /// command written; waiting kCommandRecoveryMs before next command.
         };
 
 private:
-    // this is internal -- centralize it but require that clients call the
-    // public method (which centralizes the strings and the search)
-    static constexpr const char * const m_szErrorMessages =
-        "Success\0"
-        "NoWire\0"
-        "CommandWriteFailed\0"
-        "CommandWriteBufferFailed\0"
-        "InternalInvalidParameter\0"
-        "I2cReadShort\0"
-        "I2cReadRequest\0"
-        "I2cReadLong\0"
-        "Busy\0"
-        "NotMeasuring\0"
-        "Crc\0"
-        "Uninitialized\0"
-        "InvalidParmaeter\0"
-        "InternalInvalidState\0"
-        ;
-
-    // this is internal -- centralize it but require that clients call the
-    // public method (which centralizes the strings and the search)
-    static constexpr const char * const m_szStateNames =
-        "Uninitialized" "\0"
-        "End"           "\0"
-        "Initial"       "\0"
-        "Idle"          "\0"
-        "Triggered"     "\0"
-        "Ready"         "\0"
-        ;
+    // the name tables; internal, but used by the public methods
+    // getErrorName() and getStateName().
+    static constexpr auto kErrorNames =
+        makeNameTable<kNumErrors>(MCCI_CATENA_SCD30_ERRORS(MCCI_CATENA_SCD30_NAME_));
+    static constexpr auto kStateNames =
+        makeNameTable<kNumStates>(MCCI_CATENA_SCD30_STATES(MCCI_CATENA_SCD30_NAME_));
 
 public:
     // the public methods
-    bool begin();
+    bool begin()
+        {
+        return this->begin(ProductInfoField::All);
+        }
+    bool begin(ProductInfoField fields);
     void end();
+    // fast start: begin() without a snapshot skips the discovery and
+    // the wait in Initial; see beginFast(). If measurementInterval is
+    // not zero, it's trusted, and not read from the sensor.
+    void setFastStart(bool fEnable, std::uint16_t measurementInterval = 0)
+        {
+        this->m_fFastStart = fEnable;
+        this->m_fastStartInterval = measurementInterval;
+        }
+    bool getFastStart() const { return this->m_fFastStart; }
     bool startContinuousMeasurement()
         {
         return startContinuousMeasurementCommon(0);
@@ -207,8 +509,42 @@ public:
         return startContinuousMeasurementCommon(pressure_mBar);
         }
     bool stopMeasurement();
+    bool startBurst(const BurstConfig &config);
+    // return true while a burst is collecting samples.
+    bool isBurstActive() const { return this->m_fBurst; }
+    bool setFilter(const FilterConfig &config);
+    // stop filtering readings.
+    void clearFilter() { this->m_fFilter = false; }
+    bool isFilterEnabled() const { return this->m_fFilter; }
+    void restartFilter();
+    // return true if e means the filter dropped a reading.
+    static bool isFilterError(Error e)
+        {
+        return e == Error::MeasurementWarmup ||
+               e == Error::MeasurementOutlier ||
+               e == Error::MeasurementInvalid;
+        }
+    // return the channels of the last reading that were NaN or infinite,
+    // and so reported as zero, as kChannel* bits.
+    std::uint8_t getInvalidChannels() const { return this->m_invalidChannels; }
+    bool setAmbientPressure(std::uint16_t pressure_mBar);
+    // only send pressure changes of at least threshold_mBar, at most once per minIntervalMs.
+    void setPressureGate(std::uint16_t threshold_mBar, std::uint32_t minIntervalMs)
+        {
+        this->m_pressureThreshold = threshold_mBar;
+        this->m_pressureMinIntervalMs = minIntervalMs;
+        }
+    // return the ambient pressure the sensor is compensating for, in mBar, or 0 if none.
+    std::uint16_t getAmbientPressure() const { return this->m_pressure; }
     bool setMeasurementInterval(std::uint16_t interval);
     bool queryReady(bool &fCommError);
+    bool queryReadyAsync(AsyncDoneFn_t *pDoneFn, void *pClientData);
+    bool enableReadyInterrupt(bool fEnable);
+    // return true if the RDY pin interrupt is in use.
+    bool isReadyInterruptEnabled() const
+        {
+        return this->m_iReadyInterrupt >= 0;
+        }
     bool readMeasurement();
     bool activateAutomaticSelfCalbration(bool fEnableIfTrue);
     bool setForcedRecalibrationValue(std::uint16_t CO2ppm);
@@ -219,6 +555,19 @@ public:
     float getCO2ppm() const { return this->m_Measurement.CO2ppm; }
     float getRelativeHumidity() const { return this->m_Measurement.CO2ppm; }
     Measurement getMeasurement() const { return this->m_Measurement; }
+    FixedMeasurement getFixedMeasurement() const { return this->m_FixedMeasurement; }
+    // return CO2 in ppm, rounded
+    static std::uint16_t getCO2ppm(const FixedMeasurement &m)
+        {
+        return m.CO2ppm >= 0xFFFF8000u ? 0xFFFFu : std::uint16_t((m.CO2ppm + 0x8000u) >> 16);
+        }
+    static std::uint16_t getCO2uflt16(const FixedMeasurement &m);
+    // append each new measurement to pHistory (or stop, if nullptr).
+    void setHistory(cSCD30HistoryBase *pHistory) { this->m_pHistory = pHistory; }
+    cSCD30HistoryBase *getHistory() const { return this->m_pHistory; }
+    // add each new measurement to pSummary (or stop, if nullptr).
+    void setSummary(cSCD30Summary *pSummary) { this->m_pSummary = pSummary; }
+    cSCD30Summary *getSummary() const { return this->m_pSummary; }
     // return cached copy of product information structure.
     ProductInfo getInfo() const { return this->m_ProductInfo; }
     // return cached copy of measurement interval, in ms.
@@ -233,6 +582,15 @@ public:
         return e == Error::Success;
         }
     static const char *getErrorName(Error e);
+    static ErrorClass getErrorClass(Error e);
+    // return true if the driver recovers from e by itself.
+    static bool isRecoverableError(Error e)
+        {
+        auto const c = getErrorClass(e);
+        return c == ErrorClass::Transient || c == ErrorClass::Persistent;
+        }
+    // return the number of consecutive failures since the last good measurement.
+    std::uint16_t getRecoveryFailures() const { return this->m_nFailures; }
     const char *getLastErrorName() const
         {
         return getErrorName(this->m_lastError);
@@ -242,12 +600,57 @@ public:
         {
         return getStateName(this->getState());
         }
-    bool readProductInfo();
+    // return the index of c in Stats::nTransactions[], and the reverse.
+    static unsigned getCommandIndex(Command c);
+    static Command getCommandByIndex(unsigned i);
+#if MCCI_CATENA_SCD30_STATS
+    Stats getStats() const { return this->m_stats; }
+    void clearStats() { this->m_stats = Stats {}; }
+#else
+    Stats getStats() const { return Stats {}; }
+    void clearStats() {}
+#endif
+    bool exportSnapshot(Snapshot &snapshot) const;
+    bool importSnapshot(const Snapshot &snapshot);
+    bool readProductInfo()
+        {
+        return this->readProductInfo(ProductInfoField::All);
+        }
+    bool readProductInfo(ProductInfoField fields);
+    bool readProductInfoAsync(ProductInfoField fields, AsyncDoneFn_t *pDoneFn, void *pClientData);
+    bool applyConfig(const Config &config);
+    bool applyConfigAsync(const Config &config, AsyncDoneFn_t *pDoneFn, void *pClientData);
+    // return true while applyConfigAsync() is running.
+    bool isConfigPending() const { return this->m_fConfigPending; }
+    // write avoidance: if enabled, applyConfig() doesn't write settings
+    // that the cached product info shows the sensor already has.
+    void setConfigCache(bool fEnable) { this->m_fConfigCache = fEnable; }
+    bool getConfigCache() const { return this->m_fConfigCache; }
+    // return the fields of the cached product info known to match the sensor.
+    ProductInfoField getConfigCacheValid() const { return this->m_infoValid; }
+    // forget what the sensor's settings are, so the next applyConfig() writes them.
+    void invalidateConfigCache() { this->m_infoValid = ProductInfoField::None; }
+    // allow at most one applyConfig() write per minIntervalMs; 0 for no limit.
+    void setConfigWriteLimit(std::uint32_t minIntervalMs) { this->m_configWriteLimitMs = minIntervalMs; }
+    std::uint32_t getConfigWriteLimit() const { return this->m_configWriteLimitMs; }
     bool isRunning() const
         {
         return this->m_state > State::End;
         }
     State getState() const { return this->m_state; }
+    // return the estimated measurement period in ms, corrected for the
+    // sensor's clock drift once enough ready transitions have been observed.
+    std::uint32_t getMeasurementPeriodMs() const
+        {
+        return this->m_nReadyObservations == 0 ? this->m_ProductInfo.MeasurementInterval * 1000u
+                                               : this->m_readyPeriod16 / 16u
+                                               ;
+        }
+    // return true if the drift-corrected estimate is being used.
+    bool isReadyEstimateLocked() const
+        {
+        return this->m_nReadyObservations >= kReadyLockObservations;
+        }
     // return millis to next measurement ready, or 0 if it should be ready now.
     std::uint32_t getMsToNextMeasurement() const
         {
@@ -258,12 +661,94 @@ public:
             return this->m_tReady - now;
         }
 
+    // the asynchronous command engine.
+    static void initReadRequest(
+        AsyncRequest &r, Command c, std::uint8_t *pResponse, std::uint8_t nResponse,
+        AsyncDoneFn_t *pDoneFn = nullptr, void *pClientData = nullptr
+        );
+    static void initWriteRequest(
+        AsyncRequest &r, Command c,
+        AsyncDoneFn_t *pDoneFn = nullptr, void *pClientData = nullptr
+        );
+    static void initWriteRequest(
+        AsyncRequest &r, Command c, std::uint16_t param,
+        AsyncDoneFn_t *pDoneFn = nullptr, void *pClientData = nullptr
+        );
+    bool submitRequest(AsyncRequest &r);
+    void poll();
+    // return true if any asynchronous request is queued or in progress.
+    bool isBusy() const { return this->m_pAsyncHead != nullptr; }
+    AsyncState getAsyncState() const { return this->m_asyncState; }
+    bool readMeasurementAsync(AsyncDoneFn_t *pDoneFn, void *pClientData);
+    void setBusSelectFn(BusSelectFn_t *pSelectFn, void *pClientData);
+    // return the bus used by this sensor, or nullptr if the transport isn't a TwoWire.
+    TwoWire *getWire() const { return this->m_pTransport->getWire(); }
+    cSCD30Transport &getTransport() const { return *this->m_pTransport; }
+
 protected:
+    bool runRequest(AsyncRequest &r);
+    bool waitRequest(AsyncRequest &r);
+    bool asyncStep();
+    void asyncComplete(bool fSuccess);
+    bool asyncTimeElapsed(std::uint32_t ms) const
+        {
+        return std::uint32_t(micros() - this->m_tAsyncStart) >= ms * 1000u;
+        }
+    static AsyncDoneFn_t readMeasurementDone;
+    static AsyncDoneFn_t queryReadyDone;
+    bool queryReadyFast(bool &fResult, bool &fError);
+    bool updateDataReady(std::uint16_t flag);
+    void noteMeasurementStarted();
+    bool selectBus();
+    template <unsigned i> static void readyIsr();
+    bool queryReadyPin();
+    void resetReadyEstimate();
+    void observeReady(std::uint32_t tReady);
+    void predictReady();
+    std::uint32_t getReadyRetryMs() const
+        {
+        return this->isReadyEstimateLocked() ? kReadyGuardMs : kReadyRetryMs;
+        }
+    std::uint32_t getReadyLateMs() const;
+
+    // statistics; these compile to nothing if !kStatsEnabled.
+#if MCCI_CATENA_SCD30_STATS
+    void statsCount(std::uint32_t Stats::*pCounter) { ++(this->m_stats.*pCounter); }
+    void statsCountTransaction(Command c) { ++this->m_stats.nTransactions[getCommandIndex(c)]; }
+    void statsCountMeasurement();
+    std::uint32_t statsStartWait() const { return micros(); }
+    void statsEndWait(std::uint32_t tStart) { this->m_stats.WaitUs += micros() - tStart; }
+#else
+    void statsCount(std::uint32_t Stats::*) {}
+    void statsCountTransaction(Command) {}
+    void statsCountMeasurement() {}
+    std::uint32_t statsStartWait() const { return 0; }
+    void statsEndWait(std::uint32_t) {}
+#endif
+    void checkReadyPin();
+    static AsyncDoneFn_t readProductInfoDone;
+    static AsyncDoneFn_t applyConfigDone;
+    static AsyncDoneFn_t setAmbientPressureDone;
+    void notePressureSent(std::uint16_t pressure_mBar);
+    static bool checkConfig(const Config &config);
+    static std::uint16_t getInfoWord(const ProductInfo &info, unsigned iField);
     bool startContinuousMeasurementCommon(std::uint16_t param);
+    bool beginFast();
+    bool noteFailure(Error e);
+    std::uint32_t getBackoffMs() const;
+    bool startSoftReset();
+    static AsyncDoneFn_t softResetDone;
+    bool noteBurstSample();
+    bool filterMeasurement(const FixedMeasurement &m, std::uint8_t invalidChannels);
+    static std::uint8_t getInvalidChannels(const RawMeasurement &raw);
     bool writeCommand(Command c);
     bool writeCommand(Command c, std::uint16_t param);
     bool writeCommandBuffer(const std::uint8_t *pBuffer, size_t nBuffer);
-    bool readResponse(std::uint8_t *buf, size_t nBuf);
+    bool startResponse(AsyncRequest &r);
+    bool startResponseChunk(AsyncRequest &r);
+    std::size_t getResponseChunk(const AsyncRequest &r) const;
+    bool finishResponse(AsyncRequest &r);
+    bool setTransportError(cSCD30Transport::Status status);
     bool readFirmwareVersion(std::uint16_t &version);
     bool readMeasurementInterval(std::uint16_t &interval);
     bool readAutoSelfCalibration(std::uint16_t &flag);
@@ -272,8 +757,8 @@ protected:
     bool readAltitudeCompensation(std::int16_t &meters);
     bool readDataReadyStatus(std::uint16_t &flag);
     bool readUint16(Command c, std::uint16_t &value);
+    template <typename T> bool readWords(Command c, T &value);
     static std::uint8_t crc(const std::uint8_t *buf, size_t nBuf, std::uint8_t crc8 = 0xFF);
-    bool crc_multi(const std::uint8_t *buf, size_t nBuf);
     std::int8_t getAddress() const
         { return static_cast<std::int8_t>(this->m_address); }
     bool checkRunning()
@@ -287,26 +772,177 @@ protected:
 // following are arranged for alignment.
 private:
     Measurement m_Measurement;      /// most recent measurement
-    TwoWire *m_wire;                /// pointer to bus to be used for this device
+    FixedMeasurement m_FixedMeasurement;    /// most recent measurement, in fixed point
+    cSCD30TwoWireTransport m_wireTransport; /// transport, if constructed with a TwoWire
+    cSCD30Transport *m_pTransport;  /// transport to be used for this device
     std::uint32_t m_tReady;         /// estimated time next measurement will be ready (millis)
     ProductInfo m_ProductInfo;      /// product information read from device
     Address m_address;              /// I2C address to be used
     Pin_t m_pinReady;               /// alert pin, or -1 if none.
+    std::int8_t m_iReadyInterrupt   /// index in s_pReadyInstance[], or -1 if not using RDY interrupts.
+        { -1 };
+    volatile bool m_fReadyEdge      /// set by the RDY interrupt.
+        { false };
+    volatile std::uint32_t m_tReadyEdge;    /// time of last RDY interrupt (millis)
+
+    // learning the measurement cadence
+    std::uint32_t m_tLastReady;     /// time of last observed ready transition (millis)
+    std::uint32_t m_tLastBusy;      /// time of last GetDataReady that returned not-ready (millis)
+    std::uint32_t m_readyPeriod16;  /// estimated measurement period, in 1/16 ms
+    std::uint8_t m_nReadyObservations   /// 0: no observation; else count of consistent observations
+        { 0 };
+    std::uint8_t m_nReadyLate       /// polls that found data already ready; each doubles the extra lead
+        { 0 };
+    bool m_fLastBusy                /// true if m_tLastBusy is for the current sample
+        { false };
     Error m_lastError;              /// last error.
     State m_state                   /// current state
         { State::Uninitialized };   // initially not yet started.
+    State m_snapshotState           /// state from importSnapshot(), used by next begin()
+        { State::Uninitialized };   // initially no snapshot.
+    bool m_fFastStart               /// true if begin() should use beginFast()
+        { false };
+    std::uint16_t m_fastStartInterval   /// measurement interval trusted by beginFast(), or 0
+        { 0 };
+
+    // the asynchronous command engine
+    AsyncRequest *m_pAsyncHead      /// first request in queue (the active one)
+        { nullptr };
+    AsyncRequest *m_pAsyncTail      /// last request in queue
+        { nullptr };
+    std::uint32_t m_tAsyncStart;    /// time (micros) the active command was written
+    AsyncState m_asyncState         /// state of the active request
+        { AsyncState::Idle };
+    bool m_fAsyncPolling            /// set while poll() is running, to prevent recursion
+        { false };
+    AsyncRequest m_rqMeasurement    /// request used by readMeasurementAsync()
+        {};
+    AsyncDoneFn_t *m_pMeasurementDoneFn;    /// client completion for readMeasurementAsync()
+    void *m_pMeasurementClientData; /// client context for readMeasurementAsync()
+    tSCD30Response<kMeasurementWords> m_measurementBuffer; /// response buffer for readMeasurementAsync()
+    AsyncRequest m_rqDataReady      /// GetDataReady request used by queryReadyAsync()
+        {};
+    AsyncRequest m_rqStart          /// StartContinuousMeasurement request used by queryReadyAsync()
+        {};
+    AsyncDoneFn_t *m_pReadyDoneFn;  /// client completion for queryReadyAsync()
+    void *m_pReadyClientData;       /// client context for queryReadyAsync()
+    tSCD30Response<1> m_dataReadyBuffer;    /// response buffer for queryReadyAsync()
+#if MCCI_CATENA_SCD30_STATS
+    Stats m_stats                   /// statistics
+        {};
+#endif
+    cSCD30HistoryBase *m_pHistory   /// measurement history, or nullptr
+        { nullptr };
+    cSCD30Summary *m_pSummary       /// running measurement statistics, or nullptr
+        { nullptr };
+    BusSelectFn_t *m_pBusSelectFn   /// bus selection function, or nullptr
+        { nullptr };
+    void *m_pBusSelectClientData;   /// context for bus selection function
+    AsyncRequest m_rqInfo[kProductInfoFields]       /// requests used by readProductInfoAsync()
+        {};
+    tSCD30Response<1> m_infoBuffer[kProductInfoFields]; /// response buffers for readProductInfoAsync()
+    AsyncDoneFn_t *m_pInfoDoneFn;   /// client completion for readProductInfoAsync()
+    void *m_pInfoClientData;        /// client context for readProductInfoAsync()
+    ProductInfoField m_infoFields;  /// fields being fetched by readProductInfoAsync()
+    std::uint8_t m_nInfoPending     /// number of product info reads still outstanding
+        { 0 };
+    Error m_infoError;              /// first error seen by readProductInfoAsync()
+    AsyncRequest m_rqConfig[kProductInfoFields]     /// requests used by applyConfigAsync(), by field; [0] is unused
+        {};
+    Config m_config;                /// changes being made by applyConfigAsync()
+    AsyncDoneFn_t *m_pConfigDoneFn; /// client completion for applyConfigAsync()
+    void *m_pConfigClientData;      /// client context for applyConfigAsync()
+    bool m_fConfigPending           /// true while applyConfigAsync() is running
+        { false };
+    Error m_configError;            /// result of the last applyConfigAsync()
+    ProductInfoField m_infoValid    /// fields of m_ProductInfo known to match the sensor
+        { ProductInfoField::None };
+    bool m_fConfigCache             /// true to skip writing settings the sensor already has
+        { false };
+    bool m_fConfigWritten           /// true if m_tConfigWrite is valid
+        { false };
+    std::uint32_t m_tConfigWrite;   /// time of last applyConfigAsync() write (millis), if m_fConfigWritten
+    std::uint32_t m_configWriteLimitMs  /// min time between applyConfigAsync() writes, or 0
+        { 0 };
+
+    // ambient pressure compensation
+    AsyncRequest m_rqPressure       /// StartContinuousMeasurement request used by setAmbientPressure()
+        {};
+    std::uint32_t m_tPressure;      /// time of last pressure sent to sensor (millis), if m_fPressure
+    std::uint32_t m_pressureMinIntervalMs   /// min time between pressure updates
+        { kPressureMinIntervalMs };
+    std::uint16_t m_pressure        /// ambient pressure in use by the sensor (mBar), or 0
+        { 0 };
+    std::uint16_t m_pressureThreshold   /// min pressure change worth sending (mBar)
+        { kPressureThresholdMbar };
+    bool m_fPressure                /// true if m_tPressure is valid, and the pressure sent wasn't 0
+        { false };
+
+    // burst measurements
+    BurstConfig m_burst;            /// the burst in progress, if m_fBurst
+    FixedMeasurement m_burstSamples[kMaxBurstSamples];  /// samples kept by the burst so far
+    std::uint16_t m_nBurstRead;     /// samples read by the burst so far, including settling
+    bool m_fBurst                   /// true while a burst is collecting samples
+        { false };
+
+    // measurement filter
+    FilterConfig m_filter           /// the filter, if m_fFilter
+        {};
+    FixedMeasurement m_filterHistory[2];    /// the last readings seen by the filter; [1] is the newest
+    std::uint8_t m_nFilterHistory   /// number of valid entries in m_filterHistory
+        { 0 };
+    std::uint8_t m_nWarmupLeft      /// readings still to drop while the sensor warms up
+        { 0 };
+    std::uint8_t m_invalidChannels  /// channels of the last reading that were NaN or infinite
+        { 0 };
+    bool m_fFilter                  /// true if readings are filtered
+        { false };
+
+    // error recovery
+    AsyncRequest m_rqReset          /// SoftReset request used by startSoftReset()
+        {};
+    std::uint16_t m_nFailures       /// consecutive failures since the last good measurement
+        { 0 };
+
+    static float getFloat32(std::uint32_t v);
+    static std::int32_t getFixed32(std::uint32_t v, std::uint8_t scale, unsigned fracBits);
+    static Measurement getMeasurement(const RawMeasurement &raw);
+    static FixedMeasurement getFixedMeasurement(const RawMeasurement &raw);
+
+    static cSCD30 *s_pReadyInstance[kMaxReadyInterrupts];  /// instances using RDY interrupts.
+   };
 
-    static constexpr std::uint16_t getUint16BE(const std::uint8_t *p)
-        {
-        return (p[0] << 8) + p[1];
-        }
-    static constexpr std::int16_t getInt16BE(const std::uint8_t *p)
+/// a ReadMeasurement response: CO2, T, RH, each a float in two words.
+template <>
+struct tSCD30WordLayout<cSCD30::RawMeasurement>
+    {
+    static constexpr std::size_t kWords = 3 * 2;
+    static void decode(cSCD30WordReader &r, cSCD30::RawMeasurement &m)
         {
-        return std::int16_t((p[0] << 8) + p[1]);
+        m.CO2ppm = r.getUint32();
+        m.Temperature = r.getUint32();
+        m.RelativeHumidity = r.getUint32();
         }
-    static float getFloat32BE(const std::uint8_t *p);
-   };
+    };
+static_assert(
+    tSCD30WordLayout<cSCD30::RawMeasurement>::kWords == cSCD30::kMeasurementWords,
+    "m_measurementBuffer doesn't match the RawMeasurement layout"
+    );
+
+static constexpr cSCD30::ProductInfoField operator| (cSCD30::ProductInfoField lhs, cSCD30::ProductInfoField rhs)
+    {
+    return cSCD30::ProductInfoField(std::uint8_t(lhs) | std::uint8_t(rhs));
+    }
+
+static constexpr cSCD30::ProductInfoField operator& (cSCD30::ProductInfoField lhs, cSCD30::ProductInfoField rhs)
+    {
+    return cSCD30::ProductInfoField(std::uint8_t(lhs) & std::uint8_t(rhs));
+    }
 
 } // namespace McciCatenaScd30
 
+#undef MCCI_CATENA_SCD30_ENUM_
+#undef MCCI_CATENA_SCD30_NAME_
+#undef MCCI_CATENA_SCD30_COUNT_
+
 #endif // _MCCI_CATENA_SCD30_H_
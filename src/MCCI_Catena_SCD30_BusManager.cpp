@@ -0,0 +1,283 @@
+/*
+
+Module:	MCCI_Catena_SCD30_BusManager.cpp
+
+Function:
+    Implementation of cSCD30BusManager, for driving many SCD30 sensors.
+
+Copyright and License:
+    This file copyright (C) 2020 by
+
+        MCCI Corporation
+        3520 Krums Corners Road
+        Ithaca, NY  14850
+
+    See accompanying LICENSE file for copyright and license information.
+
+Author:
+    Terry Moore, MCCI Corporation	October 2020
+
+*/
+
+#include "MCCI_Catena_SCD30_BusManager.h"
+
+using namespace McciCatenaScd30;
+
+/*
+
+Name:	cSCD30BusManager::addSensor()
+
+Function:
+    Add a sensor to the set managed by this object.
+
+Definition:
+    bool cSCD30BusManager::addSensor(
+        cSCD30 &sensor,
+        std::uint8_t channel = kNoChannel
+        );
+
+Description:
+    The sensor is added to the manager. If `channel` is not
+    kNoChannel, the sensor is behind a multiplexer on its bus, and
+    the function registered with setSelectFn() is called to select
+    `channel` before any transaction with the sensor (unless the
+    multiplexer is known to be set already).
+
+    The manager takes over the sensor's bus selection function.
+
+Returns:
+    `true` if the sensor was added, `false` if the manager is full.
+
+*/
+
+bool cSCD30BusManager::addSensor(cSCD30 &sensor, std::uint8_t channel)
+    {
+    if (this->m_nSensors >= kMaxSensors)
+        return false;
+
+    // find the bus, or add it.
+    auto const pWire = sensor.getWire();
+    unsigned iBus;
+    for (iBus = 0; iBus < this->m_nBus; ++iBus)
+        {
+        if (this->m_bus[iBus].pWire == pWire)
+            break;
+        }
+
+    if (iBus == this->m_nBus)
+        {
+        this->m_bus[iBus].pWire = pWire;
+        this->m_bus[iBus].channel = kNoChannel;
+        ++this->m_nBus;
+        }
+
+    auto const iSensor = this->m_nSensors++;
+    auto &s = this->m_sensor[iSensor];
+
+    s.pSensor = &sensor;
+    s.pManager = this;
+    s.iSensor = iSensor;
+    s.iBus = std::uint8_t(iBus);
+    s.channel = channel;
+    s.fQuerying = false;
+    s.fReading = false;
+
+    sensor.setBusSelectFn(selectBus, (void *)&s);
+    return true;
+    }
+
+/*
+
+Name:	cSCD30BusManager::begin()
+
+Function:
+    Start all the managed sensors.
+
+Definition:
+    bool cSCD30BusManager::begin();
+
+Description:
+    cSCD30::begin() is called for each sensor. A sensor that fails
+    to start is left alone by poll(); the caller can check each
+    sensor with getSensor() and retry.
+
+Returns:
+    `true` if all sensors started, `false` otherwise.
+
+*/
+
+bool cSCD30BusManager::begin()
+    {
+    bool result = true;
+
+    this->invalidateSelection();
+    for (unsigned i = 0; i < this->m_nSensors; ++i)
+        {
+        if (! this->m_sensor[i].pSensor->begin())
+            result = false;
+        }
+
+    return result;
+    }
+
+void cSCD30BusManager::end()
+    {
+    for (unsigned i = 0; i < this->m_nSensors; ++i)
+        this->m_sensor[i].pSensor->end();
+    }
+
+/*
+
+Name:	cSCD30BusManager::poll()
+
+Function:
+    Advance all the managed sensors.
+
+Definition:
+    void cSCD30BusManager::poll();
+
+Description:
+    Each sensor's asynchronous engine is polled. Then, for each
+    idle sensor, either a data-ready query or a measurement read is
+    started if it's time. Nothing here waits for the sensor, so
+    the bus is used by whichever sensor is ready to use it. When
+    a measurement has been read, the measurement function is called.
+
+    This must be called frequently (e.g. from the client's loop or
+    pollable object).
+
+Returns:
+    No explicit result.
+
+*/
+
+void cSCD30BusManager::poll()
+    {
+    for (unsigned i = 0; i < this->m_nSensors; ++i)
+        this->pollSensor(this->m_sensor[i]);
+    }
+
+void cSCD30BusManager::pollSensor(cSCD30BusManager::Sensor &s)
+    {
+    auto &sensor = *s.pSensor;
+
+    sensor.poll();
+
+    if (s.fQuerying || s.fReading || ! sensor.isRunning())
+        return;
+
+    // ask the sensor, if it's time; the answer comes back in queryReadyDone().
+    if (sensor.queryReadyAsync(queryReadyDone, (void *)&s))
+        {
+        s.fQuerying = true;
+        return;
+        }
+
+    // no need to ask; start the read if data is ready.
+    if (sensor.getState() != cSCD30::State::Ready)
+        return;
+
+    s.fReading = true;
+    if (! sensor.readMeasurementAsync(readMeasurementDone, (void *)&s))
+        {
+        s.fReading = false;
+        if (this->m_pMeasurementFn != nullptr)
+            this->m_pMeasurementFn(this->m_pMeasurementClientData, s.iSensor, sensor, false);
+        }
+    }
+
+void cSCD30BusManager::queryReadyDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pSensor = (Sensor *)pClientData;
+    auto const pThis = pSensor->pManager;
+
+    (void) pRequest;
+    pSensor->fQuerying = false;
+
+    // if the query failed the sensor has already backed off; report it.
+    if (! fSuccess && pThis->m_pMeasurementFn != nullptr)
+        pThis->m_pMeasurementFn(pThis->m_pMeasurementClientData, pSensor->iSensor, *pSensor->pSensor, false);
+    }
+
+void cSCD30BusManager::readMeasurementDone(
+    void *pClientData,
+    cSCD30::AsyncRequest *pRequest,
+    bool fSuccess
+    )
+    {
+    auto const pSensor = (Sensor *)pClientData;
+    auto const pThis = pSensor->pManager;
+
+    (void) pRequest;
+    pSensor->fReading = false;
+
+    if (pThis->m_pMeasurementFn != nullptr)
+        pThis->m_pMeasurementFn(pThis->m_pMeasurementClientData, pSensor->iSensor, *pSensor->pSensor, fSuccess);
+    }
+
+// point the multiplexer at the sensor, if needed.
+bool cSCD30BusManager::selectBus(
+    void *pClientData,
+    cSCD30 *pSCD30
+    )
+    {
+    auto const pSensor = (Sensor *)pClientData;
+    auto const pThis = pSensor->pManager;
+
+    // the sensor is known from the client data.
+    (void) pSCD30;
+
+    if (pSensor->channel == kNoChannel)
+        return true;
+
+    auto &bus = pThis->m_bus[pSensor->iBus];
+    if (bus.channel == pSensor->channel)
+        return true;
+
+    if (pThis->m_pSelectFn != nullptr &&
+        pThis->m_pSelectFn(pThis->m_pSelectClientData, bus.pWire, pSensor->channel))
+        {
+        bus.channel = pSensor->channel;
+        return true;
+        }
+
+    // we don't know what state the multiplexer is in.
+    bus.channel = kNoChannel;
+    return false;
+    }
+
+bool cSCD30BusManager::isBusy() const
+    {
+    for (unsigned i = 0; i < this->m_nSensors; ++i)
+        {
+        auto const &s = this->m_sensor[i];
+
+        if (s.fQuerying || s.fReading || s.pSensor->isBusy())
+            return true;
+        }
+
+    return false;
+    }
+
+std::uint32_t cSCD30BusManager::getMsToNextMeasurement() const
+    {
+    std::uint32_t result = UINT32_MAX;
+
+    for (unsigned i = 0; i < this->m_nSensors; ++i)
+        {
+        auto const &sensor = *this->m_sensor[i].pSensor;
+
+        if (! sensor.isRunning())
+            continue;
+
+        auto const msToNext = sensor.getMsToNextMeasurement();
+        if (msToNext < result)
+            result = msToNext;
+        }
+
+    return result == UINT32_MAX ? 0 : result;
+    }
@@ -0,0 +1,126 @@
+/*
+
+Module: MCCI_Catena_SCD30_BusManager.h
+
+Function:
+    Scheduler for many cSCD30 instances on shared TwoWire buses.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_BUSMANAGER_H_
+# define _MCCI_CATENA_SCD30_BUSMANAGER_H_
+# pragma once
+
+#include "MCCI_Catena_SCD30.h"
+
+namespace McciCatenaScd30 {
+
+/// Drive a set of SCD30 sensors, interleaving their bus transactions.
+///
+/// Each sensor's own asynchronous engine does the timing; the manager
+/// polls all of them, so a command can be sent to one sensor while
+/// another is in its read delay or command recovery, and sensors on
+/// different buses never wait for each other. If several sensors share
+/// a bus through a multiplexer, the manager calls a client-supplied
+/// function to switch the multiplexer whenever the next transaction is
+/// for a sensor on a different channel.
+class cSCD30BusManager
+    {
+public:
+    static constexpr unsigned kMaxSensors = 8;          /// max sensors per manager
+    static constexpr std::uint8_t kNoChannel = 0xFF;    /// sensor is not behind a multiplexer
+
+    /// select multiplexer `channel` on bus `pWire`; return true for success.
+    using SelectFn_t = bool (void *pClientData, TwoWire *pWire, std::uint8_t channel);
+
+    /// a measurement has been read (or failed) for sensor `iSensor`.
+    using MeasurementFn_t = void (void *pClientData, unsigned iSensor, cSCD30 &sensor, bool fSuccess);
+
+    // constructor
+    cSCD30BusManager() {}
+
+    // neither copyable nor movable
+    cSCD30BusManager(const cSCD30BusManager&) = delete;
+    cSCD30BusManager& operator=(const cSCD30BusManager&) = delete;
+    cSCD30BusManager(const cSCD30BusManager&&) = delete;
+    cSCD30BusManager& operator=(const cSCD30BusManager&&) = delete;
+
+    bool addSensor(cSCD30 &sensor, std::uint8_t channel = kNoChannel);
+    void setSelectFn(SelectFn_t *pSelectFn, void *pClientData)
+        {
+        this->m_pSelectFn = pSelectFn;
+        this->m_pSelectClientData = pClientData;
+        this->invalidateSelection();
+        }
+    void setMeasurementFn(MeasurementFn_t *pMeasurementFn, void *pClientData)
+        {
+        this->m_pMeasurementFn = pMeasurementFn;
+        this->m_pMeasurementClientData = pClientData;
+        }
+    // forget which channel is selected on each bus (e.g. if the client
+    // has used the multiplexer directly).
+    void invalidateSelection()
+        {
+        for (unsigned i = 0; i < this->m_nBus; ++i)
+            this->m_bus[i].channel = kNoChannel;
+        }
+
+    bool begin();
+    void end();
+    void poll();
+
+    unsigned getNumSensors() const { return this->m_nSensors; }
+    cSCD30 &getSensor(unsigned iSensor) { return *this->m_sensor[iSensor].pSensor; }
+    // return true if any sensor has asynchronous work in progress.
+    bool isBusy() const;
+    // return millis until the first sensor expects a measurement, or 0.
+    std::uint32_t getMsToNextMeasurement() const;
+
+private:
+    // per-sensor bookkeeping
+    struct Sensor
+        {
+        cSCD30              *pSensor;       /// the sensor
+        cSCD30BusManager    *pManager;      /// back pointer, for callbacks
+        std::uint8_t        iSensor;        /// index in m_sensor[]
+        std::uint8_t        iBus;           /// index in m_bus[]
+        std::uint8_t        channel;        /// multiplexer channel, or kNoChannel
+        bool                fQuerying;      /// queryReadyAsync() in progress
+        bool                fReading;       /// readMeasurementAsync() in progress
+        };
+
+    // per-bus bookkeeping
+    struct Bus
+        {
+        TwoWire             *pWire;         /// the bus
+        std::uint8_t        channel;        /// currently-selected channel, or kNoChannel
+        };
+
+    static cSCD30::BusSelectFn_t selectBus;
+    static cSCD30::AsyncDoneFn_t queryReadyDone;
+    static cSCD30::AsyncDoneFn_t readMeasurementDone;
+    void pollSensor(Sensor &s);
+
+    Sensor m_sensor[kMaxSensors];           /// the sensors
+    Bus m_bus[kMaxSensors];                 /// the buses
+    SelectFn_t *m_pSelectFn                 /// multiplexer selection, or nullptr
+        { nullptr };
+    void *m_pSelectClientData;              /// context for m_pSelectFn
+    MeasurementFn_t *m_pMeasurementFn       /// measurement callback, or nullptr
+        { nullptr };
+    void *m_pMeasurementClientData;         /// context for m_pMeasurementFn
+    std::uint8_t m_nSensors                 /// number of entries in m_sensor[]
+        { 0 };
+    std::uint8_t m_nBus                     /// number of entries in m_bus[]
+        { 0 };
+    };
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_BUSMANAGER_H_
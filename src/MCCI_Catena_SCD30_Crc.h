@@ -0,0 +1,157 @@
+/*
+
+Module: MCCI_Catena_SCD30_Crc.h
+
+Function:
+    CRC-8 for Sensirion sensor data, for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_CRC_H_
+# define _MCCI_CATENA_SCD30_CRC_H_
+# pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// This header has no Arduino dependencies, so host tools can use it.
+
+/// \brief select the CRC implementation.
+///
+/// If non-zero, the CRC uses a 256-entry table, one lookup per byte.
+/// If zero, it uses a 16-entry table, two lookups per byte, which
+/// saves 240 bytes of flash. Define this before including the library
+/// to override the default, which is the 16-entry table only on AVR.
+#ifndef MCCI_CATENA_SCD30_CRC_TABLE256
+# if defined(__AVR__)
+#  define MCCI_CATENA_SCD30_CRC_TABLE256 0
+# else
+#  define MCCI_CATENA_SCD30_CRC_TABLE256 1
+# endif
+#endif
+
+namespace McciCatenaScd30 {
+
+/// \brief a list of indices 0..N-1, for building tables at compile time.
+///
+/// The library is C++11, where a constexpr function can't have a loop;
+/// tables are built instead by expanding an index pack into an
+/// initializer, one element per index. (This is std::index_sequence,
+/// which C++11 doesn't have.)
+template <std::size_t... a_i>
+struct tIndices
+    {};
+
+template <std::size_t a_n, std::size_t... a_i>
+struct tMakeIndices : tMakeIndices<a_n - 1, a_n - 1, a_i...>
+    {};
+
+template <std::size_t... a_i>
+struct tMakeIndices<0, a_i...>
+    {
+    using type = tIndices<a_i...>;
+    };
+
+/// The Sensirion CRC-8: polynomial 0x31, initial value 0xFF, no
+/// reflection, no final XOR; one CRC byte follows each 16-bit word.
+///
+/// `a_fTable256` chooses the implementation. The tables are computed
+/// at compile time, and only the one that's used ends up in flash.
+template <bool a_fTable256>
+class tCrc8
+    {
+public:
+    static constexpr std::uint8_t kPolynomial = 0x31;
+    static constexpr std::uint8_t kInitial = 0xFF;
+
+    /// the table, in a struct so it can be returned by a constexpr function.
+    template <std::size_t N>
+    struct Table
+        {
+        std::uint8_t v[N];
+        };
+
+    static constexpr unsigned kTableBits = a_fTable256 ? 8 : 4;
+
+    /// the CRC register c, after nBits more zero bits.
+    static constexpr std::uint8_t shiftBits(unsigned c, unsigned nBits)
+        {
+        return nBits == 0 ? std::uint8_t(c)
+                          : shiftBits((c & 0x80) ? ((c << 1) ^ kPolynomial) & 0xFF : (c << 1) & 0xFF, nBits - 1)
+                          ;
+        }
+
+    /// entry i is the CRC of i, shifted left by (8 - kTableBits), after kTableBits more bits.
+    template <std::size_t... a_i>
+    static constexpr Table<sizeof...(a_i)> makeTable(tIndices<a_i...>)
+        {
+        return Table<sizeof...(a_i)> {{ shiftBits(unsigned(a_i) << (8 - kTableBits), kTableBits)... }};
+        }
+
+    static constexpr Table<(1u << kTableBits)> kTable =
+        makeTable(typename tMakeIndices<(1u << kTableBits)>::type {});
+
+    /// add one byte to the CRC.
+    static std::uint8_t update(std::uint8_t crc8, std::uint8_t b)
+        {
+        if (a_fTable256)
+            return kTable.v[crc8 ^ b];
+
+        // high nibble, then low nibble.
+        crc8 = std::uint8_t(crc8 << 4) ^ kTable.v[(b ^ crc8) >> 4];
+        return std::uint8_t(crc8 << 4) ^ kTable.v[((crc8 >> 4) ^ b) & 0xF];
+        }
+
+    /// compute the CRC of a buffer.
+    static std::uint8_t crc(const std::uint8_t *buf, std::size_t nBuf, std::uint8_t crc8 = kInitial)
+        {
+        for (; nBuf > 0; --nBuf, ++buf)
+            crc8 = update(crc8, *buf);
+
+        return crc8;
+        }
+
+    /// \brief check the CRCs of a response, and pack its words in place.
+    ///
+    /// `buf` holds nBuf / 3 tuples: a big-endian word, then its CRC.
+    /// In one pass, each CRC is checked, and the words are stored,
+    /// big-endian, in the first 2 * nBuf / 3 bytes of buf itself. nBuf
+    /// must be a multiple of 3. Each tuple is read before its word is
+    /// stored, and a word never lands beyond its own tuple, so nothing
+    /// is overwritten before it's checked. Returns false at the first
+    /// bad CRC, leaving buf partly packed.
+    static bool packWords(std::uint8_t *buf, std::size_t nBuf)
+        {
+        std::uint8_t *pOut = buf;
+
+        for (; nBuf >= 3; buf += 3, nBuf -= 3)
+            {
+            std::uint8_t const b0 = buf[0];
+            std::uint8_t const b1 = buf[1];
+
+            if (update(update(kInitial, b0), b1) != buf[2])
+                return false;
+
+            *pOut++ = b0;
+            *pOut++ = b1;
+            }
+
+        return true;
+        }
+    };
+
+template <bool a_fTable256>
+constexpr typename tCrc8<a_fTable256>::template Table<(1u << tCrc8<a_fTable256>::kTableBits)> tCrc8<a_fTable256>::kTable;
+
+/// the CRC used by the library.
+using Crc8 = tCrc8<MCCI_CATENA_SCD30_CRC_TABLE256 != 0>;
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_CRC_H_
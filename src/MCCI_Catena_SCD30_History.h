@@ -0,0 +1,221 @@
+/*
+
+Module: MCCI_Catena_SCD30_History.h
+
+Function:
+    Fixed-capacity measurement history for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_HISTORY_H_
+# define _MCCI_CATENA_SCD30_HISTORY_H_
+# pragma once
+
+#include "MCCI_Catena_SCD30.h"
+
+#include <cstddef>
+
+namespace McciCatenaScd30 {
+
+/// A ring buffer of measurements, in a compact quantized form.
+///
+/// This base class does all the work, but has no storage; use
+/// cSCD30History<N> to declare a history with N samples. Once attached
+/// with cSCD30::setHistory(), every successful measurement read is
+/// appended. When the buffer is full, the oldest sample is overwritten.
+///
+/// Samples are accessed in place, oldest first, either by index,
+/// by iterator, or as (at most) two contiguous spans.
+class cSCD30HistoryBase
+    {
+public:
+    /// one sample. The quantization matches the port 1 format 0x1E uplink.
+    struct Sample
+        {
+        std::uint32_t   tSample;            /// time of measurement (millis)
+        std::int16_t    Temperature;        /// temperature, in 0.005 degrees C
+        std::uint16_t   RelativeHumidity;   /// RH, where 0xFFFF is 100%
+        std::uint16_t   CO2ppm;             /// CO2 concentration, ppm
+        std::uint16_t   Flags;              /// reserved, zero.
+        };
+
+    /// iterator over samples, oldest first.
+    class const_iterator
+        {
+    public:
+        const_iterator(const cSCD30HistoryBase *pHistory, std::size_t i)
+            : m_pHistory(pHistory)
+            , m_i(i)
+            {}
+        const Sample &operator*() const { return (*this->m_pHistory)[this->m_i]; }
+        const Sample *operator->() const { return &(*this->m_pHistory)[this->m_i]; }
+        const_iterator &operator++() { ++this->m_i; return *this; }
+        bool operator==(const const_iterator &rhs) const { return this->m_i == rhs.m_i; }
+        bool operator!=(const const_iterator &rhs) const { return this->m_i != rhs.m_i; }
+    private:
+        const cSCD30HistoryBase *m_pHistory;
+        std::size_t m_i;
+        };
+
+    // neither copyable nor movable
+    cSCD30HistoryBase(const cSCD30HistoryBase&) = delete;
+    cSCD30HistoryBase& operator=(const cSCD30HistoryBase&) = delete;
+    cSCD30HistoryBase(const cSCD30HistoryBase&&) = delete;
+    cSCD30HistoryBase& operator=(const cSCD30HistoryBase&&) = delete;
+
+    std::size_t size() const { return this->m_nUsed; }
+    std::size_t capacity() const { return this->m_nBuffer; }
+    bool empty() const { return this->m_nUsed == 0; }
+    bool full() const { return this->m_nUsed == this->m_nBuffer; }
+    void clear()
+        {
+        this->m_iFirst = 0;
+        this->m_nUsed = 0;
+        }
+
+    // return sample i, where 0 is the oldest. i must be < size().
+    const Sample &operator[](std::size_t i) const
+        {
+        std::size_t j = this->m_iFirst + i;
+        if (j >= this->m_nBuffer)
+            j -= this->m_nBuffer;
+        return this->m_pBuffer[j];
+        }
+    // return the newest sample. The history must not be empty.
+    const Sample &back() const { return (*this)[this->m_nUsed - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, this->m_nUsed); }
+
+    // get the samples, oldest first, as up to two contiguous spans;
+    // returns the total number of samples.
+    std::size_t getSpans(
+        const Sample *&pFirst, std::size_t &nFirst,
+        const Sample *&pSecond, std::size_t &nSecond
+        ) const
+        {
+        std::size_t const nTail = this->m_nBuffer - this->m_iFirst;
+
+        pFirst = &this->m_pBuffer[this->m_iFirst];
+        pSecond = this->m_pBuffer;
+        if (this->m_nUsed <= nTail)
+            {
+            nFirst = this->m_nUsed;
+            nSecond = 0;
+            }
+        else
+            {
+            nFirst = nTail;
+            nSecond = this->m_nUsed - nTail;
+            }
+        return this->m_nUsed;
+        }
+
+    // append a sample, overwriting the oldest if full.
+    void put(const Sample &s)
+        {
+        if (this->m_nBuffer == 0)
+            return;
+
+        if (this->full())
+            {
+            this->m_pBuffer[this->m_iFirst] = s;
+            if (++this->m_iFirst == this->m_nBuffer)
+                this->m_iFirst = 0;
+            }
+        else
+            {
+            std::size_t j = this->m_iFirst + this->m_nUsed;
+            if (j >= this->m_nBuffer)
+                j -= this->m_nBuffer;
+            this->m_pBuffer[j] = s;
+            ++this->m_nUsed;
+            }
+        }
+
+    // convert a measurement to a sample.
+    static Sample encode(std::uint32_t tSample, const cSCD30::Measurement &m)
+        {
+        Sample s;
+
+        s.tSample = tSample;
+        s.Temperature = std::int16_t(quantize(m.Temperature * 200.0f, -32768.0f, 32767.0f));
+        s.RelativeHumidity = std::uint16_t(quantize(m.RelativeHumidity * (65535.0f / 100.0f), 0.0f, 65535.0f));
+        s.CO2ppm = std::uint16_t(quantize(m.CO2ppm, 0.0f, 65535.0f));
+        s.Flags = 0;
+        return s;
+        }
+
+    // convert a fixed-point measurement to a sample, without floating point.
+    static Sample encode(std::uint32_t tSample, const cSCD30::FixedMeasurement &m)
+        {
+        Sample s;
+
+        s.tSample = tSample;
+        s.Temperature = m.Temperature;
+        s.RelativeHumidity = m.RelativeHumidity;
+        s.CO2ppm = cSCD30::getCO2ppm(m);
+        s.Flags = 0;
+        return s;
+        }
+
+    // convert a sample back to a measurement.
+    static cSCD30::Measurement decode(const Sample &s)
+        {
+        cSCD30::Measurement m;
+
+        m.CO2ppm = float(s.CO2ppm);
+        m.Temperature = s.Temperature / 200.0f;
+        m.RelativeHumidity = s.RelativeHumidity * (100.0f / 65535.0f);
+        return m;
+        }
+
+protected:
+    cSCD30HistoryBase(Sample *pBuffer, std::size_t nBuffer)
+        : m_pBuffer(pBuffer)
+        , m_nBuffer(nBuffer)
+        {}
+
+private:
+    // round to nearest, and clamp.
+    static std::int32_t quantize(float v, float vMin, float vMax)
+        {
+        if (! (v > vMin))       // also catches NaN
+            v = vMin;
+        else if (v > vMax)
+            v = vMax;
+        return std::int32_t(v < 0.0f ? v - 0.5f : v + 0.5f);
+        }
+
+    Sample *m_pBuffer;              /// the storage
+    std::size_t m_nBuffer;          /// number of entries in m_pBuffer
+    std::size_t m_iFirst            /// index of oldest sample
+        { 0 };
+    std::size_t m_nUsed             /// number of samples
+        { 0 };
+    };
+
+/// A history with storage for N samples.
+template <std::size_t N>
+class cSCD30History : public cSCD30HistoryBase
+    {
+public:
+    static_assert(N > 0, "history must have at least one sample");
+
+    cSCD30History()
+        : cSCD30HistoryBase(m_storage, N)
+        {}
+
+private:
+    Sample m_storage[N];
+    };
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_HISTORY_H_
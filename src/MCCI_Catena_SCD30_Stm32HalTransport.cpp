@@ -0,0 +1,258 @@
+/*
+
+Module: MCCI_Catena_SCD30_Stm32HalTransport.cpp
+
+Function:
+    STM32 HAL interrupt/DMA I2C transport for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "MCCI_Catena_SCD30_Stm32HalTransport.h"
+
+#if defined(HAL_I2C_MODULE_ENABLED)
+
+using namespace McciCatenaScd30;
+
+cSCD30Stm32HalTransport *cSCD30Stm32HalTransport::s_pInstance[cSCD30Stm32HalTransport::kMaxInstances];
+
+/*
+
+Name:	cSCD30Stm32HalTransport::begin()
+
+Function:
+    Attach the transport to its HAL handle.
+
+Definition:
+    bool cSCD30Stm32HalTransport::begin() override;
+
+Description:
+    The transport is entered in the table used by the static
+    callbacks to find it from the handle. If the HAL supports
+    per-handle callbacks, ours are registered. Calling begin() again
+    is harmless.
+
+Returns:
+    `true` if the transport can be used; `false` if there's no handle,
+    another transport is attached to the handle (the callbacks could
+    only reach one of them), or the table is full.
+
+*/
+
+bool cSCD30Stm32HalTransport::begin()
+    {
+    if (this->m_phI2c == nullptr)
+        return false;
+
+    auto const pInstance = findInstance(this->m_phI2c);
+
+    if (pInstance != nullptr && pInstance != this)
+        return false;
+
+    if (pInstance == nullptr)
+        {
+        unsigned i;
+
+        for (i = 0; i < kMaxInstances; ++i)
+            {
+            if (s_pInstance[i] == nullptr)
+                break;
+            }
+
+        if (i == kMaxInstances)
+            return false;
+
+        s_pInstance[i] = this;
+        }
+
+#if defined(USE_HAL_I2C_REGISTER_CALLBACKS) && USE_HAL_I2C_REGISTER_CALLBACKS == 1
+    HAL_I2C_RegisterCallback(this->m_phI2c, HAL_I2C_MASTER_RX_COMPLETE_CB_ID, rxCompleteCallback);
+    HAL_I2C_RegisterCallback(this->m_phI2c, HAL_I2C_ERROR_CB_ID, errorCallback);
+#endif
+
+    return true;
+    }
+
+// stop any read, and take the transport out of the table, so the
+// callbacks can't reach it after it's gone.
+void cSCD30Stm32HalTransport::end()
+    {
+    bool fAttached = false;
+
+    for (auto &pInstance : s_pInstance)
+        {
+        if (pInstance == this)
+            {
+            fAttached = true;
+            break;
+            }
+        }
+
+    if (! fAttached)
+        return;
+
+    this->abortRead();
+
+#if defined(USE_HAL_I2C_REGISTER_CALLBACKS) && USE_HAL_I2C_REGISTER_CALLBACKS == 1
+    HAL_I2C_UnRegisterCallback(this->m_phI2c, HAL_I2C_MASTER_RX_COMPLETE_CB_ID);
+    HAL_I2C_UnRegisterCallback(this->m_phI2c, HAL_I2C_ERROR_CB_ID);
+#endif
+
+    for (auto &pInstance : s_pInstance)
+        {
+        if (pInstance == this)
+            pInstance = nullptr;
+        }
+    }
+
+cSCD30Transport::Status
+cSCD30Stm32HalTransport::write(
+    std::uint8_t address,
+    const std::uint8_t *pBuffer,
+    std::size_t nBuffer
+    )
+    {
+    if (HAL_I2C_Master_Transmit(
+            this->m_phI2c,
+            std::uint16_t(address << 1),
+            const_cast<std::uint8_t *>(pBuffer),
+            std::uint16_t(nBuffer),
+            kWriteTimeoutMs
+            ) != HAL_OK)
+        {
+        return Status::WriteFailed;
+        }
+
+    return Status::Success;
+    }
+
+/*
+
+Name:	cSCD30Stm32HalTransport::startRead()
+
+Function:
+    Start reading a response into the caller's buffer.
+
+Definition:
+    cSCD30Transport::Status cSCD30Stm32HalTransport::startRead(
+        std::uint8_t address,
+        std::uint8_t *pBuffer,
+        std::size_t nBuffer
+        ) override;
+
+Description:
+    The read is started with DMA if the handle has a receive DMA
+    channel, otherwise with the interrupt driver. Either way, the data
+    is stored directly in pBuffer, and the HAL callbacks set the final
+    status.
+
+Returns:
+    Status::Busy if the read was started, Status::ReadRequestFailed if
+    the HAL refused it.
+
+*/
+
+cSCD30Transport::Status
+cSCD30Stm32HalTransport::startRead(
+    std::uint8_t address,
+    std::uint8_t *pBuffer,
+    std::size_t nBuffer
+    )
+    {
+    auto const phI2c = this->m_phI2c;
+    auto const devAddress = std::uint16_t(address << 1);
+    HAL_StatusTypeDef halStatus;
+
+    this->m_address = address;
+    this->m_readStatus = Status::Busy;
+
+    if (phI2c->hdmarx != nullptr)
+        halStatus = HAL_I2C_Master_Receive_DMA(phI2c, devAddress, pBuffer, std::uint16_t(nBuffer));
+    else
+        halStatus = HAL_I2C_Master_Receive_IT(phI2c, devAddress, pBuffer, std::uint16_t(nBuffer));
+
+    if (halStatus != HAL_OK)
+        this->m_readStatus = Status::ReadRequestFailed;
+
+    return this->m_readStatus;
+    }
+
+void cSCD30Stm32HalTransport::abortRead()
+    {
+    if (this->m_readStatus != Status::Busy)
+        return;
+
+    HAL_I2C_Master_Abort_IT(this->m_phI2c, std::uint16_t(this->m_address << 1));
+    this->m_readStatus = Status::ReadRequestFailed;
+    }
+
+/*
+
+Name:	cSCD30Stm32HalTransport::recoverBus()
+
+Function:
+    Reinitialize the I2C peripheral.
+
+Definition:
+    bool cSCD30Stm32HalTransport::recoverBus() override;
+
+Description:
+    The peripheral is deinitialized and initialized again, which
+    clears a BUSY flag left set by a glitch on the bus. HAL_I2C_Init()
+    calls HAL_I2C_MspInit(), so a board that needs to clock a stuck
+    device off the bus can do that there, before the pins are given
+    back to the peripheral.
+
+Returns:
+    `true` if the peripheral was reinitialized.
+
+*/
+
+bool cSCD30Stm32HalTransport::recoverBus()
+    {
+    this->abortRead();
+
+    HAL_I2C_DeInit(this->m_phI2c);
+    return HAL_I2C_Init(this->m_phI2c) == HAL_OK;
+    }
+
+/****************************************************************************\
+|
+|   The HAL callbacks
+|
+\****************************************************************************/
+
+cSCD30Stm32HalTransport *
+cSCD30Stm32HalTransport::findInstance(I2C_HandleTypeDef *phI2c)
+    {
+    for (auto const pInstance : s_pInstance)
+        {
+        if (pInstance != nullptr && pInstance->m_phI2c == phI2c)
+            return pInstance;
+        }
+
+    return nullptr;
+    }
+
+void cSCD30Stm32HalTransport::rxCompleteCallback(I2C_HandleTypeDef *phI2c)
+    {
+    auto const pThis = findInstance(phI2c);
+
+    if (pThis != nullptr && pThis->m_readStatus == Status::Busy)
+        pThis->m_readStatus = Status::Success;
+    }
+
+void cSCD30Stm32HalTransport::errorCallback(I2C_HandleTypeDef *phI2c)
+    {
+    auto const pThis = findInstance(phI2c);
+
+    if (pThis != nullptr && pThis->m_readStatus == Status::Busy)
+        pThis->m_readStatus = Status::ReadRequestFailed;
+    }
+
+#endif // defined(HAL_I2C_MODULE_ENABLED)
@@ -0,0 +1,87 @@
+/*
+
+Module: MCCI_Catena_SCD30_Stm32HalTransport.h
+
+Function:
+    STM32 HAL interrupt/DMA I2C transport for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_STM32HALTRANSPORT_H_
+# define _MCCI_CATENA_SCD30_STM32HALTRANSPORT_H_
+# pragma once
+
+#include <Arduino.h>
+#include "MCCI_Catena_SCD30_Transport.h"
+
+// this transport is only available when the core supplies the HAL I2C driver.
+#if defined(HAL_I2C_MODULE_ENABLED)
+
+namespace McciCatenaScd30 {
+
+/// A transport that uses an STM32 HAL I2C handle.
+///
+/// Reads go straight into the caller's buffer, by DMA if the handle
+/// has a receive DMA channel linked, otherwise by the HAL's interrupt
+/// driver; the driver's engine polls for completion, so nothing waits.
+/// Writes use the blocking HAL call, as they're at most five bytes.
+///
+/// The client owns the handle, and must initialize it (and its DMA and
+/// interrupts) before calling cSCD30::begin(). The HAL reports
+/// completion through HAL_I2C_MasterRxCpltCallback() and
+/// HAL_I2C_ErrorCallback(). If USE_HAL_I2C_REGISTER_CALLBACKS is 1,
+/// begin() registers this transport's handlers on the handle; otherwise
+/// the client must call rxCompleteCallback() and errorCallback() from
+/// its own versions of those functions.
+///
+/// Only one transport can be attached to a handle at a time. end(), or
+/// the destructor, detaches it, so the callbacks no longer reach it.
+class cSCD30Stm32HalTransport : public cSCD30Transport
+    {
+public:
+    static constexpr std::size_t kMaxRead = 255;            // limited by AsyncRequest::nResponse.
+    static constexpr std::uint32_t kWriteTimeoutMs = 10;    // timeout for blocking writes.
+    static constexpr unsigned kMaxInstances = 2;            // max handles with a transport.
+
+    cSCD30Stm32HalTransport(I2C_HandleTypeDef *phI2c)
+        : m_phI2c(phI2c)
+        {}
+    virtual ~cSCD30Stm32HalTransport() { this->end(); }
+
+    virtual bool begin() override;
+    // detach from the handle; begin() attaches again.
+    void end();
+    virtual std::size_t getMaxRead() const override { return kMaxRead; }
+    virtual Status write(std::uint8_t address, const std::uint8_t *pBuffer, std::size_t nBuffer) override;
+    virtual Status startRead(std::uint8_t address, std::uint8_t *pBuffer, std::size_t nBuffer) override;
+    virtual Status pollRead() override { return this->m_readStatus; }
+    virtual void abortRead() override;
+    virtual bool recoverBus() override;
+
+    // call these from the HAL callbacks, if not registered by begin().
+    static void rxCompleteCallback(I2C_HandleTypeDef *phI2c);
+    static void errorCallback(I2C_HandleTypeDef *phI2c);
+
+private:
+    static cSCD30Stm32HalTransport *findInstance(I2C_HandleTypeDef *phI2c);
+
+    static cSCD30Stm32HalTransport *s_pInstance[kMaxInstances];
+
+    I2C_HandleTypeDef *m_phI2c;     /// the HAL handle
+    std::uint8_t m_address          /// address of the read in progress (7-bit)
+        { 0 };
+    volatile Status m_readStatus    /// result of the last read; set from interrupts
+        { Status::Success };
+    };
+
+} // namespace McciCatenaScd30
+
+#endif // defined(HAL_I2C_MODULE_ENABLED)
+
+#endif // _MCCI_CATENA_SCD30_STM32HALTRANSPORT_H_
@@ -0,0 +1,125 @@
+/*
+
+Module: MCCI_Catena_SCD30_Summary.h
+
+Function:
+    Running summary statistics for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_SUMMARY_H_
+# define _MCCI_CATENA_SCD30_SUMMARY_H_
+# pragma once
+
+#include "MCCI_Catena_SCD30.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace McciCatenaScd30 {
+
+/// Running min, max, mean and variance of one channel, in O(1) memory.
+///
+/// The mean and variance are updated with Welford's method, which
+/// stays accurate when the spread is small compared to the mean (as
+/// it is for temperature in 0.005 degree units). Values are integers,
+/// in the units of cSCD30::FixedMeasurement.
+class cSCD30RunningStats
+    {
+public:
+    void clear()
+        {
+        this->m_n = 0;
+        }
+
+    void put(std::int32_t v)
+        {
+        if (this->m_n == 0)
+            {
+            this->m_n = 1;
+            this->m_min = this->m_max = v;
+            this->m_mean = float(v);
+            this->m_m2 = 0.0f;
+            return;
+            }
+
+        ++this->m_n;
+        if (v < this->m_min)
+            this->m_min = v;
+        if (v > this->m_max)
+            this->m_max = v;
+
+        float const delta = float(v) - this->m_mean;
+        this->m_mean += delta / float(this->m_n);
+        this->m_m2 += delta * (float(v) - this->m_mean);
+        }
+
+    std::uint32_t getCount() const { return this->m_n; }
+    bool empty() const { return this->m_n == 0; }
+    // the following are only meaningful if ! empty().
+    std::int32_t getMin() const { return this->m_min; }
+    std::int32_t getMax() const { return this->m_max; }
+    float getMean() const { return this->m_mean; }
+    // sample variance (divided by n - 1); zero for fewer than two values.
+    float getVariance() const
+        {
+        return this->m_n < 2 ? 0.0f : this->m_m2 / float(this->m_n - 1);
+        }
+    float getStdDev() const { return std::sqrt(this->getVariance()); }
+
+private:
+    std::uint32_t m_n               /// number of values
+        { 0 };
+    std::int32_t m_min;             /// smallest value
+    std::int32_t m_max;             /// largest value
+    float m_mean;                   /// running mean
+    float m_m2;                     /// running sum of squared differences from the mean
+    };
+
+/// Running statistics of each channel of a series of measurements.
+///
+/// Once attached with cSCD30::setSummary(), every successful
+/// measurement read is added (during a burst, the readings after the
+/// sensor has settled). Clear it at the start of each reporting
+/// window. Temperature is in 0.005 degrees C, relative humidity has
+/// 0xFFFF as 100%, and CO2 is in ppm, as in cSCD30HistoryBase::Sample.
+class cSCD30Summary
+    {
+public:
+    void clear()
+        {
+        this->m_Temperature.clear();
+        this->m_RelativeHumidity.clear();
+        this->m_CO2ppm.clear();
+        }
+
+    void put(const cSCD30::FixedMeasurement &m)
+        {
+        this->m_Temperature.put(m.Temperature);
+        this->m_RelativeHumidity.put(m.RelativeHumidity);
+        // the first reading after power-up has no CO2; leave it out.
+        if (m.CO2ppm != 0)
+            this->m_CO2ppm.put(cSCD30::getCO2ppm(m));
+        }
+
+    // number of measurements; CO2 may have fewer.
+    std::uint32_t getCount() const { return this->m_Temperature.getCount(); }
+    const cSCD30RunningStats &getTemperature() const { return this->m_Temperature; }
+    const cSCD30RunningStats &getRelativeHumidity() const { return this->m_RelativeHumidity; }
+    const cSCD30RunningStats &getCO2ppm() const { return this->m_CO2ppm; }
+
+private:
+    cSCD30RunningStats m_Temperature;       /// temperature, in 0.005 degrees C
+    cSCD30RunningStats m_RelativeHumidity;  /// RH, where 0xFFFF is 100%
+    cSCD30RunningStats m_CO2ppm;            /// CO2 concentration, ppm
+    };
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_SUMMARY_H_
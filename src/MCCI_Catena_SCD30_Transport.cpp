@@ -0,0 +1,163 @@
+/*
+
+Module: MCCI_Catena_SCD30_Transport.cpp
+
+Function:
+    The TwoWire transport for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#include "MCCI_Catena_SCD30_Transport.h"
+
+using namespace McciCatenaScd30;
+
+bool cSCD30TwoWireTransport::begin()
+    {
+    if (this->m_wire == nullptr)
+        return false;
+
+    this->m_wire->begin();
+    return true;
+    }
+
+/*
+
+Name:	cSCD30TwoWireTransport::recoverBus()
+
+Function:
+    Free a stuck bus, and restart the TwoWire.
+
+Definition:
+    bool cSCD30TwoWireTransport::recoverBus() override;
+
+Description:
+    If a device lost clocks in the middle of a byte, it may hold SDA
+    low forever, and every transfer fails. If setRecoveryPins() was
+    called, the TwoWire is stopped, SCL is toggled (at most nine
+    times) until the device lets go of SDA, and a STOP is sent. The
+    pins are driven open-drain: low, or released to the pull-ups.
+    Either way, the TwoWire is then restarted, which clears any error
+    state in the controller.
+
+Returns:
+    `true` if the bus was restarted, `false` if there's no bus.
+
+*/
+
+bool cSCD30TwoWireTransport::recoverBus()
+    {
+    if (this->m_wire == nullptr)
+        return false;
+
+    this->m_wire->end();
+
+    if (this->m_pinSda >= 0 && this->m_pinScl >= 0)
+        {
+        auto const pinSda = this->m_pinSda;
+        auto const pinScl = this->m_pinScl;
+        auto const release = [](int pin) { pinMode(pin, INPUT_PULLUP); };
+        auto const pullLow = [](int pin) { digitalWrite(pin, LOW); pinMode(pin, OUTPUT); };
+
+        release(pinSda);
+        release(pinScl);
+        delayMicroseconds(5);
+
+        // clock out the rest of the byte the device thinks it's sending.
+        for (unsigned i = 0; i < 9 && digitalRead(pinSda) == LOW; ++i)
+            {
+            pullLow(pinScl);
+            delayMicroseconds(5);
+            release(pinScl);
+            delayMicroseconds(5);
+            }
+
+        // START then STOP, so every device sees an idle bus.
+        pullLow(pinSda);
+        delayMicroseconds(5);
+        release(pinSda);
+        delayMicroseconds(5);
+        }
+
+    this->m_wire->begin();
+    return true;
+    }
+
+cSCD30Transport::Status
+cSCD30TwoWireTransport::write(
+    std::uint8_t address,
+    const std::uint8_t *pBuffer,
+    std::size_t nBuffer
+    )
+    {
+    this->m_wire->beginTransmission(address);
+    if (this->m_wire->write(pBuffer, nBuffer) != nBuffer)
+        return Status::WriteBufferFailed;
+    if (this->m_wire->endTransmission() != 0)
+        return Status::WriteFailed;
+
+    return Status::Success;
+    }
+
+/*
+
+Name:	cSCD30TwoWireTransport::startRead()
+
+Function:
+    Read a response from the device.
+
+Definition:
+    cSCD30Transport::Status cSCD30TwoWireTransport::startRead(
+        std::uint8_t address,
+        std::uint8_t *pBuffer,
+        std::size_t nBuffer
+        ) override;
+
+Description:
+    The read is done synchronously, in one requestFrom(); the bytes
+    are then copied from the TwoWire buffer with a single readBytes().
+    Only the bytes already available are copied, so readBytes() never
+    waits for its timeout.
+
+Returns:
+    The final status of the read; never Status::Busy.
+
+*/
+
+cSCD30Transport::Status
+cSCD30TwoWireTransport::startRead(
+    std::uint8_t address,
+    std::uint8_t *pBuffer,
+    std::size_t nBuffer
+    )
+    {
+    this->m_readStatus = this->read(address, pBuffer, nBuffer);
+    return this->m_readStatus;
+    }
+
+cSCD30Transport::Status
+cSCD30TwoWireTransport::read(
+    std::uint8_t address,
+    std::uint8_t *pBuffer,
+    std::size_t nBuffer
+    )
+    {
+    if (this->m_wire->requestFrom(address, std::uint8_t(nBuffer)) != nBuffer)
+        return Status::ReadRequestFailed;
+
+    std::size_t const nResult = this->m_wire->available();
+    if (nResult > nBuffer)
+        return Status::ReadLong;
+
+    this->m_wire->readBytes(pBuffer, nResult);
+
+    if (nResult != nBuffer)
+        return Status::ReadShort;
+
+    return Status::Success;
+    }
@@ -0,0 +1,134 @@
+/*
+
+Module: MCCI_Catena_SCD30_Transport.h
+
+Function:
+    I2C transport interface for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_TRANSPORT_H_
+# define _MCCI_CATENA_SCD30_TRANSPORT_H_
+# pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <Wire.h>
+
+namespace McciCatenaScd30 {
+
+/// The bus, as seen by cSCD30.
+///
+/// The driver only writes whole commands and reads whole responses, so
+/// that's all a transport has to do. Writes are short (at most five
+/// bytes) and block. Reads are split into startRead() and pollRead(),
+/// so a backend can run the transfer from interrupts or DMA while the
+/// driver's asynchronous engine keeps polling; a backend that reads
+/// synchronously just finishes the transfer in startRead().
+///
+/// To run the driver off-target, derive a mock from this class and
+/// pass it to the cSCD30 constructor.
+class cSCD30Transport
+    {
+public:
+    /// result of a transfer.
+    enum class Status : std::uint8_t
+        {
+        Success,            /// transfer complete.
+        Busy,               /// read still in progress.
+        WriteBufferFailed,  /// couldn't buffer the write.
+        WriteFailed,        /// write not acknowledged.
+        ReadRequestFailed,  /// read not acknowledged, or couldn't be started.
+        ReadShort,          /// fewer bytes than requested.
+        ReadLong,           /// more bytes than requested.
+        };
+
+    cSCD30Transport() {}
+    virtual ~cSCD30Transport() {}
+
+    // neither copyable nor movable
+    cSCD30Transport(const cSCD30Transport&) = delete;
+    cSCD30Transport& operator=(const cSCD30Transport&) = delete;
+    cSCD30Transport(const cSCD30Transport&&) = delete;
+    cSCD30Transport& operator=(const cSCD30Transport&&) = delete;
+
+    // called from cSCD30::begin(); return false if the bus can't be used.
+    virtual bool begin() = 0;
+    // largest read that startRead() accepts.
+    virtual std::size_t getMaxRead() const = 0;
+    // write nBuffer bytes to the device at (7-bit) address; blocks until done.
+    virtual Status write(std::uint8_t address, const std::uint8_t *pBuffer, std::size_t nBuffer) = 0;
+    // start reading nBuffer bytes into pBuffer, which must remain valid
+    // until the read finishes. Returns Busy if the read is in progress,
+    // otherwise the final status.
+    virtual Status startRead(std::uint8_t address, std::uint8_t *pBuffer, std::size_t nBuffer) = 0;
+    // return the status of the last read: Busy until it finishes.
+    virtual Status pollRead() = 0;
+    // give up on a read that hasn't finished.
+    virtual void abortRead() {}
+    // return the TwoWire bus, if any; used to group sensors by bus.
+    virtual TwoWire *getWire() const { return nullptr; }
+    // try to free a stuck bus (for example, a device holding SDA low),
+    // and reinitialize the controller. Called by the driver's error
+    // recovery between transfers; return false if nothing was done.
+    virtual bool recoverBus() { return false; }
+    };
+
+/// The default transport: an Arduino TwoWire bus.
+///
+/// TwoWire reads into its own buffer (normally 32 bytes), so reads are
+/// synchronous, and limited to kMaxRead bytes. A sensor constructed
+/// with a TwoWire uses one of these.
+///
+/// TwoWire can't say which pins it uses; to let recoverBus() clock a
+/// stuck device off the bus, construct the transport yourself, call
+/// setRecoveryPins(), and pass it to the cSCD30 constructor. Otherwise
+/// recoverBus() just restarts the TwoWire.
+class cSCD30TwoWireTransport : public cSCD30Transport
+    {
+public:
+    static constexpr std::size_t kMaxRead = 30;     // largest multiple of 3 that fits in 32 bytes.
+
+    cSCD30TwoWireTransport(TwoWire &wire)
+        : m_wire(&wire)
+        {}
+    cSCD30TwoWireTransport(TwoWire *pWire)
+        : m_wire(pWire)
+        {}
+
+    virtual bool begin() override;
+    virtual std::size_t getMaxRead() const override { return kMaxRead; }
+    virtual Status write(std::uint8_t address, const std::uint8_t *pBuffer, std::size_t nBuffer) override;
+    virtual Status startRead(std::uint8_t address, std::uint8_t *pBuffer, std::size_t nBuffer) override;
+    virtual Status pollRead() override { return this->m_readStatus; }
+    virtual TwoWire *getWire() const override { return this->m_wire; }
+    virtual bool recoverBus() override;
+
+    // set the pins recoverBus() uses to clear the bus, or -1 for none.
+    void setRecoveryPins(int pinSda, int pinScl)
+        {
+        this->m_pinSda = std::int8_t(pinSda);
+        this->m_pinScl = std::int8_t(pinScl);
+        }
+
+private:
+    Status read(std::uint8_t address, std::uint8_t *pBuffer, std::size_t nBuffer);
+
+    TwoWire *m_wire;                /// the bus
+    std::int8_t m_pinSda            /// SDA pin for recoverBus(), or -1
+        { -1 };
+    std::int8_t m_pinScl            /// SCL pin for recoverBus(), or -1
+        { -1 };
+    Status m_readStatus             /// result of the last read
+        { Status::Success };
+    };
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_TRANSPORT_H_
@@ -0,0 +1,149 @@
+/*
+
+Module: MCCI_Catena_SCD30_Words.h
+
+Function:
+    Decoding of Sensirion word-stream responses, for the Catena SCD30 library.
+
+Copyright and License:
+    See accompanying LICENSE file.
+
+Author:
+    Terry Moore, MCCI Corporation   October 2020
+
+*/
+
+#ifndef _MCCI_CATENA_SCD30_WORDS_H_
+# define _MCCI_CATENA_SCD30_WORDS_H_
+# pragma once
+
+#include "MCCI_Catena_SCD30_Crc.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// This header has no Arduino dependencies, so host tools can use it.
+
+namespace McciCatenaScd30 {
+
+/// Reads the data words of a checked response, in order.
+///
+/// The words are big-endian byte pairs, as left in the response buffer
+/// by Crc8::packWords(); nothing is copied. Reading past the last word
+/// returns zero, and clears isValid().
+class cSCD30WordReader
+    {
+public:
+    constexpr cSCD30WordReader(const std::uint8_t *pWords, std::size_t nWords)
+        : m_pWords(pWords)
+        , m_nWords(nWords)
+        {}
+
+    std::uint16_t getUint16()
+        {
+        if (this->m_nWords == 0)
+            {
+            this->m_fOverrun = true;
+            return 0;
+            }
+
+        std::uint16_t const v = std::uint16_t((this->m_pWords[0] << 8) | this->m_pWords[1]);
+
+        this->m_pWords += 2;
+        --this->m_nWords;
+        return v;
+        }
+    std::int16_t getInt16()
+        {
+        return std::int16_t(this->getUint16());
+        }
+    // two words, most significant first, as the sensor sends floats.
+    std::uint32_t getUint32()
+        {
+        std::uint32_t const hi = this->getUint16();
+
+        return (hi << 16) | this->getUint16();
+        }
+    // nChars characters, two per word, high byte first.
+    void getChars(char *pChars, std::size_t nChars)
+        {
+        for (std::size_t i = 0; i < nChars; i += 2)
+            {
+            std::uint16_t const v = this->getUint16();
+
+            pChars[i] = char(v >> 8);
+            if (i + 1 < nChars)
+                pChars[i + 1] = char(v);
+            }
+        }
+    std::size_t getRemaining() const { return this->m_nWords; }
+    // false if a get ran past the end of the response.
+    bool isValid() const { return ! this->m_fOverrun; }
+
+private:
+    const std::uint8_t *m_pWords;   /// next word
+    std::size_t m_nWords;           /// words remaining
+    bool m_fOverrun                 /// set if a get ran past the end
+        { false };
+    };
+
+/// How a value is laid out in a response.
+///
+/// Specialize this for each type read with cSCD30::readWords(). A
+/// specialization provides kWords, the number of words the value
+/// takes, and decode(), which fills in the value from a reader.
+template <typename T>
+struct tSCD30WordLayout;
+
+template <>
+struct tSCD30WordLayout<std::uint16_t>
+    {
+    static constexpr std::size_t kWords = 1;
+    static void decode(cSCD30WordReader &r, std::uint16_t &v) { v = r.getUint16(); }
+    };
+
+template <>
+struct tSCD30WordLayout<std::int16_t>
+    {
+    static constexpr std::size_t kWords = 1;
+    static void decode(cSCD30WordReader &r, std::int16_t &v) { v = r.getInt16(); }
+    };
+
+/// A buffer for a response of a_nWords words.
+///
+/// The bus transfer fills `raw` with the word/CRC tuples; the CRC check
+/// then packs the words into the front of `raw`, where decode() reads
+/// them. The size is known at compile time, so decode() can check that
+/// the value fits.
+template <std::size_t a_nWords>
+struct tSCD30Response
+    {
+    static constexpr std::size_t kWords = a_nWords;
+    static constexpr std::size_t kBytes = 3 * a_nWords;
+    static_assert(kWords > 0, "a response has at least one word");
+    static_assert(kBytes <= 255, "AsyncRequest::nResponse is 8 bits");
+
+    std::uint8_t raw[kBytes];
+
+    // check the CRCs, and pack the words; false if a CRC is bad.
+    bool pack() { return Crc8::packWords(this->raw, kBytes); }
+    // read the packed words.
+    cSCD30WordReader getReader() const { return cSCD30WordReader(this->raw, kWords); }
+    // decode a value from the packed words.
+    template <typename T>
+    void decode(T &value) const
+        {
+        static_assert(tSCD30WordLayout<T>::kWords <= kWords, "response too short for this type");
+        auto r = this->getReader();
+
+        tSCD30WordLayout<T>::decode(r, value);
+        }
+    };
+
+/// the response buffer for a value of type T.
+template <typename T>
+using tSCD30ResponseFor = tSCD30Response<tSCD30WordLayout<T>::kWords>;
+
+} // namespace McciCatenaScd30
+
+#endif // _MCCI_CATENA_SCD30_WORDS_H_